@@ -19,9 +19,33 @@ struct akill {
     time_t expires;	/* or 0 for no expiry */
 };
 
-static int32 nakill = 0;
-static int32 akill_size = 0;
-static struct akill *akills = NULL;
+/* Los AKILLs se guardan en un ExpSet (expset.c) cuya clave es la mascara;
+ * struct akill solo se usa al leer la base de datos y de cada entrada
+ * cuelga un struct akilldata con el motivo y el autor. */
+
+struct akilldata {
+    char *reason;
+    char who[NICKMAX];
+};
+
+#define AKILL(e)	((struct akilldata *)(e)->data)
+
+static ExpSet *akills = NULL;
+
+static void akill_expira(ExpEntry *e);
+
+static void akill_libera(ExpEntry *e)
+{
+    free(AKILL(e)->reason);
+    free(e->data);
+}
+
+static ExpSet *lista_akills(void)
+{
+    if (!akills)
+	akills = expset_create(0, akill_expira, akill_libera);
+    return akills;
+}
 
 /*************************************************************************/
 /****************************** Statistics *******************************/
@@ -30,21 +54,21 @@ static struct akill *akills = NULL;
 void get_akill_stats(long *nrec, long *memuse)
 {
     long mem;
-    int i;
+    ExpEntry *e;
 
-    mem = sizeof(struct akill) * akill_size;
-    for (i = 0; i < nakill; i++) {
-	mem += strlen(akills[i].mask)+1;
-	mem += strlen(akills[i].reason)+1;
+    mem = expset_mem(lista_akills());
+    for (e = akills->first; e; e = e->next) {
+	mem += sizeof(struct akilldata);
+	mem += strlen(AKILL(e)->reason)+1;
     }
-    *nrec = nakill;
+    *nrec = akills->count;
     *memuse = mem;
 }
 
 
 int num_akills(void)
 {
-    return (int) nakill;
+    return lista_akills()->count;
 }
 
 /*************************************************************************/
@@ -55,7 +79,7 @@ int num_akills(void)
     if ((x) < 0) {					\
 	if (!forceload)					\
 	    fatal("Error de lectura en %s", AutokillDBName);	\
-	nakill = i;					\
+	n = i;						\
 	break;						\
     }							\
 } while (0)
@@ -66,6 +90,9 @@ void load_akill(void)
     int i, ver;
     int16 tmp16;
     int32 tmp32;
+    int32 n;
+    struct akill *lista;
+    struct akilldata *ak;
 
     if (!(f = open_db("AKILL", AutokillDBName, "r")))
 	return;
@@ -73,28 +100,22 @@ void load_akill(void)
     ver = get_file_version(f);
 
     read_int16(&tmp16, f);
-    nakill = tmp16;
-    if (nakill < 8)
-	akill_size = 16;
-    else if (nakill >= 16384)
-	akill_size = 32767;
-    else
-	akill_size = 2*nakill;
-    akills = scalloc(sizeof(*akills), akill_size);
+    n = tmp16;
+    lista = scalloc(sizeof(*lista), n ? n : 1);
 
     switch (ver) {
       case 8:
       case 7:
       case 6:
       case 5:
-	for (i = 0; i < nakill; i++) {
-	    SAFE(read_string(&akills[i].mask, f));
-	    SAFE(read_string(&akills[i].reason, f));
-	    SAFE(read_buffer(akills[i].who, f));
+	for (i = 0; i < n; i++) {
+	    SAFE(read_string(&lista[i].mask, f));
+	    SAFE(read_string(&lista[i].reason, f));
+	    SAFE(read_buffer(lista[i].who, f));
 	    SAFE(read_int32(&tmp32, f));
-	    akills[i].time = tmp32;
+	    lista[i].time = tmp32;
 	    SAFE(read_int32(&tmp32, f));
-	    akills[i].expires = tmp32;
+	    lista[i].expires = tmp32;
 	}
 	break;
 
@@ -109,15 +130,15 @@ void load_akill(void)
 	    long reserved[4];
 	} old_akill;
 
-	for (i = 0; i < nakill; i++) {
+	for (i = 0; i < n; i++) {
 	    SAFE(read_variable(old_akill, f));
-	    strscpy(akills[i].who, old_akill.who, NICKMAX);
-	    akills[i].time = old_akill.time;
-	    akills[i].expires = old_akill.expires;
+	    strscpy(lista[i].who, old_akill.who, NICKMAX);
+	    lista[i].time = old_akill.time;
+	    lista[i].expires = old_akill.expires;
 	}
-	for (i = 0; i < nakill; i++) {
-	    SAFE(read_string(&akills[i].mask, f));
-	    SAFE(read_string(&akills[i].reason, f));
+	for (i = 0; i < n; i++) {
+	    SAFE(read_string(&lista[i].mask, f));
+	    SAFE(read_string(&lista[i].reason, f));
 	}
 	break;
       } /* case 3/4 */
@@ -130,15 +151,15 @@ void load_akill(void)
 	    time_t time;
 	} old_akill;
 
-	for (i = 0; i < nakill; i++) {
+	for (i = 0; i < n; i++) {
 	    SAFE(read_variable(old_akill, f));
-	    akills[i].time = old_akill.time;
-	    strscpy(akills[i].who, old_akill.who, sizeof(akills[i].who));
-	    akills[i].expires = 0;
+	    lista[i].time = old_akill.time;
+	    strscpy(lista[i].who, old_akill.who, sizeof(lista[i].who));
+	    lista[i].expires = 0;
 	}
-	for (i = 0; i < nakill; i++) {
-	    SAFE(read_string(&akills[i].mask, f));
-	    SAFE(read_string(&akills[i].reason, f));
+	for (i = 0; i < n; i++) {
+	    SAFE(read_string(&lista[i].mask, f));
+	    SAFE(read_string(&lista[i].reason, f));
 	}
 	break;
       } /* case 2 */
@@ -150,15 +171,15 @@ void load_akill(void)
 	    time_t time;
 	} old_akill;
 
-	for (i = 0; i < nakill; i++) {
+	for (i = 0; i < n; i++) {
 	    SAFE(read_variable(old_akill, f));
-	    akills[i].time = old_akill.time;
-	    akills[i].who[0] = 0;
-	    akills[i].expires = 0;
+	    lista[i].time = old_akill.time;
+	    lista[i].who[0] = 0;
+	    lista[i].expires = 0;
 	}
-	for (i = 0; i < nakill; i++) {
-	    SAFE(read_string(&akills[i].mask, f));
-	    SAFE(read_string(&akills[i].reason, f));
+	for (i = 0; i < n; i++) {
+	    SAFE(read_string(&lista[i].mask, f));
+	    SAFE(read_string(&lista[i].reason, f));
 	}
 	break;
       } /* case 1 */
@@ -168,6 +189,23 @@ void load_akill(void)
     } /* switch (version) */
 
     close_db(f);
+
+    for (i = 0; i < n; i++) {
+	if (lista[i].mask && lista[i].reason) {
+	    ExpEntry *e;
+
+	    ak = smalloc(sizeof(*ak));
+	    ak->reason = lista[i].reason;
+	    strscpy(ak->who, lista[i].who, NICKMAX);
+	    e = expset_add(lista_akills(), lista[i].mask, lista[i].expires, ak);
+	    e->time = lista[i].time;
+	} else if (lista[i].reason) {
+	    free(lista[i].reason);
+	}
+	if (lista[i].mask)
+	    free(lista[i].mask);
+    }
+    free(lista);
 }
 
 #undef SAFE
@@ -190,17 +228,17 @@ void load_akill(void)
 void save_akill(void)
 {
     dbFILE *f;
-    int i;
+    ExpEntry *e;
     static time_t lastwarn = 0;
 
     f = open_db("AKILL", AutokillDBName, "w");
-    write_int16(nakill, f);
-    for (i = 0; i < nakill; i++) {
-	SAFE(write_string(akills[i].mask, f));
-	SAFE(write_string(akills[i].reason, f));
-	SAFE(write_buffer(akills[i].who, f));
-	SAFE(write_int32(akills[i].time, f));
-	SAFE(write_int32(akills[i].expires, f));
+    write_int16(lista_akills()->count, f);
+    for (e = akills->first; e; e = e->next) {
+	SAFE(write_string(e->key, f));
+	SAFE(write_string(AKILL(e)->reason, f));
+	SAFE(write_buffer(AKILL(e)->who, f));
+	SAFE(write_int32(e->time, f));
+	SAFE(write_int32(e->expires, f));
     }
     close_db(f);
 }
@@ -221,14 +259,15 @@ int check_akill(const char *nick, const char *username, const char *host)
     char buf[512];
     int i;
     char *host2, *username2;
+    ExpEntry *e;
 
 
     strscpy(buf, username, sizeof(buf)-2);
     i = strlen(buf);
     buf[i++] = '@';
     strlower(strscpy(buf+i, host, sizeof(buf)-i));
-    for (i = 0; i < nakill; i++) {
-	if (match_wild_nocase(akills[i].mask, buf)) {
+    for (e = lista_akills()->first; e; e = e->next) {
+	if (match_wild_nocase(e->key, buf)) {
 	    time_t now = time(NULL);
 	    /* Don't use kill_user(); that's for people who have already
 	     * signed on.  This is called before the User structure is
@@ -250,14 +289,14 @@ int check_akill(const char *nick, const char *username, const char *host)
          canaladmins(s_OperServ, "12%s 3Autokilleado por 5Gline en Akill", nick);
       
 #endif
-	    username2 = sstrdup(akills[i].mask);
+	    username2 = sstrdup(e->key);
 	    host2 = strchr(username2, '@');
 	    if (!host2) {
 		/* Glurp... this oughtn't happen, but if it does, let's not
 		 * play with null pointers.  Yell and bail out.
 		 */
-		canalopers(NULL, "Encontrado @ en el AKILL: %s", akills[i].mask);
-		logeo("Encontrado @ en el AKILL: %s", akills[i].mask);		continue;
+		canalopers(NULL, "Encontrado @ en el AKILL: %s", e->key);
+		logeo("Encontrado @ en el AKILL: %s", e->key);		continue;
 	    }
 	    *host2++ = 0;
 		    
@@ -265,15 +304,15 @@ int check_akill(const char *nick, const char *username, const char *host)
             send_cmd(NULL, 
                     "%c GL * +%s@%s %ld :Estas Baneado de esta RED",
                     convert2y[ServerNumerico], username2, host2,
-                    akills[i].expires && akills[i].expires>now                
-                                ? akills[i].expires-time(NULL)
+                    e->expires && e->expires>now                
+                                ? e->expires-time(NULL)
                                 : 999999999); 
 #else
 	    send_cmd(ServerName,
 		    "GLINE * +%s@%s %ld :Estas baneado de esta RED",
 		    username2, host2,
-		    akills[i].expires && akills[i].expires>now
-				? akills[i].expires-time(NULL)
+		    e->expires && e->expires>now
+				? e->expires-time(NULL)
 				: 999999999);
 #endif
 	    free(username2);
@@ -285,30 +324,23 @@ int check_akill(const char *nick, const char *username, const char *host)
 
 /*************************************************************************/
 
-/* Delete any expired autokills. */
+/* Llamada por expset_expire() al vencer el plazo de un AKILL. */
 
-void expire_akills(void)
+static void akill_expira(ExpEntry *e)
 {
-    int i;
-    time_t now = time(NULL);
-
-    for (i = 0; i < nakill; i++) {
-	if (akills[i].expires == 0 || akills[i].expires > now)
-	    continue;
-	    canalopers(s_OperServ, "AKILL en %s ha expirado", akills[i].mask);
-
+    canalopers(s_OperServ, "AKILL en %s ha expirado", e->key);
 #if defined(IRC_UNDERNET_P10)
-        send_cmd(NULL,"%c GL * -%s", convert2y[ServerNumerico], akills[i].mask);        	
+    send_cmd(NULL,"%c GL * -%s", convert2y[ServerNumerico], e->key);
 #else
-        send_cmd(ServerName, "GLINE * -%s", akills[i].mask);
-#endif        
-        free(akills[i].mask);
-        free(akills[i].reason);
-	nakill--;
-	if (i < nakill)
-	    memmove(akills+i, akills+i+1, sizeof(*akills) * (nakill-i));
-	i--;
-    }
+    send_cmd(ServerName, "GLINE * -%s", e->key);
+#endif
+}
+
+/* Delete any expired autokills. */
+
+void expire_akills(void)
+{
+    expset_expire(lista_akills(), time(NULL));
 }
 
 /*************************************************************************/
@@ -325,41 +357,16 @@ void expire_akills(void)
 void add_akill(const char *mask, const char *reason, const char *who,
 		      const time_t expiry)
 {
-    if (nakill >= 32767) {
+    struct akilldata *ak;
+
+    if (lista_akills()->count >= 32767) {
 	logeo("%s: Intento para aadir AKILL a la lista llena!", s_OperServ);
 	return;
     }
-    if (nakill >= akill_size) {
-	if (akill_size < 8)
-	    akill_size = 8;
-	else
-	    akill_size *= 2;
-	akills = srealloc(akills, sizeof(*akills) * akill_size);
-    }
-    akills[nakill].mask = sstrdup(mask);
-    akills[nakill].reason = sstrdup(reason);
-    akills[nakill].time = time(NULL);
-    akills[nakill].expires = expiry;
-    strscpy(akills[nakill].who, who, NICKMAX);
-/*
-    if (expiry) {
-	int amount = strtol(expiry, (char **)&expiry, 10);
-	if (amount == 0) {
-	    akills[nakill].expires = 0;
-	} else {
-	    switch (*expiry) {
-		case 'd': amount *= 24;
-		case 'h': amount *= 60;
-		case 'm': amount *= 60; break;
-		default : amount = -akills[nakill].time;
-	    }
-	    akills[nakill].expires = amount + akills[nakill].time;
-	}
-    } else {
-	akills[nakill].expires = AutokillExpiry + akills[nakill].time;
-    }
-*/
-    nakill++;
+    ak = smalloc(sizeof(*ak));
+    ak->reason = sstrdup(reason);
+    strscpy(ak->who, who, NICKMAX);
+    expset_add(akills, mask, expiry, ak);
 }
 
 /*************************************************************************/
@@ -368,20 +375,7 @@ void add_akill(const char *mask, const char *reason, const char *who,
 
 int del_akill(const char *mask)
 {
-    int i;
-
-    for (i = 0; i < nakill && strcmp(akills[i].mask, mask) != 0; i++)
-	;
-    if (i < nakill) {
-	free(akills[i].mask);
-	free(akills[i].reason);
-	nakill--;
-	if (i < nakill)
-	    memmove(akills+i, akills+i+1, sizeof(*akills) * (nakill-i));
-	return 1;
-    } else {
-	return 0;
-    }
+    return expset_del(lista_akills(), mask);
 }
 
 /*************************************************************************/
@@ -392,14 +386,14 @@ void do_akill(User *u)
 {
     char *cmd, *mask, *reason, *expiry, *s;
     time_t expires;
-    int i;
+    ExpEntry *e;
 
     cmd = strtok(NULL, " ");
     if (!cmd)
 	cmd = "";
 
     if (stricmp(cmd, "ADD") == 0) {
-	if (nakill >= 32767) {
+	if (num_akills() >= 32767) {
 	    notice_lang(s_OperServ, u, OPER_TOO_MANY_AKILLS);
 	    return;
 	}
@@ -506,10 +500,10 @@ void do_akill(User *u)
 	if (strchr(s, '@'))
 	    strlower(strchr(s, '@'));
 	notice_lang(s_OperServ, u, OPER_AKILL_LIST_HEADER);
-	for (i = 0; i < nakill; i++) {
-	    if (!s || match_wild(s, akills[i].mask)) {
+	for (e = lista_akills()->first; e; e = e->next) {
+	    if (!s || match_wild(s, e->key)) {
 		notice_lang(s_OperServ, u, OPER_AKILL_LIST_FORMAT,
-					akills[i].mask, akills[i].reason);
+					e->key, AKILL(e)->reason);
 	    }
 	}
 
@@ -521,23 +515,23 @@ void do_akill(User *u)
 	if (strchr(s, '@'))
 	    strlower(strchr(s, '@'));
 	notice_lang(s_OperServ, u, OPER_AKILL_LIST_HEADER);
-	for (i = 0; i < nakill; i++) {
-	    if (!s || match_wild(s, akills[i].mask)) {
+	for (e = lista_akills()->first; e; e = e->next) {
+	    if (!s || match_wild(s, e->key)) {
 		char timebuf[32], expirebuf[256];
 		struct tm tm;
 		time_t t = time(NULL);
 
-		tm = *localtime(akills[i].time ? &akills[i].time : &t);
+		tm = *localtime(e->time ? &e->time : &t);
 		strftime_lang(timebuf, sizeof(timebuf),
 			u, STRFTIME_SHORT_DATE_FORMAT, &tm);
-		if (akills[i].expires == 0) {
+		if (e->expires == 0) {
 		    snprintf(expirebuf, sizeof(expirebuf),
 				getstring(u->ni, OPER_AKILL_NO_EXPIRE));
-		} else if (akills[i].expires <= t) {
+		} else if (e->expires <= t) {
 		    snprintf(expirebuf, sizeof(expirebuf),
 				getstring(u->ni, OPER_AKILL_EXPIRES_SOON));
 		} else {
-		    time_t t2 = akills[i].expires - t;
+		    time_t t2 = e->expires - t;
 		    t2 += 59;
 		    if (t2 < 3600) {
 			t2 /= 60;
@@ -580,9 +574,9 @@ void do_akill(User *u)
 				
 		}
 		notice_lang(s_OperServ, u, OPER_AKILL_VIEW_FORMAT,
-				akills[i].mask,
-				*akills[i].who ? akills[i].who : "<desconocido>",
-				timebuf, expirebuf, akills[i].reason);
+				e->key,
+				*AKILL(e)->who ? AKILL(e)->who : "<desconocido>",
+				timebuf, expirebuf, AKILL(e)->reason);
 	    }
 	}
 
@@ -598,14 +592,14 @@ void do_xakill(User *u)
 {
     char *cmd, *mask, *reason, *expiry, *s;
     time_t expires;
-    int i;
+    ExpEntry *e;
 
     cmd = strtok(NULL, " ");
     if (!cmd)
 	cmd = "";
 
     if (stricmp(cmd, "ADD") == 0) {
-	if (nakill >= 32767) {
+	if (num_akills() >= 32767) {
 	    notice_lang(s_XServ, u, OPER_TOO_MANY_AKILLS);
 	    return;
 	}
@@ -712,10 +706,10 @@ void do_xakill(User *u)
 	if (strchr(s, '@'))
 	    strlower(strchr(s, '@'));
 	notice_lang(s_XServ, u, OPER_AKILL_LIST_HEADER);
-	for (i = 0; i < nakill; i++) {
-	    if (!s || match_wild(s, akills[i].mask)) {
+	for (e = lista_akills()->first; e; e = e->next) {
+	    if (!s || match_wild(s, e->key)) {
 		notice_lang(s_XServ, u, OPER_AKILL_LIST_FORMAT,
-					akills[i].mask, akills[i].reason);
+					e->key, AKILL(e)->reason);
 	    }
 	}
 
@@ -727,23 +721,23 @@ void do_xakill(User *u)
 	if (strchr(s, '@'))
 	    strlower(strchr(s, '@'));
 	notice_lang(s_XServ, u, OPER_AKILL_LIST_HEADER);
-	for (i = 0; i < nakill; i++) {
-	    if (!s || match_wild(s, akills[i].mask)) {
+	for (e = lista_akills()->first; e; e = e->next) {
+	    if (!s || match_wild(s, e->key)) {
 		char timebuf[32], expirebuf[256];
 		struct tm tm;
 		time_t t = time(NULL);
 
-		tm = *localtime(akills[i].time ? &akills[i].time : &t);
+		tm = *localtime(e->time ? &e->time : &t);
 		strftime_lang(timebuf, sizeof(timebuf),
 			u, STRFTIME_SHORT_DATE_FORMAT, &tm);
-		if (akills[i].expires == 0) {
+		if (e->expires == 0) {
 		    snprintf(expirebuf, sizeof(expirebuf),
 				getstring(u->ni, OPER_AKILL_NO_EXPIRE));
-		} else if (akills[i].expires <= t) {
+		} else if (e->expires <= t) {
 		    snprintf(expirebuf, sizeof(expirebuf),
 				getstring(u->ni, OPER_AKILL_EXPIRES_SOON));
 		} else {
-		    time_t t2 = akills[i].expires - t;
+		    time_t t2 = e->expires - t;
 		    t2 += 59;
 		    if (t2 < 3600) {
 			t2 /= 60;
@@ -786,9 +780,9 @@ void do_xakill(User *u)
 				
 		}
 		notice_lang(s_XServ, u, OPER_AKILL_VIEW_FORMAT,
-				akills[i].mask,
-				*akills[i].who ? akills[i].who : "<desconocido>",
-				timebuf, expirebuf, akills[i].reason);
+				e->key,
+				*AKILL(e)->who ? AKILL(e)->who : "<desconocido>",
+				timebuf, expirebuf, AKILL(e)->reason);
 	    }
 	}
 
@@ -25,9 +25,21 @@ struct alimit {
     time_t expires;	/* or 0 for no expiry */
 };
 
-static int32 nalimit = 0;
-static int32 alimit_size = 0;
-static struct alimit *alimits = NULL;
+/* Se guardan en un ExpSet (expset.c) con el limite en e->data;
+ * struct alimit solo se usa al leer la base de datos. */
+
+#define ALIMIT_NUMERO(e)	((int)(long)(e)->data)
+
+static ExpSet *alimits = NULL;
+
+static void alimit_expira(ExpEntry *e);
+
+static ExpSet *lista_alimits(void)
+{
+    if (!alimits)
+	alimits = expset_create(1, alimit_expira, NULL);
+    return alimits;
+}
 
 /*************************************************************************/
 /****************************** Statistics *******************************/
@@ -35,23 +47,14 @@ static struct alimit *alimits = NULL;
 
 void get_alimit_stats(long *nrec, long *memuse)
 {
-    long mem;
-    int i;
-
-    mem = sizeof(struct alimit) * alimit_size;
-    for (i = 0; i < nalimit; i++) {
-	mem += strlen(alimits[i].elcanal)+1;
-	
-	
-    }
-    *nrec = nalimit;
-    *memuse = mem;
+    *nrec = lista_alimits()->count;
+    *memuse = expset_mem(alimits);
 }
 
 
 int num_alimits(void)
 {
-    return (int) nalimit;
+    return lista_alimits()->count;
 }
 
 /*************************************************************************/
@@ -62,7 +65,7 @@ int num_alimits(void)
     if ((x) < 0) {					\
 	if (!forceload)					\
 	    fatal("Error de lectura en %s", AutolimitDBName);	\
-	nalimit = i;					\
+	n = i;						\
 	break;						\
     }							\
 } while (0)
@@ -73,6 +76,8 @@ void load_alimit(void)
     int i, ver;
     int16 tmp16;
     int32 tmp32;
+    int32 n;
+    struct alimit *lista;
 
     if (!(f = open_db("ALIMIT", AutolimitDBName, "r")))
 	return;
@@ -80,28 +85,22 @@ void load_alimit(void)
     ver = get_file_version(f);
 
     read_int16(&tmp16, f);
-    nalimit = tmp16;
-    if (nalimit < 8)
-	alimit_size = 16;
-    else if (nalimit >= 16384)
-	alimit_size = 32767;
-    else
-	alimit_size = 2*nalimit;
-    alimits = scalloc(sizeof(*alimits), alimit_size);
+    n = tmp16;
+    lista = scalloc(sizeof(*lista), n ? n : 1);
 
     switch (ver) {
       case 8:
       case 7:
       case 6:
       case 5:
-	for (i = 0; i < nalimit; i++) {
+	for (i = 0; i < n; i++) {
 	  
-	    SAFE(read_string(&alimits[i].elcanal, f));
-	    SAFE(read_variable(alimits[i].elnumero, f));
+	    SAFE(read_string(&lista[i].elcanal, f));
+	    SAFE(read_variable(lista[i].elnumero, f));
 	    SAFE(read_int32(&tmp32, f));
-	    alimits[i].time = tmp32;
+	    lista[i].time = tmp32;
 	    SAFE(read_int32(&tmp32, f));
-	    alimits[i].expires = tmp32;
+	    lista[i].expires = tmp32;
 	}
 	break;
 
@@ -115,14 +114,14 @@ void load_alimit(void)
 	    long reserved[4];
 	} old_alimit;
 
-	for (i = 0; i < nalimit; i++) {
+	for (i = 0; i < n; i++) {
 	    SAFE(read_variable(old_alimit, f));
-	    alimits[i].time = old_alimit.time;
-	    alimits[i].expires = old_alimit.expires;
+	    lista[i].time = old_alimit.time;
+	    lista[i].expires = old_alimit.expires;
 	}
-	for (i = 0; i < nalimit; i++) {
-	     SAFE(read_string(&alimits[i].elcanal, f));
-	     SAFE(read_variable(alimits[i].elnumero, f));
+	for (i = 0; i < n; i++) {
+	     SAFE(read_string(&lista[i].elcanal, f));
+	     SAFE(read_variable(lista[i].elnumero, f));
 	}
 	break;
       } /* case 3/4 */
@@ -134,14 +133,14 @@ void load_alimit(void)
 	    time_t time;
 	} old_alimit;
 
-	for (i = 0; i < nalimit; i++) {
+	for (i = 0; i < n; i++) {
 	    SAFE(read_variable(old_alimit, f));
-	    alimits[i].time = old_alimit.time;
-	     alimits[i].expires = 0;
+	    lista[i].time = old_alimit.time;
+	     lista[i].expires = 0;
 	}
-	for (i = 0; i < nalimit; i++) {
-	    SAFE(read_string(&alimits[i].elcanal, f));
-	    SAFE(read_variable(alimits[i].elnumero, f));
+	for (i = 0; i < n; i++) {
+	    SAFE(read_string(&lista[i].elcanal, f));
+	    SAFE(read_variable(lista[i].elnumero, f));
 	    
 	}
 	break;
@@ -154,14 +153,14 @@ void load_alimit(void)
 	    time_t time;
 	} old_alimit;
 
-	for (i = 0; i < nalimit; i++) {
+	for (i = 0; i < n; i++) {
 	    SAFE(read_variable(old_alimit, f));
-	    alimits[i].time = old_alimit.time;
-	    alimits[i].expires = 0;
+	    lista[i].time = old_alimit.time;
+	    lista[i].expires = 0;
 	}
-	for (i = 0; i < nalimit; i++) {
-	    SAFE(read_string(&alimits[i].elcanal, f));
-	    SAFE(read_variable(alimits[i].elnumero, f));
+	for (i = 0; i < n; i++) {
+	    SAFE(read_string(&lista[i].elcanal, f));
+	    SAFE(read_variable(lista[i].elnumero, f));
 	   	}
 	break;
       } /* case 1 */
@@ -171,6 +170,16 @@ void load_alimit(void)
     } /* switch (version) */
 
     close_db(f);
+
+    for (i = 0; i < n; i++) {
+	if (lista[i].elcanal) {
+	    ExpEntry *e = expset_add(lista_alimits(), lista[i].elcanal,
+			lista[i].expires, (void *)(long)lista[i].elnumero);
+	    e->time = lista[i].time;
+	    free(lista[i].elcanal);
+	}
+    }
+    free(lista);
 }
 
 #undef SAFE
@@ -193,17 +202,18 @@ void load_alimit(void)
 void save_alimit(void)
 {
     dbFILE *f;
-    int i;
+    ExpEntry *e;
+    int elnumero;
     static time_t lastwarn = 0;
 
     f = open_db("ALIMIT", AutolimitDBName, "w");
-    write_int16(nalimit, f);
-    for (i = 0; i < nalimit; i++) {
-	
-	SAFE(write_string(alimits[i].elcanal, f));
-	SAFE(read_variable(alimits[i].elnumero, f));
-	SAFE(write_int32(alimits[i].time, f));
-	SAFE(write_int32(alimits[i].expires, f));
+    write_int16(lista_alimits()->count, f);
+    for (e = alimits->first; e; e = e->next) {
+	elnumero = ALIMIT_NUMERO(e);
+	SAFE(write_string(e->key, f));
+	SAFE(write_variable(elnumero, f));
+	SAFE(write_int32(e->time, f));
+	SAFE(write_int32(e->expires, f));
     }
     close_db(f);
 }
@@ -213,66 +223,70 @@ void save_alimit(void)
 
 /*************************************************************************/
 
-/* Borro autolimits expirados */
+/* Limite que corresponde a un canal con 'usuarios' usuarios, segun las
+ * franjas tramo1..tramo3 e incrementos incr1..incr3 de la configuracion. */
 
-int expire_alimits(void)
+int calcula_alimit(int usuarios)
 {
-    int i;
-    time_t now = time(NULL);
+    if (usuarios < tramo1)
+	return usuarios + incr1;
+    else if (usuarios < tramo3)
+	return usuarios + incr2;
+    else
+	return usuarios + incr3;
+}
+
+/* Llamada por expset_expire() al vencer el plazo de una entrada.  El
+ * limite se calcula con los usuarios que tenga el canal en ese momento;
+ * si ya es el que tiene puesto no se manda nada. */
 
-    for (i = 0; i < nalimit; i++) {
-	if (alimits[i].expires > now)
-	    continue;
-	
+static void alimit_expira(ExpEntry *e)
+{
+    Channel *c = findchan(e->key);
+    int numero;
 
+    if (!c || !c->ci || !(c->ci->flags & CI_AUTOLIMIT) || !c->erab)
+	return;
+    numero = calcula_alimit(c->erab);
+    if (numero == c->limit)
+	return;
+    c->limit = numero;
 #if defined(IRC_UNDERNET_P10)
-        //send_cmd(NULL,"%c P * -%s", convert2y[ServerNumerico], alimits[i].elcanal);        	
+    send_cmd(s_ChanServ, "M %s +l %i", e->key, numero);
 #else
-       
-        send_cmd(s_ChanServ, "MODE %s +l %i", alimits[i].elcanal, alimits[i].elnumero);
-	
-#endif        
-        free(alimits[i].elcanal);
-	       nalimit--;
-	if (i < nalimit)
-	    memmove(alimits+i, alimits+i+1, sizeof(*alimits) * (nalimit-i));
-	i--;
-    }
+    send_cmd(MODE_SENDER(s_ChanServ), "MODE %s +l %i", e->key, numero);
+#endif
+}
+
+/* Programa la actualizacion del +l de un canal dentro de 'retardo'
+ * segundos.  Si ya hay una pendiente se deja como esta. */
+
+void programa_alimit(const char *elcanal, time_t retardo)
+{
+    if (expset_find(lista_alimits(), elcanal))
+	return;
+    add_alimit(elcanal, 0, time(NULL) + retardo);
+}
+
+/* Borro autolimits expirados */
+
+int expire_alimits(void)
+{
+    return expset_expire(lista_alimits(), time(NULL));
 }
 
 
 void add_alimit(const char *elcanal,int elnumero, time_t expiry)
 {
-    if (nalimit >= 32767) {
+    if (lista_alimits()->count >= 32767) {
 	logeo("%s: Intento para aadir ALIMIT a la lista llena!", s_ChanServ);
 	return;
     }
-    if (nalimit >= alimit_size) {
-	if (alimit_size < 8)
-	    alimit_size = 8;
-	else
-	    alimit_size *= 2;
-	alimits = srealloc(alimits, sizeof(*alimits) * alimit_size);
-    }
-    alimits[nalimit].elcanal = sstrdup(elcanal);
-    alimits[nalimit].elnumero = elnumero;
-    alimits[nalimit].time = time(NULL);
-    alimits[nalimit].expires = expiry;
-
-    nalimit++;
+    expset_add(alimits, elcanal, expiry, (void *)(long)elnumero);
 }
 /*************************************************************************/
 
 void del_alimit(const char *elcanal)
 {
-    int i;
-
-    for (i = 0; i < nalimit && strcmp(alimits[i].elcanal, elcanal) != 0; i++)
-	;
-    if (i < nalimit) {
-	free(alimits[i].elcanal);
-	nalimit--;
-	memmove(alimits+i, alimits+i+1, sizeof(*alimits) * (nalimit-i));
-	
-       }
+    expset_del(lista_alimits(), elcanal);
 }
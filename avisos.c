@@ -0,0 +1,263 @@
+/* Cola de avisos a los canales de la administracion.
+ *
+ * Services is copyright (c) 1996-1999 Andy Church.
+ *     E-mail: <achurch@dragonfire.net>
+ * This program is free but copyrighted software; see the file COPYING for
+ * details.
+ *
+ * canaladmins(), canalayuda() y canalcybers() ya no mandan el PRIVMSG en
+ * el acto: lo dejan en la cola del canal y el bucle principal la vacia con
+ * avisos_envia(), a AvisosPorSegundo lineas por segundo y canal como mucho
+ * y solo mientras el buffer de salida este medio vacio, para que un
+ * netjoin no llene la sendq del enlace con avisos y retrase lo que de
+ * verdad importa (PONG, KILL, modos...).  canalopers() no pasa por aqui:
+ * sus avisos son pocos y urgentes (errores, SQUIT, PANIC) y salen
+ * directamente.
+ *
+ * Cada cola tiene dos prioridades: AVISO_NORMAL, lo que mandan los *Serv
+ * al hacer algo, y AVISO_BAJA, las entradas, salidas y cambios de nick que
+ * se mandan con aviso().  Sale antes todo lo normal.  Si una cola pasa de
+ * AvisosCola lineas se tiran primero las de prioridad baja, y cuando se
+ * vacia se dice cuantas se tiraron.
+ *
+ * Ademas, cada clase de aviso() manda como mucho <maximo> lineas por cada
+ * <periodo> segundos (AvisosEntra, AvisosNick, AvisosCanal, AvisosSale);
+ * las demas solo se cuentan, y al acabar el periodo sale una linea de
+ * resumen ("ENTRA: 532 conexiones mas en los ultimos 5 segundos").
+ */
+
+#include "services.h"
+
+typedef struct aviso_ Aviso;
+struct aviso_ {
+    Aviso *next;
+    char fuente[NICKMAX];	/* "" para mandarlo sin origen */
+    char *texto;
+};
+
+typedef struct {
+    char **canal;		/* Sin la # */
+    Aviso *cola[2], *fin[2];	/* Por prioridad */
+    int encolados;
+    time_t segundo;		/* Segundo en curso y lo mandado en el */
+    int enviados;
+    int descartados;
+} ColaAvisos;
+
+typedef struct {
+    const char *resumen;	/* Formato: cuenta y segundos */
+    int *maximo, *periodo;
+    time_t inicio;		/* Principio del periodo en curso */
+    int enviados, resumidos;
+    char fuente[NICKMAX];
+} ClaseAvisos;
+
+static ColaAvisos colas[AVISOS_CANALES] = {
+    { &CanalAdmins }, { &CanalAyuda }, { &CanalCybers },
+};
+
+static ClaseAvisos clases[AVISO_CLASES] = {
+    { "2ENTRA: 12%d conexiones mas en los ultimos %d segundos",
+      &AvisosEntra, &AvisosEntraPeriodo },
+    { "2NICK: 12%d cambios de nick mas en los ultimos %d segundos",
+      &AvisosNick, &AvisosNickPeriodo },
+    { "2CANALES: 12%d entradas y salidas de canales mas en los"
+      " ultimos %d segundos", &AvisosCanal, &AvisosCanalPeriodo },
+    { "5SALE: 12%d desconexiones mas en los ultimos %d segundos",
+      &AvisosSale, &AvisosSalePeriodo },
+};
+
+/*************************************************************************/
+
+static void manda(const char *fuente, const char *canal, const char *texto)
+{
+    send_cmd(*fuente ? fuente : NULL, "PRIVMSG #%s :%s", canal, texto);
+}
+
+/* Pone `texto' en la cola de `canal' (AVISOS_*) con la prioridad dada.  Sin
+ * AvisosPorSegundo se manda en el acto, como antes. */
+
+void avisos_encola(int canal, int prioridad, const char *source,
+		   const char *texto)
+{
+    ColaAvisos *c = &colas[canal];
+    Aviso *a;
+
+    if (!AvisosPorSegundo) {
+	manda(source ? source : "", *c->canal, texto);
+	return;
+    }
+    if (c->encolados >= AvisosCola) {
+	if (prioridad == AVISO_BAJA || !c->cola[AVISO_BAJA]) {
+	    c->descartados++;
+	    return;
+	}
+	/* Hace sitio tirando el aviso de prioridad baja mas antiguo */
+	a = c->cola[AVISO_BAJA];
+	if (!(c->cola[AVISO_BAJA] = a->next))
+	    c->fin[AVISO_BAJA] = NULL;
+	free(a->texto);
+	free(a);
+	c->encolados--;
+	c->descartados++;
+    }
+    a = smalloc(sizeof(Aviso));
+    a->next = NULL;
+    strscpy(a->fuente, source ? source : "", sizeof(a->fuente));
+    a->texto = sstrdup(texto);
+    if (c->fin[prioridad])
+	c->fin[prioridad]->next = a;
+    else
+	c->cola[prioridad] = a;
+    c->fin[prioridad] = a;
+    c->encolados++;
+}
+
+/*************************************************************************/
+
+/* Acaba el periodo de la clase `k': si se quedaron avisos sin mandar, se
+ * encola el resumen. */
+
+static void cierra_periodo(ClaseAvisos *k, time_t now)
+{
+    char buf[BUFSIZE];
+
+    if (k->resumidos) {
+	snprintf(buf, sizeof(buf), k->resumen, k->resumidos,
+		 (int)(now - k->inicio));
+	avisos_encola(AVISOS_ADMINS, AVISO_NORMAL, k->fuente, buf);
+    }
+    k->inicio = now;
+    k->enviados = k->resumidos = 0;
+}
+
+/* Aviso de la clase `clase' (AVISO_ENTRA...) al canal de admins. */
+
+void aviso(int clase, const char *source, const char *fmt, ...)
+{
+    ClaseAvisos *k = &clases[clase];
+    time_t now = time(NULL);
+    char buf[BUFSIZE];
+    va_list args;
+
+    if (now - k->inicio >= *k->periodo)
+	cierra_periodo(k, now);
+    if (k->enviados >= *k->maximo) {
+	k->resumidos++;
+	strscpy(k->fuente, source ? source : "", sizeof(k->fuente));
+	return;
+    }
+    k->enviados++;
+    va_start(args, fmt);
+    vsnprintf(buf, sizeof(buf), fmt, args);
+    va_end(args);
+    avisos_encola(AVISOS_ADMINS, AVISO_BAJA, source, buf);
+}
+
+/*************************************************************************/
+
+/* Manda el primer aviso de la cola `c'.  Devuelve 0 si estaba vacia. */
+
+static int saca_aviso(ColaAvisos *c)
+{
+    Aviso *a;
+    int p;
+
+    if (c->cola[AVISO_NORMAL])
+	p = AVISO_NORMAL;
+    else if (c->cola[AVISO_BAJA])
+	p = AVISO_BAJA;
+    else
+	return 0;
+    a = c->cola[p];
+    if (!(c->cola[p] = a->next))
+	c->fin[p] = NULL;
+    c->encolados--;
+    manda(a->fuente, *c->canal, a->texto);
+    free(a->texto);
+    free(a);
+    return 1;
+}
+
+static void dice_descartados(ColaAvisos *c)
+{
+    send_cmd(NULL, "PRIVMSG #%s :4%d avisos descartados por"
+	     " saturacion de la cola", *c->canal, c->descartados);
+    c->descartados = 0;
+}
+
+/* Lo llama el bucle principal en cada vuelta: saca los resumenes de los
+ * periodos acabados y manda lo que se pueda de cada cola. */
+
+void avisos_envia(void)
+{
+    time_t now = time(NULL);
+    ColaAvisos *c;
+    ClaseAvisos *k;
+
+    for (k = clases; k < clases + AVISO_CLASES; k++) {
+	if (k->resumidos && now - k->inicio >= *k->periodo)
+	    cierra_periodo(k, now);
+    }
+
+    for (c = colas; c < colas + AVISOS_CANALES; c++) {
+	if (!c->encolados && !c->descartados)
+	    continue;
+	if (c->segundo != now) {
+	    c->segundo = now;
+	    c->enviados = 0;
+	}
+	while (c->enviados < AvisosPorSegundo
+			&& write_buffer_len() < NET_BUFSIZE/2 && saca_aviso(c))
+	    c->enviados++;
+	if (!c->encolados && c->descartados
+			&& c->enviados < AvisosPorSegundo) {
+	    dice_descartados(c);
+	    c->enviados++;
+	}
+    }
+}
+
+/* Manda todo lo que queda, sin mirar AvisosPorSegundo.  Lo llama main()
+ * antes del SQUIT al salir o reiniciar, para no perder los ultimos avisos
+ * (el del QUIT, el "Actualizando bases de datos.."...). */
+
+void avisos_vacia(void)
+{
+    time_t now = time(NULL);
+    ColaAvisos *c;
+    ClaseAvisos *k;
+
+    for (k = clases; k < clases + AVISO_CLASES; k++) {
+	if (k->resumidos)
+	    cierra_periodo(k, now);
+    }
+    for (c = colas; c < colas + AVISOS_CANALES; c++) {
+	while (saca_aviso(c))
+	    ;
+	if (c->descartados)
+	    dice_descartados(c);
+    }
+}
+
+/*************************************************************************/
+
+/* Devuelve 1 si queda algo por mandar o por resumir (sgets() no espera
+ * entonces mas de un segundo). */
+
+int avisos_pendientes(void)
+{
+    int i;
+
+    for (i = 0; i < AVISOS_CANALES; i++) {
+	if (colas[i].encolados || colas[i].descartados)
+	    return 1;
+    }
+    for (i = 0; i < AVISO_CLASES; i++) {
+	if (clases[i].resumidos)
+	    return 1;
+    }
+    return 0;
+}
+
+/*************************************************************************/
@@ -9,6 +9,12 @@
  * ATENCIN: Parte de este cdigo est extraido del cifranick.c del
  * IRCd de IRC-Hispano, escrito originalmente por sus desarrolladores
  * (las rutinas de TEA)
+ *
+ * Es el motor de la BDD para los dos protocolos: las series de cada tabla,
+ * los lotes de escritura, la copia local (bddlocal.c) y el cifrado de las
+ * claves de la tabla n son los mismos en P09 y en P10, y solo cambia el
+ * formato de las filas en el enlace (manda_fila()).  bdd_hispano.c tiene
+ * las funciones de siempre de P10 por encima de bdd_escribe().
  */
 #define NUMNICKLOG 6
 #define NICKLEN 30
@@ -24,9 +30,9 @@
 #include <time.h>
 #include <unistd.h>
 
- #if defined(IRC_UNDERNET_P09)
+#if defined(IRC_BDD)
 
-static const char convert2y[] = {
+static const char base64_car[] = {
   'A','B','C','D','E','F','G','H','I','J','K','L','M','N','O','P',
   'Q','R','S','T','U','V','W','X','Y','Z','a','b','c','d','e','f',
   'g','h','i','j','k','l','m','n','o','p','q','r','s','t','u','v',
@@ -34,7 +40,7 @@ static const char convert2y[] = {
 };
 
 
-static const unsigned int convert2n[] = {
+static const unsigned int base64_num[] = {
    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
@@ -54,23 +60,25 @@ static const unsigned int convert2n[] = {
    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
 };
 
-unsigned int base64toint(const char *s)
+/* Las de P10.c tienen otra forma, de ahi los nombres. */
+
+static unsigned int base64_a_int(const char *s)
 {
-  unsigned int i = convert2n[(unsigned char)*s++];
+  unsigned int i = base64_num[(unsigned char)*s++];
   while (*s)
   {
     i <<= NUMNICKLOG;
-    i += convert2n[(unsigned char)*s++];
+    i += base64_num[(unsigned char)*s++];
   }
   return i;
 }
 
-const char *inttobase64(char *buf, unsigned int v, unsigned int count)
+static const char *int_a_base64(char *buf, unsigned int v, unsigned int count)
 {
   buf[count] = '\0';
   while (count > 0)
   {
-    buf[--count] = convert2y[(v & NUMNICKMASK)];
+    buf[--count] = base64_car[(v & NUMNICKMASK)];
     v >>= NUMNICKLOG;
   }
   return buf;
@@ -124,29 +132,239 @@ void tea(unsigned int v[], unsigned int k[], unsigned int x[])
 
 
 
-static unsigned int tabla_n;
-static unsigned int tabla_c; /* para los canales persistentes*/
-static unsigned int tabla_r; /*para redireccin automtica de canales*/
-static unsigned int tabla_j; /*para jupeos de nicks*/
-static unsigned int tabla_u; /*para uworld*/
-static unsigned int tabla_v;
-static unsigned int tabla_o;
-static unsigned int tabla_w;
-static unsigned int tabla_i;
-static unsigned int tabla_z;
+/* Siguiente serie de cada tabla, de la 'a' a la 'z'.  Las de Hispano:
+ * n nicks, v vhosts, o opers, w vhosts personalizados, i ips, z claves,
+ * c canales persistentes, r redirecciones de canales, j jupeos de nicks,
+ * u uworld. */
+static unsigned int series[26];
 static void compactar_tablas(User *u);
 static void regenerar_clave(User *u);
 static void tocar_tablas(User *u);
 static void actualizar_contadores(User *u);
+static void estado_bdd(User *u);
 static void do_help(User *u);
+static void compacta_paso(void);
+static void auditar_tablas(User *u);
+static void auditoria_paso(void);
+static void estado_auditoria(User *u);
 
+/* Lotes de escritura: las filas que se escriben en una vuelta del bucle
+ * principal forman un lote.  Cada fila lleva la serie de nuestro contador
+ * local, y al acabar la vuelta bdd_fin_lote() pide un solo STATS b para
+ * todo el lote (y no mas de uno cada BddSincroniza segundos); en P10 no
+ * se pide nada. */
 
-void do_write_bdd(char *entrada, int tabla, const char *valor, ...)
+#define LOTE_CUBOS	16	/* Filas por lote: el cubo i es 2^i..2^(i+1)-1 */
+
+static unsigned int lote_filas = 0;	/* Filas del lote en curso */
+static int sincro_pendiente = 0;
+static time_t ultima_sincro = 0;
+
+static uint32 lotes = 0, filas = 0, filas_omitidas = 0, sincros = 0;
+static uint32 lote_max = 0;
+static uint32 lote_cubos[LOTE_CUBOS];
+
+/* Sincronizacion al arrancar.  Hasta que el servidor no dice (STATS b) por
+ * que serie va una tabla, lo que se escribe en ella solo se apunta en la
+ * copia local y en el diario, sin mandarlo: con el contador a 0 la red lo
+ * tiraria.  Cuando llega la serie, sale del diario lo que la red ya tiene
+ * (lo mandado antes de reiniciar con una serie que no pasa de la suya) y
+ * se manda de nuevo, en orden, solo lo demas.  Despues, cada STATS b
+ * confirma lo mandado hasta su serie.  Las tablas de las que no llega
+ * respuesta en SINCRO_ESPERA segundos siguen por la ultima serie que
+ * apunto la copia local y reenvian lo que no estaba confirmado.  En P10
+ * no hay STATS b: las tablas se dan por sincronizadas al arrancar, con la
+ * serie de la copia local, y lo que se manda no pasa por el diario. */
+
+#define SINCRO_ESPERA	30
+
+#if defined(IRC_UNDERNET_P10)
+# define CONFIRMA_SERIES 0
+#else
+# define CONFIRMA_SERIES 1
+#endif
+
+static char sincronizada[26];
+static int sincro_completa = 0;		/* Todas las tablas sincronizadas */
+static time_t arranque;
+static uint32 retenidas = 0, reenviadas = 0;
+
+/* Contador de serie de la tabla `tab', o NULL si no es una tabla. */
+
+static unsigned int *contador(char tab)
+{
+    return tab >= 'a' && tab <= 'z' ? &series[tab-'a'] : NULL;
+}
+
+/* La fila tal como va en el enlace.  Sin valor es un borrado. */
+
+static void manda_fila(char tab, unsigned int serie, const char *clave,
+		       const char *valor)
+{
+#if defined(IRC_UNDERNET_P10)
+    if (valor && *valor)
+	send_cmd(NULL, "%c DB * %u %c %s :%s", convert2y[ServerNumerico],
+		 serie, tab, clave, valor);
+    else
+	send_cmd(NULL, "%c DB * %u %c %s", convert2y[ServerNumerico],
+		 serie, tab, clave);
+#else
+    send_cmd(NULL, "DB * %u %c %s :%s", serie, tab, clave,
+	     valor ? valor : "");
+#endif
+}
+
+/* Manda el registro a la red y lo apunta en la copia local, salvo que la
+ * copia diga que la clave ya tiene ese valor.  Un valor NULL o vacio es
+ * un borrado.  La sincronizacion de los contadores la hace
+ * bdd_fin_lote(). */
+
+void bdd_escribe(char tab, const char *clave, const char *valor)
+{
+    unsigned int *serie = contador(tab);
+
+    if (!serie)
+	return;
+    if (bdd_local_igual(tab, clave, valor)) {
+	filas_omitidas++;
+	return;
+    }
+    if (!sincronizada[tab-'a']) {
+	bdd_local_pon(tab, clave, valor, 0);
+	bdd_diario_apunta(tab, clave, valor, 0);
+	retenidas++;
+	return;
+    }
+    manda_fila(tab, *serie, clave, valor);
+    bdd_local_pon(tab, clave, valor, *serie);
+    if (CONFIRMA_SERIES)
+	bdd_diario_apunta(tab, clave, valor, *serie);
+    (*serie)++;
+    lote_filas++;
+}
+
+/* Manda de nuevo una escritura del diario; devuelve su serie nueva. */
+
+static uint32 reenvia(char tab, const char *clave, const char *valor)
+{
+    unsigned int *serie = contador(tab);
+
+    manda_fila(tab, *serie, clave, valor);
+    bdd_local_pon(tab, clave, valor, *serie);
+    lote_filas++;
+    return (*serie)++;
+}
+
+/* La red tiene `tab' hasta la serie `confirmada': se quita del diario lo
+ * que ya ha llegado y, si la tabla no estaba sincronizada, se manda lo
+ * que queda. */
+
+static void sincroniza(char tab, unsigned int confirmada)
+{
+    uint32 n;
+
+    bdd_diario_confirma(tab, confirmada);
+    if (sincronizada[tab-'a'])
+	return;
+    sincronizada[tab-'a'] = 1;
+    n = bdd_diario_reenvia(tab, reenvia);
+    reenviadas += n;
+    if (!CONFIRMA_SERIES)
+	bdd_diario_confirma(tab, *contador(tab) - 1);
+    if (n)
+	logeo("BDD: tabla %c sincronizada en la serie %u, %lu escrituras"
+	      " reenviadas", tab, confirmada, (unsigned long)n);
+}
+
+/* Al cargar las bases de datos.  En P10 las tablas quedan ya
+ * sincronizadas. */
+
+void bdd_init(void)
+{
+    char tab;
+
+    arranque = time(NULL);
+    if (CONFIRMA_SERIES)
+	return;
+    for (tab = 'a'; tab <= 'z'; tab++) {
+	bdd_serie_vista(tab, bdd_local_serie(tab));
+	sincroniza(tab, bdd_local_confirmada(tab));
+    }
+    sincro_completa = 1;
+}
+
+/* Las tablas que siguen sin sincronizar pasado SINCRO_ESPERA. */
+
+static void sincro_vencida(void)
+{
+    char tab;
+
+    sincro_completa = 1;
+    for (tab = 'a'; tab <= 'z'; tab++) {
+	if (sincronizada[tab-'a'])
+	    continue;
+	bdd_serie_vista(tab, bdd_local_serie(tab));
+	sincroniza(tab, bdd_local_confirmada(tab));
+    }
+}
+
+/* Pide al servidor las series de las tablas.  En P10 no hay STATS b: las
+ * series se ponen al dia con los DB que llegan.  Devuelve 1 si se han
+ * pedido. */
+
+static int pide_series(void)
+{
+#if defined(IRC_UNDERNET_P10)
+    return 0;
+#else
+    send_cmd(s_BddServ, "STATS b");
+    return 1;
+#endif
+}
+
+/* Lo llama el bucle principal en cada vuelta: avanza la compactacion y
+ * las reparaciones de la auditoria si las hay, cierra el lote de filas
+ * escritas desde la anterior y, si toca, pide los contadores al
+ * servidor. */
+
+void bdd_fin_lote(void)
+{
+    time_t now;
+    int i;
+
+    if (!sincro_completa && time(NULL) - arranque >= SINCRO_ESPERA)
+	sincro_vencida();
+    compacta_paso();
+    auditoria_paso();
+    if (lote_filas) {
+	for (i = 0; i < LOTE_CUBOS-1 && (lote_filas >> (i+1)); i++)
+	    ;
+	lote_cubos[i]++;
+	if (lote_filas > lote_max)
+	    lote_max = lote_filas;
+	lotes++;
+	filas += lote_filas;
+	lote_filas = 0;
+	sincro_pendiente = 1;
+    }
+    if (sincro_pendiente
+		&& (now = time(NULL)) - ultima_sincro >= BddSincroniza) {
+	sincro_pendiente = 0;
+	if (pide_series()) {
+	    sincros++;
+	    ultima_sincro = now;
+	}
+    }
+}
+
+
+/* Clave de la tabla n para `nick' (ya normalizado) con la contrasea
+ * `pass': los bloques de 64 bits del nick cifrados con TEA encadenados
+ * (CBC), en base64.  Devuelve `clave', de 13 bytes por lo menos. */
+
+char *bdd_cifra_clave(const char *nick, const char *pass, char *clave)
 {
-    
     unsigned int v[2], k[2], x[2];
-    
-    char *nick = entrada;
     int longitud_nick = strlen(nick);
     /* Para nicks <16 uso cont 2 para el resto lo calculo */
     int cont=(longitud_nick < 16) ? 2 : ((longitud_nick + 8) / 8);
@@ -154,30 +372,20 @@ void do_write_bdd(char *entrada, int tabla, const char *valor, ...)
     char tmppass[12 + 1];
     unsigned int *p = (unsigned int *)tmpnick; /* int == 32 bits */
 
-    char clave[12 + 1];                /* Clave encriptada */
-    int i = 0;
-
-    /* Normalizar nick */
-    while (nick[i] != 0)
-    {
-       nick[i] = toLower((int) nick[i]);
-       i++;
-    }
-
     memset(tmpnick, 0, sizeof(tmpnick));
     strncpy(tmpnick, nick ,sizeof(tmpnick) - 1);
 
     memset(tmppass, 0, sizeof(tmppass));
-    strncpy(tmppass, valor, sizeof(tmppass) - 1);
+    strncpy(tmppass, pass, sizeof(tmppass) - 1);
 
     /* relleno   ->   123456789012 */
     strncat(tmppass, "AAAAAAAAAAAA", sizeof(tmppass) - strlen(tmppass) -1);
 
     x[0] = x[1] = 0;
 
-    k[1] = base64toint(tmppass + 6);
+    k[1] = base64_a_int(tmppass + 6);
     tmppass[6] = '\0';
-    k[0] = base64toint(tmppass);
+    k[0] = base64_a_int(tmppass);
 
     while(cont--)
     {
@@ -186,112 +394,203 @@ void do_write_bdd(char *entrada, int tabla, const char *valor, ...)
       tea(v, k, x);
     }
 
-    inttobase64(clave, x[0], 6);
-    inttobase64(clave + 6, x[1], 6);
-    
-	 if (tabla == 1) {
-		send_cmd(NULL, "DB * %d n %s :%s", tabla_n, nick, clave);
-	 	tabla_n++;
-	 } else if (tabla == 15) {
-                send_cmd(NULL, "DB * %d n %s :", tabla_n, nick);
-	 	tabla_n++;
-	 } else if (tabla == 16) {
-	 	send_cmd(NULL, "DB * %d n %s :%s+", tabla_n, nick, clave);
-	 	tabla_n++;
-	 } else if (tabla == 17) {
-	 	send_cmd(NULL, "DB * %d n %s :AAAAAAAAA", tabla_n, nick);
-		tabla_n++;
-	 } else if (tabla == 2) {
-	 	send_cmd(NULL, "DB * %d v %s :%s", tabla_v, nick, valor);
-		tabla_v++;
-	 } else if (tabla == 22) {
-		send_cmd(NULL, "DB * %d v %s :%s%s.%s", tabla_v, nick, OperColor,nick, OperHost); 
-	        tabla_v++;
-	 } else if (tabla == 23){
-	 	send_cmd(NULL, "DB * %d v %s :%s%s.%s", tabla_v, nick,AdminColor, nick, AdminHost);
-	 	tabla_v++;
-	 } else if (tabla == 24){
-	 	send_cmd(NULL, "DB * %d v %s :%s%s.%s", tabla_v, nick,DevelColor, nick, DevelHost);
-		tabla_v++;
-	  } else if (tabla == 25){
-	 	send_cmd(NULL, "DB * %d v %s :%s%s.%s", tabla_v, nick,PatrocinaColor, nick, PatrocinaHost);
-	 	tabla_v++;
-	  } else if (tabla == 26){
-	 	send_cmd(NULL, "DB * %d v %s :%s%s.%s", tabla_v, nick, CoAdminColor,nick, CoAdminHost);
-	 	tabla_v++;
-	 } else if (tabla == 27){
-	 	send_cmd(NULL, "DB * %d v %s :%s%s.%s", tabla_v, nick, RootColor,nick, RootHost);
-	 	tabla_v++;
-	 } else if (tabla == 3) {
-	 	send_cmd(NULL, "DB * %d o %s :%s", tabla_o, nick, valor);
-		tabla_o++;
-	 } else  if (tabla == 4) {
-	 	send_cmd(NULL, "DB * %d w %s :%s", tabla_w, nick, valor);
-		tabla_w++;
-	 } else  if (tabla == 5) {
-	 	send_cmd(NULL, "DB * %d i %s :%s", tabla_i, entrada, valor);
-		tabla_w++;
-	 } else  if (tabla == 6) {
-	 	send_cmd(NULL, "DB * %d z %s :%s", tabla_z, entrada, valor);
-		tabla_z++;
-	 
-          } else  if (tabla == 7) {
-	 	send_cmd(NULL, "DB * %d c %s :%s", tabla_c, entrada, valor);
-		tabla_c++;
-	 
-	 } else  if (tabla == 9) {
-	 	send_cmd(NULL, "DB * %d r %s :%s", tabla_r, entrada, valor);
-		tabla_r++;
-	 } else  if (tabla == 10) {
-	 	send_cmd(NULL, "DB * %d j %s :%s", tabla_j, entrada, valor);
-		tabla_r++;
-	 } else  if (tabla == 11) {
-	 	send_cmd(NULL, "DB * %d u %s :%s", tabla_u, entrada, valor);
-		tabla_u++;
-	 
-	 }
-	 
-/*send_cmd(NULL, "DB * %d %s %s :%s", reg, tab, ent, val);*/
-send_cmd(s_BddServ, "STATS b");	
+    int_a_base64(clave, x[0], 6);
+    int_a_base64(clave + 6, x[1], 6);
+    return clave;
+}
+
+/*************************************************************************/
+
+/* Cifrado por tandas: lo mismo que bdd_cifra_clave() para muchos nicks a la
+ * vez (una compactacion, volver a meter todos los nicks en la BDD...).
+ * Los nicks van de TEA_CARRILES en TEA_CARRILES, y cada ronda de TEA se
+ * hace para todos los carriles en el mismo bucle, sin dependencias entre
+ * ellos, de modo que el compilador puede hacerla con instrucciones SIMD.
+ * Los nicks de mas de TEA_BLOQUES bloques (muy raros) van por
+ * bdd_cifra_clave(). */
 
+#define TEA_CARRILES	8
+#define TEA_BLOQUES	4	/* Bloques de 64 bits: nicks de hasta 31 */
+
+static void tea_carriles(unsigned int y[], unsigned int z[],
+			 const unsigned int a[], const unsigned int b[])
+{
+    /* Copias locales: sin posibles alias el compilador las deja en
+     * registros vectoriales durante las 32 rondas */
+    unsigned int yy[TEA_CARRILES], zz[TEA_CARRILES];
+    unsigned int aa[TEA_CARRILES], bb[TEA_CARRILES];
+    unsigned int sum = 0, delta = 0x9E3779B9;
+    int n, i;
+
+    for (i = 0; i < TEA_CARRILES; i++) {
+	yy[i] = y[i];
+	zz[i] = z[i];
+	aa[i] = a[i];
+	bb[i] = b[i];
+    }
+    for (n = 0; n < 32; n++) {
+	sum += delta;
+	for (i = 0; i < TEA_CARRILES; i++) {
+	    yy[i] += ((zz[i] << 4) + aa[i]) ^ ((zz[i] + sum) ^ ((zz[i] >> 5) + bb[i]));
+	    zz[i] += (yy[i] << 4) ^ ((yy[i] + sum) ^ (yy[i] >> 5));
+	}
+    }
+    for (i = 0; i < TEA_CARRILES; i++) {
+	y[i] = yy[i];
+	z[i] = zz[i];
+    }
 }
+
+/* base64_a_int() de los 6 caracteres de `s'. */
+
+static unsigned int base64_6(const unsigned char *s)
+{
+    return base64_num[s[0]] << 30 | base64_num[s[1]] << 24
+	 | base64_num[s[2]] << 18 | base64_num[s[3]] << 12
+	 | base64_num[s[4]] << 6 | base64_num[s[5]];
+}
+
+/* Deja en claves[i] la clave de la tabla n de nicks[i] (ya normalizado)
+ * con la contrasea passes[i], para i de 0 a n-1. */
+
+void cifra_claves(const char *nicks[], const char *passes[],
+		  char claves[][13], int n)
+{
+    unsigned int v[TEA_CARRILES][TEA_BLOQUES*2];
+    unsigned int x0[TEA_CARRILES], x1[TEA_CARRILES];
+    unsigned int y[TEA_CARRILES], z[TEA_CARRILES];
+    unsigned int a[TEA_CARRILES], b[TEA_CARRILES];
+    int bloques[TEA_CARRILES];
+    unsigned char nick[TEA_BLOQUES*8], pass[12];
+    int base, i, j, len, max;
+
+    for (base = 0; base < n; base += TEA_CARRILES) {
+	max = 0;
+	for (i = 0; i < TEA_CARRILES; i++) {
+	    bloques[i] = 0;
+	    x0[i] = x1[i] = a[i] = b[i] = 0;
+	    if (base+i >= n)
+		continue;
+	    len = strlen(nicks[base+i]);
+	    if (len >= TEA_BLOQUES*8) {
+		bdd_cifra_clave(nicks[base+i], passes[base+i], claves[base+i]);
+		continue;
+	    }
+	    bloques[i] = len < 16 ? 2 : (len + 8) / 8;
+	    if (bloques[i] > max)
+		max = bloques[i];
+	    memset(nick, 0, sizeof(nick));
+	    memcpy(nick, nicks[base+i], len);
+	    for (j = 0; j < TEA_BLOQUES*2; j++)
+		v[i][j] = nick[j*4] << 24 | nick[j*4+1] << 16
+			| nick[j*4+2] << 8 | nick[j*4+3];
+	    memset(pass, 'A', sizeof(pass));
+	    for (j = 0; j < 12 && passes[base+i][j]; j++)
+		pass[j] = passes[base+i][j];
+	    a[i] = base64_6(pass);
+	    b[i] = base64_6(pass+6);
+	}
+	for (j = 0; j < max; j++) {
+	    for (i = 0; i < TEA_CARRILES; i++) {
+		y[i] = v[i][j*2] ^ x0[i];
+		z[i] = v[i][j*2+1] ^ x1[i];
+	    }
+	    tea_carriles(y, z, a, b);
+	    for (i = 0; i < TEA_CARRILES; i++) {
+		if (j < bloques[i]) {
+		    x0[i] = y[i];
+		    x1[i] = z[i];
+		}
+	    }
+	}
+	for (i = 0; i < TEA_CARRILES && base+i < n; i++) {
+	    if (bloques[i]) {
+		int_a_base64(claves[base+i], x0[i], 6);
+		int_a_base64(claves[base+i] + 6, x1[i], 6);
+	    }
+	}
+    }
+}
+
+void do_write_bdd(char *entrada, int tabla, const char *valor, ...)
+{
+    char *nick = entrada;
+    char clave[12 + 1];                /* Clave encriptada */
+    int i = 0;
+    char tab, buf[BUFSIZE];
+    const char *val = buf, *color = NULL, *host = NULL;
+
+    /* Normalizar nick */
+    while (nick[i] != 0)
+    {
+       nick[i] = toLower((int) nick[i]);
+       i++;
+    }
+
+    /* Solo las tablas de nicks llevan la clave cifrada */
+    if (tabla == 1 || tabla == 16)
+	bdd_cifra_clave(nick, valor, clave);
+
+    switch (tabla) {
+      case 1:  tab = 'n'; val = clave; break;
+      case 15: tab = 'n'; val = ""; break;
+      case 16: tab = 'n'; snprintf(buf, sizeof(buf), "%s+", clave); break;
+      case 17: tab = 'n'; val = "AAAAAAAAA"; break;
+      case 2:  tab = 'v'; val = valor; break;
+      case 22: tab = 'v'; color = OperColor; host = OperHost; break;
+      case 23: tab = 'v'; color = AdminColor; host = AdminHost; break;
+      case 24: tab = 'v'; color = DevelColor; host = DevelHost; break;
+      case 25: tab = 'v'; color = PatrocinaColor; host = PatrocinaHost; break;
+      case 26: tab = 'v'; color = CoAdminColor; host = CoAdminHost; break;
+      case 27: tab = 'v'; color = RootColor; host = RootHost; break;
+      case 3:  tab = 'o'; val = valor; break;
+      case 4:  tab = 'w'; val = valor; break;
+      case 5:  tab = 'i'; val = valor; break;
+      case 6:  tab = 'z'; val = valor; break;
+      case 7:  tab = 'c'; val = valor; break;
+      case 9:  tab = 'r'; val = valor; break;
+      case 10: tab = 'j'; val = valor; break;
+      case 11: tab = 'u'; val = valor; break;
+      default: return;
+    }
+    if (color)
+	snprintf(buf, sizeof(buf), "%s%s.%s", color, nick, host);
+    bdd_escribe(tab, nick, val);
+}
+
 void do_write_canal(char *entrada, int tabla, const char *valor,const char *param, ...)
 {
-if (tabla == 8) {
-	 	send_cmd(NULL, "DB * %d c %s :%s:%s", tabla_c, entrada, valor,param);
-		tabla_c++;
+    char buf[BUFSIZE];
+
+    if (tabla == 8) {
+	snprintf(buf, sizeof(buf), "%s:%s", valor, param);
+	bdd_escribe('c', entrada, buf);
+    }
 }
-send_cmd(s_BddServ, "STATS b");
+
+/* Nos ha llegado del servidor el registro `serie' de la tabla `tab'. */
+
+void bdd_serie_vista(char tab, unsigned int serie)
+{
+    unsigned int *c = contador(tab);
+
+    if (c && serie >= *c)
+	*c = serie+1;
 }
+
+/* Respuesta del servidor a STATS b: la ultima serie de la tabla.  El
+ * contador solo avanza, porque la respuesta puede llegar despues de que
+ * hayamos escrito mas filas con series que el servidor aun no habia visto
+ * cuando contesto.  Confirma lo que hemos mandado hasta esa serie. */
+
 void do_count_bdd(int tabla, unsigned int valor)
 {
+    static const char tablas[] = "nvowizccrju";
 
-	if (tabla == 1)
-		tabla_n = valor +1;
-			
-	if (tabla == 2)
-		tabla_v = valor +1;
-		
-	if (tabla == 3)
-		tabla_o = valor +1;
-
-	if (tabla == 4)
-		tabla_w = valor +1;
-
-	if (tabla == 5)
-		tabla_i = valor +1;
-	if (tabla == 6)
-		tabla_z = valor +1;
-        if (tabla == 7)
-		tabla_c = valor +1;
-	 if (tabla == 8)
-		tabla_c = valor +1;
-	 if (tabla == 9)
-		tabla_r = valor +1;
-	if (tabla == 10)
-		tabla_j = valor +1;
-	if (tabla == 11)
-		tabla_u = valor +1;
+    if (tabla >= 1 && tabla <= 11) {
+	bdd_serie_vista(tablas[tabla-1], valor);
+	sincroniza(tablas[tabla-1], valor);
+    }
 }
 
 static Command cmds[] = {
@@ -300,6 +599,8 @@ static Command cmds[] = {
 	{ "REGENERAR",	regenerar_clave,	is_services_admin, 	BDD_HELP_REGENERAR,	-1,-1,-1,-1 },
 	{ "TOCAR",	tocar_tablas,		is_services_admin,	BDD_HELP_TOCAR,	-1,-1,-1,-1 },
 	{ "ACTUALIZAR",	actualizar_contadores,	is_services_oper,	BDD_HELP_ACTUALIZAR,	-1,-1,-1,-1 },
+	{ "AUDITAR",	auditar_tablas,		is_services_oper,	BDD_HELP_AUDITAR,	-1,-1,-1,-1 },
+	{ "ESTADO",	estado_bdd,		is_services_oper,	-1,	-1,-1,-1,-1 },
 	{ NULL }
 };
 
@@ -334,18 +635,693 @@ static void do_help(User *u)
 
 static void actualizar_contadores(User *u)
 {
-	send_cmd(s_BddServ, "STATS b");
+	pide_series();
 	notice_lang(s_BddServ, u, BDD_SEQ_OK);
 }
 
+/* Contadores, tamano de la copia local y metricas de los lotes. */
+
+static void estado_bdd(User *u)
+{
+    static const char tablas[] = "nvowizcrju";
+    char buf[BUFSIZE];
+    const char *t;
+    uint32 n;
+    int i, len;
+
+    for (t = tablas; *t; t++) {
+	bdd_local_lista(*t, &n);
+	notice(s_BddServ, u->nick, "Tabla %c: siguiente serie %u,"
+	       " %lu registros en la copia local, confirmada hasta la serie %lu%s",
+	       *t, *contador(*t), (unsigned long)n,
+	       (unsigned long)bdd_local_confirmada(*t),
+	       sincronizada[*t-'a'] ? "" : " (sin sincronizar)");
+    }
+    notice(s_BddServ, u->nick, "Diario: %lu escrituras sin confirmar; al"
+	   " arrancar %lu retenidas hasta sincronizar y %lu reenviadas",
+	   (unsigned long)bdd_diario_pendientes(), (unsigned long)retenidas,
+	   (unsigned long)reenviadas);
+    notice(s_BddServ, u->nick, "Lotes: %lu con %lu filas (media %lu,"
+	   " maximo %lu); %lu filas omitidas por no cambiar nada",
+	   (unsigned long)lotes, (unsigned long)filas,
+	   (unsigned long)(lotes ? filas/lotes : 0), (unsigned long)lote_max,
+	   (unsigned long)filas_omitidas);
+    len = 0;
+    *buf = 0;
+    for (i = 0; i < LOTE_CUBOS; i++) {
+	if (lote_cubos[i] && len < (int)sizeof(buf))
+	    len += snprintf(buf+len, sizeof(buf)-len, " %u-%u:%lu",
+			    1U << i, (2U << i) - 1, (unsigned long)lote_cubos[i]);
+    }
+    if (*buf)
+	notice(s_BddServ, u->nick, "Filas por lote:%s", buf);
+    if (ultima_sincro) {
+	notice(s_BddServ, u->nick, "%lu sincronizaciones (STATS b), la"
+	       " ultima hace %ld s%s", (unsigned long)sincros,
+	       (long)(time(NULL) - ultima_sincro),
+	       sincro_pendiente ? "; hay otra pendiente" : "");
+    }
+    estado_auditoria(u);
+}
+
+/*************************************************************************/
+
+/* Compactacion de las tablas.  Al empezar cada tabla se hace una lista con
+ * las claves a revisar (las de la copia local y, en la n, ademas los nicks
+ * registrados), y luego, unas cuantas en cada vuelta del bucle, se mira
+ * que valor deberia tener cada una segun los datos de los Services: si la
+ * clave sobra se borra, si su valor esta mal se corrige y si esta bien no
+ * se manda nada.  Como la lista es una copia de las claves, se sigue por
+ * donde se iba aunque entretanto se borren nicks o canales.  Al acabar
+ * cada tabla se manda la marca "*" de siempre, para que el ircd tire las
+ * filas que ya no valen. */
+
+#define COMPACTA_REVISA	500	/* Claves revisadas por vuelta, como mucho */
+
+static const char tablas_compacta[] = "nvwocrjuz";
+
+static const char *compacta_tabla = NULL;	/* NULL: no hay compactacion */
+static char **compacta_claves = NULL;
+static uint32 compacta_nclaves = 0, compacta_pos = 0;
+static uint32 compacta_revisadas, compacta_borradas, compacta_escritas;
+static time_t compacta_inicio;
+static char compacta_quien[NICKMAX];
+
+/* La compactacion y las reparaciones de la auditoria comparten el cupo de
+ * BddCompactaFilas filas por segundo. */
+
+static time_t repaso_segundo;
+static int repaso_filas;		/* Filas mandadas en repaso_segundo */
+
+/* Claves de la tabla n de las siguientes COMPACTA_REVISA claves de la
+ * lista, cifradas de una vez con cifra_claves().  Se apunta la contrasea
+ * con que se cifro cada una, por si cambia antes de llegar a ella. */
+
+static uint32 cifradas_pos = 0, cifradas_n = 0;	/* Claves que cubren */
+static int cifradas_idx[COMPACTA_REVISA];	/* -1: nick sin clave */
+static char cifradas_pass[COMPACTA_REVISA][PASSMAX];
+static char cifradas[COMPACTA_REVISA][13];
+
+/* Filas que se pueden mandar todavia en este segundo. */
+
+static int quedan_filas(void)
+{
+    time_t now = time(NULL);
+
+    if (repaso_segundo != now) {
+	repaso_segundo = now;
+	repaso_filas = 0;
+    }
+    return BddCompactaFilas - repaso_filas;
+}
+
+/* Cifra las claves de la tabla n de la lista a partir de `pos'. */
+
+static void prepara_cifradas(uint32 pos)
+{
+    const char *nicks[COMPACTA_REVISA], *passes[COMPACTA_REVISA];
+    NickInfo *ni;
+    int i, n = 0;
+
+    cifradas_pos = pos;
+    for (i = 0; i < COMPACTA_REVISA && pos+i < compacta_nclaves; i++) {
+	cifradas_idx[i] = -1;
+	ni = findnick(compacta_claves[pos+i]);
+	if (!ni || !(ni->status & NI_ON_BDD) || (ni->status & NS_VERBOTEN))
+	    continue;
+	strscpy(cifradas_pass[i], ni->pass, PASSMAX);
+	nicks[n] = compacta_claves[pos+i];
+	passes[n] = cifradas_pass[i];
+	cifradas_idx[i] = n++;
+    }
+    cifradas_n = i;
+    cifra_claves(nicks, passes, cifradas, n);
+}
+
+/* Clave de la tabla n de la clave `pos' de la lista, para `ni'. */
+
+static char *clave_nick(uint32 pos, NickInfo *ni, char *buf)
+{
+    int i;
+
+    if (pos < cifradas_pos || pos >= cifradas_pos + cifradas_n)
+	prepara_cifradas(pos);
+    i = pos - cifradas_pos;
+    if (cifradas_idx[i] >= 0 && strcmp(cifradas_pass[i], ni->pass) == 0)
+	return strcpy(buf, cifradas[cifradas_idx[i]]);
+    return bdd_cifra_clave(compacta_claves[pos], ni->pass, buf);
+}
+
+#define SIN_LISTA	((uint32)-1)	/* Clave que no es de la lista */
+
+/* Valor que deberia tener la `clave' (normalizada) del nick `ni' (NULL si
+ * no esta registrado) en `tab', una de las tablas de nicks: NULL si no lo
+ * sabemos y se deja como este, "" si la clave sobra, o el valor, en `buf'
+ * (de BUFSIZE bytes).  `pos' es la posicion de la clave en la lista de la
+ * compactacion, para aprovechar las claves ya cifradas, o SIN_LISTA. */
+
+static const char *deseado_nick(char tab, const char *clave, NickInfo *ni,
+				uint32 pos, char *buf)
+{
+    switch (tab) {
+      case 'n':
+	if (!ni)
+	    return "";
+	if (ni->status & NS_VERBOTEN)
+	    return NULL;
+	if (!(ni->status & NI_ON_BDD))
+	    return "";
+	if (pos == SIN_LISTA)
+	    bdd_cifra_clave(clave, ni->pass, buf);
+	else
+	    clave_nick(pos, ni, buf);
+	if (ni->status & NS_SUSPENDED)
+	    strcat(buf, "+");
+	return buf;
+      case 'v':
+      case 'w':
+      case 'o':
+	/* Los vhosts y los rangos dependen de cosas que no estan solo en
+	 * los Services; lo unico seguro es que sobran los de nicks que no
+	 * estan en la BDD */
+	return ni && (ni->status & NI_ON_BDD) ? NULL : "";
+    }
+    return NULL;
+}
+
+/* Lo mismo para cualquier tabla, buscando el nick o el canal. */
+
+static const char *deseado(char tab, const char *clave, uint32 pos,
+			   char *buf)
+{
+    switch (tab) {
+      case 'n':
+      case 'v':
+      case 'w':
+      case 'o':
+	return deseado_nick(tab, clave, findnick(clave), pos, buf);
+      case 'c':
+	return cs_findchan(clave) ? NULL : "";
+    }
+    return NULL;
+}
+
+/* Escribe en la `clave' de `tab' el valor `quiere' (como lo devuelve
+ * deseado()) si la copia local dice otra cosa.  Devuelve 0 si no hacia
+ * falta, 1 si se ha borrado la clave y 2 si se ha escrito. */
+
+static int corrige(char tab, const char *clave, const char *quiere)
+{
+    const char *hay = bdd_local_valor(tab, clave);
+
+    if (!*quiere) {
+	if (!hay)
+	    return 0;
+    } else if (hay && strcmp(hay, quiere) == 0) {
+	return 0;
+    }
+    bdd_escribe(tab, clave, quiere);
+    return *quiere ? 2 : 1;
+}
+
+static void libera_claves(void)
+{
+    uint32 i;
+
+    for (i = 0; i < compacta_nclaves; i++)
+	free(compacta_claves[i]);
+    free(compacta_claves);
+    compacta_claves = NULL;
+    compacta_nclaves = compacta_pos = 0;
+    cifradas_pos = cifradas_n = 0;
+}
+
+/* Hace la lista de claves de la tabla en curso. */
+
+static void empieza_tabla(void)
+{
+    NickInfo *ni;
+    BddReg *r;
+    uint32 n, max;
+    char buf[BUFSIZE], *s;
+
+    libera_claves();
+    r = bdd_local_lista(*compacta_tabla, &max);
+    if (*compacta_tabla == 'n') {
+	for (ni = firstnickinfo(); ni; ni = nextnickinfo())
+	    max++;
+    }
+    compacta_claves = smalloc(sizeof(char *) * (max ? max : 1));
+    for (n = 0; r; r = r->lista_sig)
+	compacta_claves[n++] = sstrdup(r->clave);
+    if (*compacta_tabla == 'n') {
+	for (ni = firstnickinfo(); ni; ni = nextnickinfo()) {
+	    if (!(ni->status & NI_ON_BDD) || (ni->status & NS_VERBOTEN)
+			|| bdd_local_valor('n', ni->nick))
+		continue;
+	    strscpy(buf, ni->nick, sizeof(buf));
+	    for (s = buf; *s; s++)
+		*s = toLower(*s);
+	    compacta_claves[n++] = sstrdup(buf);
+	}
+    }
+    compacta_nclaves = n;
+}
+
+/* Revisa unas cuantas claves, sin pasar de BddCompactaFilas filas por
+ * segundo ni llenar el buffer de salida. */
+
+static void compacta_paso(void)
+{
+    const char *clave, *quiere;
+    char buf[BUFSIZE];
+    int revisadas = 0;
+
+    if (!compacta_tabla)
+	return;
+    while (quedan_filas() > 0 && revisadas < COMPACTA_REVISA
+		&& write_buffer_len() < NET_BUFSIZE/2) {
+	if (compacta_pos >= compacta_nclaves) {
+	    /* Tabla acabada: la marca y a por la siguiente */
+	    if (*compacta_tabla == 'n') {
+		bdd_escribe('n', "*", "");
+	    } else {
+		snprintf(buf, sizeof(buf), "Compactando tabla %c",
+			 *compacta_tabla);
+		bdd_escribe(*compacta_tabla, "*", buf);
+	    }
+	    repaso_filas++;
+	    if (!*++compacta_tabla) {
+		libera_claves();
+		compacta_tabla = NULL;
+		canaladmins(s_BddServ, "Compactacion de la BDD pedida por"
+			    " 12%s acabada en %ld s: %lu claves revisadas,"
+			    " %lu borradas y %lu escritas", compacta_quien,
+			    (long)(time(NULL) - compacta_inicio),
+			    (unsigned long)compacta_revisadas,
+			    (unsigned long)compacta_borradas,
+			    (unsigned long)compacta_escritas);
+		return;
+	    }
+	    empieza_tabla();
+	    continue;
+	}
+	clave = compacta_claves[compacta_pos];
+	revisadas++;
+	compacta_revisadas++;
+	if (!(quiere = deseado(*compacta_tabla, clave, compacta_pos++, buf)))
+	    continue;
+	switch (corrige(*compacta_tabla, clave, quiere)) {
+	  case 0:
+	    continue;
+	  case 1:
+	    compacta_borradas++;
+	    break;
+	  default:
+	    compacta_escritas++;
+	}
+	repaso_filas++;
+    }
+}
+
+/* COMPACTAR [PARAR]: empieza la compactacion, o dice como va. */
+
 static void compactar_tablas(User *u)
 {
-	char d[]="*";
-	do_write_bdd(d, 15, "Compactando tabla n");
-	do_write_bdd(d, 2, "Compactando tabla v");
-	do_write_bdd(d, 3, "Compactando tabla o");
-	do_write_bdd(d, 4, "Compactando tabla w");
-       	notice_lang(s_BddServ, u, BDD_COMPACT);
+    char *param = strtok(NULL, " ");
+
+    if (param && stricmp(param, "PARAR") == 0) {
+	if (compacta_tabla) {
+	    libera_claves();
+	    compacta_tabla = NULL;
+	    canaladmins(s_BddServ, "12%s ha parado la compactacion de la"
+			" BDD", u->nick);
+	    notice(s_BddServ, u->nick, "Compactacion parada.");
+	} else {
+	    notice(s_BddServ, u->nick, "No hay ninguna compactacion en"
+		   " marcha.");
+	}
+	return;
+    }
+    if (compacta_tabla) {
+	notice(s_BddServ, u->nick, "Compactando la tabla %c (%lu de %lu"
+	       " claves); llevamos %lu claves revisadas, %lu borradas y"
+	       " %lu escritas.", *compacta_tabla,
+	       (unsigned long)compacta_pos, (unsigned long)compacta_nclaves,
+	       (unsigned long)compacta_revisadas,
+	       (unsigned long)compacta_borradas,
+	       (unsigned long)compacta_escritas);
+	return;
+    }
+    compacta_tabla = tablas_compacta;
+    compacta_revisadas = compacta_borradas = compacta_escritas = 0;
+    compacta_inicio = time(NULL);
+    strscpy(compacta_quien, u->nick, sizeof(compacta_quien));
+    empieza_tabla();
+    canaladmins(s_BddServ, "12%s ha empezado a compactar la BDD",
+		u->nick);
+    notice_lang(s_BddServ, u, BDD_COMPACT);
+}
+
+/*************************************************************************/
+
+/* Auditoria de las tablas: compara la copia local con los nicks y canales
+ * registrados sin mandar nada a la red.  Primero se recorren los nicks y
+ * los canales, buscando en la copia (que es un hash) sus claves de las
+ * tablas n, v, w, o, c y r y marcandolas con el numero de la auditoria;
+ * luego se recorre cada una de esas tablas en la copia, y lo que no lleva
+ * la marca es de nicks o canales que ya no existen.  Las claves de la
+ * tabla n se cifran por tandas con cifra_claves().  Por tabla se cuenta lo
+ * que falta, lo que tiene otro valor, lo que sobra y lo que es raro pero
+ * no se sabe arreglar (redirecciones de canales que no existen, vhosts
+ * personalizados distintos del de NickServ).
+ *
+ * Con REPARAR (o BddAuditoriaRepara en las que se hacen solas cada
+ * BddAuditoria) las claves a arreglar van a una cola, que bdd_fin_lote()
+ * vacia con el cupo de filas de la compactacion; el valor se vuelve a
+ * calcular al sacar cada clave, por si entretanto ha cambiado algo. */
+
+static const char tablas_auditoria[] = "nvwocr";
+
+typedef struct {
+    uint32 filas;		/* En la copia local */
+    uint32 faltan;		/* Deberian estar y no estan */
+    uint32 distintas;		/* Estan, con otro valor */
+    uint32 sobran;		/* De nicks o canales que no deberian tener */
+    uint32 dudosas;		/* Raras, pero no se tocan */
+} CuentaAuditoria;
+
+static CuentaAuditoria auditoria[sizeof(tablas_auditoria)-1];
+static uint32 auditorias = 0, auditoria_marca = 0;
+static time_t ultima_auditoria = 0, proxima_auditoria = 0;
+static int64 auditoria_us = 0;		/* Lo que tardo la ultima */
+
+typedef struct reparacion_ Reparacion;
+struct reparacion_ {
+    Reparacion *next;
+    char tabla;
+    char *clave;
+};
+
+static Reparacion *reparaciones = NULL, *fin_reparaciones = NULL;
+static uint32 reparaciones_pendientes = 0;
+static uint32 reparaciones_revisadas = 0, reparadas = 0;
+
+/* Nicks de la tabla n pendientes de cifrar */
+static char tanda_nicks[COMPACTA_REVISA][NICKMAX];
+static NickInfo *tanda_ni[COMPACTA_REVISA];
+static BddReg *tanda_reg[COMPACTA_REVISA];
+static int tanda_n = 0;
+
+/* Devuelve 1 si hay una compactacion o reparaciones en marcha (sgets() no
+ * espera entonces mas de un segundo). */
+
+int bdd_repasando(void)
+{
+    return compacta_tabla != NULL || reparaciones != NULL;
+}
+
+static CuentaAuditoria *cuenta_auditoria(char tab)
+{
+    return &auditoria[strchr(tablas_auditoria, tab) - tablas_auditoria];
+}
+
+static void encola_reparacion(char tab, const char *clave)
+{
+    Reparacion *rp = smalloc(sizeof(Reparacion));
+
+    rp->next = NULL;
+    rp->tabla = tab;
+    rp->clave = sstrdup(clave);
+    if (fin_reparaciones)
+	fin_reparaciones->next = rp;
+    else
+	reparaciones = rp;
+    fin_reparaciones = rp;
+    reparaciones_pendientes++;
+}
+
+static void libera_reparaciones(void)
+{
+    Reparacion *rp;
+
+    while ((rp = reparaciones) != NULL) {
+	reparaciones = rp->next;
+	free(rp->clave);
+	free(rp);
+    }
+    fin_reparaciones = NULL;
+    reparaciones_pendientes = 0;
+}
+
+/* Cuenta la clave `clave' de `tab', cuyo registro en la copia es `r' (NULL
+ * si no esta) y que deberia tener `quiere' (como en deseado()), y si no
+ * esta bien y hay que `reparar', la pone en la cola. */
+
+static void audita_clave(char tab, const char *clave, BddReg *r,
+			 const char *quiere, int reparar)
+{
+    CuentaAuditoria *c = cuenta_auditoria(tab);
+
+    if (!quiere)
+	return;
+    if (!*quiere) {
+	if (!r)
+	    return;
+	c->sobran++;
+    } else if (!r) {
+	c->faltan++;
+    } else if (strcmp(r->valor, quiere) != 0) {
+	c->distintas++;
+    } else {
+	return;
+    }
+    if (reparar)
+	encola_reparacion(tab, clave);
+}
+
+/* Cifra las claves de la tanda y las compara con las de la copia. */
+
+static void audita_tanda(int reparar)
+{
+    const char *nicks[COMPACTA_REVISA], *passes[COMPACTA_REVISA];
+    char claves[COMPACTA_REVISA][13], buf[BUFSIZE];
+    int i;
+
+    for (i = 0; i < tanda_n; i++) {
+	nicks[i] = tanda_nicks[i];
+	passes[i] = tanda_ni[i]->pass;
+    }
+    cifra_claves(nicks, passes, claves, tanda_n);
+    for (i = 0; i < tanda_n; i++) {
+	snprintf(buf, sizeof(buf), "%s%s", claves[i],
+		 (tanda_ni[i]->status & NS_SUSPENDED) ? "+" : "");
+	audita_clave('n', tanda_nicks[i], tanda_reg[i], buf, reparar);
+    }
+    tanda_n = 0;
+}
+
+static void audita(int reparar)
+{
+    NickInfo *ni;
+    ChannelInfo *ci;
+    BddReg *r;
+    const char *t;
+    char clave[NICKMAX], buf[BUFSIZE];
+    int64 inicio = reloj_us();
+    int i;
+
+    memset(auditoria, 0, sizeof(auditoria));
+    if (reparar)
+	libera_reparaciones();
+    auditoria_marca++;
+
+    /* Lo que deberia haber segun los nicks registrados */
+    for (ni = firstnickinfo(); ni; ni = nextnickinfo()) {
+	for (i = 0; ni->nick[i] && i < NICKMAX-1; i++)
+	    clave[i] = toLower(ni->nick[i]);
+	clave[i] = 0;
+	for (t = "nvwo"; *t; t++) {
+	    if ((r = bdd_local_reg(*t, clave)) != NULL)
+		r->marca = auditoria_marca;
+	    if (*t == 'n' && (ni->status & NI_ON_BDD)
+			&& !(ni->status & NS_VERBOTEN)) {
+		strcpy(tanda_nicks[tanda_n], clave);
+		tanda_ni[tanda_n] = ni;
+		tanda_reg[tanda_n] = r;
+		if (++tanda_n == COMPACTA_REVISA)
+		    audita_tanda(reparar);
+		continue;
+	    }
+	    audita_clave(*t, clave, r,
+			 deseado_nick(*t, clave, ni, SIN_LISTA, buf), reparar);
+	    if (*t == 'w' && r && ni->vhost && (ni->status & NI_ON_BDD)
+			&& strcmp(r->valor, ni->vhost) != 0)
+		cuenta_auditoria('w')->dudosas++;
+	}
+    }
+    if (tanda_n)
+	audita_tanda(reparar);
+
+    /* Los canales solo se marcan: no sabemos que valor deberian tener */
+    for (ci = firstchaninfo(); ci; ci = nextchaninfo()) {
+	for (t = "cr"; *t; t++) {
+	    if ((r = bdd_local_reg(*t, ci->name)) != NULL)
+		r->marca = auditoria_marca;
+	}
+    }
+
+    /* Y lo que hay en la copia sin nick o canal detras */
+    for (t = tablas_auditoria; *t; t++) {
+	CuentaAuditoria *c = cuenta_auditoria(*t);
+
+	for (r = bdd_local_lista(*t, &c->filas); r; r = r->lista_sig) {
+	    if (r->marca == auditoria_marca)
+		continue;
+	    if (*t == 'r') {
+		c->dudosas++;
+		continue;
+	    }
+	    c->sobran++;
+	    if (reparar)
+		encola_reparacion(*t, r->clave);
+	}
+    }
+
+    auditorias++;
+    ultima_auditoria = time(NULL);
+    auditoria_us = reloj_us() - inicio;
+}
+
+/* Cuenta las diferencias de la ultima auditoria (sin las dudosas). */
+
+static uint32 diferencias(void)
+{
+    uint32 n = 0;
+    int i;
+
+    for (i = 0; i < (int)(sizeof(auditoria)/sizeof(*auditoria)); i++)
+	n += auditoria[i].faltan + auditoria[i].distintas + auditoria[i].sobran;
+    return n;
+}
+
+/* Resultado de la ultima auditoria, al usuario `u' o, sin `u', al canal de
+ * admins. */
+
+static void informa_auditoria(User *u)
+{
+    char buf[BUFSIZE];
+    const char *t;
+    CuentaAuditoria *c;
+
+    snprintf(buf, sizeof(buf), "Auditoria de la BDD en %ld.%03ld ms: %lu"
+	     " diferencias, %lu claves en cola para reparar",
+	     (long)(auditoria_us/1000), (long)(auditoria_us%1000),
+	     (unsigned long)diferencias(),
+	     (unsigned long)reparaciones_pendientes);
+    if (u)
+	notice(s_BddServ, u->nick, "%s", buf);
+    else
+	canaladmins(s_BddServ, "%s", buf);
+    for (t = tablas_auditoria; *t; t++) {
+	c = cuenta_auditoria(*t);
+	if (!c->faltan && !c->distintas && !c->sobran && !c->dudosas)
+	    continue;
+	snprintf(buf, sizeof(buf), "Tabla %c: %lu claves, faltan %lu, %lu"
+		 " con otro valor, sobran %lu, %lu dudosas", *t,
+		 (unsigned long)c->filas, (unsigned long)c->faltan,
+		 (unsigned long)c->distintas, (unsigned long)c->sobran,
+		 (unsigned long)c->dudosas);
+	if (u)
+	    notice(s_BddServ, u->nick, "%s", buf);
+	else
+	    canaladmins(s_BddServ, "%s", buf);
+    }
+}
+
+/* Lo llama bdd_fin_lote(): hace la auditoria si toca y manda las
+ * reparaciones pendientes que quepan. */
+
+static void auditoria_paso(void)
+{
+    Reparacion *rp;
+    const char *quiere;
+    char buf[BUFSIZE];
+    time_t now;
+
+    if (BddAuditoria && !reparaciones && !compacta_tabla) {
+	now = time(NULL);
+	if (!proxima_auditoria || proxima_auditoria > now + BddAuditoria)
+	    proxima_auditoria = now + BddAuditoria;
+	if (now >= proxima_auditoria) {
+	    proxima_auditoria = now + BddAuditoria;
+	    audita(BddAuditoriaRepara);
+	    if (diferencias())
+		informa_auditoria(NULL);
+	}
+    }
+    if (!reparaciones)
+	return;
+    while (reparaciones && quedan_filas() > 0
+		&& write_buffer_len() < NET_BUFSIZE/2) {
+	rp = reparaciones;
+	if (!(reparaciones = rp->next))
+	    fin_reparaciones = NULL;
+	reparaciones_pendientes--;
+	reparaciones_revisadas++;
+	quiere = deseado(rp->tabla, rp->clave, SIN_LISTA, buf);
+	if (quiere && corrige(rp->tabla, rp->clave, quiere)) {
+	    reparadas++;
+	    repaso_filas++;
+	}
+	free(rp->clave);
+	free(rp);
+    }
+    if (!reparaciones)
+	canaladmins(s_BddServ, "Reparaciones de la auditoria de la BDD"
+		    " acabadas: %lu claves corregidas en total",
+		    (unsigned long)reparadas);
+}
+
+/* AUDITAR [REPARAR]: audita las tablas y dice lo que ha encontrado. */
+
+static void auditar_tablas(User *u)
+{
+    char *param = strtok(NULL, " ");
+    int reparar = param && stricmp(param, "REPARAR") == 0;
+
+    if (param && !reparar) {
+	syntax_error(s_BddServ, u, "AUDITAR", BDD_AUDITAR_SYNTAX);
+	return;
+    }
+    audita(reparar);
+    informa_auditoria(u);
+    if (reparar && reparaciones_pendientes)
+	canaladmins(s_BddServ, "12%s ha pedido reparar %lu claves de la"
+		    " BDD", u->nick, (unsigned long)reparaciones_pendientes);
+}
+
+/* Lineas de la auditoria para ESTADO. */
+
+static void estado_auditoria(User *u)
+{
+    if (auditorias) {
+	notice(s_BddServ, u->nick, "%lu auditorias, la ultima hace %ld s"
+	       " (%ld.%03ld ms): %lu diferencias", (unsigned long)auditorias,
+	       (long)(time(NULL) - ultima_auditoria),
+	       (long)(auditoria_us/1000), (long)(auditoria_us%1000),
+	       (unsigned long)diferencias());
+    }
+    if (reparaciones_revisadas || reparaciones_pendientes) {
+	notice(s_BddServ, u->nick, "Reparaciones: %lu claves revisadas, %lu"
+	       " corregidas, %lu en cola", (unsigned long)reparaciones_revisadas,
+	       (unsigned long)reparadas, (unsigned long)reparaciones_pendientes);
+    }
+    if (BddAuditoria && proxima_auditoria) {
+	notice(s_BddServ, u->nick, "Proxima auditoria automatica dentro de"
+	       " %ld s%s", (long)(proxima_auditoria - time(NULL)),
+	       BddAuditoriaRepara ? ", con reparacion" : "");
+    }
 }
 
 static void regenerar_clave(User *u)
@@ -0,0 +1,465 @@
+/* Copia local de las tablas de la BDD.
+ *
+ * Services is copyright (c) 1996-1999 Andy Church.
+ *     E-mail: <achurch@dragonfire.net>
+ * This program is free but copyrighted software; see the file COPYING for
+ * details.
+ *
+ * Cada registro de la BDD (tabla, clave, valor y numero de serie) que
+ * escribimos con bdd_escribe() o que nos llega del servidor
+ * en un DB se apunta aqui, en una tabla hash comun a todas las tablas, de
+ * modo que bdd_local_valor() dice en O(1) que hay en la red para una clave
+ * sin preguntar a nadie.  Las claves se guardan normalizadas con toLower(),
+ * igual que hace el ircd.  Un valor vacio es un borrado: el registro sale
+ * de la copia.  Los registros de clave "*" (las marcas de compactacion) no
+ * se guardan.
+ *
+ * Los registros de cada tabla estan ademas en una lista doble, para poder
+ * recorrerla entera (bdd_local_lista()).  La copia se graba en BddDB con
+ * las demas bases de datos, solo si ha cambiado.
+ *
+ * Con la copia se graban el diario de nuestras escrituras que la red aun
+ * no ha confirmado (en orden, con la serie con que se mandaron, o 0 si no
+ * se han mandado todavia) y la ultima serie confirmada de cada tabla, para
+ * que al arrancar bdd.c mande solo lo que no llego a la red.
+ */
+
+#include "services.h"
+#include "datafiles.h"
+
+#define BDD_TABLAS	26	/* 'a' a 'z' */
+#define BDD_HASH_INICIAL 1024
+
+static BddReg **hash = NULL;
+static uint32 hash_tam = 0;		/* Potencia de 2 */
+static uint32 nregs = 0;
+
+static BddReg *listas[BDD_TABLAS];
+static uint32 regs_tabla[BDD_TABLAS];
+static uint32 series[BDD_TABLAS];	/* Ultima serie vista en cada tabla */
+
+static int cambiada = 0;		/* Hay que grabarla */
+
+typedef struct bdddiario_ BddDiario;
+struct bdddiario_ {
+    BddDiario *next;
+    uint32 serie;			/* 0: todavia sin mandar */
+    char tabla;
+    char *clave;
+    char *valor;			/* "" para un borrado */
+};
+
+static BddDiario *diario = NULL, *fin_diario = NULL;
+static uint32 ndiario = 0;
+static uint32 confirmadas[BDD_TABLAS];	/* Ultima serie confirmada por la red */
+
+/*************************************************************************/
+
+static int indice(char tabla)
+{
+    tabla = tolower(tabla);
+    return tabla >= 'a' && tabla <= 'z' ? tabla - 'a' : -1;
+}
+
+static uint32 bdd_hash(int t, const char *clave)
+{
+    uint32 h = 2166136261U ^ t;
+
+    while (*clave) {
+	h ^= (unsigned char)*clave++;
+	h *= 16777619U;
+    }
+    return h;
+}
+
+/* Copia `clave' normalizada en `buf' (de BUFSIZE bytes). */
+
+static char *normaliza(char *buf, const char *clave)
+{
+    char *s = buf;
+
+    while (*clave && s < buf+BUFSIZE-1)
+	*s++ = toLower(*clave++);
+    *s = 0;
+    return buf;
+}
+
+static void crece(void)
+{
+    BddReg **nuevo, *r, *sig;
+    uint32 i, tam = hash_tam ? hash_tam*2 : BDD_HASH_INICIAL;
+
+    nuevo = scalloc(tam, sizeof(BddReg *));
+    for (i = 0; i < hash_tam; i++) {
+	for (r = hash[i]; r; r = sig) {
+	    sig = r->next;
+	    r->next = nuevo[r->hash & (tam-1)];
+	    nuevo[r->hash & (tam-1)] = r;
+	}
+    }
+    free(hash);
+    hash = nuevo;
+    hash_tam = tam;
+}
+
+static BddReg *busca(int t, const char *clave, uint32 h)
+{
+    BddReg *r;
+
+    if (!hash_tam)
+	return NULL;
+    for (r = hash[h & (hash_tam-1)]; r; r = r->next) {
+	if (r->hash == h && r->tabla == 'a'+t && strcmp(r->clave, clave) == 0)
+	    return r;
+    }
+    return NULL;
+}
+
+static void quita(BddReg *r)
+{
+    BddReg **pr;
+    int t = r->tabla - 'a';
+
+    for (pr = &hash[r->hash & (hash_tam-1)]; *pr != r; pr = &(*pr)->next)
+	;
+    *pr = r->next;
+    if (r->lista_ant)
+	r->lista_ant->lista_sig = r->lista_sig;
+    else
+	listas[t] = r->lista_sig;
+    if (r->lista_sig)
+	r->lista_sig->lista_ant = r->lista_ant;
+    free(r->clave);
+    free(r->valor);
+    free(r);
+    nregs--;
+    regs_tabla[t]--;
+}
+
+/*************************************************************************/
+/*************************************************************************/
+
+/* Apunta que en la `tabla' de la red la `clave' vale `valor' (NULL o ""
+ * para un borrado), con el numero de serie `serie'. */
+
+void bdd_local_pon(char tabla, const char *clave, const char *valor,
+		   uint32 serie)
+{
+    char buf[BUFSIZE];
+    int t = indice(tabla);
+    uint32 h;
+    BddReg *r;
+
+    if (t < 0)
+	return;
+    if (serie > series[t])
+	series[t] = serie;
+    cambiada = 1;
+    if (strcmp(clave, "*") == 0)
+	return;
+    normaliza(buf, clave);
+    h = bdd_hash(t, buf);
+    r = busca(t, buf, h);
+    if (!valor || !*valor) {
+	if (r)
+	    quita(r);
+	return;
+    }
+    if (r) {
+	if (strcmp(r->valor, valor) != 0) {
+	    free(r->valor);
+	    r->valor = sstrdup(valor);
+	}
+	r->serie = serie;
+	return;
+    }
+    if (nregs >= hash_tam)
+	crece();
+    r = smalloc(sizeof(BddReg));
+    r->tabla = 'a'+t;
+    r->hash = h;
+    r->clave = sstrdup(buf);
+    r->valor = sstrdup(valor);
+    r->serie = serie;
+    r->marca = 0;
+    r->next = hash[h & (hash_tam-1)];
+    hash[h & (hash_tam-1)] = r;
+    r->lista_ant = NULL;
+    r->lista_sig = listas[t];
+    if (listas[t])
+	listas[t]->lista_ant = r;
+    listas[t] = r;
+    nregs++;
+    regs_tabla[t]++;
+}
+
+/* Registro de `clave' en `tabla', o NULL si no esta. */
+
+BddReg *bdd_local_reg(char tabla, const char *clave)
+{
+    char buf[BUFSIZE];
+    int t = indice(tabla);
+
+    if (t < 0)
+	return NULL;
+    normaliza(buf, clave);
+    return busca(t, buf, bdd_hash(t, buf));
+}
+
+/* Valor de `clave' en `tabla', o NULL si no esta. */
+
+const char *bdd_local_valor(char tabla, const char *clave)
+{
+    BddReg *r = bdd_local_reg(tabla, clave);
+
+    return r ? r->valor : NULL;
+}
+
+/* Devuelve 1 si escribir `valor' en `clave' no cambiaria nada: la clave ya
+ * tiene ese mismo valor.  Los borrados no se dan nunca por inutiles (que
+ * una clave no este en la copia no asegura que no este en la red). */
+
+int bdd_local_igual(char tabla, const char *clave, const char *valor)
+{
+    const char *v;
+
+    if (!valor || !*valor || strcmp(clave, "*") == 0)
+	return 0;
+    v = bdd_local_valor(tabla, clave);
+    return v && strcmp(v, valor) == 0;
+}
+
+/* Ultima serie vista en `tabla'. */
+
+uint32 bdd_local_serie(char tabla)
+{
+    int t = indice(tabla);
+
+    return t < 0 ? 0 : series[t];
+}
+
+/* Primer registro de `tabla' (los demas por lista_sig), y cuantos hay. */
+
+BddReg *bdd_local_lista(char tabla, uint32 *cuantos)
+{
+    int t = indice(tabla);
+
+    if (cuantos)
+	*cuantos = t < 0 ? 0 : regs_tabla[t];
+    return t < 0 ? NULL : listas[t];
+}
+
+/*************************************************************************/
+/*************************************************************************/
+
+/* Apunta al final del diario que hemos escrito `valor' (NULL o "" para un
+ * borrado) en la `clave' de `tabla' con la serie `serie' (0 si todavia no
+ * se ha mandado). */
+
+void bdd_diario_apunta(char tabla, const char *clave, const char *valor,
+		       uint32 serie)
+{
+    BddDiario *d;
+
+    if (indice(tabla) < 0)
+	return;
+    d = smalloc(sizeof(BddDiario));
+    d->next = NULL;
+    d->serie = serie;
+    d->tabla = tolower(tabla);
+    d->clave = sstrdup(clave);
+    d->valor = sstrdup(valor ? valor : "");
+    if (fin_diario)
+	fin_diario->next = d;
+    else
+	diario = d;
+    fin_diario = d;
+    ndiario++;
+    cambiada = 1;
+}
+
+/* La red dice que `tabla' va por la serie `serie': lo que mandamos con
+ * una serie que no pasa de esa ya ha llegado y sale del diario. */
+
+void bdd_diario_confirma(char tabla, uint32 serie)
+{
+    BddDiario **pd, *d;
+    int t = indice(tabla);
+
+    if (t < 0)
+	return;
+    if (serie > confirmadas[t]) {
+	confirmadas[t] = serie;
+	cambiada = 1;
+    }
+    fin_diario = NULL;
+    for (pd = &diario; (d = *pd) != NULL; ) {
+	if (d->tabla == 'a'+t && d->serie && d->serie <= serie) {
+	    *pd = d->next;
+	    free(d->clave);
+	    free(d->valor);
+	    free(d);
+	    ndiario--;
+	    cambiada = 1;
+	} else {
+	    fin_diario = d;
+	    pd = &d->next;
+	}
+    }
+}
+
+/* Vuelve a mandar, en orden, todo lo que queda en el diario de `tabla':
+ * `manda' lo manda y devuelve la serie nueva, que se apunta.  Devuelve
+ * cuantas escrituras se han mandado. */
+
+uint32 bdd_diario_reenvia(char tabla,
+		uint32 (*manda)(char tabla, const char *clave, const char *valor))
+{
+    BddDiario *d;
+    uint32 n = 0;
+
+    tabla = tolower(tabla);
+    for (d = diario; d; d = d->next) {
+	if (d->tabla != tabla)
+	    continue;
+	d->serie = manda(tabla, d->clave, d->valor);
+	n++;
+	cambiada = 1;
+    }
+    return n;
+}
+
+/* Ultima serie de `tabla' confirmada por la red. */
+
+uint32 bdd_local_confirmada(char tabla)
+{
+    int t = indice(tabla);
+
+    return t < 0 ? 0 : confirmadas[t];
+}
+
+/* Escrituras del diario sin confirmar. */
+
+uint32 bdd_diario_pendientes(void)
+{
+    return ndiario;
+}
+
+/*************************************************************************/
+/*************************************************************************/
+
+#define SAFE(x) do {					\
+    if ((x) < 0) {					\
+	if (!forceload)					\
+	    fatal("Error de lectura en %s", BddDBName);	\
+	goto fin;					\
+    }							\
+} while (0)
+
+void load_bdd_local(void)
+{
+    dbFILE *f;
+    int i, tabla;
+    int32 n, serie;
+    char *clave, *valor;
+
+    if (!(f = open_db(s_BddServ, BddDBName, "r")))
+	return;
+    get_file_version(f);
+    for (i = 0; i < BDD_TABLAS; i++) {
+	SAFE(read_int32(&serie, f));
+	series[i] = serie;
+    }
+    SAFE(read_int32(&n, f));
+    while (n-- > 0) {
+	clave = valor = NULL;
+	SAFE(read_int8(&tabla, f));
+	SAFE(read_int32(&serie, f));
+	SAFE(read_string(&clave, f));
+	SAFE(read_string(&valor, f));
+	if (clave && valor)
+	    bdd_local_pon(tabla, clave, valor, serie);
+	free(clave);
+	free(valor);
+    }
+    /* Las copias grabadas antes de que hubiera diario acaban aqui */
+    if (read_int32(&serie, f) < 0)
+	goto fin;
+    confirmadas[0] = serie;
+    for (i = 1; i < BDD_TABLAS; i++) {
+	SAFE(read_int32(&serie, f));
+	confirmadas[i] = serie;
+    }
+    SAFE(read_int32(&n, f));
+    while (n-- > 0) {
+	clave = valor = NULL;
+	SAFE(read_int8(&tabla, f));
+	SAFE(read_int32(&serie, f));
+	SAFE(read_string(&clave, f));
+	SAFE(read_string(&valor, f));
+	if (clave)
+	    bdd_diario_apunta(tabla, clave, valor, serie);
+	free(clave);
+	free(valor);
+    }
+  fin:
+    close_db(f);
+    cambiada = 0;
+}
+
+#undef SAFE
+
+/*************************************************************************/
+
+#define SAFE(x) do {						\
+    if ((x) < 0) {						\
+	restore_db(f);						\
+	log_perror("Write error on %s", BddDBName);		\
+	if (time(NULL) - lastwarn > WarningTimeout) {		\
+	    canalopers(NULL, "Write error on %s: %s", BddDBName,	\
+			strerror(errno));			\
+	    lastwarn = time(NULL);				\
+	}							\
+	return;							\
+    }								\
+} while (0)
+
+void save_bdd_local(void)
+{
+    dbFILE *f;
+    BddReg *r;
+    BddDiario *d;
+    int i;
+    static time_t lastwarn = 0;
+
+    if (!cambiada)
+	return;
+    if (!(f = open_db(s_BddServ, BddDBName, "w")))
+	return;
+    for (i = 0; i < BDD_TABLAS; i++)
+	SAFE(write_int32(series[i], f));
+    SAFE(write_int32(nregs, f));
+    for (i = 0; i < BDD_TABLAS; i++) {
+	for (r = listas[i]; r; r = r->lista_sig) {
+	    SAFE(write_int8(r->tabla, f));
+	    SAFE(write_int32(r->serie, f));
+	    SAFE(write_string(r->clave, f));
+	    SAFE(write_string(r->valor, f));
+	}
+    }
+    for (i = 0; i < BDD_TABLAS; i++)
+	SAFE(write_int32(confirmadas[i], f));
+    SAFE(write_int32(ndiario, f));
+    for (d = diario; d; d = d->next) {
+	SAFE(write_int8(d->tabla, f));
+	SAFE(write_int32(d->serie, f));
+	SAFE(write_string(d->clave, f));
+	SAFE(write_string(d->valor, f));
+    }
+    close_db(f);
+    cambiada = 0;
+}
+
+#undef SAFE
+
+/*************************************************************************/
@@ -478,7 +478,7 @@ if (!c) {
  for (u = c->users; u; u = u->next) {
 	if (stricmp(u->user->nick, nick) == 0) {
 	 mask = create_mask(u->user);
-	send_cmd(s_ChanServ, "MODE %s +b %s  %lu", canal, mask, time(NULL));
+	modo_canal(s_ChanServ, canal, "+b", mask);
         send_cmd(MODE_SENDER(s_ChanServ), "KICK %s %s :%s", canal, nick, reason);
 /*miramos por nicks al canal para aadir ultimo uso*/
 check_akick(u->user, canal);
@@ -586,7 +586,7 @@ snprintf(masknickuserip, sizeof(masknickuserip), "%s!%s@%s",u->user->nick,u->use
 	achanakicks[i].caza_akick= time(NULL);
 mask = create_mask(u->user);
 if (!(is_oper(u->user->nick))) { 
-	 send_cmd(s_ChanServ, "MODE %s +b %s  %lu", canal, mask, time(NULL));
+	 modo_canal(s_ChanServ, canal, "+b", mask);
 privmsg(s_ChanServ, ni->nick, "12ENFORCE 4BAN usado sobre host 4%s",mask);
    /* send_cmd(s_ChanServ, "MODE %s +b %s  %lu", canal, u->user->host, time(NULL)); <---da el host completo*/
 /*privmsg(s_ChanServ, ni->nick, "ENFORCE BAN en %s usado sobre host %s",canal,u->user->host,cont);*/
@@ -858,7 +858,7 @@ kick:
     strcpy(av[0], chan);
     av[1] = sstrdup("+b");
     av[2] = mask;
-    send_cmd(s_ChanServ, "MODE %s +b %s  %lu", chan, av[2], time(NULL));
+    modo_canal(s_ChanServ, chan, "+b", av[2]);
 	
     do_cmode(s_ChanServ, 3, av);
     free(av[0]);
@@ -13,6 +13,44 @@
 #define HASH(chan)	((chan)[1] ? ((chan)[1]&31)<<5 | ((chan)[2]&31) : 0)
 static Channel *chanlist[1024];
 
+/* Canales que entran en un burst (el del enlace, hasta que acaba, o un
+ * BURST de P10): lo que haria ChanServ al entrar cada usuario
+ * (check_modes(), restore_topic(), akicks, autoops, autolimit...) se deja
+ * para cuando acabe el burst, y entonces se hace de una vez por canal y
+ * con los modos juntos en pocas lineas (modos.c).  Se guarda el
+ * nombre y los numericos (los nicks en P09) de los que han entrado en el
+ * burst, no punteros, porque el canal o los usuarios pueden irse antes.
+ * El burst acaba con el END_OF_BURST en P10 y con el PONG al PING que se
+ * manda al enlazar en P09; si no llega, los canales se revisan a los
+ * BURST_ESPERA segundos. */
+
+#define BURST_ESPERA	120
+
+#if defined(IRC_UNDERNET_P10)
+# define CLAVE_USUARIO(u)	((u)->numerico)
+# define BUSCA_USUARIO(s)	finduserP10(s)
+#else
+# define CLAVE_USUARIO(u)	((u)->nick)
+# define BUSCA_USUARIO(s)	finduser(s)
+#endif
+
+typedef struct canal_burst CanalBurst;
+struct canal_burst {
+    CanalBurst *next;
+    char nombre[CHANMAX];
+    char *miembros;		/* Claves de usuario, cada una acabada en \0 */
+    int len, tam;
+};
+
+int en_burst = 1;		/* Hasta que acabe el burst del enlace */
+
+static CanalBurst *bursts = NULL, *fin_bursts = NULL;
+static Timeout *burst_timeout = NULL;
+
+static CanalBurst *aplaza_canal(Channel *c);
+static void apunta_miembro(CanalBurst *cb, User *user);
+static int miembro_burst(CanalBurst *cb, User *user);
+
 /*************************************************************************/
 
 /* Return statistics.  Pointers are assumed to be valid. */
@@ -280,41 +318,65 @@ Channel *nextchan(void)
  * necessary.  If creating the channel, restore mode lock and topic as
  * necessary.  Also check for auto-opping and auto-voicing. */
 
+/* Crea el canal `chan', vacio, y lo enlaza con su ChannelInfo. */
+
+static Channel *nuevo_canal(const char *chan)
+{
+    Channel *c, **list;
+
+    if (debug)
+	logeo("debug: Creando canal %s", chan);
+    /* Allocate pre-cleared memory */
+    c = scalloc(sizeof(Channel), 1);
+    strscpy(c->name, chan, sizeof(c->name));
+    list = &chanlist[HASH(c->name)];
+    c->next = *list;
+    if (*list)
+	(*list)->prev = c;
+    *list = c;
+    c->creation_time = time(NULL);
+    /* Store ChannelInfo pointer in channel record */
+    c->ci = cs_findchan(chan);
+    if (c->ci) {
+#if defined(IRC_TERRA)
+	/* This is a registered channel, ensure it's mode locked +r */
+	c->ci->mlock_on |= CMODE_r;
+	c->ci->mlock_off &= ~CMODE_r;	/* just to be safe */
+#endif
+
+	/* Store return pointer in ChannelInfo record */
+	c->ci->c = c;
+    }
+    return c;
+}
+
 void chan_adduser(User *user, const char *chan)
 {
     Channel *c = findchan(chan);
-       ChannelInfo *ki;
-    Channel **list;
-    int newchan = !c;
     struct c_userlist *u;
 
-    if (newchan) {
-	if (debug)
-	    logeo("debug: Creando canal %s", chan);
-	/* Allocate pre-cleared memory */
-	c = scalloc(sizeof(Channel), 1);
-	strscpy(c->name, chan, sizeof(c->name));
-	list = &chanlist[HASH(c->name)];
-	c->next = *list;
-	if (*list)
-	    (*list)->prev = c;
-	*list = c;
-	c->creation_time = time(NULL);
-	/* Store ChannelInfo pointer in channel record */
-	c->ci = cs_findchan(chan);
-	if (c->ci) {
-#if defined(IRC_TERRA)
-	    /* This is a registered channel, ensure it's mode locked +r */
-	    c->ci->mlock_on |= CMODE_r;
-	    c->ci->mlock_off &= ~CMODE_r;	/* just to be safe */
-#endif
-
-	    /* Store return pointer in ChannelInfo record */
-	    c->ci->c = c;
+    if (!c) {
+	c = nuevo_canal(chan);
+	if (en_burst)
+	    aplaza_canal(c);
+	else {
+	    /* Restaura el modos de candado y topic en canales reg */
+	    check_modes(chan);
+	    restore_topic(chan);
 	}
-	/* Restaura el modos de candado y topic en canales reg */
-	check_modes(chan);
-	restore_topic(chan);
+    }
+    if (c->burst) {
+	/* Canal pendiente del fin del burst: solo se apunta */
+	u = smalloc(sizeof(struct c_userlist));
+	u->next = c->users;
+	u->prev = NULL;
+	if (c->users)
+	    c->users->prev = u;
+	c->users = u;
+	u->user = user;
+	c->erab++;
+	apunta_miembro(c->burst, user);
+	return;
     }
 #if defined(IRC_PATCHS_CMODES)
     if (check_should_owner(user, chan)) {
@@ -354,7 +416,7 @@ void chan_adduser(User *user, const char *chan)
     u->user = user;
     c->erab++;
     spam_ikusi(c);
-    canal_autolimit(c,ki,chan);
+    canal_autolimit(c);
 }
 
 
@@ -447,12 +509,233 @@ void chan_deluser(User *user, Channel *c)
     } else {
 	c->erab--;
 	    spam_ikusi(c); 
+	    canal_autolimit(c);
 	    
 	   }
 }
 
 /*************************************************************************/
 
+/* Anade `ban' a la lista de bans de `c'. */
+
+static void anade_ban(Channel *c, const char *ban)
+{
+    if (c->bancount >= c->bansize) {
+	c->bansize += 8;
+	c->bans = srealloc(c->bans, sizeof(char *) * c->bansize);
+    }
+    c->bans[c->bancount++] = sstrdup(ban);
+}
+
+/*************************************************************************/
+
+static struct c_userlist *busca_en(struct c_userlist *lista, User *user)
+{
+    while (lista && lista->user != user)
+	lista = lista->next;
+    return lista;
+}
+
+static void pon_en(struct c_userlist **lista, User *user)
+{
+    struct c_userlist *u = smalloc(sizeof(*u));
+
+    u->next = *lista;
+    u->prev = NULL;
+    if (*lista)
+	(*lista)->prev = u;
+    *lista = u;
+    u->user = user;
+}
+
+static void quita_de(struct c_userlist **lista, User *user)
+{
+    struct c_userlist *u = busca_en(*lista, user);
+
+    if (!u)
+	return;
+    if (u->next)
+	u->next->prev = u->prev;
+    if (u->prev)
+	u->prev->next = u->next;
+    else
+	*lista = u->next;
+    free(u);
+}
+
+/*************************************************************************/
+
+static void timeout_fin_burst(Timeout *t);
+
+/* Apunta el canal para revisarlo al acabar el burst. */
+
+static CanalBurst *aplaza_canal(Channel *c)
+{
+    CanalBurst *cb;
+
+    if (c->burst)
+	return c->burst;
+    cb = scalloc(sizeof(CanalBurst), 1);
+    strscpy(cb->nombre, c->name, sizeof(cb->nombre));
+    if (fin_bursts)
+	fin_bursts->next = cb;
+    else
+	bursts = cb;
+    fin_bursts = cb;
+    c->burst = cb;
+    if (!burst_timeout)
+	burst_timeout = add_timeout(BURST_ESPERA, timeout_fin_burst, 0);
+    return cb;
+}
+
+/* Apunta que `user' ha entrado en el canal durante el burst. */
+
+static void apunta_miembro(CanalBurst *cb, User *user)
+{
+    int len = strlen(CLAVE_USUARIO(user)) + 1;
+
+    if (cb->len + len > cb->tam) {
+	cb->tam = cb->tam ? cb->tam*2 : 256;
+	if (cb->tam < cb->len + len)
+	    cb->tam = cb->len + len;
+	cb->miembros = srealloc(cb->miembros, cb->tam);
+    }
+    memcpy(cb->miembros + cb->len, CLAVE_USUARIO(user), len);
+    cb->len += len;
+}
+
+static int miembro_burst(CanalBurst *cb, User *user)
+{
+    const char *clave = CLAVE_USUARIO(user);
+    char *s, *fin = cb->miembros + cb->len;
+
+    for (s = cb->miembros; s < fin; s += strlen(s) + 1) {
+	if (strcmp(s, clave) == 0)
+	    return 1;
+    }
+    return 0;
+}
+
+/* Usuario de clave `clave' si sigue en `c'. */
+
+static User *en_canal(Channel *c, const char *clave)
+{
+    User *user = BUSCA_USUARIO(clave);
+    struct u_chanlist *uc;
+
+    if (!user)
+	return NULL;
+    for (uc = user->chans; uc && uc->chan != c; uc = uc->next)
+	;
+    return uc ? user : NULL;
+}
+
+/* Lo que habrian hecho do_join(), chan_adduser() y do_cmode() con cada
+ * usuario del burst: akicks, candado de modos y topic, ops y voces de
+ * ChanServ y autolimit, una sola vez por canal. */
+
+static void revisa_canal(CanalBurst *cb)
+{
+    Channel *c = findchan(cb->nombre);
+    User *user;
+    char *clave, *fin = cb->miembros + cb->len, buf[NICKMAX], *kav[2];
+    int op, voz;
+
+    if (!c)
+	return;
+    if (c->burst == cb)
+	c->burst = NULL;
+
+    for (clave = cb->miembros; clave < fin; clave += strlen(clave) + 1) {
+	if (!(user = en_canal(c, clave)) || !check_akick(user, c->name))
+	    continue;
+	/* check_akick() ya ha mandado el KICK; lo sacamos de la lista */
+	strscpy(buf, clave, sizeof(buf));
+	kav[0] = cb->nombre;
+	kav[1] = buf;
+	do_kick(s_ChanServ, 2, kav);
+	if (!(c = findchan(cb->nombre)))
+	    return;
+    }
+
+    check_modes(c->name);
+    restore_topic(c->name);
+
+    for (clave = cb->miembros; clave < fin; clave += strlen(clave) + 1) {
+	if (!(user = en_canal(c, clave)))
+	    continue;
+	op = busca_en(c->chanops, user) != NULL;
+	voz = busca_en(c->voices, user) != NULL;
+	if (op && !check_valid_op(user, c->name, 1)) {
+	    quita_de(&c->chanops, user);
+	    op = 0;
+	}
+	if (voz && !check_valid_voice(user, c->name, 1)) {
+	    quita_de(&c->voices, user);
+	    voz = 0;
+	}
+	if (op)
+	    continue;
+#if defined(IRC_PATCHS_CMODES)
+	if (check_should_owner(user, c->name))
+	    pon_en(&c->chanowners, user);
+	else
+#endif
+	if (check_should_op(user, c->name))
+	    pon_en(&c->chanops, user);
+	else if (!voz && check_should_voice(user, c->name))
+	    pon_en(&c->voices, user);
+    }
+
+    spam_ikusi(c);
+    canal_autolimit(c);
+
+    /* Los modos del canal salen ya: con miles de canales en el mismo burst
+     * la cola de modos.c crece tanto que buscar en ella se hace lento */
+    modos_envia();
+}
+
+/* Fin del burst: revisa todos los canales pendientes, en el orden en que
+ * llegaron. */
+
+void fin_burst(void)
+{
+    CanalBurst *cb;
+
+    en_burst = 0;
+    if (burst_timeout) {
+	del_timeout(burst_timeout);
+	burst_timeout = NULL;
+    }
+    while ((cb = bursts) != NULL) {
+	if (!(bursts = cb->next))
+	    fin_bursts = NULL;
+	revisa_canal(cb);
+	free(cb->miembros);
+	free(cb);
+    }
+}
+
+static void timeout_fin_burst(Timeout *t)
+{
+    burst_timeout = NULL;
+    if (bursts)
+	logeo("Canales: No ha acabado el burst en %d segundos; reviso los"
+	      " canales pendientes", BURST_ESPERA);
+    fin_burst();
+}
+
+/* Devuelve 1 si lo que pase en `chan' se deja para el fin del burst. */
+
+int canal_en_burst(const char *chan)
+{
+    Channel *c;
+
+    return en_burst || ((c = findchan(chan)) && c->burst);
+}
+
+/*************************************************************************/
+
 /* Handle a channel CREATE command. */
 /*
  *  Source = Numerico
@@ -467,23 +750,58 @@ void chan_deluser(User *user, Channel *c)
 #if defined(IRC_UNDERNET_P10)
 void do_create(const char *source, int ac, char **av)
 {
-   User *user;
+    User *user;
+    char *s, *t, *cav[3];
    
-   user = finduser(source);
-
-   if (debug)
-       logeo("debug: %s crea el canal %s", user->nick, av[0]);
-          
-   do_join(user->nick, ac, av);
-   av[0] = sstrdup(av[0]);
-   av[1] = sstrdup("+o");
-   av[2] = sstrdup(user->numerico);
-/* Al entrar el tio, le pongo op */
-   do_cmode(user->nick, 3, av);
-   free(av[0]);
-   free(av[1]);
-   free(av[2]);
-                              
+    user = finduser(source);
+    if (!user)
+	return;
+
+    if (debug)
+	logeo("debug: %s crea el canal %s", user->nick, av[0]);
+
+    /* Puede venir una lista de canales: entra en cada uno y, como lo ha
+     * creado, le ponemos op */
+    for (t = av[0]; *(s = t); ) {
+	t = s + strcspn(s, ",");
+	if (*t)
+            *t++ = 0;
+	do_join(user->nick, 1, &s);
+	cav[0] = s;
+	cav[1] = "+o";
+	cav[2] = user->numerico;
+	do_cmode(user->nick, 3, cav);
+    }
+}
+
+/*************************************************************************/
+
+/* Mete a `user' en el canal tal como viene en el BURST, sin pasar por
+ * do_join() ni por ChanServ. */
+
+static void anade_miembro(Channel *c, CanalBurst *cb, User *user,
+			  int op, int voz)
+{
+    struct u_chanlist *uc;
+
+    for (uc = user->chans; uc && uc->chan != c; uc = uc->next)
+	;
+    if (uc)
+	return;
+    pon_en(&c->users, user);
+    if (op)
+	pon_en(&c->chanops, user);
+    if (voz)
+	pon_en(&c->voices, user);
+    c->erab++;
+    uc = smalloc(sizeof(*uc));
+    uc->next = user->chans;
+    uc->prev = NULL;
+    if (user->chans)
+	user->chans->prev = uc;
+    user->chans = uc;
+    uc->chan = c;
+    apunta_miembro(cb, user);
 }
 
 /*************************************************************************/
@@ -512,128 +830,87 @@ void do_create(const char *source, int ac, char **av)
  *      av[3]  = usuarios y los modos
  *      av[4..]  = bans....
  *
+ * Los parametros de +k y +l van en el orden de las letras.  Cada miembro
+ * es "numerico[:modos]", y los modos valen tambien para los siguientes
+ * hasta que otro traiga los suyos.
+ *
  * Ejemplo:
  *   "E BURST #zoltan 93422742 +ntkli lere 12 EMS,TEJ:o,FWE:ov,JET:v,EJS,JRT :%*!*@jet.es *!*@*.lnst.es"
+ *
+ * Todo se parte en su sitio, sin copiar los parametros: el canal se busca
+ * una vez, los miembros se meten directamente en las listas y ChanServ no
+ * mira nada hasta el END_OF_BURST (fin_burst()).  Un BURST sin miembros no
+ * crea el canal, como antes.
  */
+
 void do_burst(const char *source, int ac, char **av)
-{                    
-    char **modes = NULL;
-    char *ax[3];
-    int n = 0, first = 1, mod_num = 0;
-    User *u = NULL;
-                        
-    /* Run over all remaining parameters */
+{
+    Channel *c;
+    CanalBurst *cb = NULL;
+    User *user;
+    char *mav[4], *s, *num, *sig;
+    int n, mac = 0, op = 0, voz = 0;
+
+    if (ac < 2)
+	return;
+    if ((c = findchan(av[0])) != NULL)
+	cb = aplaza_canal(c);
+
     for (n = 2; n < ac; n++) {
-        switch (av[n][0]) {        /* What type is it mode, nicks or bans? */
-            case '+':        /* modes */
-            {
-                modes = smalloc(sizeof(char*) * 2);
-                modes[mod_num++] = sstrdup(av[0]);
-                modes[mod_num++] = sstrdup(av[n]);
-                if (strchr(modes[1], 'l')) {
-                    realloc(modes, (sizeof(modes) +sizeof(char *)));
-                    modes[mod_num++] = sstrdup(av[++n]);
-                }
-                if (strchr(modes[1], 'k')) {
-                    realloc(modes, (sizeof(modes) +sizeof(char *)));
-                    modes[mod_num++] = sstrdup(av[++n]);
-                }                                                                                                    
-                break;
-            }
-             
-            case '%':        /* bans */
-            {                
-                char *pv, *p = NULL, *ban;
-                /* Run over all bans */
-                for (pv = av[n] +1; (ban = strtoken(&p, pv, " ")); pv = NULL)
-                {                       
-                    ax[0] = sstrdup(av[0]);
-                    ax[1] = sstrdup("+b");
-                    ax[2] = sstrdup(ban);
-                    /* Como no sabemos quien ha baneado, ponemos que
-                     * ha sido ChanServ :)
-                     */                
-                    do_cmode(s_ChanServ, 3, ax);
-/*                    free(ax);*/
-                }
-                break;                /* Done bans part */
-            }                     
-
-            default:                  /* nicks */
-            {                        
-                char *pv, *p = NULL, *nick, *ptr;
-                /* Default mode: */
-                char *default_mode = NULL;
-                /* Run over all nicks */
-                for (pv = av[n]; (nick = strtoken(&p, pv, ",")); pv = NULL)
-                {            
-                    if ((ptr = strchr(nick, ':')))        /* New default mode ? */
-                    {
-                        default_mode = NULL;
-                        *ptr = '\0';        /* Fix 'nick' */
-                        u = finduserP10(nick);
-
-                        /*Calculate new mode change: */
-                        while (*(++ptr)) {
-                            if (*ptr == 'o')
-                            {
-                                if (default_mode)
-                                    strcat(default_mode, "o");
-                                else
-                                    default_mode = sstrdup("o");
-                            }
-                            else if (*ptr == 'v')
-                            {
-                                if (default_mode)
-                                    strcat(default_mode, "v");
-                                else
-                                    default_mode = sstrdup("v");                                                                                                                                        
-                            }
-                            else
-                              break;                                                                                                                                       
-                        }
-                    }
-                    else 
-                        u = finduserP10(nick);                                                                                                                                                                                                                                                                                                           
-
-                    if (u) {
-                        if (debug)
-                            logeo("Canales: Usuario %s entra al canal %s", u->nick, av[0]);
-                        do_join(u->nick, 1, av);
-                        if (first && mod_num) {
-                            do_cmode(source, mod_num, modes);
-//                            free(modes);
-                        }                                                                                                            
-                        if (first)
-                            first = 0;
-                              
-                        if (default_mode) {                    
-                            if (stricmp(default_mode, "ov") == 0) {
-                                ax[0] = sstrdup(av[0]);
-                                ax[1] = sstrdup("o");
-                                ax[2] = sstrdup(u->numerico);
-                                do_cmode(s_ChanServ, 3, ax);
-                                ax[1] = sstrdup("v");
-                                do_cmode(s_ChanServ, 3, ax);
-                                free(ax);
-                            } else {
-                                ax[0] = sstrdup(av[0]);
-                                ax[1] = sstrdup(default_mode);
-                                ax[2] = sstrdup(u->numerico);                                                                                        
-                                /* Como no sabemos quien ha dado los modos,
-                                 * ponemos que ha sido ChanServ :)
-                                 */                                
-                                do_cmode(s_ChanServ, 3, ax);
-                                free(ax);                                
-                            }
-                        }    
-                    } else
-                        logeo("channel: No se encuentra user %s en canal %s", nick, av[0]);
-                }
-            }                         /* <-- Next parameter if any */    
-        }    /* Swith de la linea de burst */
-    }  /* Fin del for */
+	switch (*av[n]) {
+	  case '+':             /* Modos, con sus parametros */
+	    mav[0] = av[0];
+	    mav[1] = av[n];
+	    mac = 2;
+	    for (s = av[n]; *s; s++) {
+		if ((*s == 'k' || *s == 'l') && n+1 < ac && mac < 4)
+		    mav[mac++] = av[++n];
+	    }
+	    break;
+
+	  case '%':             /* Bans, separados por espacios */
+	    if (!c)
+		break;
+	    for (s = av[n]+1; *s; s = sig) {
+		sig = s + strcspn(s, " ");
+		if (*sig)
+		    *sig++ = 0;
+		if (*s)
+		    anade_ban(c, s);
+	    }
+	    break;
 
+	  default:              /* Miembros */
+	    for (num = av[n]; *num; num = sig) {
+		sig = num + strcspn(num, ",");
+		if (*sig)
+		    *sig++ = 0;
+		if ((s = strchr(num, ':')) != NULL) {
+                    *s++ = 0;
+		    op = strchr(s, 'o') != NULL;
+		    voz = strchr(s, 'v') != NULL;
+		}
+		if (!(user = finduserP10(num))) {
+		    logeo("channel: No se encuentra user %s en canal %s",
+			  num, av[0]);
+		    continue;
+		}
+		if (!c) {
+		    c = nuevo_canal(av[0]);
+		    c->creation_time = atol(av[1]);
+		    cb = aplaza_canal(c);
+		}
+		if (debug)
+		    logeo("Canales: Usuario %s entra al canal %s",
+			  user->nick, av[0]);
+		anade_miembro(c, cb, user, op, voz);
+	    }
+	}
+    }
+
+    /* Los modos al final, cuando el canal ya existe */
+    if (c && mac)
+	do_cmode(source, mac, mav);
 }
 #endif /* IRC_UNDERNET_P10 */
                         
@@ -837,12 +1114,7 @@ void do_cmode(const char *source, int ac, char **av)
 		break;
 	    }
 	    if (add) {
-		if (chan->bancount >= chan->bansize) {
-		    chan->bansize += 8;
-		    chan->bans = srealloc(chan->bans,
-					sizeof(char *) * chan->bansize);
-		}
-		chan->bans[chan->bancount++] = sstrdup(*av++);
+		anade_ban(chan, *av++);
 	    } else {
 		char **s = chan->bans;
 		int i = 0;
@@ -873,7 +1145,7 @@ void do_cmode(const char *source, int ac, char **av)
 		if (u)
 		    break;
 #if defined(IRC_UNDERNET_P10)
-                user = finduserP10(sstrdup(nick));
+                user = finduserP10(nick);
 #else
 		user = finduser(nick);
 #endif 		
@@ -884,7 +1156,9 @@ void do_cmode(const char *source, int ac, char **av)
 		}
 		if (debug)
 		    logeo("debug: Setting +o on %s for %s", chan->name, user->nick);
-		if (!check_valid_op(user, chan->name, !!strchr(source, '.')))
+		/* Si ha entrado en el burst, se mira al acabar */
+		if (!(chan->burst && miembro_burst(chan->burst, user))
+			&& !check_valid_op(user, chan->name, !!strchr(source, '.')))
 		    break;
 		u = smalloc(sizeof(*u));
 		u->next = chan->chanops;
@@ -936,8 +1210,9 @@ void do_cmode(const char *source, int ac, char **av)
 		if (debug)
 		    logeo("debug: Setting +v on %s for %s", chan->name, user->nick);
  
-                if (!check_valid_voice(user, chan->name, !!strchr(source, '.')))
-                    break;
+		if (!(chan->burst && miembro_burst(chan->burst, user))
+			&& !check_valid_voice(user, chan->name, !!strchr(source, '.')))
+		    break;
              
 		u = smalloc(sizeof(*u));
 		u->next = chan->voices;
@@ -966,6 +1241,9 @@ void do_cmode(const char *source, int ac, char **av)
 
     } /* while (*s) */
 
+    /* Los canales de un burst se revisan al acabar (fin_burst()) */
+    if (chan->burst)
+	return;
     /* Check modes against ChanServ mode lock */
     check_modes(chan->name);
 }
@@ -10,9 +10,6 @@
 
 #include "services.h"
 #include "pseudo.h"
-#if defined(SOPORTE_JOOMLA15)
-#include <mysql.h>
-#endif
 /*************************************************************************/
 #define canales 6000
 #define MAXPARAMS	8
@@ -86,6 +83,10 @@ static void alpha_insert_chan(ChannelInfo *ci);
 static ChannelInfo *makechan(const char *chan);
 static int delchan(ChannelInfo *ci);
 static void reset_levels(ChannelInfo *ci);
+static void add_chanref(NickInfo *ni, ChannelInfo *ci);
+static void del_chanref(NickInfo *ni, ChannelInfo *ci);
+static void link_chanrefs(ChannelInfo *ci);
+static void unlink_chanrefs(ChannelInfo *ci);
 static int is_founder(User *user, ChannelInfo *ci);
 static int is_successor(User *user, ChannelInfo *ci);
 static int is_identified(User *user, ChannelInfo *ci);
@@ -497,11 +498,7 @@ void get_chanserv_stats(long *nrec, long *memuse)
                 mem += strlen(ci->forbidreason)+1;                                                                                                                    
 	    if (ci->levels)
 		mem += sizeof(*ci->levels) * CA_SIZE;
-	    mem += ci->memos.memocount * sizeof(Memo);
-	    for (j = 0; j < ci->memos.memocount; j++) {
-		if (ci->memos.memos[j].text)
-		    mem += strlen(ci->memos.memos[j].text)+1;
-	    }
+	    mem += memo_mem(&ci->memos);
 	}
     }
     *nrec = count;
@@ -824,6 +821,7 @@ static void load_old_cs_dbase(dbFILE *f, int ver)
 	    }
 
 	    ci->memos.memomax = MSMaxMemos;
+	    link_chanrefs(ci);
 
 	    *last = ci;
 	    last = &ci->next;
@@ -865,7 +863,7 @@ void load_cs_dbase(void)
 	    while ((c = getc_db(f)) != 0) {
 		if (c != 1)
 		    fatal("Formato invalido en %s", ChanDBName);
-		ci = smalloc(sizeof(ChannelInfo));
+		ci = scalloc(1, sizeof(ChannelInfo));
 		*last = ci;
 		last = &ci->next;
 		ci->prev = prev;
@@ -1028,11 +1026,13 @@ void load_cs_dbase(void)
 			SAFE(read_buffer(memos->sender, f));
 			SAFE(read_string(&memos->text, f));
 		    }
+		    memo_importa(&ci->memos, ci->name);
 		}
 
 		SAFE(read_string(&ci->entry_message, f));
 
 		ci->c = NULL;
+		link_chanrefs(ci);
 		
 	    } /* while (getc_db(f) != 0) */
 
@@ -1095,7 +1095,6 @@ void save_cs_dbase(void)
     dbFILE *f;
     int i, j;
     ChannelInfo *ci;
-    Memo *memos;
     static time_t lastwarn = 0;
 
     if (!(f = open_db(s_ChanServ, ChanDBName, "w")))
@@ -1172,16 +1171,9 @@ void save_cs_dbase(void)
 	    SAFE(write_int32(ci->mlock_limit, f));
 	    SAFE(write_string(ci->mlock_key, f));
 
-	    SAFE(write_int16(ci->memos.memocount, f));
+	    /* Los memos van en MemoDB (memodb.c) */
+	    SAFE(write_int16(0, f));
 	    SAFE(write_int16(ci->memos.memomax, f));
-	    memos = ci->memos.memos;
-	    for (j = 0; j < ci->memos.memocount; j++, memos++) {
-		SAFE(write_int32(memos->number, f));
-		SAFE(write_int16(memos->flags, f));
-		SAFE(write_int32(memos->time, f));
-		SAFE(write_buffer(memos->sender, f));
-		SAFE(write_string(memos->text, f));
-	    }
 
 	    SAFE(write_string(ci->entry_message, f));
 
@@ -1206,11 +1198,11 @@ void check_modes(const char *chan)
 
     Channel *c = findchan(chan);
     ChannelInfo *ci;
-    char newmodes[32], *newkey = NULL;
+    char newmodes[32], *newkey = NULL, limite[16];
     int32 newlimit = 0;
     char *end = newmodes; /* *destino;*/
     int modes;
-    int set_limit = 0, set_key = 0;
+    int set_limit = 0;
    /* User *u;*/
 
     if (!c || c->bouncy_modes)
@@ -1352,14 +1344,9 @@ void check_modes(const char *chan)
 	*end++ = 'k';
 	newkey = ci->mlock_key;
 	c->key = sstrdup(newkey);
-	set_key = 1;
     } else if (c->key && ci->mlock_key && strcmp(c->key, ci->mlock_key) != 0) {
 	char *av[3];
-#if defined(IRC_UNDERNET_P10)
-        send_cmd(MODE_SENDER(s_ChanServ), "M %s -k %s", c->name, c->key);
-#else
-	send_cmd(MODE_SENDER(s_ChanServ), "MODE %s -k %s", c->name, c->key);
-#endif
+	modo_canal(MODE_SENDER(s_ChanServ), c->name, "-k", c->key);
 	av[0] = sstrdup(c->name);
 	av[1] = sstrdup("-k");
 	av[2] = sstrdup(c->key);
@@ -1371,7 +1358,6 @@ void check_modes(const char *chan)
 	*end++ = 'k';
 	newkey = ci->mlock_key;
 	c->key = sstrdup(newkey);
-	set_key = 1;
     }
 
     if (end[-1] == '+')
@@ -1450,7 +1436,6 @@ void check_modes(const char *chan)
 	newkey = sstrdup(c->key);
 	free(c->key);
 	c->key = NULL;
-	set_key = 1;
     }
     if (c->limit && (ci->mlock_off & CMODE_L)) {
 	*end++ = 'l';
@@ -1527,19 +1512,14 @@ void check_modes(const char *chan)
     if (end == newmodes)
 	return;
     *end = 0;
+    /* Los parametros van en el orden de las letras: +l antes que +k */
     if (set_limit) {
-	if (set_key)
-	    send_cmd(MODE_SENDER(s_ChanServ), "MODE %s %s %d :%s", c->name,
-				newmodes, newlimit, newkey ? newkey : "");
-	else
-	    send_cmd(MODE_SENDER(s_ChanServ), "MODE %s %s %d", c->name,
-				newmodes, newlimit);
-    } else if (set_key) {
-	send_cmd(MODE_SENDER(s_ChanServ), "MODE %s %s :%s", c->name,
-				newmodes, newkey ? newkey : "");
+	snprintf(limite, sizeof(limite), "%d", newlimit);
+	modo_canal(MODE_SENDER(s_ChanServ), c->name, newmodes, limite,
+				newkey ? newkey : "");
     } else {
-	send_cmd(MODE_SENDER(s_ChanServ), "MODE %s %s", c->name, newmodes);
-	/* mirar fuente P10 */
+	modo_canal(MODE_SENDER(s_ChanServ), c->name, newmodes,
+				newkey ? newkey : "");
     }
 
     if (newkey && !c->key)
@@ -1569,17 +1549,17 @@ int check_valid_op(User *user, const char *chan, int serverop)
     if (ci->flags & CI_VERBOTEN) {
 	/* check_kick() will get them out; we needn't explain. */
 #if defined(IRC_UNDERNET_P10)
-        send_cmd(MODE_SENDER(s_ChanServ), "M %s -o %s", chan, user->numerico);
+        modo_canal(MODE_SENDER(s_ChanServ), chan, "-o", user->numerico);
 #else
-	send_cmd(MODE_SENDER(s_ChanServ), "MODE %s -o %s", chan, user->nick);
+	modo_canal(MODE_SENDER(s_ChanServ), chan, "-o", user->nick);
 #endif
 	return 0;
     }
     if (ci->flags & CI_SUSPEND) {
 #if defined(IRC_UNDERNET_P10)
-        send_cmd(MODE_SENDER(s_ChanServ), "M %s -o %s", chan, user->numerico);
+        modo_canal(MODE_SENDER(s_ChanServ), chan, "-o", user->numerico);
 #else
-        send_cmd(MODE_SENDER(s_ChanServ), "MODE %s -o %s", chan, user->nick);    
+        modo_canal(MODE_SENDER(s_ChanServ), chan, "-o", user->nick);    
 #endif
         return 0;
     }                        
@@ -1589,9 +1569,9 @@ int check_valid_op(User *user, const char *chan, int serverop)
 	notice_lang(s_ChanServ, user, CHAN_IS_REGISTERED, s_ChanServ);
 */	
 #if defined(IRC_UNDERNET_P10)
-        send_cmd(MODE_SENDER(s_ChanServ), "M %s -o %s", chan, user->numerico);
+        modo_canal(MODE_SENDER(s_ChanServ), chan, "-o", user->numerico);
 #else
-        send_cmd(MODE_SENDER(s_ChanServ), "MODE %s -o %s", chan, user->nick);
+        modo_canal(MODE_SENDER(s_ChanServ), chan, "-o", user->nick);
 #endif
 	return 0;
     }
@@ -1602,9 +1582,9 @@ int check_valid_op(User *user, const char *chan, int serverop)
 	notice(s_ChanServ, user->nick, CHAN_NOT_ALLOWED_OP, chan);
 #endif
 #if defined(IRC_UNDERNET_P10)
-        send_cmd(MODE_SENDER(s_ChanServ), "M %s -o %s", chan, user->numerico);
+        modo_canal(MODE_SENDER(s_ChanServ), chan, "-o", user->numerico);
 #else
-        send_cmd(MODE_SENDER(s_ChanServ), "MODE %s -o %s", chan, user->nick);
+        modo_canal(MODE_SENDER(s_ChanServ), chan, "-o", user->nick);
 #endif
 	return 0;
     }
@@ -1631,9 +1611,9 @@ int check_valid_voice(User *user, const char *chan, int serverop)
     if (ci->flags & CI_VERBOTEN) {
        /* check_kick() will get them out; we needn't explain. */   
 #if defined(IRC_UNDERNET_P10)
-        send_cmd(MODE_SENDER(s_ChanServ), "M %s -v %s", chan, user->numerico);
+        modo_canal(MODE_SENDER(s_ChanServ), chan, "-v", user->numerico);
 #else
-        send_cmd(MODE_SENDER(s_ChanServ), "MODE %s -v %s", chan, user->nick);
+        modo_canal(MODE_SENDER(s_ChanServ), chan, "-v", user->nick);
 #endif
         return 0;
     }
@@ -1641,9 +1621,9 @@ int check_valid_voice(User *user, const char *chan, int serverop)
     if (ci->flags & CI_SUSPEND) {
 /*send_cmd(s_ChanServ, "PRIVMSG #opers :DEBUG canal %s esta suspend, veamos a ver ke pasa", ci->name);*/
 #if defined(IRC_UNDERNET_P10)
-        send_cmd(MODE_SENDER(s_ChanServ), "M %s -v %s", chan, user->numerico);
+        modo_canal(MODE_SENDER(s_ChanServ), chan, "-v", user->numerico);
 #else
-        send_cmd(MODE_SENDER(s_ChanServ), "MODE %s -v %s", chan, user->nick);
+        modo_canal(MODE_SENDER(s_ChanServ), chan, "-v", user->nick);
 #endif
         return 0;
     }
@@ -1654,9 +1634,9 @@ int check_valid_voice(User *user, const char *chan, int serverop)
         notice_lang(s_ChanServ, user, CHAN_IS_REGISTERED, s_ChanServ);
      */
 #if defined(IRC_UNDERNET_P10)
-        send_cmd(MODE_SENDER(s_ChanServ), "M %s -v %s", chan, user->numerico);
+        modo_canal(MODE_SENDER(s_ChanServ), chan, "-v", user->numerico);
 #else
-        send_cmd(MODE_SENDER(s_ChanServ), "MODE %s -v %s", chan, user->nick);
+        modo_canal(MODE_SENDER(s_ChanServ), chan, "-v", user->nick);
 #endif
         return 0;
     }
@@ -1668,9 +1648,9 @@ int check_valid_voice(User *user, const char *chan, int serverop)
         notice_lang(s_ChanServ, user->nick, CHAN_NOT_ALLOWED_VOICE, chan);
 #endif
 #if defined(IRC_UNDERNET_P10)
-        send_cmd(MODE_SENDER(s_ChanServ), "M %s -v %s", chan, user->numerico);
+        modo_canal(MODE_SENDER(s_ChanServ), chan, "-v", user->numerico);
 #else
-        send_cmd(MODE_SENDER(s_ChanServ), "MODE %s -v %s", chan, user->nick);
+        modo_canal(MODE_SENDER(s_ChanServ), chan, "-v", user->nick);
 #endif
         return 0;
     }
@@ -1737,9 +1717,9 @@ int check_should_op(User *user, const char *chan)
 
     if (check_access(user, ci, CA_AUTOOP)) {
 #if defined(IRC_UNDERNET_P10)
-        send_cmd(MODE_SENDER(s_ChanServ), "M %s +o %s", chan, user->numerico);
+        modo_canal(MODE_SENDER(s_ChanServ), chan, "+o", user->numerico);
 #else
-        send_cmd(MODE_SENDER(s_ChanServ), "MODE %s +o %s", chan, user->nick);
+        modo_canal(MODE_SENDER(s_ChanServ), chan, "+o", user->nick);
 #endif  
 	ci->last_used = time(NULL);
 	return 1;
@@ -1776,10 +1756,10 @@ int check_should_voice(User *user, const char *chan)
 
     if (check_access(user, ci, CA_AUTOVOICE)) {
 #if defined(IRC_UNDERNET_P10)
-        send_cmd(MODE_SENDER(s_ChanServ), "M %s +v %s", chan, user->numerico);
+        modo_canal(MODE_SENDER(s_ChanServ), chan, "+v", user->numerico);
 
 #else
-        send_cmd(MODE_SENDER(s_ChanServ), "MODE %s +v %s", chan, user->nick);
+        modo_canal(MODE_SENDER(s_ChanServ), chan, "+v", user->nick);
 #endif
 	return 1;
     }
@@ -1910,7 +1890,7 @@ kick:
     strcpy(av[0], chan);
     av[1] = sstrdup("+b");
     av[2] = mask;
-    send_cmd(s_ChanServ, "MODE %s +b %s  %lu", chan, av[2], time(NULL));
+    modo_canal(s_ChanServ, chan, "+b", av[2]);
 	
     do_cmode(s_ChanServ, 3, av);
     free(av[0]);
@@ -2046,7 +2026,6 @@ void expire_chans()
                  char subject[BUFSIZE];
                  ci->flags  &= ~CI_MAIL_REC;
                   /*ni->env_mail |= MAIL_REC ;*/
-              if (fork()==0) {
 				 buf = smalloc(sizeof(char *) * 1024);
                sprintf(buf,"\n   Hola  NiCK: %s\n"
 				"Le recordamos que a su canal %s le queda  menos de 3 dias para expirar.\n"
@@ -2063,8 +2042,7 @@ void expire_chans()
        
                snprintf(subject, sizeof(subject), "Recordatorio del Canal '%s'", ci->name);   
                       enviar_correo(ni->email, subject, buf);
-             exit(0);
-         }
+             free(buf);
 }
       else if (now - ci->last_used >=  (CSExpire)
 			&& !(ci->flags & (CI_VERBOTEN | CI_NO_EXPIRE | CI_SUSPEND)) && !(ci->flags & ( CI_MAIL_REC))) {
@@ -2079,20 +2057,8 @@ void expire_chans()
 
                 canalopers(s_ChanServ, "Expirando el canal 12%s", ci->name);
 #if defined(SOPORTE_JOOMLA15)
-MYSQL *conn;
-char modifica[BUFSIZE];
- conn = mysql_init(NULL);
-
-   /* Connect to database */
-   if (!mysql_real_connect(conn, MYSQL_SERVER,
-         MYSQL_USER,MYSQL_PASS,MYSQL_DATABASE, 0, NULL, 0)) {
-       canaladmins(s_CregServ,"%s\n", mysql_error(conn));
-         return;
-   }
-snprintf(modifica, sizeof(modifica), "delete from jos_chans where canal ='%s';",ci->name);
-if (mysql_query(conn,modifica)) 
-canaladmins(s_CregServ, "%s\n", mysql_error(conn));
- mysql_close(conn);
+		sql_query(s_CregServ, ci->name, NULL, NULL,
+			"delete from jos_chans where canal=%s", ci->name);
 #endif
 		do_write_bdd(ci->name, 7, "", ci->name);
 		delchan(ci);
@@ -2103,111 +2069,100 @@ canaladmins(s_CregServ, "%s\n", mysql_error(conn));
     }
 }
 
-void cs_remove_nick(const NickInfo *ni)
+/* Quita un nick de todos los canales donde figure.  Solo se recorren los
+ * canales de su indice inverso (ni->chanrefs), no toda la base de datos. */
+
+void cs_remove_nick(NickInfo *ni)
 {
-    int i, j;
-    ChannelInfo *ci, *next;
+    int j;
+    ChannelInfo *ci;
+    ChanRef *ref, *next;
     ChanAccess *ca;
     AutoKick *akick;
     CregInfo *cr;
 
-    for (i = 0; i < canales; i++) {
-	for (ci = chanlists[i]; ci; ci = next) {
-	    next = ci->next;
-	    if (ci->founder == ni) {
-		if (ci->successor) {
-		    NickInfo *ni2 = ci->successor;
-		    if (ni2->channelcount >= ni2->channelmax) {
-		        canalopers(s_ChanServ, "Borrando canal 12%s, sucesor 12%s"
-		         " tiene demasiados canales", ci->name, ni2->nick);
-			logeo("%s: Successor (%s) of %s owns too many channels, "
-			    "deleting channel",
-			    s_ChanServ, ni2->nick, ci->name);
-				do_write_bdd(ci->name, 7, "",ci->name);
-        			part_shadow_chan(ci->name);
-
-			    if ((cr = cr_findcreg(ci->name))) {
-                            cr->estado = 0;
-                            cr->estado |= CR_EXPIRADO;
-                            cr->time_motivo = time(NULL);
-                        }
-	#if defined(SOPORTE_JOOMLA15)
-MYSQL *conn;
-char modifica[BUFSIZE];
- conn = mysql_init(NULL);
-
-   /* Connect to database */
-   if (!mysql_real_connect(conn, MYSQL_SERVER,
-         MYSQL_USER,MYSQL_PASS,MYSQL_DATABASE, 0, NULL, 0)) {
-       canaladmins(s_CregServ,"%s\n", mysql_error(conn));
-         return;
-   }
-snprintf(modifica, sizeof(modifica), "delete from jos_chans where canal ='%s';",ci->name);
-if (mysql_query(conn,modifica)) 
-canaladmins(s_CregServ, "%s\n", mysql_error(conn));
- mysql_close(conn);
-#endif
-			delchan(ci);
-			 borra_akick(ci->name);
-		    } else {
-		        canalopers(s_ChanServ, "Transferiendo el founder de 12%s,"
-		        " del nick borrado  12%s al sucesor 12%s", ci->name, ni->nick, ni2->nick);
-			logeo("%s: Transferring foundership of %s from deleted "
-			    "nick %s to successor %s",
-			    s_ChanServ, ci->name, ni->nick, ni2->nick);
-			ci->founder = ni2;
-			ci->successor = NULL;
-			if (ni2->channelcount+1 > ni2->channelcount)
-			    ni2->channelcount++;
+    for (ref = ni->chanrefs; ref; ref = next) {
+	next = ref->next;
+	ci = ref->ci;
+	if (ci->founder == ni) {
+	    if (ci->successor && ci->successor != ni) {
+		NickInfo *ni2 = ci->successor;
+		if (ni2->channelcount >= ni2->channelmax) {
+		    canalopers(s_ChanServ, "Borrando canal 12%s, sucesor 12%s"
+		     " tiene demasiados canales", ci->name, ni2->nick);
+		    logeo("%s: Successor (%s) of %s owns too many channels, "
+			"deleting channel",
+			s_ChanServ, ni2->nick, ci->name);
+			    do_write_bdd(ci->name, 7, "",ci->name);
+			    part_shadow_chan(ci->name);
+
+			if ((cr = cr_findcreg(ci->name))) {
+			cr->estado = 0;
+			cr->estado |= CR_EXPIRADO;
+			cr->time_motivo = time(NULL);
 		    }
-		} else {
-                    canalopers(s_ChanServ, "Borrando canal 12%s propiedad del"
-                     " nick 12%s", ci->name, ni->nick);
-		    logeo("%s: Deleting channel %s owned by deleted nick %s",
-				s_ChanServ, ci->name, ni->nick);
-		do_write_bdd(ci->name, 7, "",ci->name);
-        	part_shadow_chan(ci->name);
-		if ((cr = cr_findcreg(ci->name))) {
-                            cr->estado = 0;
-                            cr->estado |= CR_EXPIRADO;
-                            cr->time_motivo = time(NULL);
-                        }
-		#if defined(SOPORTE_JOOMLA15)
-MYSQL *conn;
-char modifica[BUFSIZE];
- conn = mysql_init(NULL);
-
-   /* Connect to database */
-   if (!mysql_real_connect(conn, MYSQL_SERVER,
-         MYSQL_USER,MYSQL_PASS,MYSQL_DATABASE, 0, NULL, 0)) {
-       canaladmins(s_CregServ,"%s\n", mysql_error(conn));
-         return;
-   }
-snprintf(modifica, sizeof(modifica), "delete from jos_chans where canal ='%s';",ci->name);
-if (mysql_query(conn,modifica)) 
-canaladmins(s_CregServ, "%s\n", mysql_error(conn));
- mysql_close(conn);
+    #if defined(SOPORTE_JOOMLA15)
+		    sql_query(s_CregServ, ci->name, NULL, NULL,
+			    "delete from jos_chans where canal=%s", ci->name);
 #endif
 		    delchan(ci);
 		     borra_akick(ci->name);
+		    continue;
+		} else {
+		    canalopers(s_ChanServ, "Transferiendo el founder de 12%s,"
+		    " del nick borrado  12%s al sucesor 12%s", ci->name, ni->nick, ni2->nick);
+		    logeo("%s: Transferring foundership of %s from deleted "
+			"nick %s to successor %s",
+			s_ChanServ, ci->name, ni->nick, ni2->nick);
+		    del_chanref(ni, ci);
+		    del_chanref(ni2, ci);
+		    ci->founder = ni2;
+		    ci->successor = NULL;
+		    add_chanref(ni2, ci);
+		    if (ni2->channelcount+1 > ni2->channelcount)
+			ni2->channelcount++;
 		}
+	    } else {
+		canalopers(s_ChanServ, "Borrando canal 12%s propiedad del"
+		 " nick 12%s", ci->name, ni->nick);
+		logeo("%s: Deleting channel %s owned by deleted nick %s",
+			    s_ChanServ, ci->name, ni->nick);
+	    do_write_bdd(ci->name, 7, "",ci->name);
+	    part_shadow_chan(ci->name);
+	    if ((cr = cr_findcreg(ci->name))) {
+			cr->estado = 0;
+			cr->estado |= CR_EXPIRADO;
+			cr->time_motivo = time(NULL);
+		    }
+	    #if defined(SOPORTE_JOOMLA15)
+		    sql_query(s_CregServ, ci->name, NULL, NULL,
+			    "delete from jos_chans where canal=%s", ci->name);
+#endif
+		delchan(ci);
+		 borra_akick(ci->name);
 		continue;
 	    }
-	    for (ca = ci->access, j = ci->accesscount; j > 0; ca++, j--) {
-		if (ca->in_use && ca->ni == ni) {
-		    ca->in_use = 0;
-		    ca->ni = NULL;
-		}
+	}
+	if (ci->successor == ni) {
+	    del_chanref(ni, ci);
+	    ci->successor = NULL;
+	}
+	for (ca = ci->access, j = ci->accesscount; j > 0; ca++, j--) {
+	    if (ca->in_use && ca->ni == ni) {
+		del_chanref(ni, ci);
+		ca->in_use = 0;
+		ca->ni = NULL;
 	    }
-	    for (akick = ci->akick, j = ci->akickcount; j > 0; akick++, j--) {
-		if (akick->is_nick && akick->u.ni == ni) {
-		    akick->in_use = akick->is_nick = 0;
-		    akick->u.ni = NULL;
-		    if (akick->reason) {
-			free(akick->reason);
-			akick->reason = NULL;
+	}
+	for (akick = ci->akick, j = ci->akickcount; j > 0; akick++, j--) {
+	    if (akick->in_use && akick->is_nick && akick->u.ni == ni) {
+		del_chanref(ni, ci);
+		akick->in_use = akick->is_nick = 0;
+		akick->u.ni = NULL;
+		if (akick->reason) {
+		    free(akick->reason);
+		    akick->reason = NULL;
 		
-		    }
 		}
 	    }
 	}
@@ -2232,6 +2187,31 @@ ChannelInfo *cs_findchan(const char *chan)
 
 /*************************************************************************/
 
+/* Iterate over all ChannelInfo structures, like firstchan()/nextchan(). */
+
+static ChannelInfo *ci_actual;
+static int ci_indice;
+
+ChannelInfo *firstchaninfo(void)
+{
+    ci_indice = 0;
+    ci_actual = NULL;
+    while (ci_indice < canales && ci_actual == NULL)
+	ci_actual = chanlists[ci_indice++];
+    return ci_actual;
+}
+
+ChannelInfo *nextchaninfo(void)
+{
+    if (ci_actual)
+	ci_actual = ci_actual->next;
+    while (ci_indice < canales && ci_actual == NULL)
+	ci_actual = chanlists[ci_indice++];
+    return ci_actual;
+}
+
+/*************************************************************************/
+
 /* Return 1 if the user's access level on the given channel falls into the
  * given category, 0 otherwise.  Note that this may seem slightly confusing
  * in some cases: for example, check_access(..., CA_NOJOIN) returns true if
@@ -2269,7 +2249,8 @@ void registros(User *u, NickInfo *ni)
 {
 
     ChannelInfo *ci;
-    int i, y, z;
+    ChanRef *ref;
+    int y, z;
     int cfounder = 0;
     int csucesor = 0;
     int cregistros = 0;
@@ -2278,9 +2259,9 @@ void registros(User *u, NickInfo *ni)
     ChanAccess *access;
     AutoKick *akick;
         
-        
-    for (i = 0; i < canales; i++) {
-        for (ci = chanlists[i]; ci; ci = ci->next) {
+/* Solo los canales del indice inverso del nick */
+    for (ref = ni->chanrefs; ref; ref = ref->next) {
+           ci = ref->ci;
                   
 /* Buscar Founders de canales */
            if (ni == ci->founder) {
@@ -2295,7 +2276,7 @@ void registros(User *u, NickInfo *ni)
 
 /* Buscar registros en canales */
            for (access = ci->access, y = 0; y < ci->accesscount; access++, y++) {
-              if (access->ni->nick == ni->nick) {
+              if (access->in_use && access->ni == ni) {
                     privmsg(s_NickServ, u->nick, "   %-20s LEVEL 12%d" ,
                     ci->name, access->level);
                     cregistros++;
@@ -2304,13 +2285,12 @@ void registros(User *u, NickInfo *ni)
                                                                                                              
 /* Buscar Akicks en canales */
            for (akick = ci->akick, z = 0; z < ci->akickcount; akick++, z++) {
-              if (akick->u.ni->nick == ni->nick) {
+              if (akick->in_use && akick->is_nick && akick->u.ni == ni) {
                      privmsg(s_NickServ, u->nick, "   %-20s 12AKICK", ci->name);
                      cakicks++;
               }
                                
            }
-        }
     }
     if (cfounder)
         privmsg(s_NickServ, u->nick, "   Total de FOUNDERS: 12%d", cfounder);
@@ -2452,6 +2432,7 @@ static int delchan(ChannelInfo *ci)
     int i;
     NickInfo *ni = ci->founder;
 
+    unlink_chanrefs(ci);
     if (ci->c)
 	ci->c->ci = NULL;
     if (ci->next)
@@ -2490,13 +2471,7 @@ static int delchan(ChannelInfo *ci)
     
     if (ci->levels)
 	free(ci->levels);
-    if (ci->memos.memos) {
-	for (i = 0; i < ci->memos.memocount; i++) {
-	    if (ci->memos.memos[i].text)
-		free(ci->memos.memos[i].text);
-	}
-	free(ci->memos.memos);
-    }
+    memo_borra_todos(&ci->memos);
     free(ci);
     while (ni) {
 	if (ni->channelcount > 0)
@@ -2508,6 +2483,95 @@ static int delchan(ChannelInfo *ci)
 
 /*************************************************************************/
 
+/* Indice inverso nick -> canales.  Cada vez que un nick entra como founder,
+ * sucesor, acceso o akick de un canal se llama a add_chanref(), y al salir
+ * a del_chanref(); la entrada desaparece cuando ya no queda ninguna
+ * referencia del nick en ese canal. */
+
+static ChanRef *find_chanref(NickInfo *ni, ChannelInfo *ci)
+{
+    ChanRef *ref;
+
+    for (ref = ni->chanrefs; ref; ref = ref->next) {
+	if (ref->ci == ci)
+	    return ref;
+    }
+    return NULL;
+}
+
+static void add_chanref(NickInfo *ni, ChannelInfo *ci)
+{
+    ChanRef *ref;
+
+    if (!ni)
+	return;
+    if ((ref = find_chanref(ni, ci))) {
+	ref->refs++;
+	return;
+    }
+    ref = smalloc(sizeof(ChanRef));
+    ref->ci = ci;
+    ref->refs = 1;
+    ref->prev = NULL;
+    ref->next = ni->chanrefs;
+    if (ni->chanrefs)
+	ni->chanrefs->prev = ref;
+    ni->chanrefs = ref;
+}
+
+static void del_chanref(NickInfo *ni, ChannelInfo *ci)
+{
+    ChanRef *ref;
+
+    if (!ni || !(ref = find_chanref(ni, ci)))
+	return;
+    if (--ref->refs > 0)
+	return;
+    if (ref->next)
+	ref->next->prev = ref->prev;
+    if (ref->prev)
+	ref->prev->next = ref->next;
+    else
+	ni->chanrefs = ref->next;
+    free(ref);
+}
+
+/* Da de alta (o de baja) en el indice todas las referencias de un canal. */
+
+static void link_chanrefs(ChannelInfo *ci)
+{
+    int i;
+
+    add_chanref(ci->founder, ci);
+    add_chanref(ci->successor, ci);
+    for (i = 0; i < ci->accesscount; i++) {
+	if (ci->access[i].in_use)
+	    add_chanref(ci->access[i].ni, ci);
+    }
+    for (i = 0; i < ci->akickcount; i++) {
+	if (ci->akick[i].in_use && ci->akick[i].is_nick)
+	    add_chanref(ci->akick[i].u.ni, ci);
+    }
+}
+
+static void unlink_chanrefs(ChannelInfo *ci)
+{
+    int i;
+
+    del_chanref(ci->founder, ci);
+    del_chanref(ci->successor, ci);
+    for (i = 0; i < ci->accesscount; i++) {
+	if (ci->access[i].in_use)
+	    del_chanref(ci->access[i].ni, ci);
+    }
+    for (i = 0; i < ci->akickcount; i++) {
+	if (ci->akick[i].in_use && ci->akick[i].is_nick)
+	    del_chanref(ci->akick[i].u.ni, ci);
+    }
+}
+
+/*************************************************************************/
+
 /* Reset channel access level values to their default state. */
 
 static void reset_levels(ChannelInfo *ci)
@@ -2751,6 +2815,7 @@ notice(s_ChanServ, u->nick, "Comando deshabilitado, use 2/msg 12%s ,para los
 	ci->memos.memomax = MSMaxMemos;
 	ci->last_used = ci->time_registered;
 	ci->founder = u->real_ni;
+	add_chanref(ci->founder, ci);
 #if defined(USE_ENCRYPTION)
 	if (strlen(pass) > PASSMAX)
 	    notice_lang(s_ChanServ, u, PASSWORD_TRUNCATED, PASSMAX);
@@ -2827,6 +2892,7 @@ int registra_con_creg(User *u, NickInfo *ni, const char *chan, const char *pass,
 	ci->memos.memomax = MSMaxMemos;
 	ci->last_used = ci->time_registered;
 	ci->founder = ni;
+	add_chanref(ni, ci);
 	strscpy(ci->founderpass, pass, PASSMAX);
 	ci->desc = sstrdup(desc);
 	if (c->topic) {
@@ -3294,10 +3360,12 @@ static void do_set_founder(User *u, ChannelInfo *ci, char *param)
     }
     if (ni0->channelcount > 0)  /* Let's be paranoid... */
 	ni0->channelcount--;
+    del_chanref(ni0, ci);
     ni0 = getlink(ni0);
     if (ni0 != ci->founder && ni0->channelcount > 0)
 	ni0->channelcount--;
     ci->founder = ni;
+    add_chanref(ni, ci);
     if (ni->channelcount+1 > ni->channelcount)
 	ni->channelcount++;
     ni = getlink(ni);
@@ -3329,7 +3397,9 @@ static void do_set_successor(User *u, ChannelInfo *ci, char *param)
     } else {
 	ni = NULL;
     }
+    del_chanref(ci->successor, ci);
     ci->successor = ni;
+    add_chanref(ni, ci);
     if (ni)
 	notice_lang(s_ChanServ, u, CHAN_SUCCESSOR_CHANGED, ci->name, param);
     else
@@ -4042,7 +4112,8 @@ if (!is_services_root(u)) {
  * `perm' is incremented whenever a permission-denied error occurs
  */
 #if defined(CAPADO)
-static int access_del(User *u, ChanAccess *access, int *perm, int uacc)
+static int access_del(User *u, ChannelInfo *ci, ChanAccess *access, int *perm,
+		      int uacc)
 {
     if (!access->in_use)
 	return 0;
@@ -4050,6 +4121,7 @@ static int access_del(User *u, ChanAccess *access, int *perm, int uacc)
 	(*perm)++;
 	return 0;
     }
+    del_chanref(access->ni, ci);
     access->ni = NULL;
     access->in_use = 0;
     return 1;
@@ -4064,7 +4136,7 @@ static int access_del_callback(User *u, int num, va_list args)
     if (num < 1 || num > ci->accesscount)
 	return 0;
     *last = num;
-    return access_del(u, &ci->access[num-1], perm, uacc);
+    return access_del(u, ci, &ci->access[num-1], perm, uacc);
 }
 #endif
 
@@ -4135,8 +4207,13 @@ static void do_delaccess(User *u)
 		if (ci->access[i].ni == ni)
 		    break;
 	 }
+		if (i == ci->accesscount) {
+		    notice_lang(s_ChanServ, u, CHAN_MSG_DELACCESS_NEG, chan);
+		    return;
+		}
 
 		access = &ci->access[i];
+		del_chanref(ni, ci);
 		access->ni = NULL;
 		access->in_use = 0;
 		if (ci->flags & CI_OPNOTICE) {
@@ -4186,8 +4263,10 @@ static void do_delsuccessor(User *u)
                 notice(s_ChanServ, chan, "Baja de %s como SUCESOR del canal.",
                     u->nick);
                 }
-               if (ci->successor)
+               if (ci->successor) {
+                     del_chanref(ci->successor, ci);
                      ci->successor = NULL;
+               }
 		/*notice_lang(s_ChanServ, u, CHAN_MSG_DELACCESS_SUCCESS, chan);*/
 	}
 
@@ -4302,6 +4381,7 @@ static void do_access(User *u)
 	access = &ci->access[i];
 	access->ni = ni;
 	access->in_use = 1;
+	add_chanref(ni, ci);
 	access->level = level;
 	notice_lang(s_ChanServ, u, CHAN_ACCESS_ADDED,
 		access->ni->nick, chan, level);
@@ -4371,6 +4451,7 @@ static void do_access(User *u)
                     notice(s_ChanServ, chan, "%s borra de %s a %s.",
                     u->nick, chan, access->ni->nick);
                 }                                                                   
+		del_chanref(access->ni, ci);
 		access->ni = NULL;
 		access->in_use = 0;
 	    }
@@ -4416,6 +4497,10 @@ static void do_access(User *u)
             return;
         }
         
+        for (i = 0; i < ci->accesscount; i++) {
+            if (ci->access[i].in_use)
+                del_chanref(ci->access[i].ni, ci);
+        }
         free(ci->access);
         ci->access = NULL;
         ci->accesscount = 0;
@@ -4434,11 +4519,12 @@ static void do_access(User *u)
 
 /* `last' is set to the last index this routine was called with */
 
-static int akick_del(User *u, AutoKick *akick)
+static int akick_del(User *u, ChannelInfo *ci, AutoKick *akick)
 {
     if (!akick->in_use)
 	return 0;
     if (akick->is_nick) {
+	del_chanref(akick->u.ni, ci);
 	akick->u.ni = NULL;
     } else {
 	free(akick->u.mask);
@@ -4459,7 +4545,7 @@ static int akick_del_callback(User *u, int num, va_list args)
     if (num < 1 || num > ci->akickcount)
 	return 0;
     *last = num;
-    return akick_del(u, &ci->akick[num-1]);
+    return akick_del(u, ci, &ci->akick[num-1]);
 }
 #endif
 
@@ -4587,6 +4673,7 @@ static void do_akick(User *u)
 	if (ni) {
 	    akick->is_nick = 1;
 	    akick->u.ni = ni;
+	    add_chanref(ni, ci);
 	} else {
 	    akick->is_nick = 0;
 	    akick->u.mask = mask;
@@ -4671,7 +4758,7 @@ NickInfo *ni = findnick(mask);
 		return;
 	    }
 	    notice_lang(s_ChanServ, u, CHAN_AKICK_DELETED, mask, chan);
-	    akick_del(u, akick);
+	    akick_del(u, ci, akick);
 /*	}*/
 
     } else if (stricmp(cmd, "LIST") == 0) {
@@ -4860,91 +4947,18 @@ decido hacerlo por franjas al fijar el modo autom�tico +l*/
 /* tramo1,tramo2,tramo3 son los l�mites de las 3 franjas*/
 /* incr1,incr2,incr3 son los incrementos de cada una de ellas*/
 
-void canal_autolimit(Channel *ki,ChannelInfo *ci,const char *chan)
-{
-int numero;
- time_t expires;
-ci = cs_findchan(chan);
-if ((cs_findchan(chan)) && (ci->flags & CI_AUTOLIMIT)) {
-	 expires = time(NULL);
- if (ki->erab > 0 && ki->erab < tramo1)  {
-	 	numero = ki->erab + incr1;
- #if defined(IRC_UNDERNET_P10)
-del_alimit(ki->name);
-add_alimit( ki->name,numero,expires);
- /*send_cmd(s_ChanServ, "M %s +l %i", ki->name,numero);*/
- #else
-del_alimit(ki->name);
-add_alimit( ki->name,numero,expires);
-/*send_cmd(MODE_SENDER(s_ChanServ), "MODE %s +l %i", ki->name, numero);*/
-#endif
-} else if (ki->erab >=tramo1 && ki->erab < tramo2)  {
-	 	numero = ki->erab + incr2;
- #if defined(IRC_UNDERNET_P10)
- send_cmd(s_ChanServ, "M %s +l %i", ki->name,numero);
- #else
-del_alimit(ki->name);
-add_alimit( ki->name,numero,expires);
-/*send_cmd(MODE_SENDER(s_ChanServ), "MODE %s +l %i", ki->name, numero);*/
-#endif
-} else if (ki->erab >= tramo3)  {
-	 	numero = ki->erab + incr3;
- #if defined(IRC_UNDERNET_P10)
- send_cmd(s_ChanServ, "M %s +l %i", ki->name,numero);
- #else
-del_alimit(ki->name);
-add_alimit( ki->name,numero,expires);
-/*send_cmd(MODE_SENDER(s_ChanServ), "MODE %s +l %i", ki->name, numero);*/
-#endif
-}
-}
-}
-
-
-/*tengo en cuenta las franjas anteriores para ir desactivando los l�mites de usuarios
-*permitidos en el canal,uso otro m�todo porque me baso en el debug de salidas
-*no eleg� hacerlo con las entradas*/
+/* Se llama en cada entrada y salida (chan_adduser/chan_deluser, que ya
+ * llevan la cuenta de usuarios en c->erab).  Solo hay una actualizacion
+ * pendiente por canal: si ya la hay no se toca su plazo, asi que en un
+ * canal con mucho movimiento el +l se pone como mucho cada
+ * AutolimitRetardo segundos, con los usuarios que haya en ese momento
+ * (ver alimit_expira() en autolimit.c). */
 
-void sale_autolimit(char *s) 
+void canal_autolimit(Channel *c)
 {
-int numero,suma;
-suma=0;
-numero=0;
- Channel *c = s ? findchan(s) : NULL;
-    struct c_userlist *u;
-ChannelInfo *ci;
-ci = cs_findchan(s);
-if ((cs_findchan(s)) && (ci->flags & CI_AUTOLIMIT)) {
-
-for (u = c->users; u; u = u->next)
-     numero=numero+1;
-
-if (numero < tramo1)  {
-	 	suma = numero + incr1 -1;
- #if defined(IRC_UNDERNET_P10)
- send_cmd(s_ChanServ, "M %s +l %i", ci->name,suma);
- #else
-del_alimit(ci->name);
-send_cmd(MODE_SENDER(s_ChanServ), "MODE %s +l %i", ci->name, suma);
-#endif
-} else if (numero < tramo3)  {
-	 	suma = numero + incr2 -1;
- #if defined(IRC_UNDERNET_P10)
- send_cmd(s_ChanServ, "M %s +l %i", ci->name,suma);
- #else
-del_alimit(ci->name);
-send_cmd(MODE_SENDER(s_ChanServ), "MODE %s +l %i", ci->name, suma);
-#endif
-} else if (numero >= tramo3)  {
-	 	suma = numero + incr3 -1;
- #if defined(IRC_UNDERNET_P10)
- send_cmd(s_ChanServ, "M %s +l %i", ci->name,suma);
- #else
-del_alimit(ci->name);
-send_cmd(MODE_SENDER(s_ChanServ), "MODE %s +l %i", ci->name, suma);
-#endif
-}
-}
+    if (!c->ci || !(c->ci->flags & CI_AUTOLIMIT))
+	return;
+    programa_alimit(c->name, AutolimitRetardo);
 }
 
 /*************************************************************************/
@@ -5357,7 +5371,7 @@ char *destino;
 while ((destino = strtok(NULL, " ")) && (i++ < MAXPARAMS)) {
 	char *av[3];
  	if (is_on_chan(destino,chan) && !is_voiced(destino,chan)) {
-	    send_cmd(MODE_SENDER(s_ChanServ), "MODE %s +v %s", chan, destino);
+	    modo_canal(MODE_SENDER(s_ChanServ), chan, "+v", destino);
             av[0] = chan;
 	    av[1] = sstrdup("+v");
 	    av[2] = destino;
@@ -5408,7 +5422,7 @@ char *destino;
 while ((destino = strtok(NULL, " ")) && (i++ < MAXPARAMS)) {
 	char *av[3];
  	if (is_on_chan(destino,chan) && is_voiced(destino,chan)) {
-	   send_cmd(MODE_SENDER(s_ChanServ), "MODE %s -v %s", chan, destino);
+	   modo_canal(MODE_SENDER(s_ChanServ), chan, "-v", destino);
             av[0] = chan;
 	    av[1] = sstrdup("-v");
 	    av[2] = destino;
@@ -5460,7 +5474,7 @@ char *destino;
 while ((destino = strtok(NULL, " ")) && (i++ < MAXPARAMS)) {
 	char *av[3];
  	if (is_on_chan(destino,chan) && !is_chanop(destino,chan)) {
-            send_cmd(MODE_SENDER(s_ChanServ), "MODE %s +o %s", chan, destino);
+            modo_canal(MODE_SENDER(s_ChanServ), chan, "+o", destino);
             av[0] = chan;
 	    av[1] = sstrdup("+o");
 	    av[2] = destino;
@@ -5515,7 +5529,7 @@ char *destino;
 	          continue;
             }
 	    
-	    send_cmd(MODE_SENDER(s_ChanServ), "MODE %s -o %s", chan, destino);
+	    modo_canal(MODE_SENDER(s_ChanServ), chan, "-o", destino);
             av[0] = chan;
 	    av[1] = sstrdup("-o");
 	    av[2] = destino;
@@ -5698,8 +5712,7 @@ static void do_unban(User *u)
 	av[1] = sstrdup("-b");
 	for (i = 0; i < count; i++) {
 	    if (match_usermask(bans[i], u)) {
-		send_cmd(MODE_SENDER(s_ChanServ), "MODE %s -b %s",
-			chan, bans[i]);
+		modo_canal(MODE_SENDER(s_ChanServ), chan, "-b", bans[i]);
 		av[2] = sstrdup(bans[i]);
 		do_cmode(s_ChanServ, 3, av);
 		desban = 1;
@@ -5750,8 +5763,7 @@ static void do_clear(User *u)
 	    av[0] = sstrdup(chan);
 	    av[1] = sstrdup("-b");
 	    av[2] = bans[i];
-	    send_cmd(MODE_SENDER(s_ChanServ), "MODE %s %s :%s",
-			av[0], av[1], av[2]);
+	    modo_canal(MODE_SENDER(s_ChanServ), chan, "-b", av[2]);
 	    do_cmode(s_ChanServ, 3, av);
 	    free(av[2]);
 	    free(av[1]);
@@ -5768,8 +5780,10 @@ static void do_clear(User *u)
 	    av[2] = sstrdup(c->key);
 	else
 	    av[2] = sstrdup("");
-	send_cmd(MODE_SENDER(s_ChanServ), "MODE %s %s :%s",
-			av[0], av[1], av[2]);
+	if (c->key)
+	    modo_canal(MODE_SENDER(s_ChanServ), chan, "-cmintpslk", c->key);
+	else
+	    modo_canal(MODE_SENDER(s_ChanServ), chan, "-cmintpsl");
 	do_cmode(s_ChanServ, 3, av);
 	free(av[2]);
 	free(av[1]);      	
@@ -5788,8 +5802,7 @@ static void do_clear(User *u)
 #else
 	    av[2] = sstrdup(cu->user->nick);
 #endif	    
-	    send_cmd(MODE_SENDER(s_ChanServ), "MODE %s %s :%s",
-			av[0], av[1], av[2]);
+	    modo_canal(MODE_SENDER(s_ChanServ), chan, av[1], av[2]);
 	    do_cmode(s_ChanServ, 3, av);
 	    free(av[2]);
 	    free(av[1]);
@@ -5809,8 +5822,7 @@ static void do_clear(User *u)
 #else	    
 	    av[2] = sstrdup(cu->user->nick);
 #endif	    
-	    send_cmd(MODE_SENDER(s_ChanServ), "MODE %s %s :%s",
-			av[0], av[1], av[2]);
+	    modo_canal(MODE_SENDER(s_ChanServ), chan, av[1], av[2]);
 	    do_cmode(s_ChanServ, 3, av);
 	    free(av[2]);
 	    free(av[1]);
@@ -5904,8 +5916,7 @@ static void do_reset(User *u)
                   av[0] = sstrdup(chan);
                   av[1] = sstrdup("-b");
                   av[2] = bans[i];
-                  send_cmd(MODE_SENDER(s_ChanServ), "MODE %s %s :%s",
-                          av[0], av[1], av[2]);
+                  modo_canal(MODE_SENDER(s_ChanServ), chan, "-b", av[2]);
                   do_cmode(s_ChanServ, 3, av);
                   free(av[2]);
                   free(av[1]);
@@ -5921,8 +5932,10 @@ static void do_reset(User *u)
             av[2] = sstrdup(c->key);
         else
         av[2] = sstrdup("");
-        send_cmd(MODE_SENDER(s_ChanServ), "MODE %s %s :%s",
-                av[0], av[1], av[2]);
+        if (c->key)
+            modo_canal(MODE_SENDER(s_ChanServ), chan, "-cmintpslkRAS", c->key);
+        else
+            modo_canal(MODE_SENDER(s_ChanServ), chan, "-cmintpslRAS");
         do_cmode(s_ChanServ, 3, av);
         free(av[2]);
         free(av[1]);
@@ -5940,8 +5953,7 @@ static void do_reset(User *u)
 #else             
              av[2] = sstrdup(cu->user->nick);
 #endif             
-             send_cmd(MODE_SENDER(s_ChanServ), "MODE %s %s :%s",
-                      av[0], av[1], av[2]);
+             modo_canal(MODE_SENDER(s_ChanServ), chan, av[1], av[2]);
              do_cmode(s_ChanServ, 3, av);
              free(av[2]);
              free(av[1]);
@@ -5959,8 +5971,7 @@ static void do_reset(User *u)
 #else
              av[2] = sstrdup(cu->user->nick);
 #endif             
-             send_cmd(MODE_SENDER(s_ChanServ), "MODE %s %s :%s",
-                       av[0], av[1], av[2]);
+             modo_canal(MODE_SENDER(s_ChanServ), chan, av[1], av[2]);
              do_cmode(s_ChanServ, 3, av);
              free(av[2]);
              free(av[1]);
@@ -30,16 +30,26 @@ Command *lookup_cmd(Command *list, const char *cmd)
 /*************************************************************************/
 
 /* Run the routine for the given command, if it exists and the user has
- * privilege to do so; if not, print an appropriate error message.
+ * privilege to do so; if not, print an appropriate error message.  The
+ * time the routine takes goes to the latency histograms, and the routine
+ * is marked as running for the profiler (latencia.c).
  */
 
 void run_cmd(const char *service, User *u, Command *list, const char *cmd)
 {
     Command *c = lookup_cmd(list, cmd);
+    Latencia *l;
+    int64 inicio;
+
     if (c && c->routine) {
-	if ((c->has_priv == NULL) || c->has_priv(u))
+	if ((c->has_priv == NULL) || c->has_priv(u)) {
+	    l = latencia_busca(service, c->name);
+	    perfil_entra(l);
+	    inicio = reloj_us();
 	    c->routine(u);
-	else
+	    latencia_suma(l, reloj_us() - inicio);
+	    perfil_sale();
+	} else
 	    notice_lang(service, u, ACCESS_DENIED);
     } else {
     	notice_lang(service, u, UNKNOWN_COMMAND_HELP, cmd, service);
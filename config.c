@@ -27,6 +27,8 @@ char *MYSQL_SERVER;
 char *MYSQL_USER;
 char *MYSQL_PASS;
 char *MYSQL_DATABASE;
+int   MYSQL_CONEXIONES;
+int   MYSQL_COLA;
 
 char *ServerDesc;
 char *ServerHUB;
@@ -44,6 +46,7 @@ int  ServerNumerico;
 #endif
 int tramo1,tramo2,tramo3;
 int incr1,incr2,incr3;
+int AutolimitRetardo;
 
 char *s_NickServ;
 char *s_ChanServ;
@@ -147,6 +150,22 @@ char *AutochanakickDBName;
 char *AutolimitDBName;
 char *NickSuspendsDBName;
 char *NewsDBName;
+char *MemoDBName;
+char *BddDBName;
+int   BddSincroniza;
+int   BddCompactaFilas;
+int   BddAuditoria;
+int   BddAuditoriaRepara;
+char *LatenciaFichero;
+int   LineaLenta;
+int   PerfilIntervalo;
+int   AvisosPorSegundo = -1;
+int   AvisosCola;
+int   AvisosEntra, AvisosEntraPeriodo;
+int   AvisosNick, AvisosNickPeriodo;
+int   AvisosCanal, AvisosCanalPeriodo;
+int   AvisosSale, AvisosSalePeriodo;
+int   ModosPorLinea;
 char *GeoIPDBName;
 
 int   SpamUsers;
@@ -159,6 +178,13 @@ int   UpdateTimeout;
 int   ExpireTimeout;
 int   ReadTimeout;
 int   WarningTimeout;
+int   FloodCoste;
+int   FloodIgnora;
+int   FloodKill;
+int   FloodHost;
+static char *FloodPesosTexto;
+FloodPeso *FloodPesos;
+int   FloodPesosNumber;
 int   TimeoutCheck;
 
 #if defined(REG_NICK_MAIL)
@@ -230,6 +256,9 @@ char **Puertos;
 int   LogMaxUsers;
 int   AutokillExpiry;
 int   GlinePscannerExpiry;
+int   ScannerConexiones;
+int   ScannerTimeout;
+int   ScannerCache;
 int   AutoregistraExpiry;
 
 int   KillClonesAkillExpire;
@@ -283,6 +312,9 @@ Directive directives[] = {
     { "NickSuspendsDB",       { { PARAM_STRING, 0, &NickSuspendsDBName } } },
     { "AutokillExpiry",   { { PARAM_TIME, 0, &AutokillExpiry } } },
     { "GlinePscannerExpiry",   { { PARAM_TIME, 0, &GlinePscannerExpiry } } },
+    { "ScannerConexiones",     { { PARAM_POSINT, 0, &ScannerConexiones } } },
+    { "ScannerTimeout",        { { PARAM_TIME, 0, &ScannerTimeout } } },
+    { "ScannerCache",          { { PARAM_TIME, 0, &ScannerCache } } },
     { "AutoregistraExpiry",   { { PARAM_TIME, 0, &AutoregistraExpiry } } },
     { "BadPassLimit",     { { PARAM_POSINT, 0, &BadPassLimit } } },
     { "BadPassTimeout",   { { PARAM_TIME, 0, &BadPassTimeout } } },
@@ -327,6 +359,26 @@ Directive directives[] = {
     { "MSNotifyAll",      { { PARAM_SET, 0, &MSNotifyAll } } },
     { "MSSendDelay",      { { PARAM_TIME, 0, &MSSendDelay } } },
     { "NewsDB",           { { PARAM_STRING, 0, &NewsDBName } } },
+    { "MemoDB",           { { PARAM_STRING, 0, &MemoDBName } } },
+    { "BddDB",            { { PARAM_STRING, 0, &BddDBName } } },
+    { "BddSincroniza",    { { PARAM_TIME, 0, &BddSincroniza } } },
+    { "BddCompactaFilas", { { PARAM_POSINT, 0, &BddCompactaFilas } } },
+    { "BddAuditoria",     { { PARAM_TIME, 0, &BddAuditoria } } },
+    { "BddAuditoriaRepara",{ { PARAM_SET, 0, &BddAuditoriaRepara } } },
+    { "LatenciaFichero",  { { PARAM_STRING, 0, &LatenciaFichero } } },
+    { "LineaLenta",       { { PARAM_POSINT, 0, &LineaLenta } } },
+    { "PerfilIntervalo",  { { PARAM_POSINT, 0, &PerfilIntervalo } } },
+    { "AvisosPorSegundo", { { PARAM_INT, 0, &AvisosPorSegundo } } },
+    { "AvisosCola",       { { PARAM_POSINT, 0, &AvisosCola } } },
+    { "AvisosEntra",      { { PARAM_INT, 0, &AvisosEntra },
+                            { PARAM_TIME, 0, &AvisosEntraPeriodo } } },
+    { "AvisosNick",       { { PARAM_INT, 0, &AvisosNick },
+                            { PARAM_TIME, 0, &AvisosNickPeriodo } } },
+    { "AvisosCanal",      { { PARAM_INT, 0, &AvisosCanal },
+                            { PARAM_TIME, 0, &AvisosCanalPeriodo } } },
+    { "AvisosSale",       { { PARAM_INT, 0, &AvisosSale },
+                            { PARAM_TIME, 0, &AvisosSalePeriodo } } },
+    { "ModosPorLinea",    { { PARAM_POSINT, 0, &ModosPorLinea } } },
     { "NewsServName",     { { PARAM_STRING, 0, &s_NewsServ },
                             { PARAM_STRING, 0, &desc_NewsServ } } },
     { "NickservDB",       { { PARAM_STRING, 0, &NickDBName } } },
@@ -357,6 +409,7 @@ Directive directives[] = {
      { "incr1",   { { PARAM_INT, 0, &incr1 } } },
       { "incr2",   { { PARAM_INT, 0, &incr2 } } },
       { "incr3",   { { PARAM_INT, 0, &incr3 } } },
+    { "AutolimitRetardo", { { PARAM_TIME, 0, &AutolimitRetardo } } },
 
     { "NoSplitRecovery",  { { PARAM_SET, 0, &NoSplitRecovery } } },
     { "NSAccessMax",      { { PARAM_POSINT, 0, &NSAccessMax } } },
@@ -420,6 +473,8 @@ Directive directives[] = {
     { "MYSQL_USER",       { { PARAM_STRING, 0, &MYSQL_USER } } },
     { "MYSQL_PASS",       { { PARAM_STRING, 0, &MYSQL_PASS } } },
     { "MYSQL_DATABASE",       { { PARAM_STRING, 0, &MYSQL_DATABASE } } },
+    { "MYSQL_CONEXIONES",     { { PARAM_POSINT, 0, &MYSQL_CONEXIONES } } },
+    { "MYSQL_COLA",           { { PARAM_POSINT, 0, &MYSQL_COLA } } },
      { "SpamUsers",        { { PARAM_INT, 0, &SpamUsers } } },
     { "ServicesRoot",     { { PARAM_STRING, 0, &ServicesRoot } } },
     { "Puerto",           { { PARAM_STRING, 0, &Puerto } } },
@@ -463,6 +518,11 @@ Directive directives[] = {
     { "TimeoutCheck",     { { PARAM_TIME, 0, &TimeoutCheck } } },
     { "UpdateTimeout",    { { PARAM_TIME, 0, &UpdateTimeout } } },
     { "WarningTimeout",   { { PARAM_TIME, 0, &WarningTimeout } } },
+    { "FloodCoste",       { { PARAM_POSINT, 0, &FloodCoste } } },
+    { "FloodIgnora",      { { PARAM_TIME, 0, &FloodIgnora } } },
+    { "FloodKill",        { { PARAM_TIME, 0, &FloodKill } } },
+    { "FloodHost",        { { PARAM_POSINT, 0, &FloodHost } } },
+    { "FloodPesos",       { { PARAM_STRING, 0, &FloodPesosTexto } } },
 };
 
 /*************************************************************************/
@@ -674,7 +734,7 @@ int parse(char *buf, int linenum)
 int read_config()
 {
     FILE *config;
-    int linenum = 1, retval = 1;
+    int linenum = 1, retval = 1, i;
     char buf[1024], *s;
 
     config = fopen(SERVICES_CONF, "r");
@@ -841,6 +901,36 @@ s = strtok(Puerto, " ");
         retval = 0;
     }
 
+    /* FloodPesos "Servicio:COMANDO:peso ..."; en un rehash se tiran los
+     * de antes */
+    for (i = 0; i < FloodPesosNumber; i++) {
+	free(FloodPesos[i].servicio);
+	free(FloodPesos[i].comando);
+    }
+    free(FloodPesos);
+    FloodPesos = NULL;
+    FloodPesosNumber = 0;
+    if (FloodPesosTexto) {
+	char *c, *p;
+
+	for (s = strtok(FloodPesosTexto, " "); s; s = strtok(NULL, " ")) {
+	    if (!(c = strchr(s, ':')) || !(p = strchr(c+1, ':'))
+			|| !isdigit(p[1])) {
+		error(0, "Formato invalido en FloodPesos: %s", s);
+		retval = 0;
+		continue;
+	    }
+	    *c++ = 0;
+	    *p++ = 0;
+	    FloodPesosNumber++;
+	    FloodPesos = srealloc(FloodPesos,
+				sizeof(FloodPeso) * FloodPesosNumber);
+	    FloodPesos[FloodPesosNumber-1].servicio = sstrdup(s);
+	    FloodPesos[FloodPesosNumber-1].comando = sstrdup(c);
+	    FloodPesos[FloodPesosNumber-1].peso = atoi(p);
+	}
+    }
+
     if (temp_userhost) {
 	if (!(s = strchr(temp_userhost, '@'))) {
 	    error(0, "Falta `@' para ServiceUser");
@@ -896,6 +986,61 @@ if (temp_usereuskalirc) {
     }
 
 
+    if (!MYSQL_CONEXIONES)
+	MYSQL_CONEXIONES = 2;
+    if (!MYSQL_COLA)
+	MYSQL_COLA = 1024;
+    if (!ScannerConexiones)
+	ScannerConexiones = 64;
+    if (!ScannerTimeout)
+	ScannerTimeout = 10;
+    if (!ScannerCache)
+	ScannerCache = 3600;
+    if (!AutolimitRetardo)
+	AutolimitRetardo = 30;
+    if (!MemoDBName)
+	MemoDBName = sstrdup("memos.db");
+    if (!BddDBName)
+	BddDBName = sstrdup("bdd.db");
+    if (!BddSincroniza)
+	BddSincroniza = 5;
+    if (!BddCompactaFilas)
+	BddCompactaFilas = 20;
+    if (!LatenciaFichero)
+	LatenciaFichero = sstrdup("latencia.txt");
+    if (!LineaLenta)
+	LineaLenta = 100;
+    if (AvisosPorSegundo < 0)
+	AvisosPorSegundo = 20;
+    if (!AvisosCola)
+	AvisosCola = 1000;
+    if (!AvisosEntraPeriodo) {
+	AvisosEntra = 10;
+	AvisosEntraPeriodo = 5;
+    }
+    if (!AvisosNickPeriodo) {
+	AvisosNick = 10;
+	AvisosNickPeriodo = 5;
+    }
+    if (!AvisosCanalPeriodo) {
+	AvisosCanal = 10;
+	AvisosCanalPeriodo = 5;
+    }
+    if (!AvisosSalePeriodo) {
+	AvisosSale = 10;
+	AvisosSalePeriodo = 5;
+    }
+    if (!ModosPorLinea)
+	ModosPorLinea = 6;
+    if (!FloodCoste)
+	FloodCoste = 1000000;
+    if (!FloodIgnora)
+	FloodIgnora = 5;
+    if (!FloodKill)
+	FloodKill = 10;
+    if (!FloodHost)
+	FloodHost = 3;
+
     if (s_ShadowServ) 
         CHECK(desc_ShadowServ);
      
@@ -1,127 +1,560 @@
-/* prueba */
-/* #ifdef A_TOMAR_POR_EL_CULO */
+/* Cola de correo de los Services.
+ *
+ * Antes cada correo se mandaba desde un fork() de todo el proceso, que
+ * hacia popen() del sendmail o abria una conexion SMTP bloqueante.  En
+ * una ola de expiraciones eso eran cientos de copias de los Services.
+ * Ahora enviar_correo() solo deja el mensaje en el directorio CORREO_DIR y
+ * avisa por una tuberia a un unico proceso de envio, que se arranca en
+ * init() antes de cargar las bases de datos (asi ocupa poco).  Ese proceso
+ * reparte todo lo pendiente por una sola conexion SMTP (con PIPELINING si
+ * el servidor lo anuncia) o por el sendmail, reintenta los fallos con
+ * esperas cada vez mayores y deja su estado en CORREO_ESTADO para el
+ * comando CORREO de OperServ.
+ */
+
 #include "services.h"
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/file.h>
 
+#define CORREO_DIR	"correo"		/* Mensajes pendientes */
+#define CORREO_TMP	"correo/tmp"		/* Mensajes a medio escribir */
+#define CORREO_FALLIDOS	"correo/fallidos"	/* Mensajes abandonados */
+#define CORREO_ESTADO	"correo/estado"
+#define CORREO_BLOQUEO	"correo/bloqueo"
 
-#if defined(SMTP)
-int check_smtp(char buf[BUFSIZE]);
-#endif
+#define CORREO_REINTENTOS	10	/* Intentos antes de abandonar */
+#define CORREO_ESPERA		60	/* Primera espera tras un fallo */
+#define CORREO_ESPERA_MAX	3600	/* Espera maxima entre intentos */
+#define CORREO_LOTE		100	/* Mensajes por conexion */
+
+static int correo_aviso = -1;	/* Tuberia hacia el proceso de envio */
+static pid_t correo_pid = 0;
+static int correo_num = 0;
 
+/* Reintentos pendientes (solo en el proceso de envio) */
+typedef struct reintento_ Reintento;
+struct reintento_ {
+    Reintento *next;
+    char *fichero;
+    int intentos;
+    time_t proximo;
+};
+static Reintento *reintentos = NULL;
+
+/* Estadisticas (solo en el proceso de envio; se publican en CORREO_ESTADO) */
+static long c_enviados = 0, c_reintentos = 0, c_fallidos = 0;
+static int c_encola = 0;
+static time_t c_ultimo = 0;
+static char c_error[BUFSIZE] = "";
+
+/* Resultado de un intento de envio */
+#define ENVIO_OK	0
+#define ENVIO_REINTENTA	1	/* Fallo temporal (4xx, conexion...) */
+#define ENVIO_FALLA	2	/* Fallo permanente (5xx) */
+
+/*************************************************************************/
+/*************************** Proceso principal ***************************/
+/*************************************************************************/
 
 /**************** enviar_correo *******************************
-Esta funcion envia un correo con el email configurado del source k sea
-con el subject y body pertinentes al destino indicado.
+Esta funcion encola un correo con el email configurado del source k sea
+con el subject y body pertinentes al destino indicado.  El envio real lo
+hace el proceso de la cola; devuelve 0 si no se ha podido encolar.
 *************************************************************/
 int enviar_correo(const char * destino, const char *subject, const char *body)
 {
+    char nombre[64], tmp[PATH_MAX], fin[PATH_MAX];
+    FILE *f;
+
+    if (!destino || !*destino)
+	return 0;
+    snprintf(nombre, sizeof(nombre), "%010ld.%d.%d", (long)time(NULL),
+	     (int)getpid(), correo_num++);
+    snprintf(tmp, sizeof(tmp), "%s/%s", CORREO_TMP, nombre);
+    snprintf(fin, sizeof(fin), "%s/%s", CORREO_DIR, nombre);
+    if (!(f = fopen(tmp, "w"))) {
+	logeo("Correo: no puedo crear %s: %s", tmp, strerror(errno));
+	return 0;
+    }
+    fprintf(f, "%s\n%s\n%s", destino, subject, body);
+    if (fclose(f) != 0 || rename(tmp, fin) < 0) {
+	logeo("Correo: no puedo encolar %s: %s", fin, strerror(errno));
+	remove(tmp);
+	return 0;
+    }
+    if (correo_aviso >= 0)
+	write(correo_aviso, "", 1);
+    return 1;
+}
+
+/*************************************************************************/
+
+/* Lee el estado que publica el proceso de envio.  Devuelve el pid del
+ * proceso si sigue vivo, o 0 si no. */
+
+int correo_estado(long *enviados, long *reintenta, long *fallidos,
+		  int *encola, time_t *ultimo, char *error, int errlen)
+{
+    FILE *f;
+    long ult = 0;
+
+    *enviados = *reintenta = *fallidos = 0;
+    *encola = 0;
+    *ultimo = 0;
+    *error = 0;
+    if ((f = fopen(CORREO_ESTADO, "r"))) {
+	if (fscanf(f, "%ld %ld %ld %d %ld\n", enviados, reintenta, fallidos,
+		   encola, &ult) == 5 && fgets(error, errlen, f))
+	    strtok(error, "\n");
+	fclose(f);
+    }
+    *ultimo = ult;
+    if (correo_pid > 0 && kill(correo_pid, 0) == 0)
+	return correo_pid;
+    return 0;
+}
+
+/*************************************************************************/
+/**************************** Proceso de envio ***************************/
+/*************************************************************************/
+
+static void correo_publica_estado(void)
+{
+    FILE *f;
+
+    if (!(f = fopen(CORREO_ESTADO ".tmp", "w")))
+	return;
+    fprintf(f, "%ld %ld %ld %d %ld\n%s\n", c_enviados, c_reintentos,
+	    c_fallidos, c_encola, (long)c_ultimo, c_error);
+    fclose(f);
+    rename(CORREO_ESTADO ".tmp", CORREO_ESTADO);
+}
+
+static void correo_error(const char *fmt, ...)
+{
+    va_list args;
+
+    va_start(args, fmt);
+    vsnprintf(c_error, sizeof(c_error), fmt, args);
+    va_end(args);
+    logeo("Correo: %s", c_error);
+}
+
+static Reintento *busca_reintento(const char *fichero)
+{
+    Reintento *r;
+
+    for (r = reintentos; r; r = r->next) {
+	if (strcmp(r->fichero, fichero) == 0)
+	    return r;
+    }
+    return NULL;
+}
+
+static void quita_reintento(const char *fichero)
+{
+    Reintento *r, **pr;
+
+    for (pr = &reintentos; (r = *pr); pr = &r->next) {
+	if (strcmp(r->fichero, fichero) == 0) {
+	    *pr = r->next;
+	    free(r->fichero);
+	    free(r);
+	    return;
+	}
+    }
+}
+
+/* Apunta el resultado de un envio: borra el mensaje, lo programa para
+ * mas tarde o lo aparta a CORREO_FALLIDOS. */
+
+static void correo_resultado(const char *fichero, int res)
+{
+    char ruta[PATH_MAX], dest[PATH_MAX];
+    Reintento *r;
+    int espera, i;
+
+    snprintf(ruta, sizeof(ruta), "%s/%s", CORREO_DIR, fichero);
+    if (res == ENVIO_OK) {
+	remove(ruta);
+	quita_reintento(fichero);
+	c_enviados++;
+	c_ultimo = time(NULL);
+	return;
+    }
+    if (!(r = busca_reintento(fichero))) {
+	r = scalloc(1, sizeof(Reintento));
+	r->fichero = sstrdup(fichero);
+	r->next = reintentos;
+	reintentos = r;
+    }
+    if (res == ENVIO_FALLA || ++r->intentos >= CORREO_REINTENTOS) {
+	snprintf(dest, sizeof(dest), "%s/%s", CORREO_FALLIDOS, fichero);
+	rename(ruta, dest);
+	quita_reintento(fichero);
+	c_fallidos++;
+	return;
+    }
+    espera = CORREO_ESPERA;
+    for (i = 1; i < r->intentos && espera < CORREO_ESPERA_MAX; i++)
+	espera *= 2;
+    if (espera > CORREO_ESPERA_MAX)
+	espera = CORREO_ESPERA_MAX;
+    r->proximo = time(NULL) + espera;
+    c_reintentos++;
+}
+
+/* Lee un mensaje de la cola: destino, asunto y cuerpo. */
+
+static char *correo_lee(const char *fichero, char **destino, char **subject)
+{
+    char ruta[PATH_MAX], *buf, *s;
+    struct stat st;
+    FILE *f;
+
+    snprintf(ruta, sizeof(ruta), "%s/%s", CORREO_DIR, fichero);
+    if (!(f = fopen(ruta, "r")))
+	return NULL;
+    if (fstat(fileno(f), &st) < 0) {
+	fclose(f);
+	return NULL;
+    }
+    buf = smalloc(st.st_size + 1);
+    buf[fread(buf, 1, st.st_size, f)] = 0;
+    fclose(f);
+    *destino = buf;
+    if (!(s = strchr(buf, '\n'))) {
+	free(buf);
+	return NULL;
+    }
+    *s++ = 0;
+    *subject = s;
+    if ((s = strchr(s, '\n')))
+	*s++ = 0;
+    else
+	s = *subject + strlen(*subject);
+    return s;
+}
+
 #if defined(SMTP)
-	int sockmail;
-	struct hostent *hp;
-	struct sockaddr_in their_addr;
-	char buf[1024];
-
-	if ((hp=gethostbyname(ServerSMTP)) == NULL)
-		return 0;
-	if ((sockmail=socket(AF_INET, SOCK_STREAM, 0)) == -1)
-		return 0;
-	their_addr.sin_family = AF_INET;
-	their_addr.sin_port = htons(PortSMTP);
-	their_addr.sin_addr = *((struct in_addr *)hp->h_addr);
-	bzero(&(their_addr.sin_zero),8);
-
-	if (connect(sockmail, (struct sockaddr *)&their_addr,sizeof(struct sockaddr)) == -1)
-		return 0;
-	sprintf(buf, "HELO localhost\n"
-			"MAIL FROM: %s\n"
-			"RCPT TO: %s\n"
-			"DATA\n"
-			"From: %s\n"
-			"To: %s\n"
-			"Subject: %s\n"
-			"%s\n"
-			".\n"
-			"QUIT\n", SendFrom, destino, SendFrom, destino, subject, body);
-	if (send(sockmail, buf, sizeof(buf),0) == -1)
-		return 0;
-
-	close(sockmail);
-	return 1;
-	
-}    
-#endif
+
+/* Lee una respuesta (posiblemente de varias lineas) del servidor SMTP y
+ * devuelve su codigo, o -1 si se ha cerrado la conexion.  Si pipelining no
+ * es NULL, se pone a 1 cuando el servidor anuncia PIPELINING. */
+
+static int smtp_respuesta(FILE *in, char *buf, int size, int *pipelining)
+{
+    do {
+	if (!fgets(buf, size, in))
+	    return -1;
+	if (pipelining && strnicmp(buf+4, "PIPELINING", 10) == 0)
+	    *pipelining = 1;
+    } while (strlen(buf) > 3 && buf[3] == '-');
+    strtok(buf, "\r\n");
+    return atoi(buf);
+}
+
+/* Clasifica un codigo SMTP inesperado */
+
+static int smtp_fallo(int codigo, const char *buf)
+{
+    correo_error("SMTP %s", codigo < 0 ? "conexion cerrada" : buf);
+    return (codigo >= 500 && codigo < 600) ? ENVIO_FALLA : ENVIO_REINTENTA;
+}
+
+/* Manda un mensaje por una conexion SMTP ya abierta.  Con PIPELINING se
+ * mandan MAIL, RCPT y DATA de una vez y luego se leen las tres
+ * respuestas. */
+
+static int smtp_envia(FILE *in, FILE *out, int pipelining,
+		      const char *destino, const char *subject, const char *body)
+{
+    char buf[BUFSIZE], motivo[BUFSIZE];
+    const char *s;
+    int c1, c2, c3, bol;
+
+    if (pipelining) {
+	fprintf(out, "MAIL FROM:<%s>\r\nRCPT TO:<%s>\r\nDATA\r\n",
+		SendFrom, destino);
+	fflush(out);
+	c1 = smtp_respuesta(in, buf, sizeof(buf), NULL);
+	strscpy(motivo, buf, sizeof(motivo));
+	c2 = smtp_respuesta(in, buf, sizeof(buf), NULL);
+	if (c1 == 250)
+	    strscpy(motivo, buf, sizeof(motivo));
+	c3 = smtp_respuesta(in, buf, sizeof(buf), NULL);
+	if (c1 != 250 || (c2 != 250 && c2 != 251)) {
+	    if (c3 == 354) {
+		/* DATA aceptado sin remitente o destinatario validos */
+		fprintf(out, ".\r\n");
+		fflush(out);
+		smtp_respuesta(in, buf, sizeof(buf), NULL);
+	    }
+	    fprintf(out, "RSET\r\n");
+	    fflush(out);
+	    smtp_respuesta(in, buf, sizeof(buf), NULL);
+	    return smtp_fallo(c1 != 250 ? c1 : c2, motivo);
+	}
+    } else {
+	fprintf(out, "MAIL FROM:<%s>\r\n", SendFrom);
+	fflush(out);
+	if ((c1 = smtp_respuesta(in, buf, sizeof(buf), NULL)) != 250)
+	    return smtp_fallo(c1, buf);
+	fprintf(out, "RCPT TO:<%s>\r\n", destino);
+	fflush(out);
+	if ((c2 = smtp_respuesta(in, buf, sizeof(buf), NULL)) != 250
+		&& c2 != 251) {
+	    strscpy(motivo, buf, sizeof(motivo));
+	    fprintf(out, "RSET\r\n");
+	    fflush(out);
+	    smtp_respuesta(in, buf, sizeof(buf), NULL);
+	    return smtp_fallo(c2, motivo);
+	}
+	fprintf(out, "DATA\r\n");
+	fflush(out);
+	c3 = smtp_respuesta(in, buf, sizeof(buf), NULL);
+    }
+    if (c3 != 354)
+	return smtp_fallo(c3, buf);
+
+    fprintf(out, "From: %s\r\nTo: %s\r\nSubject: %s\r\n\r\n",
+	    SendFrom, destino, subject);
+    /* Cuerpo con finales de linea CRLF y puntos duplicados al principio */
+    for (s = body, bol = 1; *s; s++) {
+	if (bol && *s == '.')
+	    fputc('.', out);
+	if (*s == '\n')
+	    fputc('\r', out);
+	if (*s != '\r')
+	    fputc(*s, out);
+	bol = (*s == '\n');
+    }
+    fprintf(out, "%s.\r\n", bol ? "" : "\r\n");
+    fflush(out);
+    if ((c3 = smtp_respuesta(in, buf, sizeof(buf), NULL)) != 250)
+	return smtp_fallo(c3, buf);
+    return ENVIO_OK;
+}
+
+#endif /* SMTP */
+
 #if defined(SENDMAIL)
+
+static int sendmail_envia(const char *destino, const char *subject,
+			  const char *body)
+{
     FILE *p;
     char sendmail[PATH_MAX];
-                                                                              
+    int res;
+
     snprintf(sendmail, sizeof(sendmail), SendMailPatch, destino);
-/*   snprintf(sendmail, sizeof(sendmail), "/usr/sbin/sendmail masakresoft@wanadoo.es");*/
-                                                                                           
     if (!(p = popen(sendmail, "w"))) {
-/*        privmsg(s_NickServ, u->nick, "mail jodido");*/
-        logeo("mail jodio");
-        return 0;
+	correo_error("no puedo ejecutar %s: %s", sendmail, strerror(errno));
+	return ENVIO_REINTENTA;
     }
-
     fprintf(p, "From: %s\n", SendFrom);
     fprintf(p, "To: %s\n", destino);
-    fprintf(p, "Subject: %s\n", subject);    
+    fprintf(p, "Subject: %s\n", subject);
     fprintf(p, "%s\n", body);
-
     fprintf(p, "\n.\n");
-         
-    pclose(p);    
-/*    log("Parece que funciona!! - %s - %s - %s", destino, subject, body);*/
-    return 1;    
-}    
-#endif
+    if ((res = pclose(p)) != 0) {
+	correo_error("%s ha devuelto %d", sendmail, res);
+	return ENVIO_REINTENTA;
+    }
+    return ENVIO_OK;
+}
+
+#endif /* SENDMAIL */
+
+static int correo_filtro(const struct dirent *d)
+{
+    return d->d_name[0] != '.' && isdigit(d->d_name[0]);
+}
+
+/* Reparte los mensajes pendientes.  Devuelve cuantos segundos se puede
+ * esperar hasta el siguiente reintento. */
 
+static int correo_reparte(void)
+{
+    struct dirent **lista;
+    Reintento *r;
+    char *destino, *subject, *body;
+    time_t ahora = time(NULL), proximo = ahora + CORREO_ESPERA_MAX;
+    int n, i, res, enviados = 0;
+#if defined(SMTP)
+    FILE *in = NULL, *out = NULL;
+    char buf[BUFSIZE];
+    int sock, codigo, pipelining = 0, caida = 0;
+#endif
 
+    if ((n = scandir(CORREO_DIR, &lista, correo_filtro, alphasort)) < 0) {
+	correo_error("no puedo leer %s: %s", CORREO_DIR, strerror(errno));
+	return CORREO_ESPERA;
+    }
+    c_encola = n;
+    for (i = 0; i < n; i++) {
+	const char *fichero = lista[i]->d_name;
 
+	if ((r = busca_reintento(fichero)) && r->proximo > ahora) {
+	    if (r->proximo < proximo)
+		proximo = r->proximo;
+	    continue;
+	}
+	if (enviados >= CORREO_LOTE) {
+	    proximo = ahora;
+	    continue;
+	}
+	if (!(body = correo_lee(fichero, &destino, &subject)))
+	    continue;
 #if defined(SMTP)
-int check_smtp(char buf[BUFSIZE])
-{
-/** Esta funcion recibe la contestacion k recibimos del smtp y nos
-devuelve si se ha producido un erro o no. Caso de ser asi, logea el
-error. ***/
-
-    char cod[5];
-    int codigo;
-        
-  /*log("SMTP = %s",buf);*/
-    strncpy(cod,buf,4);
-  /*log("strncpy....");*/
-    codigo = strlen(cod);
-    cod[codigo] = '\0';
-  /*log("asignado cod..");*/
-    if (cod) codigo = atoi(cod);
-    else codigo = 500;
-    
-  /*log("Codigo SMTP = %d",codigo);*/
-
-    switch(codigo) {
-        case 220:
-            return 1;
-            break;
-                 
-        case 221:
-            return 1;
-            break;    
-
-        case 250:
-            return 1;
-            break;
-                                
-        case 354:
-            return 1;
-            break;            
-            
-        default:
-            logeo("SMTP ERROR(%d) : %s",codigo,buf);
-            return 0;
-    }            
-    return 0;
-}
+	if (caida) {
+	    res = ENVIO_REINTENTA;
+	} else {
+	    if (!in) {
+		if ((sock = conn(ServerSMTP, PortSMTP, NULL, 0)) < 0) {
+		    correo_error("no puedo conectar a %s:%d: %s", ServerSMTP,
+				 PortSMTP, strerror(errno));
+		    caida = 1;
+		} else {
+		    in = fdopen(sock, "r");
+		    out = fdopen(dup(sock), "w");
+		    pipelining = 0;
+		    if ((codigo = smtp_respuesta(in, buf, sizeof(buf), NULL))
+			    != 220) {
+			smtp_fallo(codigo, buf);
+			caida = 1;
+		    } else {
+			fprintf(out, "EHLO %s\r\n", ServerName);
+			fflush(out);
+			if (smtp_respuesta(in, buf, sizeof(buf), &pipelining)
+				!= 250) {
+			    pipelining = 0;
+			    fprintf(out, "HELO %s\r\n", ServerName);
+			    fflush(out);
+			    if ((codigo = smtp_respuesta(in, buf, sizeof(buf),
+					NULL)) != 250) {
+				smtp_fallo(codigo, buf);
+				caida = 1;
+			    }
+			}
+		    }
+		}
+	    }
+	    if (caida) {
+		res = ENVIO_REINTENTA;
+	    } else {
+		res = smtp_envia(in, out, pipelining, destino, subject, body);
+		if (res != ENVIO_OK && (feof(in) || ferror(out)))
+		    caida = 1;
+	    }
+	}
+#elif defined(SENDMAIL)
+	res = sendmail_envia(destino, subject, body);
+#else
+	correo_error("compilados sin SMTP ni SENDMAIL");
+	res = ENVIO_FALLA;
 #endif
+	free(destino);
+	correo_resultado(fichero, res);
+	if (res == ENVIO_OK) {
+	    enviados++;
+	    c_encola--;
+	} else if (res == ENVIO_FALLA) {
+	    c_encola--;
+	} else if ((r = busca_reintento(fichero)) && r->proximo < proximo) {
+	    proximo = r->proximo;
+	}
+    }
+#if defined(SMTP)
+    if (in) {
+	if (!caida) {
+	    fprintf(out, "QUIT\r\n");
+	    fflush(out);
+	    smtp_respuesta(in, buf, sizeof(buf), NULL);
+	}
+	fclose(out);
+	fclose(in);
+    }
+#endif
+    for (i = 0; i < n; i++)
+	free(lista[i]);
+    free(lista);
+    correo_publica_estado();
+    return proximo > ahora ? proximo - ahora : 0;
+}
+
+/* Bucle del proceso de envio: espera avisos por la tuberia (o a que toque
+ * un reintento) y reparte.  Termina cuando el proceso principal cierra la
+ * tuberia. */
+
+static void correo_bucle(int fd)
+{
+    fd_set fds;
+    struct timeval tv;
+    char buf[256];
+    int espera = 0, bloqueo;
+
+    /* Un solo proceso de envio a la vez (tambien tras un RESTART) */
+    if ((bloqueo = open(CORREO_BLOQUEO, O_WRONLY | O_CREAT, 0600)) >= 0)
+	flock(bloqueo, LOCK_EX);
+
+    for (;;) {
+	FD_ZERO(&fds);
+	FD_SET(fd, &fds);
+	tv.tv_sec = espera;
+	tv.tv_usec = 0;
+	if (select(fd+1, &fds, NULL, NULL, &tv) > 0) {
+	    if (read(fd, buf, sizeof(buf)) <= 0)
+		exit(0);
+	}
+	espera = correo_reparte();
+    }
+}
+
+/*************************************************************************/
+
+/* Crea los directorios de la cola y arranca el proceso de envio.  Se llama
+ * desde init() antes de cargar las bases de datos, para que el proceso
+ * hijo ocupe lo minimo. */
+
+void correo_init(void)
+{
+    int fds[2];
+
+    mkdir(CORREO_DIR, 0700);
+    mkdir(CORREO_TMP, 0700);
+    mkdir(CORREO_FALLIDOS, 0700);
+
+    if (pipe(fds) < 0) {
+	logeo("Correo: pipe(): %s", strerror(errno));
+	return;
+    }
+    if ((correo_pid = fork()) < 0) {
+	logeo("Correo: fork(): %s", strerror(errno));
+	close(fds[0]);
+	close(fds[1]);
+	correo_pid = 0;
+	return;
+    }
+    if (correo_pid == 0) {
+	close(fds[1]);
+	signal(SIGINT, SIG_IGN);
+	signal(SIGTERM, SIG_DFL);
+	signal(SIGHUP, SIG_IGN);
+	signal(SIGCHLD, SIG_DFL);
+	correo_bucle(fds[0]);
+	exit(0);
+    }
+    close(fds[0]);
+    correo_aviso = fds[1];
+    fcntl(correo_aviso, F_SETFD, FD_CLOEXEC);
+    fcntl(correo_aviso, F_SETFL, O_NONBLOCK);
+    if (debug)
+	logeo("debug: Proceso de la cola de correo: %d", (int)correo_pid);
+}
+
+/*************************************************************************/
 
 /* #endif  #ifdef A_TOMAR_POR_EL_CULO */
 
@@ -15,9 +15,6 @@
 
 #include "services.h"
 #include "pseudo.h"
-#if defined(SOPORTE_JOOMLA15)
-#include <mysql.h>
-#endif
 #define canales 6000
 static CregInfo *creglists[canales]; 
 
@@ -136,21 +133,8 @@ void expire_creg(void)
 	  if (now - cr->time_peticion >= 604800 && (cr->estado & CR_PROCESO_REG)) {
 	   canalopers(s_CregServ, "Expirado el proceso de registro de %s", cr->name);
 	#if defined(SOPORTE_JOOMLA15)
-MYSQL *conn;
-char modifica[BUFSIZE];
- conn = mysql_init(NULL);
-
-   /* Connect to database */
-   if (!mysql_real_connect(conn, MYSQL_SERVER,
-         MYSQL_USER,MYSQL_PASS,MYSQL_DATABASE, 0, NULL, 0)) {
-       canaladmins(s_CregServ,"%s\n", mysql_error(conn));
-         return;
-   }
-snprintf(modifica, sizeof(modifica), "delete from jos_chans where canal ='%s';",cr->name);
-if (mysql_query(conn,modifica)) 
-canaladmins(s_CregServ, "%s\n", mysql_error(conn));
- mysql_close(conn);
-
+	sql_query(s_CregServ, cr->name, NULL, NULL,
+		"delete from jos_chans where canal=%s", cr->name);
 #endif
 	   delcreg(cr);
 	
@@ -158,21 +142,8 @@ canaladmins(s_CregServ, "%s\n", mysql_error(conn));
           if (now - cr->time_motivo >= 172800 && !(cr->estado & (CR_PROCESO_REG | CR_REGISTRADO | CR_ACEPTADO))) {
 	   canalopers(s_CregServ, "Expirado el canal no registrado %s", cr->name);
 	#if defined(SOPORTE_JOOMLA15)
-MYSQL *conn;
-char modifica[BUFSIZE];
- conn = mysql_init(NULL);
-
-   /* Connect to database */
-   if (!mysql_real_connect(conn, MYSQL_SERVER,
-         MYSQL_USER,MYSQL_PASS,MYSQL_DATABASE, 0, NULL, 0)) {
-       canaladmins(s_CregServ,"%s\n", mysql_error(conn));
-         return;
-   }
-snprintf(modifica, sizeof(modifica), "delete from jos_chans where canal ='%s';",cr->name);
-if (mysql_query(conn,modifica)) 
-canaladmins(s_CregServ, "%s\n", mysql_error(conn));
- mysql_close(conn);
-
+	sql_query(s_CregServ, cr->name, NULL, NULL,
+		"delete from jos_chans where canal=%s", cr->name);
 #endif
 	   delcreg(cr);
 	  }
@@ -530,21 +501,8 @@ static void do_cancela(User *u)
            }
            if (stricmp(u->nick, cr->founder) == 0) {
 		#if defined(SOPORTE_JOOMLA15)
-MYSQL *conn;
-char modifica[BUFSIZE];
- conn = mysql_init(NULL);
-
-   /* Connect to database */
-   if (!mysql_real_connect(conn, MYSQL_SERVER,
-         MYSQL_USER,MYSQL_PASS,MYSQL_DATABASE, 0, NULL, 0)) {
-       canaladmins(s_CregServ,"%s\n", mysql_error(conn));
-         return;
-   }
-snprintf(modifica, sizeof(modifica), "delete from jos_chans where canal ='%s';",chan);
-if (mysql_query(conn,modifica)) 
-canaladmins(s_CregServ, "%s\n", mysql_error(conn));
- mysql_close(conn);
-
+	    sql_query(s_CregServ, chan, NULL, NULL,
+		    "delete from jos_chans where canal=%s", chan);
 #endif
                delcreg(cr);                                      
                privmsg(s_CregServ, u->nick, "El canal 12%s ha sido cancelado", chan);
@@ -1027,30 +985,18 @@ static void do_registra(User *u)
 | status       | varchar(100) |
 			*/
 
-MYSQL *conn;
-char inserta[BUFSIZE], buf[BUFSIZE];
- conn = mysql_init(NULL);
-struct tm *tm;
-   /* Connect to database */
-   if (!mysql_real_connect(conn, MYSQL_SERVER,
-         MYSQL_USER,MYSQL_PASS,MYSQL_DATABASE, 0, NULL, 0)) {
-       canaladmins(s_CregServ,"%s\n", mysql_error(conn));
-         return;
-   }
-
-tm = localtime(&cr->time_lastapoyo);
-strftime_lang(buf, sizeof(buf), u, STRFTIME_DATE_TIME_FORMAT, tm);
-if (CregApoyos) {
-snprintf(inserta, sizeof(inserta), "INSERT INTO jos_chans VALUES('','%s','%s','%s','%s','PROCESO')", seccion,chan,cr->founder,buf);
-} else {
- snprintf(inserta, sizeof(inserta), "INSERT INTO jos_chans VALUES('','%s','%s','%s','%s','ACEPTADO')", seccion,chan,cr->founder,buf);
-        	
+{
+	    char buf[BUFSIZE];
+	    struct tm *tm;
+
+	    tm = localtime(&cr->time_lastapoyo);
+	    strftime_lang(buf, sizeof(buf), u, STRFTIME_DATE_TIME_FORMAT, tm);
+	    sql_query(s_CregServ, chan, NULL, NULL,
+		    "INSERT INTO jos_chans (canal,seccion,username,registerDate,status)"
+		    " VALUES(%s,%s,%s,%s,%s)", chan, seccion, cr->founder, buf,
+		    CregApoyos ? "PROCESO" : "ACEPTADO");
 	}
 
-if (mysql_query(conn,inserta)) 
-canaladmins(s_CregServ, "%s\n", mysql_error(conn));
- mysql_close(conn);
-
 #endif				
 					    
        cr->desc = sstrdup(desc);
@@ -1154,24 +1100,16 @@ static void do_reg(User *u)
 
 
 
-MYSQL *conn;
-char inserta[BUFSIZE], buf[BUFSIZE];
- conn = mysql_init(NULL);
-struct tm *tm;
-   /* Connect to database */
-   if (!mysql_real_connect(conn, MYSQL_SERVER,
-         MYSQL_USER,MYSQL_PASS,MYSQL_DATABASE, 0, NULL, 0)) {
-       canaladmins(s_CregServ,"%s\n", mysql_error(conn));
-         return;
-   }
-
-tm = localtime(&cr->time_lastapoyo);
-strftime_lang(buf, sizeof(buf), u, STRFTIME_DATE_TIME_FORMAT, tm);
-snprintf(inserta, sizeof(inserta), "INSERT INTO jos_chans VALUES('','%s','%s','%s','%s','ACEPTADO')", tipo,chan,cr->founder,buf);
-
-if (mysql_query(conn,inserta)) 
-canaladmins(s_CregServ, "%s\n", mysql_error(conn));
- mysql_close(conn);
+{
+	    char buf[BUFSIZE];
+	    struct tm *tm;
+
+	    tm = localtime(&cr->time_lastapoyo);
+	    strftime_lang(buf, sizeof(buf), u, STRFTIME_DATE_TIME_FORMAT, tm);
+	    sql_query(s_CregServ, chan, NULL, NULL,
+		    "INSERT INTO jos_chans (canal,seccion,username,registerDate,status)"
+		    " VALUES(%s,%s,%s,%s,'ACEPTADO')", chan, tipo, cr->founder, buf);
+	}
 
 #endif							  
 			
@@ -1446,22 +1384,8 @@ static void do_acepta(User *u)
         cr->estado = 0;
         cr->estado |= CR_REGISTRADO;
 #if defined(SOPORTE_JOOMLA15)
- MYSQL *conn;
-char actualiza[BUFSIZE];
- conn = mysql_init(NULL);
- char buf[BUFSIZE];
-   /* Connect to database */
-   if (!mysql_real_connect(conn, MYSQL_SERVER,
-         MYSQL_USER,MYSQL_PASS,MYSQL_DATABASE, 0, NULL, 0)) {
-       canaladmins(s_CregServ,"%s\n", mysql_error(conn));
-         return;
-   }
-snprintf(actualiza, sizeof(actualiza), "update jos_chans set status ='Registrado' where canal ='%s';",chan);
-
-if (mysql_query(conn,actualiza)) 
-canaladmins(s_CregServ, "%s\n", mysql_error(conn));
- mysql_close(conn);
-
+	sql_query(s_CregServ, chan, NULL, NULL,
+		"update jos_chans set status='Registrado' where canal=%s", chan);
 #endif
          
  
@@ -1472,7 +1396,7 @@ canaladmins(s_CregServ, "%s\n", mysql_error(conn));
        	/*soporte envio de memos a los founders de los nuevos canales registrados que han sido aceptados*/
           
        MemoInfo *mi;
-       Memo *m;
+       uint32 number;
 	int ischan;
         /*if (!(mi = getmemoinfo(cr->founder, &ischan))) 
 	notice_lang(s_MemoServ, u,
@@ -1481,34 +1405,16 @@ canaladmins(s_CregServ, "%s\n", mysql_error(conn));
         time_t now = time(NULL);
         u->lastmemosend = now;
 	char *source =  u->nick;
-        mi->memocount++;
-        mi->memos = srealloc(mi->memos, sizeof(Memo) * mi->memocount);
-	m = &mi->memos[mi->memocount-1];
-	strscpy(m->sender, source, NICKMAX);
-	if (mi->memocount > 1) {
-	    m->number = m[-1].number + 1;
-	    if (m->number < 1) {
-		int i;
-		for (i = 0; i < mi->memocount; i++)
-		    mi->memos[i].number = i+1;
-	    }
-	} else {
-	    m->number = 1;
-	}
-	m->time = time(NULL);
 	char text[BUFSIZE];
     	snprintf(text, sizeof(text), "Nos Complace comunicarle, que la admnistracin de canales de la red, despues de haber revisado su solicitud,ha resuelto darle por 3ACEPTADO su peticin de registro, de su nuevo canal 2%#s .No dude si lo considera necesario, solicitar soporte en el canal 4#%s .Un Saludo", chan,CanalAyuda);
-	m->text =sstrdup(text);
-	m->flags = MF_UNREAD;
+	number = memo_anade(mi, getlink(ni)->nick, source, text);
   
 
 	    if (ni->flags & NI_MEMO_RECEIVE) {
 		if (MSNotifyAll) {
-		    for (u = firstuser(); u; u = nextuser()) {
-			if (u->real_ni == ni) {
-			    notice_lang(s_MemoServ, u, MEMO_NEW_MEMO_ARRIVED,
-					source, s_MemoServ, m->number);
-			}
+		    for (u = getlink(ni)->sesiones; u; u = u->sesion_next) {
+			notice_lang(s_MemoServ, u, MEMO_NEW_MEMO_ARRIVED,
+					source, s_MemoServ, number);
 		    }
 		
 		} /* if (MSNotifyAll) */
@@ -1545,22 +1451,8 @@ static void do_deniega(User *u)
         cr->estado = 0;
         cr->estado |= CR_RECHAZADO;
 #if defined(SOPORTE_JOOMLA15)
- MYSQL *conn;
-char actualiza[BUFSIZE];
- conn = mysql_init(NULL);
- char buf[BUFSIZE];
-   /* Connect to database */
-   if (!mysql_real_connect(conn, MYSQL_SERVER,
-         MYSQL_USER,MYSQL_PASS,MYSQL_DATABASE, 0, NULL, 0)) {
-       canaladmins(s_CregServ,"%s\n", mysql_error(conn));
-         return;
-   }
-snprintf(actualiza, sizeof(actualiza), "update jos_chans set status ='Denegado' where canal ='%s';",chan);
-
-if (mysql_query(conn,actualiza)) 
-canaladmins(s_CregServ, "%s\n", mysql_error(conn));
- mysql_close(conn);
-
+	sql_query(s_CregServ, chan, NULL, NULL,
+		"update jos_chans set status='Denegado' where canal=%s", chan);
 #endif
          
  
@@ -1571,7 +1463,7 @@ canaladmins(s_CregServ, "%s\n", mysql_error(conn));
        	/*soporte envio de memos a los founders de los nuevos canales registrados que han sido aceptados*/
           
        MemoInfo *mi;
-       Memo *m;
+       uint32 number;
 	int ischan;
         /*if (!(mi = getmemoinfo(cr->founder, &ischan))) 
 	notice_lang(s_MemoServ, u,
@@ -1580,35 +1472,16 @@ canaladmins(s_CregServ, "%s\n", mysql_error(conn));
         time_t now = time(NULL);
         u->lastmemosend = now;
 	char *source =  u->nick;
-        mi->memocount++;
-        mi->memos = srealloc(mi->memos, sizeof(Memo) * mi->memocount);
-	m = &mi->memos[mi->memocount-1];
-	strscpy(m->sender, source, NICKMAX);
-	if (mi->memocount > 1) {
-	    m->number = m[-1].number + 1;
-	    if (m->number < 1) {
-		int i;
-		for (i = 0; i < mi->memocount; i++)
-		    mi->memos[i].number = i+1;
-	    }
-	} else {
-	    m->number = 1;
-	}
-	m->time = time(NULL);
 	char text[BUFSIZE];
     	snprintf(text, sizeof(text), "Lamentamos comunicarle,que la admnistracin de canales de la red, despues de haber revisado su solicitud,ha resuelto darle por 4DENEGADO su peticin de registro,del canal 2%#s .Motivo 5%s.Un Saludo", chan,razon);
-	m->text =sstrdup(text);
-	m->text =sstrdup(text);
-	m->flags = MF_UNREAD;
+	number = memo_anade(mi, getlink(ni)->nick, source, text);
   
 
 	    if (ni->flags & NI_MEMO_RECEIVE) {
 		if (MSNotifyAll) {
-		    for (u = firstuser(); u; u = nextuser()) {
-			if (u->real_ni == ni) {
-			    notice_lang(s_MemoServ, u, MEMO_NEW_MEMO_ARRIVED,
-					source, s_MemoServ, m->number);
-			}
+		    for (u = getlink(ni)->sesiones; u; u = u->sesion_next) {
+			notice_lang(s_MemoServ, u, MEMO_NEW_MEMO_ARRIVED,
+					source, s_MemoServ, number);
 		    }
 		
 		} /* if (MSNotifyAll) */
@@ -1716,22 +1589,8 @@ static void do_suspend(User *u)
         privmsg(s_CregServ, u->nick, "Al canal 12%s se le ha SUSPENDIDO", chan);
         canaladmins(s_CregServ, "4%s ha SUSPENDIDO el Canal  12%s", u->nick, chan);
 #if defined(SOPORTE_JOOMLA15)
- MYSQL *conn;
-char actualiza[BUFSIZE];
- conn = mysql_init(NULL);
- char buf[BUFSIZE];
-   /* Connect to database */
-   if (!mysql_real_connect(conn, MYSQL_SERVER,
-         MYSQL_USER,MYSQL_PASS,MYSQL_DATABASE, 0, NULL, 0)) {
-       canaladmins(s_CregServ,"%s\n", mysql_error(conn));
-         return;
-   }
-snprintf(actualiza, sizeof(actualiza), "update jos_chans set status ='SUSPENDIDO' where canal ='%s';",chan);
-
-if (mysql_query(conn,actualiza)) 
-canaladmins(s_CregServ, "%s\n", mysql_error(conn));
- mysql_close(conn);
-
+	sql_query(s_CregServ, chan, NULL, NULL,
+		"update jos_chans set status='SUSPENDIDO' where canal=%s", chan);
 #endif
     }
 }
@@ -1765,22 +1624,8 @@ static void do_unsuspend(User *u)
         canaladmins(s_CregServ, "4%s ha REACTIVADO el Canal  12%s", u->nick, chan);
 	
  #if defined(SOPORTE_JOOMLA15)
- MYSQL *conn;
-char actualiza[BUFSIZE];
- conn = mysql_init(NULL);
- char buf[BUFSIZE];
-   /* Connect to database */
-   if (!mysql_real_connect(conn, MYSQL_SERVER,
-         MYSQL_USER,MYSQL_PASS,MYSQL_DATABASE, 0, NULL, 0)) {
-       canaladmins(s_CregServ,"%s\n", mysql_error(conn));
-         return;
-   }
-snprintf(actualiza, sizeof(actualiza), "update jos_chans set status ='REGISTRADO' where canal ='%s';",chan);
-
-if (mysql_query(conn,actualiza)) 
-canaladmins(s_CregServ, "%s\n", mysql_error(conn));
- mysql_close(conn);
-
+	sql_query(s_CregServ, chan, NULL, NULL,
+		"update jos_chans set status='REGISTRADO' where canal=%s", chan);
 #endif
     }
 }
@@ -1807,21 +1652,8 @@ static void do_drop(User *u)
         privmsg(s_CregServ, u->nick, "El canal 12%s ha sido dropado de CReG", chan); 
         canalopers(s_CregServ, "4%s ha dropado el canal 12%s", u->nick, chan);
 	#if defined(SOPORTE_JOOMLA15)
-MYSQL *conn;
-char modifica[BUFSIZE];
- conn = mysql_init(NULL);
-
-   /* Connect to database */
-   if (!mysql_real_connect(conn, MYSQL_SERVER,
-         MYSQL_USER,MYSQL_PASS,MYSQL_DATABASE, 0, NULL, 0)) {
-       canaladmins(s_CregServ,"%s\n", mysql_error(conn));
-         return;
-   }
-snprintf(modifica, sizeof(modifica), "delete from jos_chans where canal ='%s';",chan);
-if (mysql_query(conn,modifica)) 
-canaladmins(s_CregServ, "%s\n", mysql_error(conn));
- mysql_close(conn);
-
+	sql_query(s_CregServ, chan, NULL, NULL,
+		"delete from jos_chans where canal=%s", chan);
 #endif
       
     }
@@ -1860,28 +1692,14 @@ static void do_fuerza(User *u)
         privmsg(s_CregServ, u->nick, "12%s ha sido registrado en %s", chan, s_ChanServ);
 
 #if defined(SOPORTE_JOOMLA15)
- MYSQL *conn;
-char actualiza[BUFSIZE];
- conn = mysql_init(NULL);
- char buf[BUFSIZE];
-   /* Connect to database */
-   if (!mysql_real_connect(conn, MYSQL_SERVER,
-         MYSQL_USER,MYSQL_PASS,MYSQL_DATABASE, 0, NULL, 0)) {
-       canaladmins(s_CregServ,"%s\n", mysql_error(conn));
-         return;
-   }
-snprintf(actualiza, sizeof(actualiza), "update jos_chans set status ='Registrado' where canal ='%s';",chan);
-
-if (mysql_query(conn,actualiza)) 
-canaladmins(s_CregServ, "%s\n", mysql_error(conn));
- mysql_close(conn);
-
+	sql_query(s_CregServ, chan, NULL, NULL,
+		"update jos_chans set status='Registrado' where canal=%s", chan);
 #endif
 
 /*soporte envio de memos a los founders de los nuevos canales registrados que han sido forzados*/
           
        MemoInfo *mi;
-       Memo *m;
+       uint32 number;
 	int ischan;
         /*if (!(mi = getmemoinfo(cr->founder, &ischan))) 
 	notice_lang(s_MemoServ, u,
@@ -1890,34 +1708,16 @@ canaladmins(s_CregServ, "%s\n", mysql_error(conn));
         time_t now = time(NULL);
         u->lastmemosend = now;
 	char *source =  u->nick;
-        mi->memocount++;
-        mi->memos = srealloc(mi->memos, sizeof(Memo) * mi->memocount);
-	m = &mi->memos[mi->memocount-1];
-	strscpy(m->sender, source, NICKMAX);
-	if (mi->memocount > 1) {
-	    m->number = m[-1].number + 1;
-	    if (m->number < 1) {
-		int i;
-		for (i = 0; i < mi->memocount; i++)
-		    mi->memos[i].number = i+1;
-	    }
-	} else {
-	    m->number = 1;
-	}
-	m->time = time(NULL);
 	char text[BUFSIZE];
     	snprintf(text, sizeof(text), "Nos Complace comunicarle, que la admnistracin de canales de la red, despues de haber revisado su solicitud,ha resuelto darle por 5ACEPTADO su peticin de registro, de su nuevo canal 2%#s .No dude si lo considera necesario, solicitar soporte en el canal 4#%s .Un Saludo", chan,CanalAyuda);
-	m->text =sstrdup(text);
-	m->flags = MF_UNREAD;
+	number = memo_anade(mi, getlink(ni)->nick, source, text);
   
 
 	    if (ni->flags & NI_MEMO_RECEIVE) {
 		if (MSNotifyAll) {
-		    for (u = firstuser(); u; u = nextuser()) {
-			if (u->real_ni == ni) {
-			    notice_lang(s_MemoServ, u, MEMO_NEW_MEMO_ARRIVED,
-					source, s_MemoServ, m->number);
-			}
+		    for (u = getlink(ni)->sesiones; u; u = u->sesion_next) {
+			notice_lang(s_MemoServ, u, MEMO_NEW_MEMO_ARRIVED,
+					source, s_MemoServ, number);
 		    }
 		
 		} /* if (MSNotifyAll) */
@@ -0,0 +1,278 @@
+/* Conjuntos de entradas con caducidad (AREGISTRA, ALIMIT, ANICK, AKILL).
+ *
+ * Services is copyright (c) 1996-1999 Andy Church.
+ *     E-mail: <achurch@dragonfire.net>
+ * This program is free but copyrighted software; see the file COPYING for
+ * details.
+ *
+ * Antes cada lista era un array con busqueda lineal y memmove() en cada
+ * borrado, y la expiracion recorria el array entero en cada ExpireTimeout.
+ * Aqui cada entrada esta en una tabla hash por clave (busqueda y borrado
+ * en O(1)), en un monticulo ordenado por fecha de expiracion (O(log n)) y
+ * en una lista en orden de insercion para los listados y las grabaciones.
+ * expset_run() se llama en cada vuelta del bucle principal y caduca las
+ * entradas en cuanto vence su plazo.
+ */
+
+#include "services.h"
+
+#define EXPSET_HASH	64	/* Tamano inicial de la tabla hash */
+
+static ExpSet *expsets = NULL;	/* Todos los conjuntos, para expset_run() */
+
+/*************************************************************************/
+
+static unsigned int expset_hash(ExpSet *s, const char *key)
+{
+    unsigned int h = 0;
+
+    if (s->nocase) {
+	while (*key)
+	    h = h*31 + (unsigned char)tolower(*key++);
+    } else {
+	while (*key)
+	    h = h*31 + (unsigned char)*key++;
+    }
+    return h & (s->hashsize-1);
+}
+
+static void expset_rehash(ExpSet *s, int size)
+{
+    ExpEntry **old = s->hash, *e, *next;
+    int oldsize = s->hashsize, i;
+    unsigned int h;
+
+    s->hash = scalloc(size, sizeof(ExpEntry *));
+    s->hashsize = size;
+    for (i = 0; i < oldsize; i++) {
+	for (e = old[i]; e; e = next) {
+	    next = e->hnext;
+	    h = expset_hash(s, e->key);
+	    e->hnext = s->hash[h];
+	    s->hash[h] = e;
+	}
+    }
+    free(old);
+}
+
+/*************************************************************************/
+/******************************* Monticulo *******************************/
+/*************************************************************************/
+
+static void heap_pon(ExpSet *s, int pos, ExpEntry *e)
+{
+    s->heap[pos] = e;
+    e->heappos = pos;
+}
+
+static void heap_sube(ExpSet *s, int pos)
+{
+    ExpEntry *e = s->heap[pos];
+    int padre;
+
+    while (pos > 0) {
+	padre = (pos-1) / 2;
+	if (s->heap[padre]->expires <= e->expires)
+	    break;
+	heap_pon(s, pos, s->heap[padre]);
+	pos = padre;
+    }
+    heap_pon(s, pos, e);
+}
+
+static void heap_baja(ExpSet *s, int pos)
+{
+    ExpEntry *e = s->heap[pos];
+    int hijo;
+
+    while ((hijo = 2*pos+1) < s->nheap) {
+	if (hijo+1 < s->nheap
+		&& s->heap[hijo+1]->expires < s->heap[hijo]->expires)
+	    hijo++;
+	if (e->expires <= s->heap[hijo]->expires)
+	    break;
+	heap_pon(s, pos, s->heap[hijo]);
+	pos = hijo;
+    }
+    heap_pon(s, pos, e);
+}
+
+static void heap_mete(ExpSet *s, ExpEntry *e)
+{
+    if (s->nheap >= s->heapsize) {
+	s->heapsize = s->heapsize ? s->heapsize*2 : 16;
+	s->heap = srealloc(s->heap, sizeof(ExpEntry *) * s->heapsize);
+    }
+    heap_pon(s, s->nheap++, e);
+    heap_sube(s, e->heappos);
+}
+
+static void heap_saca(ExpSet *s, ExpEntry *e)
+{
+    int pos = e->heappos;
+
+    e->heappos = -1;
+    if (--s->nheap == pos)
+	return;
+    heap_pon(s, pos, s->heap[s->nheap]);
+    heap_sube(s, pos);
+    heap_baja(s, s->heap[pos]->heappos);
+}
+
+/*************************************************************************/
+/************************** Funciones externas ***************************/
+/*************************************************************************/
+
+/* Crea un conjunto.  expira (puede ser NULL) se llama al caducar una
+ * entrada; libera (puede ser NULL) cuando se borra por cualquier motivo,
+ * para que suelte e->data. */
+
+ExpSet *expset_create(int nocase, void (*expira)(ExpEntry *e),
+		      void (*libera)(ExpEntry *e))
+{
+    ExpSet *s = scalloc(1, sizeof(ExpSet));
+
+    s->nocase = nocase;
+    s->expira = expira;
+    s->libera = libera;
+    s->hashsize = EXPSET_HASH;
+    s->hash = scalloc(s->hashsize, sizeof(ExpEntry *));
+    s->sig = expsets;
+    expsets = s;
+    return s;
+}
+
+ExpEntry *expset_find(ExpSet *s, const char *key)
+{
+    ExpEntry *e;
+
+    for (e = s->hash[expset_hash(s, key)]; e; e = e->hnext) {
+	if (s->nocase ? stricmp(e->key, key) == 0 : strcmp(e->key, key) == 0)
+	    return e;
+    }
+    return NULL;
+}
+
+/* Cambia la fecha de expiracion (0 = no expira). */
+
+void expset_set_expires(ExpSet *s, ExpEntry *e, time_t expires)
+{
+    if (e->heappos >= 0)
+	heap_saca(s, e);
+    e->expires = expires;
+    if (expires)
+	heap_mete(s, e);
+}
+
+/* Anade una entrada, o actualiza la que ya hubiera con esa clave (en ese
+ * caso se libera su data anterior). */
+
+ExpEntry *expset_add(ExpSet *s, const char *key, time_t expires, void *data)
+{
+    ExpEntry *e;
+    unsigned int h;
+
+    if ((e = expset_find(s, key))) {
+	if (s->libera)
+	    s->libera(e);
+    } else {
+	if (s->count >= s->hashsize*2)
+	    expset_rehash(s, s->hashsize*2);
+	e = scalloc(1, sizeof(ExpEntry));
+	e->key = sstrdup(key);
+	e->heappos = -1;
+	h = expset_hash(s, key);
+	e->hnext = s->hash[h];
+	s->hash[h] = e;
+	e->prev = s->last;
+	if (s->last)
+	    s->last->next = e;
+	else
+	    s->first = e;
+	s->last = e;
+	s->count++;
+    }
+    e->time = time(NULL);
+    e->data = data;
+    expset_set_expires(s, e, expires);
+    return e;
+}
+
+void expset_remove(ExpSet *s, ExpEntry *e)
+{
+    ExpEntry **pe;
+
+    for (pe = &s->hash[expset_hash(s, e->key)]; *pe != e; pe = &(*pe)->hnext)
+	;
+    *pe = e->hnext;
+    if (e->prev)
+	e->prev->next = e->next;
+    else
+	s->first = e->next;
+    if (e->next)
+	e->next->prev = e->prev;
+    else
+	s->last = e->prev;
+    if (e->heappos >= 0)
+	heap_saca(s, e);
+    s->count--;
+    if (s->libera)
+	s->libera(e);
+    free(e->key);
+    free(e);
+}
+
+/* Devuelve 1 si la clave estaba en el conjunto. */
+
+int expset_del(ExpSet *s, const char *key)
+{
+    ExpEntry *e = expset_find(s, key);
+
+    if (!e)
+	return 0;
+    expset_remove(s, e);
+    return 1;
+}
+
+/* Caduca las entradas cuyo plazo ha vencido.  Devuelve cuantas. */
+
+int expset_expire(ExpSet *s, time_t now)
+{
+    ExpEntry *e;
+    int n = 0;
+
+    while (s->nheap && (e = s->heap[0])->expires <= now) {
+	heap_saca(s, e);
+	if (s->expira)
+	    s->expira(e);
+	expset_remove(s, e);
+	n++;
+    }
+    return n;
+}
+
+/* Llamado en cada vuelta del bucle principal. */
+
+void expset_run(void)
+{
+    ExpSet *s;
+    time_t now = time(NULL);
+
+    for (s = expsets; s; s = s->sig) {
+	if (s->nheap && s->heap[0]->expires <= now)
+	    expset_expire(s, now);
+    }
+}
+
+/* Memoria usada por el conjunto, sin contar lo que cuelga de data. */
+
+long expset_mem(ExpSet *s)
+{
+    ExpEntry *e;
+    long mem;
+
+    mem = sizeof(ExpSet) + sizeof(ExpEntry *) * (s->hashsize + s->heapsize);
+    for (e = s->first; e; e = e->next)
+	mem += sizeof(ExpEntry) + strlen(e->key)+1;
+    return mem;
+}
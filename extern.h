@@ -33,6 +33,18 @@ E void add_akill(const char *mask, const char *reason, const char *who,
 E int del_akill(const char *mask);
 E void delete_user(User *user);
 
+/**** expset.c ****/
+E ExpSet *expset_create(int nocase, void (*expira)(ExpEntry *e),
+			void (*libera)(ExpEntry *e));
+E ExpEntry *expset_find(ExpSet *s, const char *key);
+E ExpEntry *expset_add(ExpSet *s, const char *key, time_t expires, void *data);
+E void expset_set_expires(ExpSet *s, ExpEntry *e, time_t expires);
+E void expset_remove(ExpSet *s, ExpEntry *e);
+E int expset_del(ExpSet *s, const char *key);
+E int expset_expire(ExpSet *s, time_t now);
+E void expset_run(void);
+E long expset_mem(ExpSet *s);
+
 /**** aregistra.c ****/
 E void get_aregistra_stats(long *nrec, long *memuse);
 E int num_aregistras(void);
@@ -49,6 +61,8 @@ E void save_alimit(void);
 E int expire_alimits(void);
 E void add_alimit(const char *elcanal,int elnumero,const time_t expiry);
 E void del_alimit(const char *elcanal);
+E int calcula_alimit(int usuarios);
+E void programa_alimit(const char *elcanal, time_t retardo);
 
 /**** achanakick.c ****/
 E void get_achanakick_stats(long *nrec, long *memuse);
@@ -89,6 +103,9 @@ E Channel *nextchan(void);
 E void chan_adduser(User *user, const char *chan);
 E void chan_deluser(User *user, Channel *c);
 
+E int en_burst;
+E void fin_burst(void);
+E int canal_en_burst(const char *chan);
 #if defined(IRC_UNDERNET_P10)
 E void do_burst(const char *source, int ac, char **av);
 E void do_create(const char *source, int ac, char **av);
@@ -118,16 +135,18 @@ E void record_topic(const char *chan);
 E void restore_topic(const char *chan);
 E int check_topiclock(const char *chan);
 E void expire_chans(void);
-E void cs_remove_nick(const NickInfo *ni);
+E void cs_remove_nick(NickInfo *ni);
 
 E ChannelInfo *cs_findchan(const char *chan);
+E ChannelInfo *firstchaninfo(void);
+E ChannelInfo *nextchaninfo(void);
 E int check_access(User *user, ChannelInfo *ci, int what);
 E void registros(User *u, NickInfo *ni);
 E void join_chanserv(void);
 E void join_shadow(void);
-E void canal_autolimit(Channel *ki,ChannelInfo *ci,const char *chan);
-E void sale_autolimit(char *s);
+E void canal_autolimit(Channel *c);
 E int  tramo1,tramo2,tramo3,incr1,incr2,incr3;
+E int  AutolimitRetardo;
 
 /**** cregserv.c ****/
 E void cr_init(void);
@@ -258,6 +277,8 @@ E char *MYSQL_SERVER;
 E char *MYSQL_USER;
 E char *MYSQL_PASS;
 E char *MYSQL_DATABASE;
+E int   MYSQL_CONEXIONES;
+E int   MYSQL_COLA;
 
 #if defined(IRC_UNDERNET_P10)
 E int   ServerNumerico;
@@ -364,6 +385,22 @@ E char *AutolimitDBName;
 E char *AutochanakickDBName;
 E char *NickSuspendsDBName;
 E char *NewsDBName;
+E char *MemoDBName;
+E char *BddDBName;
+E int   BddSincroniza;
+E int   BddCompactaFilas;
+E int   BddAuditoria;
+E int   BddAuditoriaRepara;
+E char *LatenciaFichero;
+E int   LineaLenta;
+E int   PerfilIntervalo;
+E int   AvisosPorSegundo;
+E int   AvisosCola;
+E int   AvisosEntra, AvisosEntraPeriodo;
+E int   AvisosNick, AvisosNickPeriodo;
+E int   AvisosCanal, AvisosCanalPeriodo;
+E int   AvisosSale, AvisosSalePeriodo;
+E int   ModosPorLinea;
 E char *StatDBName;
 
 #if defined(REG_NICK_MAIL)
@@ -385,6 +422,12 @@ E int   UpdateTimeout;
 E int   ExpireTimeout;
 E int   ReadTimeout;
 E int   WarningTimeout;
+E int   FloodCoste;
+E int   FloodIgnora;
+E int   FloodKill;
+E int   FloodHost;
+E FloodPeso *FloodPesos;
+E int   FloodPesosNumber;
 E int   TimeoutCheck;
 
 #define PNAME "euskalirc-services-bdd"
@@ -444,6 +487,9 @@ E char **Puertos;
 E int   LogMaxUsers;
 E int   AutokillExpiry;
 E int   GlinePscannerExpiry;
+E int   ScannerConexiones;
+E int   ScannerTimeout;
+E int   ScannerCache;
 E int   AutoregistraExpiry;
 
 E int   KillClonesAkillExpire;
@@ -455,6 +501,9 @@ E int read_config(void);
 /**** correo.c ****/
 
 E int enviar_correo(const char * destino, const char *subject, const char *body);
+E int correo_estado(long *enviados, long *reintenta, long *fallidos,
+		int *encola, time_t *ultimo, char *error, int errlen);
+E void correo_init(void);
 E int enviar_web(const char *desde, const char *body);
 
 /**** helpserv.c ****/
@@ -480,6 +529,20 @@ E void introduce_user(const char *user);
 E int init(int ac, char **av);
 
 
+/**** joomla.c ****/
+
+#if defined(SOPORTE_JOOMLA15)
+E void sql_init(void);
+E void sql_shutdown(void);
+E int sql_query(const char *source, const char *clave, SqlCallback callback,
+		void *data, const char *fmt, ...);
+E void sql_process(void);
+E void sql_joomla_gid(const char *source, const char *nick, int gid);
+E void get_sql_stats(long *encoladas, long *ejecutadas, long *errores,
+		long *descartadas, long *reconexiones, int *encola);
+#endif
+
+
 /**** language.c ****/
 
 E char **langtexts[NUM_LANGS];
@@ -536,6 +599,8 @@ E char *quitmsg;
 E char  inbuf[BUFSIZE];
 E int   servsock;
 E int   save_data;
+E int   waiting;
+E const char *nombre_fase(int fase);
 E int   got_alarm;
 E time_t start_time;
 E void sighandler(int signum);
@@ -549,6 +614,79 @@ E void *srealloc(void *oldptr, long newsize);
 E char *sstrdup(const char *s);
 
 
+/**** bddlocal.c ****/
+
+E void bdd_local_pon(char tabla, const char *clave, const char *valor,
+		uint32 serie);
+E BddReg *bdd_local_reg(char tabla, const char *clave);
+E const char *bdd_local_valor(char tabla, const char *clave);
+E int bdd_local_igual(char tabla, const char *clave, const char *valor);
+E uint32 bdd_local_serie(char tabla);
+E BddReg *bdd_local_lista(char tabla, uint32 *cuantos);
+E void bdd_diario_apunta(char tabla, const char *clave, const char *valor,
+			 uint32 serie);
+E void bdd_diario_confirma(char tabla, uint32 serie);
+E uint32 bdd_diario_reenvia(char tabla,
+		uint32 (*manda)(char tabla, const char *clave, const char *valor));
+E uint32 bdd_local_confirmada(char tabla);
+E uint32 bdd_diario_pendientes(void);
+E void load_bdd_local(void);
+E void save_bdd_local(void);
+
+
+/**** modos.c ****/
+
+E void modo_canal(const char *fuente, const char *canal, const char *modos,
+		...);
+E void modos_envia(void);
+E int modos_pendientes(void);
+
+
+/**** avisos.c ****/
+
+E void avisos_encola(int canal, int prioridad, const char *source,
+		const char *texto);
+E void aviso(int clase, const char *source, const char *fmt, ...)
+	FORMAT(printf,3,4);
+E void avisos_envia(void);
+E void avisos_vacia(void);
+E int avisos_pendientes(void);
+
+
+/**** latencia.c ****/
+
+E LentaData lineas_lentas[];
+E int lineas_lentas_pos;
+E time_t perfil_desde;
+E Latencia *latencia_busca(const char *servicio, const char *comando);
+E void latencia_suma(Latencia *l, int64 us);
+E int64 latencia_percentil(Latencia *l, int pct);
+E int latencia_lista(Latencia ***lista);
+E void latencia_borra(void);
+E void latencia_vuelca(void);
+E void perfil_entra(Latencia *l);
+E void perfil_sale(void);
+E void linea_lenta(int64 usado, const char *linea, int privado);
+E int perfil_arranca(int ms);
+E int perfil_estado(uint32 *total, uint32 *fases);
+
+
+/**** memodb.c ****/
+
+E void memo_importa(MemoInfo *mi, const char *owner);
+E void load_memos(void);
+E void save_memos(void);
+E uint32 memo_anade(MemoInfo *mi, const char *owner, const char *sender,
+		    const char *text);
+E void memo_carga(MemoInfo *mi);
+E void memo_descarga_todo(void);
+E void memo_borra(MemoInfo *mi, int index);
+E void memo_borra_todos(MemoInfo *mi);
+E void memo_leido(MemoInfo *mi, int index);
+E int memo_no_leido(MemoInfo *mi, int index);
+E long memo_mem(MemoInfo *mi);
+
+
 /**** memoserv.c ****/
 
 E void ms_init(void);
@@ -587,6 +725,7 @@ typedef int (*range_callback_t)(User *u, int num, va_list args);
 E int process_numlist(const char *numstr, int *count_ret,
 		range_callback_t callback, User *u, ...);
 E int dotime(const char *s);
+E int64 reloj_us(void);
 
 
 /**** news.c ****/
@@ -633,8 +772,15 @@ E int nick_identified(User *u);
 E int nick_recognized(User *u);
 E int nick_suspended(User *u);
 E void expire_nicks(void);
+#if defined(SOPORTE_JOOMLA15)
+E void mirar_tablas(void);
+E void get_joomla_sync_stats(long *leidas, long *aplicadas,
+		long *total_leidas, long *total_aplicadas);
+#endif
 
 E NickInfo *findnick(const char *nick);
+E NickInfo *firstnickinfo(void);
+E NickInfo *nextnickinfo(void);
 E NickInfo *getlink(NickInfo *ni);
 
 
@@ -709,11 +855,16 @@ E void joku_canal(const char *source,const char *chan, char *buf);
 E void do_write_bdd(char *entrada, int tabla, const char *valor, ...);
 E void do_write_canal(char *entrada, int tabla, const char *valor, const char *param, ...);
 E void do_count_bdd(int tabla, unsigned int valor);
+E void bdd_serie_vista(char tab, unsigned int serie);
+E void bdd_escribe(char tab, const char *clave, const char *valor);
+E char *bdd_cifra_clave(const char *nick, const char *pass, char *clave);
+E void bdd_fin_lote(void);
+E int bdd_repasando(void);
 E void bddserv(const char *source, char *buf);
 E void bdd_init(void);
-E unsigned int base64toint(const char *s);
-E const char *inttobase64(char *buf, unsigned int v, unsigned int count);
 E void tea(unsigned int v[], unsigned int k[], unsigned int x[]);
+E void cifra_claves(const char *nicks[], const char *passes[],
+		char claves[][13], int n);
 E char *gen_nice_key(unsigned int ilevel);
 
 /**** bdd_hispano.c ****/
@@ -735,16 +886,17 @@ E void dbchan_reg(char *elnick, char *dato, char cual);
 /**** process.c ****/
 
 E int allow_ignore;
-
-E DebugData *debugserv[];
-E IgnoreData *ignore[];
+E ExpSet *flood_nicks;
+E ExpSet *flood_hosts;
+E DebugData debugserv[];
+E int debugserv_pos;
 
 
-E void add_ignore(const char *nick, time_t delta,const char *servicio,const char *inbuf);
-E IgnoreData *get_ignore(const char *nick);
-
-E void almacena_debugserv(const char *nick, time_t delta,const char *servicio,const char *inbuf);
-E DebugData *get_debugserv(const char *nick);
+E int flood_comprueba(const char *nick, const char *servicio, const char *inbuf);
+E void flood_carga(const char *nick, const char *servicio, const char *texto,
+		   const char *inbuf, int64 usado);
+E void almacena_debugserv(const char *nick, int64 usado, const char *servicio,
+			  const char *inbuf);
 
 E int split_buf(char *buf, char ***argv, int colon_special);
 E void process(void);
@@ -799,10 +951,28 @@ E char *sgets(char *buf, int len, int s);
 E char *sgets2(char *buf, int len, int s);
 E int sread(int s, char *buf, int len);
 E int sputs(char *str, int s);
+E void sflush(void);
 E int sockprintf(int s, char *fmt,...);
 E int conn(const char *host, int port, const char *lhost, int lport);
 E void disconn(int s);
 
+/**** replay.c ****/
+
+E int replay_conecta(void);
+
+/**** scanner.c ****/
+
+#if defined(SOPORTE_SCANNER)
+E void scanner_init(void);
+E void scanner_add(const char *host);
+E void scanner_process(void);
+E int scanner_fd(int *ocupado);
+E void expire_scanner(void);
+E void get_scanner_stats(long *hosts, long *cache, long *conex,
+		long *abiertos, long *gls, long *dns, long *por_minuto,
+		int *activas, int *cola_hosts, int *cola_glines);
+#endif
+
 /**** statserv.c ****/
 E void statserv(const char *source, char *buf);
 
@@ -832,6 +1002,8 @@ E User *finduserP10(const char *nick);
 #endif
 E User *firstuser(void);
 E User *nextuser(void);
+E void quita_sesion(User *user);
+E void actualiza_sesion(User *user);
 
 E void do_nick(const char *source, int ac, char **av);
 E void do_join(const char *source, int ac, char **av);
@@ -90,7 +90,7 @@ const char * GeoIP_canal[258] = {CanalCybers,CanalCybers,CanalCybers,CanalCybers
 
        if ( strcasecmp(cadena,GeoIP_dominio_codigo[i])== 0) {
       send_cmd(ServerName, "SVSJOIN  %s #%s", av[0],GeoIP_canal[i]);
-      canaladmins(s_GeoIP, "2ENTRA: %s 12HOST[%s]5(%s) 12CANAL:4 #%s",av[0],av[4],cadena,GeoIP_canal[i]);
+      aviso(AVISO_ENTRA, s_GeoIP, "2ENTRA: %s 12HOST[%s]5(%s) 12CANAL:4 #%s",av[0],av[4],cadena,GeoIP_canal[i]);
       return;
       }
     
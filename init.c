@@ -788,6 +788,8 @@ static int parse_options(int ac, char **av)
 
 /*************************************************************************/
 
+#if !defined(REPLAY_BENCH)
+
 /* Remove our PID file.  Done at exit. */
 
 static void remove_pidfile(void)
@@ -813,6 +815,8 @@ static void write_pidfile(void)
     }
 }
 
+#endif	/* !REPLAY_BENCH */
+
 /*************************************************************************/
 
 /* Overall initialization routine.  Returns 0 on success, -1 on failure. */
@@ -955,8 +959,10 @@ LogMaxUsersold=LogMaxUsers;
 	}
     }
 
+#if !defined(REPLAY_BENCH)
     /* Write our PID to the PID file. */
     write_pidfile();
+#endif
 
     /* Announce ourselves to the logfile. */
     if (debug || readonly || skeleton) {
@@ -1000,6 +1006,13 @@ LogMaxUsersold=LogMaxUsers;
 
     signal(SIGUSR1, sighandler);  /* This is our "out-of-memory" panic switch */
 
+    /* Perfil por muestreo (latencia.c) */
+    if (PerfilIntervalo)
+	perfil_arranca(PerfilIntervalo);
+
+    /* Proceso de la cola de correo, antes de cargar nada para que ocupe poco */
+    correo_init();
+
     /* Initialize multi-language support */
     lang_init();
     if (debug)
@@ -1027,6 +1040,7 @@ LogMaxUsersold=LogMaxUsers;
 	    load_cr_dbase();
 	if (debug)
 	    logeo("debug: Cargando la DB de %s (3/7)", s_CregServ);
+	load_memos();
     }
 	
     load_os_dbase();
@@ -1048,8 +1062,28 @@ load_jok_dbase();
     load_ipv();
     load_achanakick();
     load_X_dbase();
+    load_bdd_local();
+#if defined(IRC_BDD)
+    bdd_init();
+#endif
     logeo("Cargadas las bases de datos");
 
+#if !defined(REPLAY_BENCH)
+    /* replay-bench no habla con MySQL ni escanea (ver replay.c) */
+#if defined(SOPORTE_JOOMLA15)
+    /* Los hilos de MySQL, siempre despues del fork() */
+    sql_init();
+#endif
+#if defined(SOPORTE_SCANNER)
+    scanner_init();
+#endif
+#endif	/* !REPLAY_BENCH */
+
+#if defined(REPLAY_BENCH)
+    /* El "servidor" es la salida de replay-bench (replay.c) */
+    servsock = replay_conecta();
+    send_cmd(NULL, "PASS :%s", RemotePassword);
+#else
     /* Connect to the remote server */
     servsock = conn(RemoteServer, RemotePort, LocalHost, LocalPort);
     if (servsock < 0)
@@ -1070,6 +1104,7 @@ load_jok_dbase();
 	servsock = -1;
 	fatal("El servidor ha devuelto: %s", inbuf);
     }
+#endif
 
 
     /* Announce a logfile error if there was one */
@@ -1107,6 +1142,11 @@ load_jok_dbase();
     join_chanserv();
      join_jokuserv(); 
 
+#if !defined(IRC_UNDERNET_P10)
+    /* Sin END_OF_BURST, el fin del burst es el PONG a esto (m_pong()) */
+    send_cmd(ServerName, "PING :%s", ServerName);
+#endif
+
     /* Success! */
     return 0;
 }
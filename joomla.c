@@ -0,0 +1,421 @@
+/* Cola asincrona de consultas a la base de datos MySQL de la web (Joomla).
+ *
+ * Services is copyright (c) 1996-1999 Andy Church.
+ *     E-mail: <achurch@dragonfire.net>
+ * This program is free but copyrighted software; see the file COPYING for
+ * details.
+ *
+ * Antes cada comando abria su propia conexion (mysql_init +
+ * mysql_real_connect), lanzaba una consulta y cerraba, todo desde el bucle
+ * principal: mientras tanto los Services no leian del servidor.  Ahora hay
+ * MYSQL_CONEXIONES hilos, cada uno con una conexion persistente, y una cola
+ * acotada de sentencias con parametros.  Los hilos nunca tocan las
+ * estructuras de los Services: al terminar dejan el trabajo en la lista de
+ * hechos y el bucle principal (sql_process()) llama a los callbacks.
+ */
+
+#include "services.h"
+
+#if defined(SOPORTE_JOOMLA15)
+
+#include <mysql.h>
+#include <pthread.h>
+
+/*************************************************************************/
+
+#define SQL_MAXPARAMS	8	/* Parametros por sentencia */
+#define SQL_LOTE	32	/* Sentencias por COMMIT */
+
+typedef struct sqljob_ SqlJob;
+struct sqljob_ {
+    SqlJob *next;
+    char *source;		/* Servicio que la lanza (para los errores) */
+    char *fmt;
+    char *params[SQL_MAXPARAMS];
+    char esnumero[SQL_MAXPARAMS];	/* 1 si el parametro va sin comillas */
+    int nparams;
+    SqlCallback callback;
+    void *data;
+    SqlResult res;
+};
+
+typedef struct {
+    pthread_t hilo;
+    pthread_cond_t cond;
+    MYSQL *conn;
+    SqlJob *cola, **ultimo;
+} SqlWorker;
+
+static SqlWorker *workers = NULL;
+static int nworkers = 0;
+
+static pthread_mutex_t sql_lock = PTHREAD_MUTEX_INITIALIZER;
+static SqlJob *hechos = NULL, **hechos_ultimo = &hechos;
+static int pendientes = 0;
+static int terminando = 0;
+
+/* Estadisticas (solo se tocan con sql_lock) */
+static long sql_encoladas = 0, sql_ejecutadas = 0, sql_errores = 0,
+	    sql_descartadas = 0, sql_reconexiones = 0;
+
+/*************************************************************************/
+/************************* Hilos de la base de datos *********************/
+/*************************************************************************/
+
+/* Abre (o reabre) la conexion de un hilo.  Devuelve 0 si no hay forma. */
+
+static int sql_conectar(SqlWorker *w)
+{
+    if (w->conn) {
+	if (mysql_ping(w->conn) == 0)
+	    return 1;
+	mysql_close(w->conn);
+	pthread_mutex_lock(&sql_lock);
+	sql_reconexiones++;
+	pthread_mutex_unlock(&sql_lock);
+    }
+    if (!(w->conn = mysql_init(NULL)))
+	return 0;
+    if (!mysql_real_connect(w->conn, MYSQL_SERVER, MYSQL_USER, MYSQL_PASS,
+			    MYSQL_DATABASE, 0, NULL, 0)) {
+	mysql_close(w->conn);
+	w->conn = NULL;
+	return 0;
+    }
+    mysql_autocommit(w->conn, 0);
+    return 1;
+}
+
+/* Monta la sentencia final escapando los parametros con la conexion del
+ * hilo.  %s es una cadena (entre comillas), %d un numero, %% un %. */
+
+static char *sql_montar(MYSQL *conn, SqlJob *job)
+{
+    char *buf, *d;
+    const char *s;
+    size_t len;
+    int i, n = 0;
+
+    len = strlen(job->fmt) + 1;
+    for (i = 0; i < job->nparams; i++)
+	len += strlen(job->params[i])*2 + 2;
+    if (!(buf = malloc(len)))
+	return NULL;
+    for (s = job->fmt, d = buf; *s; s++) {
+	if (*s != '%') {
+	    *d++ = *s;
+	} else if (s[1] == '%') {
+	    *d++ = '%';
+	    s++;
+	} else if ((s[1] == 's' || s[1] == 'd') && n < job->nparams) {
+	    if (job->esnumero[n]) {
+		strcpy(d, job->params[n]);
+		d += strlen(d);
+	    } else {
+		*d++ = '\'';
+		d += mysql_real_escape_string(conn, d, job->params[n],
+					      strlen(job->params[n]));
+		*d++ = '\'';
+	    }
+	    n++;
+	    s++;
+	} else {
+	    *d++ = *s;
+	}
+    }
+    *d = 0;
+    return buf;
+}
+
+/* Ejecuta una sentencia y guarda el resultado (o el error) en job->res. */
+
+static void sql_ejecutar(SqlWorker *w, SqlJob *job)
+{
+    MYSQL_RES *res;
+    MYSQL_ROW row;
+    char *query;
+    int i, n;
+
+    if (!(query = sql_montar(w->conn, job))) {
+	job->res.error = 1;
+	strscpy(job->res.errmsg, "sin memoria", sizeof(job->res.errmsg));
+	return;
+    }
+    if (mysql_query(w->conn, query)) {
+	job->res.error = 1;
+	job->res.errnum = mysql_errno(w->conn);
+	strscpy(job->res.errmsg, mysql_error(w->conn), sizeof(job->res.errmsg));
+	free(query);
+	return;
+    }
+    free(query);
+    job->res.affected = (long) mysql_affected_rows(w->conn);
+    if (!(res = mysql_store_result(w->conn)))
+	return;
+    job->res.ncols = mysql_num_fields(res);
+    n = (int) mysql_num_rows(res);
+    job->res.rows = n ? calloc(n, sizeof(char **)) : NULL;
+    while (job->res.nrows < n && (row = mysql_fetch_row(res))) {
+	char **r = calloc(job->res.ncols, sizeof(char *));
+	if (!r)
+	    break;
+	for (i = 0; i < job->res.ncols; i++)
+	    r[i] = row[i] ? strdup(row[i]) : NULL;
+	job->res.rows[job->res.nrows++] = r;
+    }
+    mysql_free_result(res);
+}
+
+static void *sql_worker(void *arg)
+{
+    SqlWorker *w = arg;
+    SqlJob *lote, *job, *next;
+    sigset_t senales;
+    int n;
+
+    /* El perfil (SIGPROF) solo mira el hilo principal */
+    sigemptyset(&senales);
+    sigaddset(&senales, SIGPROF);
+    pthread_sigmask(SIG_BLOCK, &senales, NULL);
+    mysql_thread_init();
+    for (;;) {
+	pthread_mutex_lock(&sql_lock);
+	while (!w->cola && !terminando)
+	    pthread_cond_wait(&w->cond, &sql_lock);
+	if (!w->cola) {
+	    pthread_mutex_unlock(&sql_lock);
+	    break;
+	}
+	/* Nos llevamos hasta SQL_LOTE sentencias de golpe */
+	lote = w->cola;
+	for (job = lote, n = 1; job->next && n < SQL_LOTE; job = job->next)
+	    n++;
+	w->cola = job->next;
+	job->next = NULL;
+	if (!w->cola)
+	    w->ultimo = &w->cola;
+	pthread_mutex_unlock(&sql_lock);
+
+	if (sql_conectar(w)) {
+	    for (job = lote; job; job = job->next)
+		sql_ejecutar(w, job);
+	    mysql_commit(w->conn);
+	} else {
+	    for (job = lote; job; job = job->next) {
+		job->res.error = 1;
+		strscpy(job->res.errmsg, "No se puede conectar con MySQL",
+			sizeof(job->res.errmsg));
+	    }
+	}
+
+	pthread_mutex_lock(&sql_lock);
+	for (job = lote; job; job = next) {
+	    next = job->next;
+	    job->next = NULL;
+	    *hechos_ultimo = job;
+	    hechos_ultimo = &job->next;
+	    if (job->res.error)
+		sql_errores++;
+	    else
+		sql_ejecutadas++;
+	    pendientes--;
+	}
+	pthread_mutex_unlock(&sql_lock);
+    }
+    if (w->conn)
+	mysql_close(w->conn);
+    w->conn = NULL;
+    mysql_thread_end();
+    return NULL;
+}
+
+/*************************************************************************/
+/***************************** Bucle principal ***************************/
+/*************************************************************************/
+
+void sql_init(void)
+{
+    int i;
+
+    if (mysql_library_init(0, NULL, NULL)) {
+	logeo("SQL: No se puede inicializar la libreria de MySQL");
+	return;
+    }
+    nworkers = MYSQL_CONEXIONES;
+    workers = scalloc(nworkers, sizeof(SqlWorker));
+    for (i = 0; i < nworkers; i++) {
+	workers[i].ultimo = &workers[i].cola;
+	pthread_cond_init(&workers[i].cond, NULL);
+	if (pthread_create(&workers[i].hilo, NULL, sql_worker, &workers[i])) {
+	    log_perror("SQL: pthread_create()");
+	    nworkers = i;
+	    break;
+	}
+    }
+    logeo("SQL: %d conexiones con %s", nworkers, MYSQL_SERVER);
+}
+
+/* Espera a que se vacien las colas y cierra las conexiones. */
+
+void sql_shutdown(void)
+{
+    int i;
+
+    if (!workers)
+	return;
+    pthread_mutex_lock(&sql_lock);
+    terminando = 1;
+    for (i = 0; i < nworkers; i++)
+	pthread_cond_signal(&workers[i].cond);
+    pthread_mutex_unlock(&sql_lock);
+    for (i = 0; i < nworkers; i++)
+	pthread_join(workers[i].hilo, NULL);
+    sql_process();
+    for (i = 0; i < nworkers; i++)
+	pthread_cond_destroy(&workers[i].cond);
+    free(workers);
+    workers = NULL;
+    nworkers = 0;
+    mysql_library_end();
+}
+
+/* Encola una sentencia.  fmt admite %s (cadena, se escapa y se pone entre
+ * comillas) y %d (entero).  Las sentencias con la misma clave (el nick o
+ * el canal al que se refieren) van siempre al mismo hilo, asi que se
+ * ejecutan en el orden en que se encolaron; las que no tienen (clave NULL)
+ * van al primero.  callback (puede ser NULL) se llama desde el bucle
+ * principal con el resultado.  Devuelve 0 si la cola esta llena y la
+ * sentencia se descarta. */
+
+int sql_query(const char *source, const char *clave, SqlCallback callback,
+	      void *data, const char *fmt, ...)
+{
+    va_list args;
+    SqlJob *job;
+    SqlWorker *w;
+    const char *s;
+    char buf[32];
+    unsigned long hash = 0;
+
+    if (!nworkers) {
+	canaladmins(source, "SQL: Sin conexiones con la base de datos");
+	return 0;
+    }
+    pthread_mutex_lock(&sql_lock);
+    if (pendientes >= MYSQL_COLA) {
+	sql_descartadas++;
+	pthread_mutex_unlock(&sql_lock);
+	canaladmins(source, "SQL: Cola llena, se descarta: %s", fmt);
+	return 0;
+    }
+    pthread_mutex_unlock(&sql_lock);
+
+    job = scalloc(1, sizeof(SqlJob));
+    job->source = sstrdup(source);
+    job->fmt = sstrdup(fmt);
+    job->callback = callback;
+    job->data = data;
+    va_start(args, fmt);
+    for (s = fmt; *s && job->nparams < SQL_MAXPARAMS; s++) {
+	if (*s != '%')
+	    continue;
+	if (s[1] == 's') {
+	    const char *p = va_arg(args, const char *);
+	    job->params[job->nparams++] = sstrdup(p ? p : "");
+	} else if (s[1] == 'd') {
+	    snprintf(buf, sizeof(buf), "%d", va_arg(args, int));
+	    job->esnumero[job->nparams] = 1;
+	    job->params[job->nparams++] = sstrdup(buf);
+	}
+	if (s[1])
+	    s++;
+    }
+    va_end(args);
+
+    for (s = clave; s && *s; s++)
+	hash = hash*31 + tolower(*s);
+    w = &workers[hash % nworkers];
+
+    pthread_mutex_lock(&sql_lock);
+    *w->ultimo = job;
+    w->ultimo = &job->next;
+    pendientes++;
+    sql_encoladas++;
+    pthread_cond_signal(&w->cond);
+    pthread_mutex_unlock(&sql_lock);
+    return 1;
+}
+
+/* Libera los datos de un resultado (no la estructura). */
+
+static void sql_free_result(SqlResult *res)
+{
+    int i, j;
+
+    for (i = 0; i < res->nrows; i++) {
+	for (j = 0; j < res->ncols; j++)
+	    free(res->rows[i][j]);
+	free(res->rows[i]);
+    }
+    free(res->rows);
+}
+
+/* Llamado desde el bucle principal: entrega los resultados terminados. */
+
+void sql_process(void)
+{
+    SqlJob *lista, *job, *next;
+    int i;
+
+    pthread_mutex_lock(&sql_lock);
+    lista = hechos;
+    hechos = NULL;
+    hechos_ultimo = &hechos;
+    pthread_mutex_unlock(&sql_lock);
+
+    for (job = lista; job; job = next) {
+	next = job->next;
+	if (job->res.error)
+	    canaladmins(job->source, "SQL: %s", job->res.errmsg);
+	if (job->callback)
+	    job->callback(&job->res, job->data);
+	sql_free_result(&job->res);
+	for (i = 0; i < job->nparams; i++)
+	    free(job->params[i]);
+	free(job->fmt);
+	free(job->source);
+	free(job);
+    }
+}
+
+/*************************************************************************/
+
+/* Cambia el grupo de un usuario de la web: jos_users.gid y su entrada en
+ * jos_core_acl_groups_aro_map (a traves de jos_core_acl_aro). */
+
+void sql_joomla_gid(const char *source, const char *nick, int gid)
+{
+    sql_query(source, nick, NULL, NULL,
+	"update jos_users set gid=%d where username=%s", gid, nick);
+    sql_query(source, nick, NULL, NULL,
+	"update jos_core_acl_groups_aro_map m, jos_core_acl_aro a, jos_users u"
+	" set m.group_id=%d where u.username=%s and a.value=u.id"
+	" and m.aro_id=a.id", gid, nick);
+}
+
+/*************************************************************************/
+
+void get_sql_stats(long *encoladas, long *ejecutadas, long *errores,
+		   long *descartadas, long *reconexiones, int *encola)
+{
+    pthread_mutex_lock(&sql_lock);
+    *encoladas = sql_encoladas;
+    *ejecutadas = sql_ejecutadas;
+    *errores = sql_errores;
+    *descartadas = sql_descartadas;
+    *reconexiones = sql_reconexiones;
+    *encola = pendientes;
+    pthread_mutex_unlock(&sql_lock);
+}
+
+#endif /* SOPORTE_JOOMLA15 */
@@ -0,0 +1,330 @@
+/* Histogramas de latencia por servicio y comando.
+ *
+ * Services is copyright (c) 1996-1999 Andy Church.
+ *     E-mail: <achurch@dragonfire.net>
+ * This program is free but copyrighted software; see the file COPYING for
+ * details.
+ *
+ * run_cmd() mide cada comando de los *Serv y process() cada mensaje del
+ * servidor, con el reloj monotono en microsegundos.  Cada (servicio,
+ * comando) tiene un histograma en escala logaritmica: el cubo i cuenta las
+ * medidas entre 2^i y 2^(i+1)-1 microsegundos.  Con eso se sacan p50/p99
+ * sin guardar las medidas; el maximo se guarda exacto.  StatServ LATENCY
+ * los muestra y latencia_vuelca() los escribe en LatenciaFichero.
+ *
+ * Ademas hay un perfilador por muestreo: con PerfilIntervalo, SIGPROF
+ * salta cada tantos milisegundos de CPU y apunta la muestra al comando que
+ * se este ejecutando (perfil_entra()/perfil_sale()) o, fuera de process(),
+ * a la fase del bucle principal en la que este (`waiting' en main.c).  Las
+ * lineas que tardan mas de LineaLenta milisegundos se guardan, con la ruta
+ * de comandos que recorrieron, en lineas_lentas[].  OperServ PERFIL
+ * muestra las dos cosas.
+ */
+
+#include "services.h"
+
+#define LATENCIA_HASH	256
+#define PERFIL_PILA	4	/* Anidamiento maximo de perfil_entra() */
+
+static Latencia *latencias[LATENCIA_HASH];
+static int nlatencias = 0;
+
+/* Comandos en curso: perfil_pila[0] es el mensaje del servidor y los
+ * siguientes los *Serv a los que se ha pasado.  perfil_hondo es hasta
+ * donde llego la ultima linea, para sacar la ruta cuando ya ha vuelto. */
+static Latencia *perfil_pila[PERFIL_PILA];
+static int perfil_nivel = 0, perfil_hondo = 0;
+static Latencia * volatile perfil_actual = NULL;
+
+static volatile uint32 perfil_fases[PERFIL_FASES];
+static volatile uint32 perfil_total = 0;
+static int perfil_ms = 0;
+time_t perfil_desde = 0;
+
+LentaData lineas_lentas[LENTAS_MAX];
+int lineas_lentas_pos = 0;
+
+/*************************************************************************/
+
+static unsigned int latencia_hash(const char *servicio, const char *comando)
+{
+    unsigned int h = 0;
+
+    while (*servicio)
+	h = h*31 + (unsigned char)tolower(*servicio++);
+    h = h*31;
+    while (*comando)
+	h = h*31 + (unsigned char)tolower(*comando++);
+    return h % LATENCIA_HASH;
+}
+
+static int latencia_cubo(int64 us)
+{
+    int i = 0;
+
+    while (us > 1 && i < LATENCIA_CUBOS-1) {
+	us >>= 1;
+	i++;
+    }
+    return i;
+}
+
+/*************************************************************************/
+
+/* Devuelve la entrada de (`servicio', `comando'), creandola si hace
+ * falta.  Las entradas no se liberan nunca (latencia_borra() solo las pone
+ * a cero), asi que el puntero vale mientras dure el proceso. */
+
+Latencia *latencia_busca(const char *servicio, const char *comando)
+{
+    Latencia *l;
+    unsigned int h = latencia_hash(servicio, comando);
+
+    for (l = latencias[h]; l; l = l->next) {
+	if (stricmp(l->comando, comando) == 0
+			&& stricmp(l->servicio, servicio) == 0)
+	    return l;
+    }
+    l = scalloc(1, sizeof(Latencia));
+    l->servicio = sstrdup(servicio);
+    l->comando = sstrdup(comando);
+    l->next = latencias[h];
+    latencias[h] = l;
+    nlatencias++;
+    return l;
+}
+
+/* Anota en `l' una medida de `us' microsegundos. */
+
+void latencia_suma(Latencia *l, int64 us)
+{
+    if (us < 0)
+	us = 0;
+    l->cuenta++;
+    l->total += us;
+    if (us > l->max)
+	l->max = us;
+    l->cubos[latencia_cubo(us)]++;
+}
+
+/* Percentil `pct' (0-100) en microsegundos: el limite superior del cubo
+ * donde cae, sin pasar del maximo medido. */
+
+int64 latencia_percentil(Latencia *l, int pct)
+{
+    uint32 objetivo, suma = 0;
+    int i;
+
+    if (!l->cuenta)
+	return 0;
+    objetivo = (uint32)(((uint64)l->cuenta * pct + 99) / 100);
+    if (objetivo < 1)
+	objetivo = 1;
+    for (i = 0; i < LATENCIA_CUBOS; i++) {
+	suma += l->cubos[i];
+	if (suma >= objetivo)
+	    break;
+    }
+    if (i >= LATENCIA_CUBOS-1)
+	return l->max;
+    return ((int64)2 << i) - 1 < l->max ? ((int64)2 << i) - 1 : l->max;
+}
+
+/* Devuelve en *lista (hay que liberarla) las entradas con medidas o
+ * muestras. */
+
+int latencia_lista(Latencia ***lista)
+{
+    Latencia *l;
+    int i, n = 0;
+
+    *lista = smalloc(sizeof(Latencia *) * (nlatencias ? nlatencias : 1));
+    for (i = 0; i < LATENCIA_HASH; i++) {
+	for (l = latencias[i]; l; l = l->next) {
+	    if (l->cuenta || l->muestras)
+		(*lista)[n++] = l;
+	}
+    }
+    return n;
+}
+
+void latencia_borra(void)
+{
+    Latencia *l;
+    int i;
+
+    for (i = 0; i < LATENCIA_HASH; i++) {
+	for (l = latencias[i]; l; l = l->next) {
+	    l->cuenta = 0;
+	    l->total = l->max = 0;
+	    memset(l->cubos, 0, sizeof(l->cubos));
+	    l->muestras = 0;
+	}
+    }
+    for (i = 0; i < PERFIL_FASES; i++)
+	perfil_fases[i] = 0;
+    perfil_total = 0;
+    perfil_desde = time(NULL);
+    memset(lineas_lentas, 0, sizeof(lineas_lentas));
+    lineas_lentas_pos = 0;
+}
+
+/*************************************************************************/
+
+/* Escribe los histogramas en LatenciaFichero, una linea por entrada:
+ *
+ *	servicio comando cuenta total max p50 p99 cubo0 ... cubo31
+ *
+ * con los tiempos en microsegundos.  Se escribe en un temporal y se
+ * renombra, para que quien lo lea nunca vea un fichero a medias. */
+
+void latencia_vuelca(void)
+{
+    static time_t lastwarn = 0;
+    char tmp[PATH_MAX];
+    Latencia *l;
+    FILE *fp;
+    int i, j;
+
+    snprintf(tmp, sizeof(tmp), "%s.tmp", LatenciaFichero);
+    if (!(fp = fopen(tmp, "w"))) {
+	log_perror("Can't write %s", tmp);
+	return;
+    }
+    fprintf(fp, "# %ld servicio comando cuenta total_us max_us p50_us p99_us"
+		" cubos[%d]\n", (long)time(NULL), LATENCIA_CUBOS);
+    for (i = 0; i < LATENCIA_HASH; i++) {
+	for (l = latencias[i]; l; l = l->next) {
+	    if (!l->cuenta)
+		continue;
+	    fprintf(fp, "%s %s %lu %lld %lld %lld %lld", l->servicio,
+		    l->comando, (unsigned long)l->cuenta, (long long)l->total,
+		    (long long)l->max, (long long)latencia_percentil(l, 50),
+		    (long long)latencia_percentil(l, 99));
+	    for (j = 0; j < LATENCIA_CUBOS; j++)
+		fprintf(fp, " %lu", (unsigned long)l->cubos[j]);
+	    fputc('\n', fp);
+	}
+    }
+    if (fclose(fp) == EOF || rename(tmp, LatenciaFichero) < 0) {
+	log_perror("Write error on %s", LatenciaFichero);
+	if (time(NULL) - lastwarn > WarningTimeout) {
+	    canalopers(NULL, "Write error on %s: %s", LatenciaFichero,
+			strerror(errno));
+	    lastwarn = time(NULL);
+	}
+	unlink(tmp);
+    }
+}
+
+/*************************************************************************/
+/*************************************************************************/
+
+/* Marca que empieza a ejecutarse el comando de `l', dentro del que
+ * estuviera en curso. */
+
+void perfil_entra(Latencia *l)
+{
+    if (perfil_nivel == 0)
+	perfil_hondo = 0;
+    if (perfil_nivel < PERFIL_PILA) {
+	perfil_pila[perfil_nivel] = l;
+	perfil_hondo = perfil_nivel+1;
+	perfil_actual = l;
+    }
+    perfil_nivel++;
+}
+
+void perfil_sale(void)
+{
+    if (perfil_nivel > 0)
+	perfil_nivel--;
+    if (perfil_nivel == 0)
+	perfil_actual = NULL;
+    else if (perfil_nivel <= PERFIL_PILA)
+	perfil_actual = perfil_pila[perfil_nivel-1];
+}
+
+/*************************************************************************/
+
+/* Guarda `linea' en lineas_lentas[] con la ruta que siguio la ultima vez
+ * que se llamo a perfil_entra() desde fuera.  Si `privado' es 1 la linea
+ * es un PRIVMSG a un *Serv: se guarda solo la primera palabra del texto,
+ * para no apuntar claves. */
+
+void linea_lenta(int64 usado, const char *linea, int privado)
+{
+    LentaData *ll = &lineas_lentas[lineas_lentas_pos];
+    char *s;
+    int i, n;
+
+    lineas_lentas_pos = (lineas_lentas_pos+1) % LENTAS_MAX;
+    ll->time = time(NULL);
+    ll->usado = usado;
+    *ll->ruta = 0;
+    for (i = 0, n = 0; i < perfil_hondo && n < (int)sizeof(ll->ruta); i++) {
+	n += snprintf(ll->ruta+n, sizeof(ll->ruta)-n, "%s%s %s",
+		      i ? " > " : "", perfil_pila[i]->servicio,
+		      perfil_pila[i]->comando);
+    }
+    strscpy(ll->linea, linea, sizeof(ll->linea));
+    if (privado && (s = strstr(ll->linea, " :")) && (s = strchr(s+2, ' ')))
+	strscpy(s, " ...", sizeof(ll->linea) - (s - ll->linea));
+}
+
+/*************************************************************************/
+
+static void perfil_senal(int signum)
+{
+    Latencia *l = perfil_actual;
+    int w = waiting;
+
+    perfil_total++;
+    if (l)
+	l->muestras++;
+    else if (w < 0 && -w < PERFIL_FASES)
+	perfil_fases[-w]++;
+    else
+	perfil_fases[0]++;
+}
+
+/* Arranca (o para, con `ms' 0) el muestreo cada `ms' milisegundos de CPU.
+ * Devuelve 0 si no se pudo programar el temporizador. */
+
+int perfil_arranca(int ms)
+{
+    struct sigaction sa;
+    struct itimerval it;
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = ms ? perfil_senal : SIG_IGN;
+    sa.sa_flags = SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGPROF, &sa, NULL);
+    it.it_interval.tv_sec = ms / 1000;
+    it.it_interval.tv_usec = ms % 1000 * 1000;
+    it.it_value = it.it_interval;
+    if (setitimer(ITIMER_PROF, &it, NULL) < 0) {
+	log_perror("setitimer(ITIMER_PROF)");
+	perfil_ms = 0;
+	return 0;
+    }
+    perfil_ms = ms;
+    if (!perfil_desde)
+	perfil_desde = time(NULL);
+    return 1;
+}
+
+/* Datos del muestreo para OperServ PERFIL.  Devuelve el intervalo actual
+ * en ms (0 si esta parado); en *total deja las muestras tomadas y en
+ * fases[] (de PERFIL_FASES elementos) las de cada fase del bucle. */
+
+int perfil_estado(uint32 *total, uint32 *fases)
+{
+    int i;
+
+    *total = perfil_total;
+    for (i = 0; i < PERFIL_FASES; i++)
+	fases[i] = perfil_fases[i];
+    return perfil_ms;
+}
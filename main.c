@@ -53,11 +53,13 @@ int save_data = 0;
 /* At what time were we started? */
 time_t start_time;
 
+/* What the main loop is doing: 0 = processing a line, 1 = waiting for
+ * input, negative = the routine named by nombre_fase().  Also read by the
+ * profiler (latencia.c). */
+int waiting = 0;
 
-/******** Local variables! ********/
 
-/* Set to 1 if we are waiting for input */
-static int waiting = 0;
+/******** Local variables! ********/
 
 /* Set to 1 after we've set everything up */
 static int started = 0;
@@ -67,6 +69,88 @@ static jmp_buf panic_jmp;
 
 /*************************************************************************/
 
+/* Describe what the main loop is doing for a given value of `waiting'.
+ * Returns a static buffer. */
+
+const char *nombre_fase(int fase)
+{
+    /* This is static on the off-chance we run low on stack */
+    static char buf[BUFSIZE];
+
+    switch (fase) {
+	case   1: snprintf(buf, sizeof(buf), "waiting for input");
+		  break;
+	case   0: snprintf(buf, sizeof(buf), "processing input");
+		  break;
+	case  -1: snprintf(buf, sizeof(buf), "in timed_update");
+		  break;
+	case  -2: snprintf(buf, sizeof(buf), "saving databases");
+		  break;
+	case  -3: snprintf(buf, sizeof(buf), "syncing BDD serials");
+		  break;
+	case  -4: snprintf(buf, sizeof(buf), "in the main loop");
+		  break;
+	case  -5: snprintf(buf, sizeof(buf), "processing SQL results");
+		  break;
+	case  -6: snprintf(buf, sizeof(buf), "running the port scanner");
+		  break;
+	case  -7: snprintf(buf, sizeof(buf), "expiring timed entries");
+		  break;
+	case  -8: snprintf(buf, sizeof(buf), "sending staff channel notices");
+		  break;
+	case  -9: snprintf(buf, sizeof(buf), "saving %s", LatenciaFichero);
+		  break;
+	case -10: snprintf(buf, sizeof(buf), "saving %s", MemoDBName);
+		  break;
+	case -11: snprintf(buf, sizeof(buf), "saving %s", NickDBName);
+		  break;
+	case -12: snprintf(buf, sizeof(buf), "saving %s", ChanDBName);
+		  break;
+	case -13: snprintf(buf, sizeof(buf), "saving %s", CregDBName);
+		  break;
+	case -14: snprintf(buf, sizeof(buf), "saving %s", OperDBName);
+		  break;
+	case -15: snprintf(buf, sizeof(buf), "saving %s", AutokillDBName);
+		  break;
+	case -16: snprintf(buf, sizeof(buf), "saving %s", NewsDBName);
+		  break;
+	case -17: snprintf(buf, sizeof(buf), "saving %s", SpamDBName);
+		  break;
+	case -18: snprintf(buf, sizeof(buf), "saving %s", IpVirtualDBName);
+		  break;
+	case -19: snprintf(buf, sizeof(buf), "saving %s", JokuDBName);
+		  break;
+	case -20: snprintf(buf, sizeof(buf), "checking the web tables");
+		  break;
+	case -21: snprintf(buf, sizeof(buf), "expiring nicknames");
+		  break;
+	case -22: snprintf(buf, sizeof(buf), "expiring channels");
+		  break;
+	case -23: snprintf(buf, sizeof(buf), "expiring the scanner cache");
+		  break;
+	case -24: snprintf(buf, sizeof(buf), "saving %s", XDBName);
+		  break;
+	case -25: snprintf(buf, sizeof(buf), "expiring autokills");
+		  break;
+	case -26: snprintf(buf, sizeof(buf), "saving %s", AutoregistraDBName);
+		  break;
+	case -27: snprintf(buf, sizeof(buf), "saving %s", AutolimitDBName);
+		  break;
+	case -28: snprintf(buf, sizeof(buf), "saving %s", NickSuspendsDBName);
+		  break;
+	case -29: snprintf(buf, sizeof(buf), "saving %s", AutochanakickDBName);
+		  break;
+	case -30: snprintf(buf, sizeof(buf), "saving %s", BddDBName);
+		  break;
+	case -31: snprintf(buf, sizeof(buf), "sending stacked channel modes");
+		  break;
+	default : snprintf(buf, sizeof(buf), "waiting=%d", fase);
+    }
+    return buf;
+}
+
+/*************************************************************************/
+
 /* If we get a weird signal, come here. */
 
 void sighandler(int signum)
@@ -99,31 +183,7 @@ void sighandler(int signum)
 	    }
 	    canalopers(NULL, "PANIC! buffer = %s\r\n", inbuf);
 	} else if (waiting < 0) {
-	    /* This is static on the off-chance we run low on stack */
-	    static char buf[BUFSIZE];
-	    switch (waiting) {
-		case  -1: snprintf(buf, sizeof(buf), "in timed_update");
-		          break;
-		case -11: snprintf(buf, sizeof(buf), "saving %s", NickDBName);
-		          break;
-		case -12: snprintf(buf, sizeof(buf), "saving %s", ChanDBName);
-		          break;
-		case -14: snprintf(buf, sizeof(buf), "saving %s", OperDBName);
-		          break;
-		case -15: snprintf(buf, sizeof(buf), "saving %s", AutokillDBName);
-		          break;
-		case -16: snprintf(buf, sizeof(buf), "saving %s", NewsDBName);
-		          break;
-		case -21: snprintf(buf, sizeof(buf), "expiring nicknames");
-		          break;
-		case -22: snprintf(buf, sizeof(buf), "expiring channels");
-		          break;
-	        case -24: snprintf(buf, sizeof(buf), "saving %s", XDBName);
-		          break;
-		case -25: snprintf(buf, sizeof(buf), "expiring autokills");
-		          break;
-		default : snprintf(buf, sizeof(buf), "waiting=%d", waiting);
-	    }
+	    const char *buf = nombre_fase(waiting);
 	    canalopers(NULL, "PANIC! %s (%s)", buf, strsignal(signum));
 	    logeo("PANIC! %s (%s)", buf, strsignal(signum));
 	}
@@ -151,7 +211,10 @@ void sighandler(int signum)
 
 /*************************************************************************/
 
-/* Main routine.  (What does it look like? :-) ) */
+/* Main routine.  (What does it look like? :-) )  replay-bench brings its
+ * own (replay.c). */
+
+#if !defined(REPLAY_BENCH)
 
 int main(int ac, char **av, char **envp)
 {
@@ -223,11 +286,10 @@ int main(int ac, char **av, char **envp)
 		waiting = -23;
                 /*expire_creg();*/
 	    }
-	    waiting = -25;
-	    expire_akills();
-            expire_aregistras();
-	    expire_alimits();
-	    expire_anicks();
+	    /* AKILL, AREGISTRA, ALIMIT y ANICK caducan en expset_run() */
+#if defined(SOPORTE_SCANNER)
+	    expire_scanner();
+#endif
 	
 	    
             
@@ -246,6 +308,8 @@ int main(int ac, char **av, char **envp)
 		save_cs_dbase();
 		waiting = -13;
                 save_cr_dbase();
+		waiting = -10;
+		save_memos();
 	    }
 	  
 	    waiting = -14;
@@ -260,16 +324,20 @@ int main(int ac, char **av, char **envp)
 	    save_ipv();
 	    waiting = -19;
 	    save_jok_dbase();
-           waiting = -20;
+           waiting = -26;
 	    save_aregistra();
-	   waiting = -21;
+	   waiting = -27;
 	  save_alimit();
-           waiting = -22;
+           waiting = -28;
 	  save_anick();
-	  waiting = -23;
+	  waiting = -29;
 	  save_achanakick();
 	  waiting = -24;
           /*save_x_dbase();*/
+	    waiting = -30;
+	    save_bdd_local();
+	    waiting = -9;
+	    latencia_vuelca();
              
 	    if (save_data < 0)
 		break;	/* out of main loop */
@@ -284,6 +352,26 @@ int main(int ac, char **av, char **envp)
 	    check_timeouts();
 	    last_check = t;
 	}
+#if defined(SOPORTE_JOOMLA15)
+	waiting = -5;
+	sql_process();
+#endif
+#if defined(SOPORTE_SCANNER)
+	waiting = -6;
+	scanner_process();
+#endif
+	if (!readonly) {
+	    waiting = -7;
+	    expset_run();
+	}
+	waiting = -31;
+	modos_envia();
+#if defined(IRC_BDD)
+	waiting = -3;
+	bdd_fin_lote();
+#endif
+	waiting = -8;
+	avisos_envia();
 	waiting = 1;
 	i = (int)(long)sgets2(inbuf, sizeof(inbuf), servsock);
 	waiting = 0;
@@ -303,6 +391,13 @@ int main(int ac, char **av, char **envp)
 	waiting = -4;
     }
 
+#if defined(SOPORTE_JOOMLA15)
+    sql_shutdown();
+#endif
+
+    /* Lo que quede en las colas sale antes del SQUIT */
+    modos_envia();
+    avisos_vacia();
 
     /* Check for restart instead of exit */
     if (save_data == -2) {
@@ -335,4 +430,6 @@ int main(int ac, char **av, char **envp)
     return 0;
 }
 
+#endif	/* !REPLAY_BENCH */
+
 /*************************************************************************/
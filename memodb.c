@@ -0,0 +1,722 @@
+/* Almacen de memos en disco.
+ *
+ * Services is copyright (c) 1996-1999 Andy Church.
+ *     E-mail: <achurch@dragonfire.net>
+ * This program is free but copyrighted software; see the file COPYING for
+ * details.
+ *
+ * Los memos ya no van dentro de nick.db/chan.db (que se reescribian enteros
+ * en cada grabacion, con todos los textos cargados en memoria).  Ahora hay
+ * un fichero aparte (MemoDB) al que solo se le anaden registros:
+ *
+ *	ALTA	id, dueno, numero, flags, hora, remitente, texto
+ *	BAJA	id
+ *	FLAGS	id, flags
+ *	NUMERO	id, numero
+ *
+ * En memoria cada MemoInfo guarda solo un indice (id, numero y posicion del
+ * ALTA en el fichero) y un mapa de bits de no leidos.  Los textos se leen
+ * del disco con memo_carga() cuando un comando de MemoServ los necesita, y
+ * memo_descarga_todo() los libera al acabar el comando.  Cuando el fichero
+ * tiene mas del doble de registros que memos vivos, save_memos() lo
+ * reescribe solo con los vivos.
+ */
+
+#include "services.h"
+#include "datafiles.h"
+
+#define MEMO_ALTA	1
+#define MEMO_BAJA	2
+#define MEMO_FLAGS	3
+#define MEMO_NUMERO	4
+
+#define MEMO_COMPACTA	1000	/* No compactar por debajo de estos registros */
+
+#define NO_LEIDO(mi,i)		((mi)->unread[(i)>>5] & (1U << ((i)&31)))
+#define PON_NO_LEIDO(mi,i)	((mi)->unread[(i)>>5] |= (1U << ((i)&31)))
+#define QUITA_NO_LEIDO(mi,i)	((mi)->unread[(i)>>5] &= ~(1U << ((i)&31)))
+
+static dbFILE *memofile = NULL;
+static int32 siguiente_id = 1;
+static int32 nregistros = 0;	/* Registros en el fichero */
+static int32 nvivos = 0;	/* Memos vivos con copia en el fichero */
+
+static MemoInfo *memoinfos = NULL;	/* MemoInfos con algun memo */
+static MemoInfo *cargados = NULL;	/* MemoInfos con los textos en memoria */
+
+/* Memos leidos de nick.db/chan.db antiguos, pendientes de pasar a MemoDB */
+typedef struct memoimport_ MemoImport;
+struct memoimport_ {
+    MemoImport *next;
+    MemoInfo *mi;
+    char *owner;
+    int16 count;
+    Memo *memos;
+};
+static MemoImport *importados = NULL;
+
+/*************************************************************************/
+/*************************************************************************/
+
+static void error_escritura(void)
+{
+    static time_t lastwarn = 0;
+
+    log_perror("Write error on %s", MemoDBName);
+    if (time(NULL) - lastwarn > WarningTimeout) {
+	canalopers(NULL, "Write error on %s: %s", MemoDBName,
+			strerror(errno));
+	lastwarn = time(NULL);
+    }
+}
+
+static int abre_memos(void)
+{
+    FILE *fp;
+
+    if (memofile)
+	return 1;
+    if (!(fp = fopen(MemoDBName, readonly ? "rb" : "a+b"))) {
+	if (!readonly || errno != ENOENT)
+	    log_perror("Can't open %s", MemoDBName);
+	return 0;
+    }
+    memofile = scalloc(1, sizeof(dbFILE));
+    memofile->mode = 'a';
+    memofile->fp = fp;
+    strscpy(memofile->filename, MemoDBName, sizeof(memofile->filename));
+    return 1;
+}
+
+/* Prepara el fichero para anadir un registro.  Devuelve la posicion donde
+ * empezara, o -1 si no se puede escribir. */
+
+static long empieza_registro(void)
+{
+    if (readonly || !memofile)
+	return -1;
+    if (fseek(memofile->fp, 0, SEEK_END) < 0)
+	return -1;
+    return ftell(memofile->fp);
+}
+
+static int acaba_registro(int error)
+{
+    if (fflush(memofile->fp) == EOF)
+	error = 1;
+    if (error) {
+	error_escritura();
+	clearerr(memofile->fp);
+	return 0;
+    }
+    nregistros++;
+    return 1;
+}
+
+static int escribe_alta(dbFILE *f, int32 id, const char *owner, Memo *m)
+{
+    return write_int8(MEMO_ALTA, f) < 0
+	|| write_int32(id, f) < 0
+	|| write_string(owner, f) < 0
+	|| write_int32(m->number, f) < 0
+	|| write_int16(m->flags, f) < 0
+	|| write_int32(m->time, f) < 0
+	|| !write_buffer(m->sender, f)
+	|| write_string(m->text, f) < 0;
+}
+
+/* Escribe un registro de dos campos (BAJA, FLAGS o NUMERO). */
+
+static void escribe_cambio(int tipo, int32 id, int32 valor)
+{
+    int error;
+
+    if (empieza_registro() < 0)
+	return;
+    error = write_int8(tipo, memofile) < 0 || write_int32(id, memofile) < 0;
+    if (!error && tipo == MEMO_FLAGS)
+	error = write_int16(valor, memofile) < 0;
+    else if (!error && tipo == MEMO_NUMERO)
+	error = write_int32(valor, memofile) < 0;
+    acaba_registro(error);
+}
+
+/* Lee el ALTA que hay en `offset'.  Devuelve 1 si es correcto. */
+
+static int lee_alta(dbFILE *f, long offset, int32 id, char **owner, Memo *m)
+{
+    int tipo;
+    int32 tmp32, leido;
+
+    *owner = NULL;
+    m->text = NULL;
+    if (!f || offset < 0 || fseek(f->fp, offset, SEEK_SET) < 0)
+	return 0;
+    if (read_int8(&tipo, f) < 0 || tipo != MEMO_ALTA
+	    || read_int32(&leido, f) < 0 || leido != id
+	    || read_string(owner, f) < 0
+	    || read_int32(&tmp32, f) < 0
+	    || read_int16(&m->flags, f) < 0
+	    || read_int32(&tmp32, f) < 0
+	    || !read_buffer(m->sender, f)
+	    || read_string(&m->text, f) < 0) {
+	if (*owner)
+	    free(*owner);
+	*owner = NULL;
+	return 0;
+    }
+    m->time = tmp32;
+    return 1;
+}
+
+/*************************************************************************/
+
+static void enlaza_memoinfo(MemoInfo *mi)
+{
+    mi->prev = NULL;
+    mi->next = memoinfos;
+    if (memoinfos)
+	memoinfos->prev = mi;
+    memoinfos = mi;
+}
+
+static void desenlaza_memoinfo(MemoInfo *mi)
+{
+    if (mi->prev)
+	mi->prev->next = mi->next;
+    else
+	memoinfos = mi->next;
+    if (mi->next)
+	mi->next->prev = mi->prev;
+    mi->next = mi->prev = NULL;
+}
+
+static void quita_cargado(MemoInfo *mi)
+{
+    MemoInfo **pmi;
+
+    for (pmi = &cargados; *pmi; pmi = &(*pmi)->cargado_sig) {
+	if (*pmi == mi) {
+	    *pmi = mi->cargado_sig;
+	    break;
+	}
+    }
+    mi->cargado_sig = NULL;
+}
+
+/* Anade una entrada al final del indice. */
+
+static void mi_anade(MemoInfo *mi, int32 id, uint32 number, long offset,
+		     int unread)
+{
+    if (mi->memocount == 0)
+	enlaza_memoinfo(mi);
+    if (mi->memocount % 32 == 0)
+	mi->unread = srealloc(mi->unread,
+			sizeof(uint32) * (mi->memocount/32 + 1));
+    mi->idx = srealloc(mi->idx, sizeof(MemoIdx) * (mi->memocount+1));
+    mi->idx[mi->memocount].id = id;
+    mi->idx[mi->memocount].number = number;
+    mi->idx[mi->memocount].offset = offset;
+    if (unread) {
+	PON_NO_LEIDO(mi, mi->memocount);
+	mi->unreadcount++;
+    } else {
+	QUITA_NO_LEIDO(mi, mi->memocount);
+    }
+    mi->memocount++;
+    if (offset >= 0)
+	nvivos++;
+}
+
+/* Anade un memo ya construido (el MemoInfo se queda con m->text).  Si no
+ * se ha podido escribir en el fichero, el memo se queda en memoria. */
+
+static void anade_memo(MemoInfo *mi, const char *owner, Memo *m)
+{
+    long offset = empieza_registro();
+
+    if (offset >= 0 && !acaba_registro(
+			escribe_alta(memofile, siguiente_id, owner, m)))
+	offset = -1;
+    if (offset < 0 && !mi->memos && mi->memocount)
+	memo_carga(mi);
+    mi_anade(mi, siguiente_id++, m->number, offset, m->flags & MF_UNREAD);
+    if (mi->memos || offset < 0) {
+	if (!mi->memos) {
+	    mi->cargado_sig = cargados;
+	    cargados = mi;
+	}
+	mi->memos = srealloc(mi->memos, sizeof(Memo) * mi->memocount);
+	mi->memos[mi->memocount-1] = *m;
+    } else {
+	free(m->text);
+    }
+}
+
+/*************************************************************************/
+/************************** Funciones externas ***************************/
+/*************************************************************************/
+
+/* Llamado al leer nick.db/chan.db de antes de MemoDB: aparta los memos que
+ * traian para pasarlos al fichero nuevo en load_memos(). */
+
+void memo_importa(MemoInfo *mi, const char *owner)
+{
+    MemoImport *imp;
+
+    if (!mi->memocount)
+	return;
+    imp = scalloc(1, sizeof(MemoImport));
+    imp->mi = mi;
+    imp->owner = sstrdup(owner);
+    imp->count = mi->memocount;
+    imp->memos = mi->memos;
+    mi->memocount = 0;
+    mi->memos = NULL;
+    imp->next = importados;
+    importados = imp;
+}
+
+/*************************************************************************/
+
+/* Devuelve el MemoInfo del dueno de un memo guardado en el fichero. */
+
+static MemoInfo *memo_dueno(const char *owner)
+{
+    ChannelInfo *ci;
+    NickInfo *ni;
+
+    if (*owner == '#')
+	return (ci = cs_findchan(owner)) ? &ci->memos : NULL;
+    return (ni = findnick(owner)) ? &ni->memos : NULL;
+}
+
+void load_memos(void)
+{
+    struct memocarga {
+	char *owner;
+	uint32 number;
+	int16 flags;
+	long offset;
+    } *tabla = NULL, *mc;
+    int32 ntabla = 0, id, tmp32, hora, i;
+    int tipo, error = 0, nimport = 0;
+    int16 tmp16;
+    uint16 len;
+    long pos, fin;
+    Memo m;
+    char *owner;
+    FILE *fp;
+    MemoImport *imp;
+    MemoInfo *mi;
+
+    if (!abre_memos()) {
+	if (!readonly)
+	    fatal("Can't open %s", MemoDBName);
+    } else {
+	fp = memofile->fp;
+	fseek(fp, 0, SEEK_END);
+	fin = ftell(fp);
+	fseek(fp, 0, SEEK_SET);
+	if (fin == 0) {
+	    if (!readonly && (!write_file_version(memofile)
+				|| fflush(fp) == EOF))
+		fatal("Write error on %s", MemoDBName);
+	} else if (!get_file_version(memofile)) {
+	    fatal("Unsupported version number on %s", MemoDBName);
+	}
+	for (;;) {
+	    pos = ftell(fp);
+	    if (read_int8(&tipo, memofile) < 0)
+		break;
+	    if (read_int32(&id, memofile) < 0 || id < 1) {
+		error = 1;
+		break;
+	    }
+	    if (id >= ntabla) {
+		int32 nuevo = ntabla ? ntabla : 1024;
+		while (nuevo <= id)
+		    nuevo *= 2;
+		tabla = srealloc(tabla, sizeof(*tabla) * nuevo);
+		memset(tabla + ntabla, 0, sizeof(*tabla) * (nuevo - ntabla));
+		ntabla = nuevo;
+	    }
+	    mc = &tabla[id];
+	    if (tipo == MEMO_ALTA) {
+		if (read_string(&owner, memofile) < 0) {
+		    error = 1;
+		    break;
+		}
+		if (read_int32(&tmp32, memofile) < 0
+			|| read_int16(&tmp16, memofile) < 0
+			|| read_int32(&hora, memofile) < 0
+			|| !read_buffer(m.sender, memofile)
+			|| read_int16((int16 *)&len, memofile) < 0
+			|| fseek(fp, len, SEEK_CUR) < 0 || ftell(fp) > fin) {
+		    if (owner)
+			free(owner);
+		    error = 1;
+		    break;
+		}
+		if (mc->owner)
+		    free(mc->owner);
+		mc->owner = owner;
+		mc->number = tmp32;
+		mc->flags = tmp16;
+		mc->offset = pos;
+	    } else if (tipo == MEMO_BAJA) {
+		if (mc->owner)
+		    free(mc->owner);
+		mc->owner = NULL;
+	    } else if (tipo == MEMO_FLAGS) {
+		if (read_int16(&tmp16, memofile) < 0) {
+		    error = 1;
+		    break;
+		}
+		mc->flags = tmp16;
+	    } else if (tipo == MEMO_NUMERO) {
+		if (read_int32(&tmp32, memofile) < 0) {
+		    error = 1;
+		    break;
+		}
+		mc->number = tmp32;
+	    } else {
+		error = 1;
+		break;
+	    }
+	    nregistros++;
+	    if (mc - tabla >= siguiente_id)
+		siguiente_id = mc - tabla + 1;
+	}
+	if (error) {
+	    logeo("%s: registro incompleto en la posicion %ld, se descarta"
+		  " el resto", MemoDBName, pos);
+	    if (!readonly) {
+		fflush(fp);
+		if (ftruncate(fileno(fp), pos) < 0)
+		    log_perror("Can't truncate %s", MemoDBName);
+	    }
+	}
+    }
+
+    /* Se reparten por orden de id, que es el orden en que llegaron. */
+    for (id = 1; id < ntabla; id++) {
+	mc = &tabla[id];
+	if (!mc->owner)
+	    continue;
+	if ((mi = memo_dueno(mc->owner))) {
+	    mi_anade(mi, id, mc->number, mc->offset, mc->flags & MF_UNREAD);
+	} else {
+	    if (debug)
+		logeo("debug: %s: memo %d de %s sin dueno", MemoDBName, id,
+			mc->owner);
+	    escribe_cambio(MEMO_BAJA, id, 0);
+	}
+	free(mc->owner);
+    }
+    free(tabla);
+
+    while ((imp = importados)) {
+	importados = imp->next;
+	for (i = 0; i < imp->count; i++)
+	    anade_memo(imp->mi, imp->owner, &imp->memos[i]);
+	nimport += imp->count;
+	free(imp->memos);
+	free(imp->owner);
+	free(imp);
+    }
+    if (nimport && !readonly) {
+	logeo("Pasados %d memos de %s/%s a %s", nimport, NickDBName,
+		ChanDBName, MemoDBName);
+	save_ns_dbase();
+	save_cs_dbase();
+    }
+}
+
+/*************************************************************************/
+
+/* Reescribe el fichero solo con los memos vivos. */
+
+static void compacta_memos(void)
+{
+    dbFILE *f;
+    MemoInfo *mi;
+    Memo m;
+    char *owner;
+    long *offsets;
+    int32 n = 0, i;
+    int error = 0;
+
+    offsets = smalloc(sizeof(long) * (nvivos + 1));
+    if (!(f = open_db(s_MemoServ, MemoDBName, "w"))) {
+	free(offsets);
+	return;
+    }
+    for (mi = memoinfos; mi && !error; mi = mi->next) {
+	for (i = 0; i < mi->memocount && !error; i++) {
+	    if (mi->idx[i].offset < 0)	/* Solo en memoria */
+		continue;
+	    if (!lee_alta(memofile, mi->idx[i].offset, mi->idx[i].id,
+			  &owner, &m)) {
+		logeo("%s: no se puede leer el memo %d al compactar",
+			MemoDBName, mi->idx[i].id);
+		error = 1;
+		break;
+	    }
+	    m.number = mi->idx[i].number;
+	    m.flags = NO_LEIDO(mi, i) ? MF_UNREAD : 0;
+	    offsets[n] = ftell(f->fp);
+	    n++;
+	    if (escribe_alta(f, n, owner, &m))
+		error = 2;
+	    free(owner);
+	    if (m.text)
+		free(m.text);
+	}
+    }
+    if (error || fflush(f->fp) == EOF) {
+	if (error != 1)
+	    error_escritura();
+	restore_db(f);
+	free(offsets);
+	return;
+    }
+    close_db(f);
+    fclose(memofile->fp);
+    free(memofile);
+    memofile = NULL;
+    if (!abre_memos()) {
+	free(offsets);
+	return;
+    }
+    n = 0;
+    for (mi = memoinfos; mi; mi = mi->next) {
+	for (i = 0; i < mi->memocount; i++) {
+	    if (mi->idx[i].offset < 0)
+		continue;
+	    mi->idx[i].id = ++n;
+	    mi->idx[i].offset = offsets[n-1];
+	}
+    }
+    free(offsets);
+    siguiente_id = n + 1;
+    nregistros = nvivos = n;
+}
+
+/* Llamado desde el bucle principal al grabar las bases de datos. */
+
+void save_memos(void)
+{
+    if (!memofile)
+	return;
+    if (nregistros > MEMO_COMPACTA && nregistros > nvivos*2)
+	compacta_memos();
+}
+
+/*************************************************************************/
+
+/* Envia un memo nuevo.  `owner' es el nombre con el que se encontrara el
+ * MemoInfo al arrancar.  Devuelve el numero del memo. */
+
+uint32 memo_anade(MemoInfo *mi, const char *owner, const char *sender,
+		  const char *text)
+{
+    Memo m;
+    int i;
+
+    if (mi->memocount > 0) {
+	m.number = mi->idx[mi->memocount-1].number + 1;
+	if (m.number < 1) {
+	    for (i = 0; i < mi->memocount; i++) {
+		mi->idx[i].number = i+1;
+		if (mi->memos)
+		    mi->memos[i].number = i+1;
+		if (mi->idx[i].offset >= 0)
+		    escribe_cambio(MEMO_NUMERO, mi->idx[i].id, i+1);
+	    }
+	    m.number = mi->memocount+1;
+	}
+    } else {
+	m.number = 1;
+    }
+    strscpy(m.sender, sender, NICKMAX);
+    m.time = time(NULL);
+    m.text = sstrdup(text);
+    m.flags = MF_UNREAD;
+    anade_memo(mi, owner, &m);
+    return m.number;
+}
+
+/*************************************************************************/
+
+/* Trae del disco los textos de un MemoInfo.  Se liberan con
+ * memo_descarga_todo() al acabar el comando. */
+
+void memo_carga(MemoInfo *mi)
+{
+    Memo *m;
+    char *owner;
+    int i;
+
+    if (mi->memos || !mi->memocount)
+	return;
+    mi->memos = scalloc(mi->memocount, sizeof(Memo));
+    for (i = 0; i < mi->memocount; i++) {
+	m = &mi->memos[i];
+	if (lee_alta(memofile, mi->idx[i].offset, mi->idx[i].id, &owner, m)) {
+	    free(owner);
+	} else {
+	    logeo("%s: no se puede leer el memo %d", MemoDBName,
+		    mi->idx[i].id);
+	    strscpy(m->sender, "?", NICKMAX);
+	    m->time = 0;
+	    m->text = sstrdup("(memo ilegible)");
+	}
+	m->number = mi->idx[i].number;
+	m->flags = NO_LEIDO(mi, i) ? MF_UNREAD : 0;
+    }
+    mi->cargado_sig = cargados;
+    cargados = mi;
+}
+
+static void libera_textos(MemoInfo *mi)
+{
+    int i;
+
+    if (!mi->memos)
+	return;
+    for (i = 0; i < mi->memocount; i++) {
+	if (mi->memos[i].text)
+	    free(mi->memos[i].text);
+    }
+    free(mi->memos);
+    mi->memos = NULL;
+}
+
+/* Libera los textos cargados, salvo los de memos que solo estan en memoria
+ * (modo readonly o error de escritura). */
+
+void memo_descarga_todo(void)
+{
+    MemoInfo *mi, *fijos = NULL;
+    int i;
+
+    while ((mi = cargados)) {
+	cargados = mi->cargado_sig;
+	for (i = 0; i < mi->memocount; i++) {
+	    if (mi->idx[i].offset < 0)
+		break;
+	}
+	if (i < mi->memocount) {
+	    mi->cargado_sig = fijos;
+	    fijos = mi;
+	} else {
+	    libera_textos(mi);
+	    mi->cargado_sig = NULL;
+	}
+    }
+    cargados = fijos;
+}
+
+/*************************************************************************/
+
+/* Borra el memo en la posicion `index'. */
+
+void memo_borra(MemoInfo *mi, int index)
+{
+    int i;
+
+    if (index < 0 || index >= mi->memocount)
+	return;
+    if (mi->memocount == 1) {
+	memo_borra_todos(mi);
+	return;
+    }
+    if (mi->idx[index].offset >= 0) {
+	escribe_cambio(MEMO_BAJA, mi->idx[index].id, 0);
+	nvivos--;
+    }
+    if (NO_LEIDO(mi, index))
+	mi->unreadcount--;
+    mi->memocount--;
+    memmove(mi->idx + index, mi->idx + index+1,
+		sizeof(MemoIdx) * (mi->memocount - index));
+    for (i = index; i < mi->memocount; i++) {
+	if (NO_LEIDO(mi, i+1))
+	    PON_NO_LEIDO(mi, i);
+	else
+	    QUITA_NO_LEIDO(mi, i);
+    }
+    if (mi->memos) {
+	free(mi->memos[index].text);
+	memmove(mi->memos + index, mi->memos + index+1,
+		sizeof(Memo) * (mi->memocount - index));
+    }
+}
+
+/* Borra todos los memos (DEL ALL, o al borrar el nick o el canal). */
+
+void memo_borra_todos(MemoInfo *mi)
+{
+    int i;
+
+    if (!mi->memocount)
+	return;
+    for (i = 0; i < mi->memocount; i++) {
+	if (mi->idx[i].offset >= 0) {
+	    escribe_cambio(MEMO_BAJA, mi->idx[i].id, 0);
+	    nvivos--;
+	}
+    }
+    if (mi->memos) {
+	quita_cargado(mi);
+	libera_textos(mi);
+    }
+    desenlaza_memoinfo(mi);
+    free(mi->idx);
+    free(mi->unread);
+    mi->idx = NULL;
+    mi->unread = NULL;
+    mi->memocount = 0;
+    mi->unreadcount = 0;
+}
+
+/* Marca como leido el memo en la posicion `index'. */
+
+void memo_leido(MemoInfo *mi, int index)
+{
+    if (index < 0 || index >= mi->memocount || !NO_LEIDO(mi, index))
+	return;
+    QUITA_NO_LEIDO(mi, index);
+    mi->unreadcount--;
+    if (mi->memos)
+	mi->memos[index].flags &= ~MF_UNREAD;
+    if (mi->idx[index].offset >= 0)
+	escribe_cambio(MEMO_FLAGS, mi->idx[index].id, 0);
+}
+
+int memo_no_leido(MemoInfo *mi, int index)
+{
+    return index >= 0 && index < mi->memocount && NO_LEIDO(mi, index);
+}
+
+/* Memoria usada por un MemoInfo (indice, mapa de bits y textos cargados). */
+
+long memo_mem(MemoInfo *mi)
+{
+    long mem;
+    int i;
+
+    mem = mi->memocount * sizeof(MemoIdx);
+    if (mi->memocount)
+	mem += sizeof(uint32) * ((mi->memocount+31) / 32);
+    if (mi->memos) {
+	mem += mi->memocount * sizeof(Memo);
+	for (i = 0; i < mi->memocount; i++) {
+	    if (mi->memos[i].text)
+		mem += strlen(mi->memos[i].text)+1;
+	}
+    }
+    return mem;
+}
@@ -103,6 +103,7 @@ void memoserv(const char *source, char *buf)
 	    notice_lang(s_MemoServ, u, NICK_NOT_REGISTERED_HELP, s_NickServ);
 	else
 	    run_cmd(s_MemoServ, u, cmds, cmd);
+	memo_descarga_todo();
     }
 }
 
@@ -176,6 +177,7 @@ void load_old_ms_dbase(void)
 		if (ni) {
 		    ni->memos.memocount = old_memolist.n_memos;
 		    ni->memos.memos = old_memolist.memos;
+		    memo_importa(&ni->memos, ni->nick);
 		}
 	    }
 	}
@@ -196,7 +198,7 @@ void load_old_ms_dbase(void)
 void check_memos(User *u)
 {
     NickInfo *ni;
-    int i, newcnt = 0;
+    int i, newcnt;
     struct u_chanlist *ul; /* Tiene memos los canales del user? */
     ChannelInfo *ci; /** Comprobar si el canal esta registrado.*/
 
@@ -204,22 +206,19 @@ void check_memos(User *u)
 			 !(ni->flags & NI_MEMO_SIGNON))
 	return;
 
-    for (i = 0; i < ni->memos.memocount; i++) {
-	if (ni->memos.memos[i].flags & MF_UNREAD)
-	    newcnt++;
-    }
+    newcnt = ni->memos.unreadcount;
     if (newcnt > 0) {
 	notice_lang(s_MemoServ, u,
 		newcnt==1 ? MEMO_HAVE_NEW_MEMO : MEMO_HAVE_NEW_MEMOS, newcnt);
-	if (newcnt == 1 && (ni->memos.memos[i-1].flags & MF_UNREAD)) {
+	if (newcnt == 1 && memo_no_leido(&ni->memos, ni->memos.memocount-1)) {
 	    notice_lang(s_MemoServ, u, MEMO_TYPE_READ_LAST, s_MemoServ);
 	} else if (newcnt == 1) {
 	    for (i = 0; i < ni->memos.memocount; i++) {
-		if (ni->memos.memos[i].flags & MF_UNREAD)
+		if (memo_no_leido(&ni->memos, i))
 		    break;
 	    }
 	    notice_lang(s_MemoServ, u, MEMO_TYPE_READ_NUM, s_MemoServ,
-			ni->memos.memos[i].number);
+			ni->memos.idx[i].number);
 	} else {
 	    notice_lang(s_MemoServ, u, MEMO_TYPE_LIST_NEW, s_MemoServ);
 	}
@@ -289,19 +288,11 @@ static int delmemo(MemoInfo *mi, int num)
     int i;
 
     for (i = 0; i < mi->memocount; i++) {
-	if (mi->memos[i].number == num)
+	if (mi->idx[i].number == num)
 	    break;
     }
     if (i < mi->memocount) {
-	free(mi->memos[i].text); /* Deallocate memo text memory */
-	mi->memocount--;	 /* One less memo now */
-	if (i < mi->memocount)	 /* Move remaining memos down a slot */
-	    memmove(mi->memos + i, mi->memos + i+1,
-				sizeof(Memo) * (mi->memocount - i));
-	if (mi->memocount == 0) { /* If no more memos, free array */
-	    free(mi->memos);
-	    mi->memos = NULL;
-	}
+	memo_borra(mi, i);
 	return 1;
     } else {
 	return 0;
@@ -341,7 +332,7 @@ static void do_send(User *u)
     char *source = u->nick;
     int ischan;
     MemoInfo *mi;
-    Memo *m;
+    uint32 number;
     char *name = strtok(NULL, " ");
     char *text = strtok(NULL, "");
     time_t now = time(NULL);
@@ -379,39 +370,22 @@ static void do_send(User *u)
 	return; }
         }
 	u->lastmemosend = now;
-	mi->memocount++;
-	mi->memos = srealloc(mi->memos, sizeof(Memo) * mi->memocount);
-	m = &mi->memos[mi->memocount-1];
-	strscpy(m->sender, source, NICKMAX);
-	if (mi->memocount > 1) {
-	    m->number = m[-1].number + 1;
-	    if (m->number < 1) {
-		int i;
-		for (i = 0; i < mi->memocount; i++)
-		    mi->memos[i].number = i+1;
-	    }
-	} else {
-	    m->number = 1;
-	}
-	m->time = time(NULL);
-	m->text = sstrdup(text);
-	m->flags = MF_UNREAD;
+	number = memo_anade(mi, ischan ? name : getlink(findnick(name))->nick,
+			    source, text);
 	notice_lang(s_MemoServ, u, MEMO_SENT, name);
 	if (!ischan) {
 	    NickInfo *ni = getlink(findnick(name));
 	    if (ni->flags & NI_MEMO_RECEIVE) {
 		if (MSNotifyAll) {
-		    for (u = firstuser(); u; u = nextuser()) {
-			if (u->real_ni == ni) {
-			    notice_lang(s_MemoServ, u, MEMO_NEW_MEMO_ARRIVED,
-					source, s_MemoServ, m->number);
-			}
+		    for (u = ni->sesiones; u; u = u->sesion_next) {
+			notice_lang(s_MemoServ, u, MEMO_NEW_MEMO_ARRIVED,
+					source, s_MemoServ, number);
 		    }
 		} else {
 		    u = finduser(name);
 		    if (u) {
 			notice_lang(s_MemoServ, u, MEMO_NEW_MEMO_ARRIVED,
-					source, s_MemoServ, m->number);
+					source, s_MemoServ, number);
 		    }
 		} /* if (MSNotifyAll) */
 	    } /* if (flags & MEMO_RECEIVE) */
@@ -442,6 +416,7 @@ static void do_cancel(User *u)
     } else { 
         int i;
         
+        memo_carga(mi);
         for (i = mi->memocount -1; i >= 0; i--) {
              if ((mi->memos[i].flags & MF_UNREAD) && !stricmp(mi->memos[i].sender, u->ni->nick)) {
                  delmemo(mi, mi->memos[i].number);
@@ -541,6 +516,7 @@ static void do_list(User *u)
 	}
 	mi = &u->ni->memos;
     }
+    memo_carga(mi);
     if (param && !isdigit(*param) && stricmp(param, "NEW") != 0) {
 	syntax_error(s_MemoServ, u, "LIST", MEMO_LIST_SYNTAX);
     } else if (mi->memocount == 0) {
@@ -601,7 +577,7 @@ static int read_memo(User *u, int index, MemoInfo *mi, const char *chan)
 	notice_lang(s_MemoServ, u, MEMO_HEADER, m->number,
 		m->sender, timebuf, s_MemoServ, m->number);
     notice_lang(s_MemoServ, u, MEMO_TEXT, m->text);
-    m->flags &= ~MF_UNREAD;
+    memo_leido(mi, index);
     return 1;
 }
 
@@ -647,6 +623,7 @@ static void do_read(User *u)
 	}
 	mi = &u->ni->memos;
     }
+    memo_carga(mi);
     num = numstr ? atoi(numstr) : -1;
     if (!numstr || (stricmp(numstr,"LAST") != 0 && stricmp(numstr,"NEW") != 0
                     && num <= 0)) {
@@ -732,7 +709,7 @@ static void do_del(User *u)
     MemoInfo *mi;
     ChannelInfo *ci;
     char *numstr = strtok(NULL, ""), *chan = NULL;
-    int last, last0, i;
+    int last, last0;
     char buf[BUFSIZE], *end;
     int delcount, count, left;
 
@@ -794,11 +771,7 @@ static void do_del(User *u)
 	    }
 	} else {
 	    /* Delete all memos. */
-	    for (i = 0; i < mi->memocount; i++)
-		free(mi->memos[i].text);
-	    free(mi->memos);
-	    mi->memos = NULL;
-	    mi->memocount = 0;
+	    memo_borra_todos(mi);
 	    notice_lang(s_MemoServ, u, MEMO_DELETED_ALL);
 	}
     }
@@ -1014,16 +987,12 @@ static void do_info(User *u)
 	if (!mi->memocount) {
 	    notice_lang(s_MemoServ, u, MEMO_INFO_X_NO_MEMOS, name);
 	} else if (mi->memocount == 1) {
-	    if (mi->memos[0].flags & MF_UNREAD)
+	    if (memo_no_leido(mi, 0))
 		notice_lang(s_MemoServ, u, MEMO_INFO_X_MEMO_UNREAD, name);
 	    else
 		notice_lang(s_MemoServ, u, MEMO_INFO_X_MEMO, name);
 	} else {
-	    int count = 0, i;
-	    for (i = 0; i < mi->memocount; i++) {
-		if (mi->memos[i].flags & MF_UNREAD)
-		    count++;
-	    }
+	    int count = mi->unreadcount;
 	    if (count == mi->memocount)
 		notice_lang(s_MemoServ, u, MEMO_INFO_X_MEMOS_ALL_UNREAD,
 			name, count);
@@ -1053,16 +1022,12 @@ static void do_info(User *u)
 	if (!mi->memocount) {
 	    notice_lang(s_MemoServ, u, MEMO_INFO_NO_MEMOS);
 	} else if (mi->memocount == 1) {
-	    if (mi->memos[0].flags & MF_UNREAD)
+	    if (memo_no_leido(mi, 0))
 		notice_lang(s_MemoServ, u, MEMO_INFO_MEMO_UNREAD);
 	    else
 		notice_lang(s_MemoServ, u, MEMO_INFO_MEMO);
 	} else {
-	    int count = 0, i;
-	    for (i = 0; i < mi->memocount; i++) {
-		if (mi->memos[i].flags & MF_UNREAD)
-		    count++;
-	    }
+	    int count = mi->unreadcount;
 	    if (count == mi->memocount)
 		notice_lang(s_MemoServ, u, MEMO_INFO_MEMOS_ALL_UNREAD, count);
 	    else if (count == 0)
@@ -73,6 +73,9 @@ static void m_create(char *source, int ac, char **av)
 static void m_end_of_burst(char *source, int ac, char **av)
 {
      Server *server;
+
+     /* Acabado el burst, ChanServ revisa los canales que han llegado */
+     fin_burst();
      server = find_servernumeric(source);
      if (!server)
          return;
@@ -269,7 +272,7 @@ static void m_nick(char *source, int ac, char **av)
     }
     // Sarrera berria bada,..
 if (ac >= 9) {
-    canaladmins(s_SpamServ, "3%s@14%s ha entrado en la red", av[0], av[4]);
+    aviso(AVISO_ENTRA, s_SpamServ, "3%s@14%s ha entrado en la red", av[0], av[4]);
 }
 #else
     if ((!*source && ac != 7) || (*source && ac != 2)) {
@@ -304,6 +307,17 @@ static void m_ping(char *source, int ac, char **av)
     send_cmd(ServerName, "PONG %s %s", ac>1 ? av[1] : ServerName, av[0]);
 }
 
+/*************************************************************************/
+
+/* El PONG al PING que se manda al enlazar llega detras del burst del hub
+ * (P09 no tiene END_OF_BURST). */
+
+static void m_pong(char *source, int ac, char **av)
+{
+    if (en_burst)
+	fin_burst();
+}
+
 /*************************************************************************/
 #if defined(IRC_UNDERNET_P09)
 static void m_count(char *source, int ac, char **av)
@@ -351,9 +365,32 @@ static void m_count(char *source, int ac, char **av)
 
 /************************************************************************/
 
+#if defined(IRC_HISPANO)
+/* Registro de la BDD que llega del servidor: lo apuntamos en la copia
+ * local y adelantamos el contador de la tabla si hace falta.
+ *	av[0] = destino, av[1] = serie, av[2] = tabla, av[3] = clave,
+ *	av[4] = valor (si no esta, es un borrado)
+ * Los de serie 0 son ordenes entre servidores (J, D...) y no tocan datos. */
+
+static void m_db(char *source, int ac, char **av)
+{
+    unsigned long serie;
+
+    if (ac < 4 || strlen(av[2]) != 1)
+	return;
+    serie = strtoul(av[1], NULL, 10);
+    if (!serie)
+	return;
+    bdd_local_pon(*av[2], av[3], ac > 4 ? av[4] : NULL, serie);
+    bdd_serie_vista(*av[2], serie);
+}
+#endif
+
+/************************************************************************/
+
 static void m_privmsg(char *source, int ac, char **av)
 {
-    time_t starttime, stoptime;	/* When processing started and finished */
+    int64 starttime;	/* When processing started (microseconds) */
     char *s;
     int i,is_root,is_patrocs;
     i=is_root=is_patrocs=0;
@@ -361,23 +398,9 @@ static void m_privmsg(char *source, int ac, char **av)
     if (ac != 2)
 	return;
 
-    /* Check if we should ignore.  Operators always get through. */
-    if (allow_ignore && !is_oper(source)) {
-	IgnoreData *ign = get_ignore(source);
-	/*DebugData *igndebug = get_debugserv(source);*/
-	if (ign && ign->time > time(NULL) +8) {
-	    /*log("Ignored message from %s: \"%s\"", source, inbuf);*/
-		 send_cmd(av[0], "KILL %s :No Flodee a los Servicios!", source);
-	        
-	} else if (ign && ign->time > time(NULL) +4) {
-	    /*log("Ignored message from %s: \"%s\"", source, inbuf);*/
-		privmsg(av[0], source, "4Espere Varios Segundos.Mensaje Ignorado.");
-	    return;
-	}
-    }
-
     /* If a server is specified (nick@server format), make sure it matches
-     * us, and strip it off. */
+     * us, and strip it off.  Before the flood check, so that the
+     * FloodPesos weight of NickServ@host is the one of NickServ. */
     s = strchr(av[0], '@');
     if (s) {
 	*s++ = 0;
@@ -385,7 +408,22 @@ static void m_privmsg(char *source, int ac, char **av)
 	    return;
     }
 
-     starttime = time(NULL);
+    /* Check if we should ignore.  Operators always get through, and
+     * channel messages are not commands to us. */
+    if (allow_ignore && *av[0] != '#' && !is_oper(source)) {
+	switch (flood_comprueba(source, av[0], inbuf)) {
+	  case FLOOD_KILL:
+	    /*log("Ignored message from %s: \"%s\"", source, inbuf);*/
+	    kill_user(av[0], source, "No Flodee a los Servicios!");
+	    return;
+	  case FLOOD_IGNORA:
+	    /*log("Ignored message from %s: \"%s\"", source, inbuf);*/
+	    privmsg(av[0], source, "4Espere Varios Segundos.Mensaje Ignorado.");
+	    return;
+	}
+    }
+
+     starttime = reloj_us();
      
     if (strchr(av[0], '#'))
 	eskaneatu_kanala(source, av[0], av[1]);
@@ -497,12 +535,12 @@ static void m_privmsg(char *source, int ac, char **av)
 	helpserv(s_mIRCHelp, source, buf);
     }
 #endif    
-    /* Add to ignore list if the command took a significant amount of time. */
-    if (allow_ignore) {
-	stoptime = time(NULL) + 10;
-	if (stoptime > starttime && *source && !strchr(source, '.'))
-	    add_ignore(source, stoptime-starttime,av[0],inbuf);
-	    almacena_debugserv(source, stoptime-starttime,av[0],inbuf);
+    /* Charge the time the command took to the sender's flood buckets. */
+    if (*av[0] != '#' && *source && !strchr(source, '.')) {
+	int64 usado = reloj_us() - starttime;
+	if (allow_ignore)
+	    flood_carga(source, av[0], av[1], inbuf, usado);
+	almacena_debugserv(source, usado, av[0], inbuf);
     }
 }
 
@@ -698,6 +736,7 @@ Message messages[] = {
     { "PART",      m_part },
     { "PASS",      NULL },
     { "PING",      m_ping },
+    { "PONG",      m_pong },
     { "PRIVMSG",   m_privmsg },
     { "QUIT",      m_quit },
     { "SERVER",    m_server },
@@ -747,7 +786,7 @@ Message messages[] = {
 
 #if defined(IRC_HISPANO)
     { "BMODE",     m_bmode }, 
-    { "DB",        NULL }, 
+    { "DB",        m_db }, 
     { "DBQ",       NULL },
     { "DBH",       NULL },        
     { "CONFIG",    NULL },
@@ -514,3 +514,17 @@ int dotime(const char *s)
 }
 
 /*************************************************************************/
+
+/* reloj_us:  Return a monotonic clock reading in microseconds, for
+ *            measuring how long things take.
+ */
+
+int64 reloj_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/*************************************************************************/
@@ -0,0 +1,234 @@
+/* Cambios de modo de canal juntados en pocas lineas MODE.
+ *
+ * Services is copyright (c) 1996-1999 Andy Church.
+ *     E-mail: <achurch@dragonfire.net>
+ * This program is free but copyrighted software; see the file COPYING for
+ * details.
+ *
+ * modo_canal() no manda el MODE en el acto: guarda el cambio con los demas
+ * del mismo canal y origen, y el bucle principal los manda todos con
+ * modos_envia() en cada vuelta (despues de los timeouts y de cada linea
+ * del servidor), en lineas de hasta ModosPorLinea parametros (el MAXMODES
+ * del ircd) y sin pasar de la longitud de una linea.  Asi un OP con varios
+ * nicks, un CLEAR OPS o la revision de un canal al acabar el burst salen
+ * en unas pocas lineas en vez de en una por usuario.
+ *
+ * Dentro de la misma vuelta un cambio repetido (el mismo signo, letra y
+ * parametro) solo se manda una vez, un +o y un -o (o +v y -v) al mismo
+ * usuario se anulan entre si, y un +l nuevo sustituye al pendiente.  Los
+ * cambios salen en el orden en que se pidieron, y los canales en el orden
+ * en que aparecieron.
+ *
+ * Un KICK puede depender de un modo pendiente (el +b de un akick, el +o
+ * de ChanServ en LIMPIA): send_cmd() llama a modos_envia() antes de mandar
+ * un KICK, asi que en la red salen en el mismo orden que antes.
+ */
+
+#include "services.h"
+
+typedef struct {
+    char signo, letra;
+    char *param;		/* NULL si no lleva */
+} Cambio;
+
+typedef struct modos_ Modos;
+struct modos_ {
+    Modos *next;
+    char fuente[NICKMAX];
+    char canal[CHANMAX];
+    Cambio *cambios;
+    int n, tam;
+};
+
+static Modos *pendientes = NULL, *fin_pendientes = NULL;
+
+/*************************************************************************/
+
+/* Las letras que llevan parametro al ponerlas (+) y al quitarlas (-). */
+
+static int lleva_param(char signo, char letra)
+{
+    switch (letra) {
+      case 'o': case 'v': case 'b': case 'k':
+#if defined(IRC_PATCHS_CMODES)
+      case 'q':
+#endif
+	return 1;
+      case 'l':
+	return signo == '+';
+    }
+    return 0;
+}
+
+/* Las que van sobre un usuario, que se anulan con la contraria.  Un +b y
+ * un -b no: el -b puede ser para quitar un ban que ya estaba puesto. */
+
+static int de_usuario(char letra)
+{
+#if defined(IRC_PATCHS_CMODES)
+    if (letra == 'q')
+	return 1;
+#endif
+    return letra == 'o' || letra == 'v';
+}
+
+static void manda(const char *fuente, const char *canal, const char *modos,
+		  const char *params)
+{
+#if defined(IRC_UNDERNET_P10)
+    send_cmd(fuente, "M %s %s%s", canal, modos, params);
+#else
+    send_cmd(fuente, "MODE %s %s%s", canal, modos, params);
+#endif
+}
+
+/*************************************************************************/
+
+static Modos *busca_modos(const char *fuente, const char *canal)
+{
+    Modos *m;
+
+    for (m = pendientes; m; m = m->next) {
+	if (stricmp(m->canal, canal) == 0 && strcmp(m->fuente, fuente) == 0)
+	    return m;
+    }
+    m = scalloc(sizeof(Modos), 1);
+    strscpy(m->fuente, fuente, sizeof(m->fuente));
+    strscpy(m->canal, canal, sizeof(m->canal));
+    if (fin_pendientes)
+	fin_pendientes->next = m;
+    else
+	pendientes = m;
+    fin_pendientes = m;
+    return m;
+}
+
+static void apunta(Modos *m, char signo, char letra, const char *param)
+{
+    Cambio *c;
+    int i;
+
+    for (i = 0; i < m->n; i++) {
+	c = &m->cambios[i];
+	if (c->letra != letra)
+	    continue;
+	if (letra == 'l' && signo == '+' && c->signo == '+') {
+	    free(c->param);
+	    c->param = sstrdup(param);
+	    return;
+	}
+	if (param ? !c->param || stricmp(c->param, param) != 0 : c->param != NULL)
+	    continue;
+	if (c->signo == signo)
+	    return;
+	if (de_usuario(letra)) {
+	    free(c->param);
+	    memmove(c, c+1, sizeof(Cambio) * (m->n - i - 1));
+	    m->n--;
+	    return;
+	}
+    }
+    if (m->n >= m->tam) {
+	m->tam = m->tam ? m->tam*2 : 8;
+	m->cambios = srealloc(m->cambios, sizeof(Cambio) * m->tam);
+    }
+    c = &m->cambios[m->n++];
+    c->signo = signo;
+    c->letra = letra;
+    c->param = param ? sstrdup(param) : NULL;
+}
+
+/* Manda los cambios de `m' en el menor numero de lineas y lo libera. */
+
+static void vacia(Modos *m)
+{
+    char modos[128], params[BUFSIZE], *fm, *fp;
+    char signo;
+    int i, nparams, largo, maximo;
+    Cambio *c;
+
+    /* Lo que queda de los 510 caracteres tras ":fuente MODE #canal " */
+    maximo = 510 - strlen(m->fuente) - strlen(m->canal) - 8;
+    fm = modos;
+    fp = params;
+    signo = 0;
+    nparams = 0;
+    for (i = 0; i <= m->n; i++) {
+	c = i < m->n ? &m->cambios[i] : NULL;
+	largo = c && c->param ? strlen(c->param) + 1 : 0;
+	if (fm > modos && (!c || (c->param && nparams >= ModosPorLinea)
+			|| fm - modos >= (int)sizeof(modos) - 3
+			|| (fm - modos) + (fp - params) + largo + 2 > maximo)) {
+	    *fm = 0;
+	    *fp = 0;
+	    manda(*m->fuente ? m->fuente : NULL, m->canal, modos, params);
+	    fm = modos;
+	    fp = params;
+	    signo = 0;
+	    nparams = 0;
+	}
+	if (!c)
+	    break;
+	if (c->signo != signo)
+	    *fm++ = signo = c->signo;
+	*fm++ = c->letra;
+	if (c->param) {
+	    snprintf(fp, params + sizeof(params) - fp, " %s", c->param);
+	    fp += strlen(fp);
+	    nparams++;
+	    free(c->param);
+	}
+    }
+    free(m->cambios);
+    free(m);
+}
+
+/*************************************************************************/
+
+/* Cambia los modos `modos' ("+o-v"...) de `canal' como `fuente'.  Detras
+ * van los parametros (char *) de las letras que los llevan, en orden. */
+
+void modo_canal(const char *fuente, const char *canal, const char *modos, ...)
+{
+    va_list args;
+    char signo = '+';
+    const char *param;
+    Modos *m = busca_modos(fuente ? fuente : "", canal);
+
+    va_start(args, modos);
+    for (; *modos; modos++) {
+	if (*modos == '+' || *modos == '-') {
+	    signo = *modos;
+	    continue;
+	}
+	param = lleva_param(signo, *modos) ? va_arg(args, const char *) : NULL;
+	if (lleva_param(signo, *modos) && (!param || !*param))
+	    continue;
+	apunta(m, signo, *modos, param);
+    }
+    va_end(args);
+}
+
+/*************************************************************************/
+
+/* Manda todo lo pendiente. */
+
+void modos_envia(void)
+{
+    Modos *m;
+
+    while ((m = pendientes) != NULL) {
+	if (!(pendientes = m->next))
+	    fin_pendientes = NULL;
+	vacia(m);
+    }
+}
+
+/* Devuelve 1 si hay cambios sin mandar. */
+
+int modos_pendientes(void)
+{
+    return pendientes != NULL;
+}
+
+/*************************************************************************/
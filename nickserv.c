@@ -25,9 +25,6 @@
 
 #include "services.h"
 #include "pseudo.h"
-#if defined(SOPORTE_JOOMLA15)
-#include <mysql.h>
-#endif
 /*************************************************************************/
 #define aliases 6000
 static NickInfo *nicklists[aliases];	/* One for each initial character */
@@ -351,11 +348,7 @@ void get_nickserv_stats(long *nrec, long *memuse)
 		if (*accptr)
 		    mem += strlen(*accptr)+1;
 	    }
-	    mem += ni->memos.memocount * sizeof(Memo);
-	    for (j = 0; j < ni->memos.memocount; j++) {
-		if (ni->memos.memos[j].text)
-		    mem += strlen(ni->memos.memos[j].text)+1;
-	    }
+	    mem += memo_mem(&ni->memos);
 	}
     }
     *nrec = count;
@@ -706,6 +699,7 @@ void load_ns_dbase(void)
 			    SAFE(read_buffer(memos->sender, f));
 			    SAFE(read_string(&memos->text, f));
 			}
+			memo_importa(&ni->memos, ni->nick);
 		    }
 		    SAFE(read_int16(&ni->channelcount, f));
 		    SAFE(read_int16(&ni->channelmax, f));
@@ -770,7 +764,6 @@ void save_ns_dbase(void)
     int i, j;
     NickInfo *ni;
     char **access;
-    Memo *memos;
     static time_t lastwarn = 0;
 
     if (!(f = open_db(s_NickServ, NickDBName, "w")))
@@ -817,16 +810,9 @@ void save_ns_dbase(void)
 		SAFE(write_int16(ni->accesscount, f));
 		for (j=0, access=ni->access; j<ni->accesscount; j++, access++)
 		    SAFE(write_string(*access, f));
-		SAFE(write_int16(ni->memos.memocount, f));
+		/* Los memos van en MemoDB (memodb.c) */
+		SAFE(write_int16(0, f));
 		SAFE(write_int16(ni->memos.memomax, f));
-		memos = ni->memos.memos;
-		for (j = 0; j < ni->memos.memocount; j++, memos++) {
-		    SAFE(write_int32(memos->number, f));
-		    SAFE(write_int16(memos->flags, f));
-		    SAFE(write_int32(memos->time, f));
-		    SAFE(write_buffer(memos->sender, f));
-		    SAFE(write_string(memos->text, f));
-		}
 		SAFE(write_int16(ni->channelcount, f));
 		SAFE(write_int16(ni->channelmax, f));
 		SAFE(write_int16(ni->language, f));
@@ -1065,7 +1051,6 @@ void expire_nicks()
                  char subject[BUFSIZE];
                   ni->env_mail &= ~MAIL_REC ;
                   /*ni->env_mail |= MAIL_REC ;*/
-              if (fork()==0) {
 				 buf = smalloc(sizeof(char *) * 1024);
                sprintf(buf,"\n   Hola  NiCK: %s\n"
 				"Queda  menos de una semana para expirar su nick.\n"
@@ -1084,32 +1069,17 @@ void expire_nicks()
        
                snprintf(subject, sizeof(subject), "Recordatorio del NiCK '%s'", ni->nick);       
               enviar_correo(ni->email, subject, buf);
-             exit(0);
-         }
+             free(buf);
        }
             else if (now - ni->last_seen >=  (NSExpire)
 			&& !(ni->status & (NS_VERBOTEN | NS_NO_EXPIRE | NS_SUSPENDED)) && !(ni->env_mail & ( MAIL_REC))) {
       		logeo("Expirando Nick %s", ni->nick);
 		canalopers(s_NickServ, "El nick 12%s ha expirado", ni->nick);
-		delnick(ni);
 		#if defined(SOPORTE_JOOMLA15)
- MYSQL *conn;
-char modifica[BUFSIZE];
- conn = mysql_init(NULL);
-
-   /* Connect to database */
-   if (!mysql_real_connect(conn, MYSQL_SERVER,
-         MYSQL_USER,MYSQL_PASS,MYSQL_DATABASE, 0, NULL, 0)) {
-       canaladmins(s_NickServ,"%s\n", mysql_error(conn));
-         return;
-   }
-snprintf(modifica, sizeof(modifica), "delete from jos_users where username ='%s';", ni->nick);
-
-if (mysql_query(conn,modifica)) 
-canaladmins(s_NickServ, "%s\n", mysql_error(conn));
- mysql_close(conn);
-
+		sql_query(s_NickServ, ni->nick, NULL, NULL,
+			"delete from jos_users where username=%s", ni->nick);
      #endif
+		delnick(ni);
 
 	    } else if (now - ni->time_registered >=  (NSRegMail) && !(ni->active & (ACTIV_CONFIRM | ACTIV_FORZADO))) { 
                       canalopers(s_NickServ, "El nick 12%s ha expirado por no activar 5%s", ni->nick,ni->email);
@@ -1176,6 +1146,31 @@ NickInfo *findnick(const char *nick)
 
 /*************************************************************************/
 
+/* Iterate over all NickInfo structures, like firstchan()/nextchan(). */
+
+static NickInfo *ni_actual;
+static int ni_indice;
+
+NickInfo *firstnickinfo(void)
+{
+    ni_indice = 0;
+    ni_actual = NULL;
+    while (ni_indice < aliases && ni_actual == NULL)
+	ni_actual = nicklists[ni_indice++];
+    return ni_actual;
+}
+
+NickInfo *nextnickinfo(void)
+{
+    if (ni_actual)
+	ni_actual = ni_actual->next;
+    while (ni_indice < aliases && ni_actual == NULL)
+	ni_actual = nicklists[ni_indice++];
+    return ni_actual;
+}
+
+/*************************************************************************/
+
 /* Return the "master" nick for the given nick; i.e., trace the linked list
  * through the `link' field until we find a nickname with a NULL `link'
  * field.  Assumes `ni' is not NULL.
@@ -1283,13 +1278,28 @@ static NickInfo *makenick(const char *nick)
 static int delnick(NickInfo *ni)
 {
     int i;
+    User *u, *next;
+
     cs_remove_nick(ni);
     os_remove_nick(ni);
 
+    /* Los usuarios conectados con este nick se quedan sin NickInfo */
+    for (u = getlink(ni)->sesiones; u; u = next) {
+	next = u->sesion_next;
+	if (u->real_ni == ni) {
+	    quita_sesion(u);
+	    u->ni = u->real_ni = NULL;
+	}
+    }
     if (ni->linkcount)
 	remove_links(ni);
     if (ni->link)
 	ni->link->linkcount--;
+    /* y los que usan sus links pasan al nuevo nick principal */
+    while ((u = ni->sesiones)) {
+	u->ni = getlink(u->real_ni);
+	actualiza_sesion(u);
+    }
     if (ni->next)
 	ni->next->prev = ni->prev;
     if (ni->prev)
@@ -1328,13 +1338,7 @@ static int delnick(NickInfo *ni)
 	}
 	free(ni->access);
     }
-    if (ni->memos.memos) {
-	for (i = 0; i < ni->memos.memocount; i++) {
-	    if (ni->memos.memos[i].text)
-		free(ni->memos.memos[i].text);
-	}
-	free(ni->memos.memos);
-    }
+    memo_borra_todos(&ni->memos);
     if (ni->status & NI_ON_BDD) {
           
            do_write_bdd(ni->nick, 15, "");
@@ -1673,77 +1677,71 @@ static void do_help(User *u)
     }
 }
 #if defined(SOPORTE_JOOMLA15)
-void mirar_tablas() {
-//Registrado (Registered), Autor (Autor), Editor (Editor) y Supervisor (Publisher).
-// Mnager, Administrador y Sper-Administrador
-static const char karak[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789-_{}[]";
-   MYSQL *conn;
-   MYSQL_RES *res,*resid,*residaro;
-   MYSQL_ROW row,rowid,rowidaro;
-   NickInfo *ni, *ni2;
-   int i;
-   char *cadena,*block;
-   char borra[BUFSIZE];
-   conn = mysql_init(NULL);
-
-   /* Connect to database */
-   if (!mysql_real_connect(conn, MYSQL_SERVER,
-         MYSQL_USER,MYSQL_PASS,MYSQL_DATABASE, 0, NULL, 0)) {
-       canaladmins(s_NickServ,"%s\n", mysql_error(conn));
-         return;
-   }
 
-   /* send SQL query */
-/*
-      row[0] name
-      row[1] username=nick
-      row[2] password
-      row[3] email
-      row[4] gid
-      row[5] block	*/
+/* Sincronizacion de jos_users con la base de datos de nicks.
+ *
+ * Antes se leia la tabla entera en cada ciclo de expiracion desde el bucle
+ * principal.  Ahora se recorre por paginas de SYNC_LOTE filas a traves de
+ * la cola de joomla.c, y solo se leen las filas nuevas (id mayor que el
+ * ultimo visto) y las que aparecen en jos_users_cambios, una tabla que
+ * rellenan estos triggers:
+ *
+ *   CREATE TABLE jos_users_cambios (
+ *	id INT NOT NULL AUTO_INCREMENT PRIMARY KEY, user_id INT NOT NULL);
+ *   CREATE TRIGGER jos_users_upd AFTER UPDATE ON jos_users FOR EACH ROW
+ *	INSERT INTO jos_users_cambios (user_id) VALUES (NEW.id);
+ *
+ * Si la tabla no existe se vuelve a recorrer jos_users entera en cada
+ * ciclo (igual que antes, pero por paginas y fuera del bucle principal).
+ */
 
+#define SYNC_LOTE	500
 
-   if (mysql_query(conn, "select name,username,password,email,gid,block from jos_users")) {
-      canaladmins( s_NickServ,"%s\n", mysql_error(conn));
-     }
+static int sync_activo = 0;	/* Hay un recorrido en marcha */
+static int sync_cambios = 1;	/* Existe jos_users_cambios */
+static int sync_ultimo_id = 0;	/* Marca de jos_users.id */
+static int sync_ultimo_cambio = 0;	/* Marca de jos_users_cambios.id */
+static time_t sync_inicio;
 
-   res = mysql_use_result(conn);
+/* Estadisticas: filas leidas y aplicadas en el ultimo ciclo y en total */
+static long sync_leidas = 0, sync_aplicadas = 0;
+static long sync_ult_leidas = 0, sync_ult_aplicadas = 0;
+static long sync_total_leidas = 0, sync_total_aplicadas = 0;
 
-   /* output table name */
-/*Registramos los nicks de la web a IRC*/
-   while ((row = mysql_fetch_row(res)) != NULL) {
-	 if (!(ni = findnick(row[1])) && (strcmp("0", row[5]) == 0)) { 
-		cadena = row[1];
-		block=  row[5];
-	
-	/*chequeo aliases no permitidos*/
-		if (cadena[strspn(cadena, karak)]) {
- canaladmins(s_NickServ, "El Nick 2%s Contiene Palabras No Permitidas ,No se registra y Se Borra De La Web",cadena);
+static void sync_usuarios(SqlResult *res, void *data);
+static void sync_cambiados(SqlResult *res, void *data);
 
+/*************************************************************************/
 
+/* Aplica una fila de jos_users.  Devuelve 1 si ha cambiado algo.
+ *	row[0] name
+ *	row[1] username=nick
+ *	row[2] password
+ *	row[3] email
+ *	row[4] gid
+ *	row[5] block
+ */
 
- MYSQL *check;
-char modifica[BUFSIZE];
- check = mysql_init(NULL);
+static int aplica_usuario(char **row)
+{
+//Registrado (Registered), Autor (Autor), Editor (Editor) y Supervisor (Publisher).
+// Mnager, Administrador y Sper-Administrador
+static const char karak[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789-_{}[]";
+    NickInfo *ni;
+    int cambios = 0;
 
-   /* Connect to database */
-   if (!mysql_real_connect(check, MYSQL_SERVER,
-         MYSQL_USER,MYSQL_PASS,MYSQL_DATABASE, 0, NULL, 0)) {
-       canaladmins(s_NickServ,"%s\n", mysql_error(conn));
-         return;
-   }
-snprintf(modifica, sizeof(modifica), "delete from jos_users where username ='%s';",cadena);
-//canalopers(s_NickServ, "5%s eliminadose de tablas", nick);
-if (mysql_query(check,modifica))  {
-canaladmins(s_NickServ, "%s\n", mysql_error(check));
- mysql_close(check);
-mysql_close(conn);
- return;
- }
-return;
-}
-/* REG_NICK_MAIL */
-         
+    if (!row[0] || !row[1] || !row[2] || !row[3] || !row[5])
+	return 0;
+
+/*Registramos los nicks de la web a IRC*/
+    if (!(ni = findnick(row[1])) && (strcmp("0", row[5]) == 0)) {
+	/*chequeo aliases no permitidos*/
+	if (row[1][strspn(row[1], karak)]) {
+	    canaladmins(s_NickServ, "El Nick 2%s Contiene Palabras No Permitidas ,No se registra y Se Borra De La Web",row[1]);
+	    sql_query(s_NickServ, row[1], NULL, NULL,
+		      "delete from jos_users where username=%s", row[1]);
+	    return 1;
+	}
 		ni = makenick(row[1]);
 		if (ni) {
 	   	ni->status |= NI_ON_BDD;
@@ -1787,151 +1785,158 @@ return;
 	    ni->memos.memomax = MSMaxMemos;
 	    ni->channelcount = 0;
 	    ni->channelmax = CSMaxReg;
-	    ni->last_usermask = smalloc(strlen(row[1]));
-	    sprintf(ni->last_usermask, "%s@%s", "webchat","*");
+	    ni->last_usermask = sstrdup("webchat@*");
 	    ni->last_realname = sstrdup(row[0]);
 	    ni->time_registered = ni->last_seen = time(NULL);
 	    ni->expira_min = ni->last_seen+NSExpire;
 	    ni->language = DEF_LANGUAGE;
 	    ni->link = NULL;
-	
-	    }
+	    cambios = 1;
 	}
-     if (ni = findnick(row[1])) {
-
-      /*
-      row[0] name
-      row[1] username=nick
-      row[2] password
-      row[3] email
-      row[4] gid
-			*/
-	
-         
-
+    }
+    if ((ni = findnick(row[1]))) {
          if (strcmp(ni->pass, row[2]) != 0) {
 	canalopers( s_NickServ,"12WEBCHAT:4PassWord:3%s2(%s)",row[1], row[2]);
 	 strscpy(ni->pass, row[2], PASSMAX);
 	do_write_bdd(ni->nick, 1,ni->pass);
+	cambios = 1;
 	 }
 
 	 /* if (strcmp(ni->last_realname, row[0]) != 0) {
 	canalopers( s_NickServ,"12WEBCHAT:4Nombre:3%s2(%s)",row[1], row[0]);
 	  ni->last_realname = sstrdup(row[0]); }*/
 
-	if (strcmp(ni->email, row[3]) != 0) {
+	if (!ni->email || strcmp(ni->email, row[3]) != 0) {
 	canalopers( s_NickServ,"12WEBCHAT:4email:3%s2(%s)",row[1], row[3]);
-	  ni->email = sstrdup(row[3]); }
+	  ni->email = sstrdup(row[3]);
+	cambios = 1; }
+    }
+    return cambios;
+}
 
+/*************************************************************************/
 
+/* Fin de un recorrido: guarda las estadisticas del ciclo. */
 
-      }
-	/* if (!(ni = findnick(row[1]))) {
-		if (strcmp(ni->nick, row[1]) != 0) {
-	canalopers( s_NickServ,"12WEBCHAT:4Borrado :3%s",row[1]);
-	delnick(ni);
-	 }*/
+static void sync_fin(void)
+{
+    sync_activo = 0;
+    sync_ult_leidas = sync_leidas;
+    sync_ult_aplicadas = sync_aplicadas;
+    sync_total_leidas += sync_leidas;
+    sync_total_aplicadas += sync_aplicadas;
+    if (debug || sync_aplicadas)
+	logeo("%s: jos_users: %ld filas leidas, %ld aplicadas en %ld segundos",
+	      s_NickServ, sync_leidas, sync_aplicadas,
+	      (long)(time(NULL) - sync_inicio));
+}
 
-   
+/* Pide la siguiente pagina de jos_users_cambios (o termina si no hay). */
 
+static void sync_pide_cambios(void)
+{
+    if (!sync_cambios || !sql_query(s_NickServ, NULL, sync_cambiados, NULL,
+		"select u.name,u.username,u.password,u.email,u.gid,u.block,c.id"
+		" from jos_users_cambios c, jos_users u"
+		" where c.id > %d and u.id=c.user_id order by c.id limit %d",
+		sync_ultimo_cambio, SYNC_LOTE))
+	sync_fin();
+}
 
-  
-	   
+/* Resultado de una pagina de jos_users (filas nuevas o recorrido entero). */
+
+static void sync_usuarios(SqlResult *res, void *data)
+{
+    int i, id, desde = (int)(long) data;
+
+    if (res->error) {
+	sync_fin();
+	return;
+    }
+    for (i = 0; i < res->nrows; i++) {
+	sync_leidas++;
+	sync_aplicadas += aplica_usuario(res->rows[i]);
+	id = res->rows[i][6] ? atoi(res->rows[i][6]) : 0;
+	if (id > desde)
+	    desde = id;
+    }
+    if (desde > sync_ultimo_id)
+	sync_ultimo_id = desde;
+    if (res->nrows < SYNC_LOTE) {
+	sync_pide_cambios();
+	return;
+    }
+    if (!sql_query(s_NickServ, NULL, sync_usuarios, (void *)(long) desde,
+		"select name,username,password,email,gid,block,id from jos_users"
+		" where id > %d order by id limit %d", desde, SYNC_LOTE))
+	sync_fin();
 }
-mysql_free_result(res);
-
-/*Registramos los nicks del IRC a la web (Registrando a tablas) <-- cuando desactivemos registro por web
-
-char consulta[BUFSIZE],inserta[BUFSIZE],modifica[BUFSIZE],groups[BUFSIZE];
-int cont;
-cont=0;
-
-
- for (i = 0; i < aliases; i++)
-        for (ni = nicklists[i]; ni; ni = ni->next) {
-	      ni =findnick(ni->nick);
-		snprintf(consulta, sizeof(consulta), "select username from jos_users where username ='%s'",ni->nick);
-      if (mysql_query(conn,consulta)) 
-				return;
-		 res = mysql_use_result(conn);
-              	while ((row = mysql_fetch_row(res)) != NULL) {
-                           if (stricmp(row[0], ni->nick) == 0)
-                               cont++;
-                                }
-
-                        if (cont) {
-			   //canalopers( s_NickServ,"12 %s esta en tablas",ni->nick);
-                           cont =0;
-			   } else {
-				registramos usuario que no esta en sql*/	
-			 /*
-                          id       int(11)
-                          name     varchar(255)
-			  username varchar(150)
-			  email	   varchar(100)
-			  password varchar(100)
-			  usertype varchar(25)
-			  block    tinyint (4)
-			  sendEmail tinyint (4)
-			  gid       tinyint (3) unsigned -->  18:Registrados; 19:autores ; 20:editores
-			  registerDate datetime		      21:publicadores,23:gestores,24:Admins
-			  lastvisitDate datetime
-			  activation   varchar(100)		
-			  params	text
-
-
-insert into jos_users values(67,'guipuzcoano','donostiarra','admin.euskalirc@gmail.com','pass','Registered',
-0,1,18,'2005-09-28 00:00:00','2007-09-28 00:00:00','','');
-
-insert into jos_core_acl_aro values(15,'users','67',0,'guipuzcoano',0);
-
-insert into jos_core_acl_groups_aro_map values(18,'',15);
-
-
-			char buf[BUFSIZE];
-			int id,idaro;
-		
-                            struct tm *tm,*te;
-				User *u;
-				tm = localtime(&ni->time_registered);
-				strftime_lang(buf, sizeof(buf), u,STRFTIME_MESES_NUM, tm);
-					//canalopers( s_NickServ,"5 %s NO esta en tablas",ni->nick);
-		if (mysql_query(conn,"select id from jos_users;")) 
-      				canaladmins(s_NickServ, "%s\n", mysql_error(conn));
-
-				resid = mysql_use_result(conn);
-                            id=60;idaro=15;
-			 while ((rowid = mysql_fetch_row(resid)) != NULL) {
-					id++; idaro++;
-                              }
-			
-				canalopers( s_NickServ,"5VALOR Id es %d Idaro %d",id,idaro);
-			
-				canalopers( s_NickServ,"5Registrado a tablas:12%s2(%s)10<%s>",ni->nick, ni->email,ni->pass);
-				snprintf(inserta, sizeof(inserta), "INSERT INTO jos_users VALUES('%d','%s','%s','%s','%s','%s','%d','%d','%d','%s','%d','%s','%s')", id,ni->nick,ni->nick,ni->email,ni->pass,"Registered",0,0,atol("18"), buf,ni->last_seen,"","\n");
-				if (mysql_query(conn,inserta)) {
-      				canaladmins(s_NickServ, "%s\n", mysql_error(conn));
-				id++;
-                                }
 
-	
-		snprintf(modifica, sizeof(modifica), "INSERT INTO jos_core_acl_aro VALUES('%d','%s','%d','%d','%s','%d')", idaro,"users",id,0,ni->last_realname,0);
-				if (mysql_query(conn,modifica)) 
-      				canaladmins(s_NickServ, "%s\n", mysql_error(conn));
-      				
-		snprintf(groups, sizeof(groups), "INSERT INTO jos_core_acl_groups_aro_map VALUES('%d','%s','%d')",atol("18"),"",idaro);
-				if (mysql_query(conn,groups)) 
-      				canaladmins(s_NickServ, "%s\n", mysql_error(conn));
-      				
-				
-		                 }
-              	       
-	            }*/
- 
-      mysql_close(conn);
-			
+/* Resultado de una pagina de jos_users_cambios. */
+
+static void sync_cambiados(SqlResult *res, void *data)
+{
+    int i, id;
+
+    if (res->error && res->errnum == SQL_SIN_TABLA) {
+	/* No hay triggers: a partir de ahora se recorre la tabla entera */
+	canaladmins(s_NickServ, "Sin jos_users_cambios, se leera jos_users "
+		    "entera en cada ciclo");
+	sync_cambios = 0;
+	sync_fin();
+	return;
+    } else if (res->error) {
+	/* Conexion perdida, timeout...: se vuelve a intentar en el ciclo
+	 * siguiente desde la misma marca */
+	logeo("%s: jos_users_cambios: %s", s_NickServ, res->errmsg);
+	sync_fin();
+	return;
+    }
+    for (i = 0; i < res->nrows; i++) {
+	sync_leidas++;
+	sync_aplicadas += aplica_usuario(res->rows[i]);
+	id = res->rows[i][6] ? atoi(res->rows[i][6]) : 0;
+	if (id > sync_ultimo_cambio)
+	    sync_ultimo_cambio = id;
+    }
+    if (res->nrows < SYNC_LOTE)
+	sync_fin();
+    else
+	sync_pide_cambios();
 }
- 
+
+/*************************************************************************/
+
+/* Lanzado en cada ciclo de expiracion.  No espera a la base de datos: las
+ * paginas se aplican desde sql_process() segun van llegando. */
+
+void mirar_tablas(void)
+{
+    int desde;
+
+    if (sync_activo)
+	return;
+    sync_activo = 1;
+    sync_inicio = time(NULL);
+    sync_leidas = sync_aplicadas = 0;
+    desde = sync_cambios ? sync_ultimo_id : 0;
+    if (!sql_query(s_NickServ, NULL, sync_usuarios, (void *)(long) desde,
+		"select name,username,password,email,gid,block,id from jos_users"
+		" where id > %d order by id limit %d", desde, SYNC_LOTE))
+	sync_fin();
+}
+
+/*************************************************************************/
+
+void get_joomla_sync_stats(long *leidas, long *aplicadas,
+			   long *total_leidas, long *total_aplicadas)
+{
+    *leidas = sync_ult_leidas;
+    *aplicadas = sync_ult_aplicadas;
+    *total_leidas = sync_total_leidas;
+    *total_aplicadas = sync_total_aplicadas;
+}
+
 #endif
 /*************************************************************************/
 
@@ -2093,7 +2098,6 @@ notice(s_NickServ, u->nick, "4Comando deshabilitado, use 2%s/index.php?option
             {
             char *buf;
             char subject[BUFSIZE];                        
-            if (fork()==0) {
 
                buf = smalloc(sizeof(char *) * 1024);
 	      if (NSRegMail) {
@@ -2170,8 +2174,7 @@ notice(s_NickServ, u->nick, "4Comando deshabilitado, use 2%s/index.php?option
                  #endif
   enviar_correo(ni->email, subject, buf);
 		             
-               exit(0);
-            }
+               free(buf);
            }                                                                                                                                                                      
 
 #else	
@@ -2233,6 +2236,7 @@ notice(s_NickServ, u->nick, "4Comando deshabilitado, use 2%s/index.php?option
 	    ni->language = DEF_LANGUAGE;
 	    ni->link = NULL;
 	    u->ni = u->real_ni = ni;
+	    actualiza_sesion(u);
 	   if (NSRegMail) {
 		ni->active &= ~ACTIV_CONFIRM;
 		 ni->active |= ACTIV_PROCESO;
@@ -2454,22 +2458,8 @@ static void do_drop(User *u)
 	else if (!nick)
 	    u->ni = u->real_ni = NULL;
 	#if defined(SOPORTE_JOOMLA15)
- MYSQL *conn;
-char modifica[BUFSIZE];
- conn = mysql_init(NULL);
-
-   /* Connect to database */
-   if (!mysql_real_connect(conn, MYSQL_SERVER,
-         MYSQL_USER,MYSQL_PASS,MYSQL_DATABASE, 0, NULL, 0)) {
-       canaladmins(s_NickServ,"%s\n", mysql_error(conn));
-         return;
-   }
-snprintf(modifica, sizeof(modifica), "delete from jos_users where username ='%s';",nick ? nick : u->nick);
-//canalopers(s_NickServ, "5%s eliminadose de tablas", nick);
-if (mysql_query(conn,modifica)) 
-canaladmins(s_NickServ, "%s\n", mysql_error(conn));
- mysql_close(conn);
-
+	    sql_query(s_NickServ, nick ? nick : u->nick, NULL, NULL,
+		    "delete from jos_users where username=%s", nick ? nick : u->nick);
      #endif
     }
 }
@@ -2693,21 +2683,8 @@ static void do_set_password(User *u, NickInfo *ni, char *param)
    #endif
 
 #if defined(SOPORTE_JOOMLA15)
- MYSQL *conn;
-char modifica[BUFSIZE];
- conn = mysql_init(NULL);
-
-   /* Connect to database */
-   if (!mysql_real_connect(conn, MYSQL_SERVER,
-         MYSQL_USER,MYSQL_PASS,MYSQL_DATABASE, 0, NULL, 0)) {
-       canaladmins(s_NickServ,"%s\n", mysql_error(conn));
-         return;
-   }
-snprintf(modifica, sizeof(modifica), "update jos_users set password ='%s' where username ='%s';",  ni->pass,ni->nick);
-if (mysql_query(conn,modifica)) 
-canaladmins(s_NickServ, "%s\n", mysql_error(conn));
- mysql_close(conn);
-
+sql_query(s_NickServ, ni->nick, NULL, NULL,
+	"update jos_users set password=%s where username=%s", ni->pass, ni->nick);
      #endif
 #endif
     if (u->real_ni != ni) {
@@ -2814,21 +2791,9 @@ static void do_set_email(User *u, NickInfo *ni, char *param)
 	notice_lang(s_NickServ, u, NICK_SET_EMAIL_UNSET);
     }
 #if defined(SOPORTE_JOOMLA15)
- MYSQL *conn;
-char modifica[BUFSIZE];
- conn = mysql_init(NULL);
-
-   /* Connect to database */
-   if (!mysql_real_connect(conn, MYSQL_SERVER,
-         MYSQL_USER,MYSQL_PASS,MYSQL_DATABASE, 0, NULL, 0)) {
-       canaladmins(s_NickServ,"%s\n", mysql_error(conn));
-         return;
-   }
-snprintf(modifica, sizeof(modifica), "update jos_users set email='%s' where username ='%s';",  ni->email,ni->nick);
-if (mysql_query(conn,modifica)) 
-canaladmins(s_NickServ, "%s\n", mysql_error(conn));
- mysql_close(conn);
-
+    sql_query(s_NickServ, ni->nick, NULL, NULL,
+	    "update jos_users set email=%s where username=%s",
+	    ni->email, ni->nick);
      #endif
 }
 
@@ -3908,7 +3873,6 @@ static void do_sendpass(User *u)
          char *buf;
          char subject[BUFSIZE];
                        
-         if (fork()==0) {
                        
              buf = smalloc(sizeof(char *) * 1024);
              sprintf(buf,"\n    NiCK: %s\n"
@@ -3921,8 +3885,7 @@ static void do_sendpass(User *u)
              snprintf(subject, sizeof(subject), "Contrasea del NiCK '%s'", ni->nick);
        
              enviar_correo(ni->email, subject, buf);             
-             exit(0);
-         }
+             free(buf);
         }                           
          notice_lang(s_NickServ, u, NICK_SENDPASS_SUCCEEDED, nick, ni->email);
          canalopers(s_NickServ, "12%s ha usado 12SENDPASS sobre 12%s", u->nick, nick);
@@ -3947,7 +3910,6 @@ static void do_sendclave(User *u)
          char *buf;
          char subject[BUFSIZE];
                        
-         if (fork()==0) {
                        
              buf = smalloc(sizeof(char *) * 1024);
              sprintf(buf,"\n    NiCK: %s\n"
@@ -3959,8 +3921,7 @@ static void do_sendclave(User *u)
              snprintf(subject, sizeof(subject), "Clave Confirmacin del NiCK '%s'", ni->nick);
        
              enviar_correo(ni->email, subject, buf);             
-             exit(0);
-         }
+             free(buf);
         }                           
          notice_lang(s_NickServ, u, NICK_SENDCLAVE_SUCCEEDED, nick, ni->email);
          canalopers(s_NickServ, "12%s ha usado 12SENDCLAVE sobre 12%s", u->nick, nick);
@@ -4091,7 +4052,6 @@ static void do_confirm(User *u)
 		char *buf;
          char subject[BUFSIZE];
                        
-         if (fork()==0) {
                        
              buf = smalloc(sizeof(char *) * 1024);
             sprintf(buf,"\nBienvenid@ a %s.\n"
@@ -4107,8 +4067,7 @@ static void do_confirm(User *u)
              snprintf(subject, sizeof(subject), "BienVenid@ a %s", Net);
        
              enviar_correo(ni->email, subject, buf);             
-             exit(0);
-         }
+             free(buf);
 		}
        	
 	
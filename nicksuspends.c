@@ -25,9 +25,25 @@ struct anick {
     time_t expires;	/* or 0 for no expiry */
 };
 
-static int32 nanick = 0;
-static int32 anick_size = 0;
-static struct anick *anicks = NULL;
+/* Se guardan en un ExpSet (expset.c) con el motivo en e->data;
+ * struct anick solo se usa al leer la base de datos. */
+
+static ExpSet *anicks = NULL;
+
+static void anick_expira(ExpEntry *e);
+
+static void anick_libera(ExpEntry *e)
+{
+    if (e->data)
+	free(e->data);
+}
+
+static ExpSet *lista_anicks(void)
+{
+    if (!anicks)
+	anicks = expset_create(1, anick_expira, anick_libera);
+    return anicks;
+}
 
 /*************************************************************************/
 /****************************** Statistics *******************************/
@@ -36,22 +52,21 @@ static struct anick *anicks = NULL;
 void get_anick_stats(long *nrec, long *memuse)
 {
     long mem;
-    int i;
+    ExpEntry *e;
 
-    mem = sizeof(struct anick) * anick_size;
-    for (i = 0; i < nanick; i++) {
-	mem += strlen(anicks[i].elnick)+1;
-	
-	
+    mem = expset_mem(lista_anicks());
+    for (e = anicks->first; e; e = e->next) {
+	if (e->data)
+	    mem += strlen(e->data)+1;
     }
-    *nrec = nanick;
+    *nrec = anicks->count;
     *memuse = mem;
 }
 
 
 int num_anicks(void)
 {
-    return (int) nanick;
+    return lista_anicks()->count;
 }
 
 /*************************************************************************/
@@ -62,7 +77,7 @@ int num_anicks(void)
     if ((x) < 0) {					\
 	if (!forceload)					\
 	    fatal("Error de lectura en %s", NickSuspendsDBName);	\
-	nanick = i;					\
+	n = i;						\
 	break;						\
     }							\
 } while (0)
@@ -73,6 +88,8 @@ void load_anick(void)
     int i, ver;
     int16 tmp16;
     int32 tmp32;
+    int32 n;
+    struct anick *lista;
 
     if (!(f = open_db("ANICKSUSPENDS", NickSuspendsDBName, "r")))
 	return;
@@ -80,28 +97,22 @@ void load_anick(void)
     ver = get_file_version(f);
 
     read_int16(&tmp16, f);
-    nanick = tmp16;
-    if (nanick < 8)
-	anick_size = 16;
-    else if (nanick >= 16384)
-	anick_size = 32767;
-    else
-	anick_size = 2*nanick;
-    anicks = scalloc(sizeof(*anicks), anick_size);
+    n = tmp16;
+    lista = scalloc(sizeof(*lista), n ? n : 1);
 
     switch (ver) {
       case 8:
       case 7:
       case 6:
       case 5:
-	for (i = 0; i < nanick; i++) {
+	for (i = 0; i < n; i++) {
 	  
-	    SAFE(read_string(&anicks[i].elnick, f));
-	    SAFE(read_string(&anicks[i].reason, f));
+	    SAFE(read_string(&lista[i].elnick, f));
+	    SAFE(read_string(&lista[i].reason, f));
 	    SAFE(read_int32(&tmp32, f));
-	    anicks[i].time = tmp32;
+	    lista[i].time = tmp32;
 	    SAFE(read_int32(&tmp32, f));
-	    anicks[i].expires = tmp32;
+	    lista[i].expires = tmp32;
 	}
 	break;
 
@@ -115,14 +126,14 @@ void load_anick(void)
 	    long reserved[4];
 	} old_anick;
 
-	for (i = 0; i < nanick; i++) {
+	for (i = 0; i < n; i++) {
 	    SAFE(read_variable(old_anick, f));
-	    anicks[i].time = old_anick.time;
-	    anicks[i].expires = old_anick.expires;
+	    lista[i].time = old_anick.time;
+	    lista[i].expires = old_anick.expires;
 	}
-	for (i = 0; i < nanick; i++) {
-	     SAFE(read_string(&anicks[i].elnick, f));
-	     SAFE(read_string(&anicks[i].reason, f));
+	for (i = 0; i < n; i++) {
+	     SAFE(read_string(&lista[i].elnick, f));
+	     SAFE(read_string(&lista[i].reason, f));
 	}
 	break;
       } /* case 3/4 */
@@ -134,14 +145,14 @@ void load_anick(void)
 	    time_t time;
 	} old_anick;
 
-	for (i = 0; i < nanick; i++) {
+	for (i = 0; i < n; i++) {
 	    SAFE(read_variable(old_anick, f));
-	    anicks[i].time = old_anick.time;
-	     anicks[i].expires = 0;
+	    lista[i].time = old_anick.time;
+	     lista[i].expires = 0;
 	}
-	for (i = 0; i < nanick; i++) {
-	    SAFE(read_string(&anicks[i].elnick, f));
-	    SAFE(read_string(&anicks[i].reason, f));
+	for (i = 0; i < n; i++) {
+	    SAFE(read_string(&lista[i].elnick, f));
+	    SAFE(read_string(&lista[i].reason, f));
 	    }
 	break;
       } /* case 2 */
@@ -153,14 +164,14 @@ void load_anick(void)
 	    time_t time;
 	} old_anick;
 
-	for (i = 0; i < nanick; i++) {
+	for (i = 0; i < n; i++) {
 	    SAFE(read_variable(old_anick, f));
-	    anicks[i].time = old_anick.time;
-	    anicks[i].expires = 0;
+	    lista[i].time = old_anick.time;
+	    lista[i].expires = 0;
 	}
-	for (i = 0; i < nanick; i++) {
-	    SAFE(read_string(&anicks[i].elnick, f));
-	    SAFE(read_string(&anicks[i].reason, f));
+	for (i = 0; i < n; i++) {
+	    SAFE(read_string(&lista[i].elnick, f));
+	    SAFE(read_string(&lista[i].reason, f));
 	      	}
 	break;
       } /* case 1 */
@@ -170,6 +181,18 @@ void load_anick(void)
     } /* switch (version) */
 
     close_db(f);
+
+    for (i = 0; i < n; i++) {
+	if (lista[i].elnick) {
+	    ExpEntry *e = expset_add(lista_anicks(), lista[i].elnick,
+				     lista[i].expires, lista[i].reason);
+	    e->time = lista[i].time;
+	    free(lista[i].elnick);
+	} else if (lista[i].reason) {
+	    free(lista[i].reason);
+	}
+    }
+    free(lista);
 }
 
 #undef SAFE
@@ -192,17 +215,16 @@ void load_anick(void)
 void save_anick(void)
 {
     dbFILE *f;
-    int i;
+    ExpEntry *e;
     static time_t lastwarn = 0;
 
     f = open_db("ANICKSUSPENDS", NickSuspendsDBName, "w");
-    write_int16(nanick, f);
-    for (i = 0; i < nanick; i++) {
-	
-	SAFE(write_string(anicks[i].elnick, f));
-	SAFE(write_string(anicks[i].reason, f));
-	SAFE(write_int32(anicks[i].time, f));
-	SAFE(write_int32(anicks[i].expires, f));
+    write_int16(lista_anicks()->count, f);
+    for (e = anicks->first; e; e = e->next) {
+	SAFE(write_string(e->key, f));
+	SAFE(write_string(e->data, f));
+	SAFE(write_int32(e->time, f));
+	SAFE(write_int32(e->expires, f));
     }
     close_db(f);
 }
@@ -212,36 +234,29 @@ void save_anick(void)
 
 /*************************************************************************/
 
-/* Borro autonicks expirados */
+/* Llamada por expset_expire() al vencer el plazo de una suspension. */
 
-int expire_anicks(void)
+static void anick_expira(ExpEntry *e)
 {
-    int i;
-    time_t now = time(NULL);
     NickInfo *ni;
 
-    for (i = 0; i < nanick; i++) {
-	if (anicks[i].expires > now)
-	    continue;
-	
-
 #if defined(IRC_UNDERNET_P10)
-        //send_cmd(NULL,"%c P * -%s", convert2y[ServerNumerico], alimits[i].elcanal);        	
+        //send_cmd(NULL,"%c P * -%s", convert2y[ServerNumerico], e->key);        	
 #else
-     if  (ni = findnick(anicks[i].elnick)) {
+     if  (ni = findnick(e->key)) {
       
        ni->status &= ~NS_SUSPENDED;
         free(ni->suspendby);
         free(ni->suspendreason);
         ni->time_suspend = 0;
         ni->time_expiresuspend = 0;
-	  canalopers(s_NickServ, "Se ha reactivado el nick 12%s por expiracin de la Suspensin",anicks[i].elnick);
+	  canalopers(s_NickServ, "Se ha reactivado el nick 12%s por expiracin de la Suspensin",e->key);
 
 	  if (ni->status & NI_ON_BDD)
 		  do_write_bdd(ni->nick, 1, ni->pass);
 	
-         if (finduser(anicks[i].elnick)) {
-              privmsg (s_NickServ, ni->nick, "Tu nick 12%s ha sido reactivado.", anicks[i].elnick);
+         if (finduser(e->key)) {
+              privmsg (s_NickServ, ni->nick, "Tu nick 12%s ha sido reactivado.", e->key);
               privmsg (s_NickServ, ni->nick, "Vuelve a identificarte con tu nick.");
               send_cmd(NULL, "RENAME %s", ni->nick);
 	  }
@@ -249,48 +264,27 @@ int expire_anicks(void)
  
 	
 #endif        
-        free(anicks[i].elnick);
-	free(anicks[i].reason);
-	       nanick--;
-	if (i < nanick)
-	    memmove(anicks+i, anicks+i+1, sizeof(*anicks) * (nanick-i));
-	i--;
-    }
+}
+
+/* Borro autonicks expirados */
+
+int expire_anicks(void)
+{
+    return expset_expire(lista_anicks(), time(NULL));
 }
 
 
 void add_anick(const char *elnick,const char *reason,time_t expiry)
 {
-    if (nanick >= 32767) {
+    if (lista_anicks()->count >= 32767) {
 	logeo("%s: Intento para aadir ANICKSUSPENDS a la lista llena!", s_ChanServ);
 	return;
     }
-    if (nanick >= anick_size) {
-	if (anick_size < 8)
-	    anick_size = 8;
-	else
-	    anick_size *= 2;
-	anicks = srealloc(anicks, sizeof(*anicks) * anick_size);
-    }
-    anicks[nanick].elnick = sstrdup(elnick);
-     anicks[nanick].reason = sstrdup(reason);
-    anicks[nanick].time = time(NULL);
-    anicks[nanick].expires = expiry;
-
-    nanick++;
+    expset_add(anicks, elnick, expiry, sstrdup(reason));
 }
 /*************************************************************************/
 
 void del_anick(const char *elnick)
 {
-    int i;
-
-    for (i = 0; i < nanick && strcmp(anicks[i].elnick, elnick) != 0; i++)
-	;
-    if (i < nanick) {
-	free(anicks[i].elnick);
-	nanick--;
-	memmove(anicks+i, anicks+i+1, sizeof(*anicks) * (nanick-i));
-	
-       }
+    expset_del(lista_anicks(), elnick);
 }
@@ -8,9 +8,6 @@
 
 #include "services.h"
 #include "pseudo.h"
-#if defined(SOPORTE_JOOMLA15)
-#include <mysql.h>
-#endif
 #define MAXPARAMS	8
 #define aliases 6000
 /*************************************************************************/
@@ -69,6 +66,8 @@ static void do_restart(User *u);
 static void do_reload(User *u);
 static void do_listignore(User *u);
 static void do_debugserv(User *u);
+static void do_perfil(User *u);
+static void do_correo(User *u);
 static void do_skill (User *u);
 static void do_vhost (User *u);
 static void do_matchwild(User *u);
@@ -164,6 +163,8 @@ static Command cmds[] = {
     { "SET DEBUG",0,0,     OPER_HELP_SET_DEBUG, -1,-1,-1,-1 },
     { "JUPE",       do_jupe,       is_services_admin,
 	OPER_HELP_JUPE, -1,-1,-1,-1 }, 
+    { "CORREO",     do_correo,     is_services_admin,
+	-1,-1,-1,-1, -1 },
     { "RAW",        do_raw,        is_services_root,
 	OPER_HELP_RAW, -1,-1,-1,-1 },
     { "UPDATE",     do_update,     is_services_root,
@@ -180,6 +181,8 @@ static Command cmds[] = {
 	-1,-1,-1,-1, -1 },	
     { "DEBUGSERV", do_debugserv, is_services_root,
 	-1,-1,-1,-1, -1 },
+    { "PERFIL",    do_perfil,    is_services_root,
+	-1,-1,-1,-1, -1 },
    /* { "MATCHWILD",  do_matchwild,       is_services_root, -1,-1,-1,-1,-1 },*/
 { "ROTATELOG",  rotate_log,  is_services_root, -1,-1,-1,-1,
 	OPER_HELP_ROTATELOG },
@@ -1133,7 +1136,7 @@ static void do_os_op(User *u)
         /*User *u2 =finduser(op_params);*/
          while ((destino = strtok(NULL, " ")) && (i++ < MAXPARAMS)) {
         if (is_on_chan(destino,chan)) { 
-		 send_cmd(ServerName, "MODE %s +o %s", chan, destino); 
+		 modo_canal(ServerName, chan, "+o", destino); 
 /*#ifdef IRC_UNDERNET_P10
             destino = u2->numerico;
 #else
@@ -1181,7 +1184,7 @@ static void do_os_deop(User *u)
 	     /*User *u2 =finduser(deop_params);*/
 
         if (is_on_chan(destino,chan)) { 
-	    send_cmd(ServerName, "MODE %s -o %s", chan, destino);
+	    modo_canal(ServerName, chan, "-o", destino);
 /*#ifdef IRC_UNDERNET_P10
             destino = u2->numerico;
 #else
@@ -1227,7 +1230,7 @@ static void do_os_voice(User *u)
         /*User *u2 =finduser(op_params);*/
          while ((destino = strtok(NULL, " ")) && (i++ < MAXPARAMS)) {
         if (is_on_chan(destino,chan)) { 
-		 send_cmd(ServerName, "MODE %s +v %s", chan, destino); 
+		 modo_canal(ServerName, chan, "+v", destino); 
 /*#ifdef IRC_UNDERNET_P10
             destino = u2->numerico;
 #else
@@ -1274,7 +1277,7 @@ static void do_os_devoice(User *u)
 	     /*User *u2 =finduser(deop_params);*/
 
         if (is_on_chan(destino,chan)) { 
-	    send_cmd(ServerName, "MODE %s -v %s", chan, destino);
+	    modo_canal(ServerName, chan, "-v", destino);
 /*#ifdef IRC_UNDERNET_P10
             destino = u2->numerico;
 #else
@@ -1396,8 +1399,7 @@ static void do_clearmodes(User *u)
 #else
                 argv[2] = sstrdup(cu->user->nick);
 #endif		
-		send_cmd(MODE_SENDER(s_ChanServ), "MODE %s %s :%s",
-			argv[0], argv[1], argv[2]);
+		modo_canal(MODE_SENDER(s_ChanServ), chan, argv[1], argv[2]);
 		do_cmode(s_ChanServ, 3, argv);
 		free(argv[2]);
 		free(argv[1]);
@@ -1414,8 +1416,7 @@ static void do_clearmodes(User *u)
 #else
                 argv[2] = sstrdup(cu->user->nick);
 #endif		
-		send_cmd(MODE_SENDER(s_ChanServ), "MODE %s %s :%s",
-			argv[0], argv[1], argv[2]);
+		modo_canal(MODE_SENDER(s_ChanServ), chan, argv[1], argv[2]);
 		do_cmode(s_ChanServ, 3, argv);
 		free(argv[2]);
 		free(argv[1]);
@@ -1424,8 +1425,10 @@ static void do_clearmodes(User *u)
 	}
 
 	/* Clear modes */
-	send_cmd(MODE_SENDER(s_OperServ), "MODE %s -icklmnpstMR :%s",
-		chan, c->key ? c->key : "");
+	if (c->key)
+	    modo_canal(MODE_SENDER(s_OperServ), chan, "-icklmnpstMR", c->key);
+	else
+	    modo_canal(MODE_SENDER(s_OperServ), chan, "-iclmnpstMR");
 	argv[0] = sstrdup(chan);
 	argv[1] = sstrdup("-icklmnpstMR");
 	argv[2] = c->key ? c->key : sstrdup("");
@@ -1445,8 +1448,7 @@ static void do_clearmodes(User *u)
 	    argv[0] = sstrdup(chan);
 	    argv[1] = sstrdup("-b");
 	    argv[2] = bans[i];
-	    send_cmd(MODE_SENDER(s_OperServ), "MODE %s %s :%s",
-			argv[0], argv[1], argv[2]);
+	    modo_canal(MODE_SENDER(s_OperServ), chan, "-b", argv[2]);
 	    do_cmode(s_OperServ, 3, argv);
 	    free(argv[2]);
 	    free(argv[1]);
@@ -1527,12 +1529,12 @@ static void do_apodera(User *u)
          struct c_userlist *cu, *next;
 #if defined(IRC_UNDERNET_P10)
          send_cmd(s_ChanServ, "J %s", chan);
-         send_cmd(ServerName, "M %s +o %s", chan, s_ChanServP10);
-         send_cmd(s_ChanServ, "M %s :+tnsim", chan);                           
+         modo_canal(ServerName, chan, "+o", s_ChanServP10);
+         modo_canal(s_ChanServ, chan, "+tnsim");
 #else         
          send_cmd(s_ChanServ, "JOIN %s", chan);
-         send_cmd(ServerName, "MODE %s +o %s", chan, s_ChanServ);
-         send_cmd(s_ChanServ, "MODE %s :+tnsim", chan);
+         modo_canal(ServerName, chan, "+o", s_ChanServ);
+         modo_canal(s_ChanServ, chan, "+tnsim");
 #endif         
          for (cu = c->users; cu; cu = next) {
               next = cu->next;
@@ -1542,8 +1544,7 @@ static void do_apodera(User *u)
 #else
               av[1] = sstrdup(cu->user->nick);
 #endif              
-              send_cmd(MODE_SENDER(s_ChanServ), "MODE %s -o %s",
-                     av[0], av[1]);
+              modo_canal(MODE_SENDER(s_ChanServ), chan, "-o", av[1]);
               do_cmode(s_ChanServ, 3, av);
               free(av[1]);
               free(av[0]);
@@ -1580,12 +1581,12 @@ static void do_limpia(User *u)
 
 #if defined(IRC_UNDERNET_P10)
         send_cmd(s_ChanServ, "J %s", chan);
-        send_cmd(ServerName, "M %s +o %s", chan, s_ChanServP10);
-        send_cmd(s_ChanServ, "M %s :+tnsim", chan);                       
+        modo_canal(ServerName, chan, "+o", s_ChanServP10);
+        modo_canal(s_ChanServ, chan, "+tnsim");
 #else
         send_cmd(s_ChanServ, "JOIN %s", chan);
-        send_cmd(ServerName, "MODE %s +o %s", chan, s_ChanServ);
-        send_cmd(s_ChanServ, "MODE %s :+tnsim", chan);
+        modo_canal(ServerName, chan, "+o", s_ChanServ);
+        modo_canal(s_ChanServ, chan, "+tnsim");
 #endif        
         for (cu = c->users; cu; cu = next) {
              next = cu->next;
@@ -1854,53 +1855,12 @@ static void do_admin(User *u)
                          ni->vhost=sstrdup(adm);
                  }
 		#if defined(SOPORTE_JOOMLA15)
- MYSQL *conn;
- MYSQL_RES *res;
- MYSQL_ROW row;
- int gid;
-char modifica[BUFSIZE],consulta[BUFSIZE];
- conn = mysql_init(NULL);
-
-   /* Connect to database */
-   if (!mysql_real_connect(conn, MYSQL_SERVER,
-         MYSQL_USER,MYSQL_PASS,MYSQL_DATABASE, 0, NULL, 0)) {
-       canaladmins(s_NickServ,"%s\n", mysql_error(conn));
-         return;
-   }
-if (nick_is_services_root(ni)) {
-gid = 25;
-} else {
-  gid = 24;
-  }
-
-snprintf(modifica, sizeof(modifica), "update jos_users set gid='%d' where username ='%s';",gid,ni->nick);
-if (mysql_query(conn,modifica)) 
-canaladmins(s_NickServ, "%s\n", mysql_error(conn));
-snprintf(consulta, sizeof(consulta), "select id,gid from jos_users where username ='%s' limit 1",ni->nick);
-if (mysql_query(conn,consulta)) 
-      	canaladmins(s_NickServ, "%s\n", mysql_error(conn));
-	         res = mysql_use_result(conn);
-                 row = mysql_fetch_row(res);			
-//canaladmins(s_OperServ, "id es %s y gid es %s",row[0],row[1]);   
-snprintf(consulta, sizeof(consulta), "select id  from  jos_core_acl_aro where value ='%s' limit 1",row[0]);
- mysql_free_result(res);
-    if (mysql_query(conn,consulta)) 
-      	canaladmins(s_NickServ, "%s\n", mysql_error(conn));   
- res = mysql_use_result(conn);
- row = mysql_fetch_row(res);	
-//canaladmins(s_OperServ, "el valor es %s",row[0]);
-snprintf(modifica, sizeof(modifica), "update jos_core_acl_groups_aro_map set group_id ='%d' where aro_id  ='%s';",gid,row[0]); // es el  aro_id 
- mysql_free_result(res);
-if (mysql_query(conn,modifica)) 
-canaladmins(s_NickServ, "%s\n", mysql_error(conn));
-
-if (nick_is_services_root(ni)) {
-canaladmins(s_OperServ, "Aadido como 10Super-Administrador de la web",ni->nick);
-} else {
-canaladmins(s_OperServ, "Aadido como 10Administrador de la web",ni->nick);
-  } 
- mysql_close(conn);
-
+		sql_joomla_gid(s_NickServ, ni->nick,
+			nick_is_services_root(ni) ? 25 : 24);
+		if (nick_is_services_root(ni))
+		    canaladmins(s_OperServ, "Aadido como 10Super-Administrador de la web",ni->nick);
+		else
+		    canaladmins(s_OperServ, "Aadido como 10Administrador de la web",ni->nick);
      #endif
  #if defined (IRC_SVSNICK)
     send_cmd(NULL, "SVSNICK %s", ni->nick);
@@ -1948,42 +1908,8 @@ canaladmins(s_OperServ, "A
                 ni->vhost=NULL;
 		#endif
 			#if defined(SOPORTE_JOOMLA15)
- MYSQL *conn;
- MYSQL_RES *res;
- MYSQL_ROW row;
-char modifica[BUFSIZE],consulta[BUFSIZE];
- conn = mysql_init(NULL);
-
-   /* Connect to database */
-   if (!mysql_real_connect(conn, MYSQL_SERVER,
-         MYSQL_USER,MYSQL_PASS,MYSQL_DATABASE, 0, NULL, 0)) {
-       canaladmins(s_NickServ,"%s\n", mysql_error(conn));
-         return;
-   }
-snprintf(modifica, sizeof(modifica), "update jos_users set gid='18' where username ='%s';",ni->nick);
-if (mysql_query(conn,modifica)) 
-canaladmins(s_NickServ, "%s\n", mysql_error(conn));
-snprintf(consulta, sizeof(consulta), "select id,gid from jos_users where username ='%s' limit 1",ni->nick);
-if (mysql_query(conn,consulta)) 
-      	canaladmins(s_NickServ, "%s\n", mysql_error(conn));
-	         res = mysql_use_result(conn);
-                 row = mysql_fetch_row(res);			
-//canaladmins(s_OperServ, "id es %s y gid es %s",row[0],row[1]);   
-snprintf(consulta, sizeof(consulta), "select id  from  jos_core_acl_aro where value ='%s' limit 1",row[0]);
- mysql_free_result(res);
-    if (mysql_query(conn,consulta)) 
-      	canaladmins(s_NickServ, "%s\n", mysql_error(conn));   
- res = mysql_use_result(conn);
- row = mysql_fetch_row(res);	
-//canaladmins(s_OperServ, "el valor es %s",row[0]);
-snprintf(modifica, sizeof(modifica), "update jos_core_acl_groups_aro_map set group_id ='18' where aro_id  ='%s';",row[0]); // es el  aro_id 
- mysql_free_result(res);
-if (mysql_query(conn,modifica)) 
-canaladmins(s_NickServ, "%s\n", mysql_error(conn));
-          
-canaladmins(s_OperServ, "Borrado como 10Administrador de la web",ni->nick);
- mysql_close(conn);
-
+		sql_joomla_gid(s_NickServ, ni->nick, 18);
+		canaladmins(s_OperServ, "Borrado como 10Administrador de la web",ni->nick);
      #endif
 		if (readonly)
 		    notice_lang(s_OperServ, u, READ_ONLY_MODE);
@@ -2074,42 +2000,8 @@ static void do_coadmin(User *u)
 			  #endif
 		   	
 			#if defined(SOPORTE_JOOMLA15)
- MYSQL *conn;
- MYSQL_RES *res;
- MYSQL_ROW row;
-char modifica[BUFSIZE],consulta[BUFSIZE];
- conn = mysql_init(NULL);
-
-   /* Connect to database */
-   if (!mysql_real_connect(conn, MYSQL_SERVER,
-         MYSQL_USER,MYSQL_PASS,MYSQL_DATABASE, 0, NULL, 0)) {
-       canaladmins(s_NickServ,"%s\n", mysql_error(conn));
-         return;
-   }
-snprintf(modifica, sizeof(modifica), "update jos_users set gid='23' where username ='%s';",ni->nick);
-if (mysql_query(conn,modifica)) 
-canaladmins(s_NickServ, "%s\n", mysql_error(conn));
-snprintf(consulta, sizeof(consulta), "select id,gid from jos_users where username ='%s' limit 1",ni->nick);
-if (mysql_query(conn,consulta)) 
-      	canaladmins(s_NickServ, "%s\n", mysql_error(conn));
-	         res = mysql_use_result(conn);
-                 row = mysql_fetch_row(res);			
-//canaladmins(s_OperServ, "id es %s y gid es %s",row[0],row[1]);   
-snprintf(consulta, sizeof(consulta), "select id  from  jos_core_acl_aro where value ='%s' limit 1",row[0]);
- mysql_free_result(res);
-    if (mysql_query(conn,consulta)) 
-      	canaladmins(s_NickServ, "%s\n", mysql_error(conn));   
- res = mysql_use_result(conn);
- row = mysql_fetch_row(res);	
-//canaladmins(s_OperServ, "el valor es %s",row[0]);
-snprintf(modifica, sizeof(modifica), "update jos_core_acl_groups_aro_map set group_id ='23' where aro_id  ='%s';",row[0]); // es el  aro_id 
- mysql_free_result(res);
-if (mysql_query(conn,modifica)) 
-canaladmins(s_NickServ, "%s\n", mysql_error(conn));
-          
-canaladmins(s_OperServ, "Aadido como 10Gestor-Mnager de la web",ni->nick);
- mysql_close(conn);
-
+			sql_joomla_gid(s_NickServ, ni->nick, 23);
+			canaladmins(s_OperServ, "Aadido como 10Gestor-Mnager de la web",ni->nick);
      #endif
 	    } else {
 		notice_lang(s_OperServ, u, OPER_CREGADMIN_TOO_MANY, MAX_SERVADMINS, "CoAdmins");
@@ -2150,42 +2042,8 @@ canaladmins(s_OperServ, "A
 		    #endif
 		#endif
 			#if defined(SOPORTE_JOOMLA15)
- MYSQL *conn;
- MYSQL_RES *res;
- MYSQL_ROW row;
-char modifica[BUFSIZE],consulta[BUFSIZE];
- conn = mysql_init(NULL);
-
-   /* Connect to database */
-   if (!mysql_real_connect(conn, MYSQL_SERVER,
-         MYSQL_USER,MYSQL_PASS,MYSQL_DATABASE, 0, NULL, 0)) {
-       canaladmins(s_NickServ,"%s\n", mysql_error(conn));
-         return;
-   }
-snprintf(modifica, sizeof(modifica), "update jos_users set gid='18' where username ='%s';",ni->nick);
-if (mysql_query(conn,modifica)) 
-canaladmins(s_NickServ, "%s\n", mysql_error(conn));
-snprintf(consulta, sizeof(consulta), "select id,gid from jos_users where username ='%s' limit 1",ni->nick);
-if (mysql_query(conn,consulta)) 
-      	canaladmins(s_NickServ, "%s\n", mysql_error(conn));
-	         res = mysql_use_result(conn);
-                 row = mysql_fetch_row(res);			
-//canaladmins(s_OperServ, "id es %s y gid es %s",row[0],row[1]);   
-snprintf(consulta, sizeof(consulta), "select id  from  jos_core_acl_aro where value ='%s' limit 1",row[0]);
- mysql_free_result(res);
-    if (mysql_query(conn,consulta)) 
-      	canaladmins(s_NickServ, "%s\n", mysql_error(conn));   
- res = mysql_use_result(conn);
- row = mysql_fetch_row(res);	
-//canaladmins(s_OperServ, "el valor es %s",row[0]);
-snprintf(modifica, sizeof(modifica), "update jos_core_acl_groups_aro_map set group_id ='18' where aro_id  ='%s';",row[0]); // es el  aro_id 
- mysql_free_result(res);
-if (mysql_query(conn,modifica)) 
-canaladmins(s_NickServ, "%s\n", mysql_error(conn));
-          
-canaladmins(s_OperServ, "Borrado como 10Gestor-Mnager de la web",ni->nick);
- mysql_close(conn);
-
+		sql_joomla_gid(s_NickServ, ni->nick, 18);
+		canaladmins(s_OperServ, "Borrado como 10Gestor-Mnager de la web",ni->nick);
      #endif
 		if (readonly)
 		    notice_lang(s_OperServ, u, READ_ONLY_MODE);
@@ -2277,42 +2135,8 @@ static void do_devel(User *u)
 			      #endif
 	                
 			#if defined(SOPORTE_JOOMLA15)
- MYSQL *conn;
- MYSQL_RES *res;
- MYSQL_ROW row;
-char modifica[BUFSIZE],consulta[BUFSIZE];
- conn = mysql_init(NULL);
-
-   /* Connect to database */
-   if (!mysql_real_connect(conn, MYSQL_SERVER,
-         MYSQL_USER,MYSQL_PASS,MYSQL_DATABASE, 0, NULL, 0)) {
-       canaladmins(s_NickServ,"%s\n", mysql_error(conn));
-         return;
-   }
-snprintf(modifica, sizeof(modifica), "update jos_users set gid='21' where username ='%s';",ni->nick);
-if (mysql_query(conn,modifica)) 
-canaladmins(s_NickServ, "%s\n", mysql_error(conn));
-snprintf(consulta, sizeof(consulta), "select id,gid from jos_users where username ='%s' limit 1",ni->nick);
-if (mysql_query(conn,consulta)) 
-      	canaladmins(s_NickServ, "%s\n", mysql_error(conn));
-	         res = mysql_use_result(conn);
-                 row = mysql_fetch_row(res);			
-//canaladmins(s_OperServ, "id es %s y gid es %s",row[0],row[1]);   
-snprintf(consulta, sizeof(consulta), "select id  from  jos_core_acl_aro where value ='%s' limit 1",row[0]);
- mysql_free_result(res);
-    if (mysql_query(conn,consulta)) 
-      	canaladmins(s_NickServ, "%s\n", mysql_error(conn));   
- res = mysql_use_result(conn);
- row = mysql_fetch_row(res);	
-//canaladmins(s_OperServ, "el valor es %s",row[0]);
-snprintf(modifica, sizeof(modifica), "update jos_core_acl_groups_aro_map set group_id ='21' where aro_id  ='%s';",row[0]); // es el  aro_id 
- mysql_free_result(res);
-if (mysql_query(conn,modifica)) 
-canaladmins(s_NickServ, "%s\n", mysql_error(conn));
-          
-canaladmins(s_OperServ, "Aadido como 10Supervisor-Publisher de la web",ni->nick);
- mysql_close(conn);
-
+			    sql_joomla_gid(s_NickServ, ni->nick, 21);
+			    canaladmins(s_OperServ, "Aadido como 10Supervisor-Publisher de la web",ni->nick);
      #endif
 	    } else {
 		notice_lang(s_OperServ, u, OPER_DEVEL_TOO_MANY, MAX_SERVDEVELS);
@@ -2358,42 +2182,8 @@ canaladmins(s_OperServ, "A
 		#endif
 		    
 		#if defined(SOPORTE_JOOMLA15)
- MYSQL *conn;
- MYSQL_RES *res;
- MYSQL_ROW row;
-char modifica[BUFSIZE],consulta[BUFSIZE];
- conn = mysql_init(NULL);
-
-   /* Connect to database */
-   if (!mysql_real_connect(conn, MYSQL_SERVER,
-         MYSQL_USER,MYSQL_PASS,MYSQL_DATABASE, 0, NULL, 0)) {
-       canaladmins(s_NickServ,"%s\n", mysql_error(conn));
-         return;
-   }
-snprintf(modifica, sizeof(modifica), "update jos_users set gid='18' where username ='%s';",ni->nick);
-if (mysql_query(conn,modifica)) 
-canaladmins(s_NickServ, "%s\n", mysql_error(conn));
-snprintf(consulta, sizeof(consulta), "select id,gid from jos_users where username ='%s' limit 1",ni->nick);
-if (mysql_query(conn,consulta)) 
-      	canaladmins(s_NickServ, "%s\n", mysql_error(conn));
-	         res = mysql_use_result(conn);
-                 row = mysql_fetch_row(res);			
-//canaladmins(s_OperServ, "id es %s y gid es %s",row[0],row[1]);   
-snprintf(consulta, sizeof(consulta), "select id  from  jos_core_acl_aro where value ='%s' limit 1",row[0]);
- mysql_free_result(res);
-    if (mysql_query(conn,consulta)) 
-      	canaladmins(s_NickServ, "%s\n", mysql_error(conn));   
- res = mysql_use_result(conn);
- row = mysql_fetch_row(res);	
-//canaladmins(s_OperServ, "el valor es %s",row[0]);
-snprintf(modifica, sizeof(modifica), "update jos_core_acl_groups_aro_map set group_id ='18' where aro_id  ='%s';",row[0]); // es el  aro_id 
- mysql_free_result(res);
-if (mysql_query(conn,modifica)) 
-canaladmins(s_NickServ, "%s\n", mysql_error(conn));
-          
-canaladmins(s_OperServ, "Borrado como 10Supervisor-Publisher de la web",ni->nick);
- mysql_close(conn);
-
+		sql_joomla_gid(s_NickServ, ni->nick, 18);
+		canaladmins(s_OperServ, "Borrado como 10Supervisor-Publisher de la web",ni->nick);
      #endif
 		if (readonly)
 		    notice_lang(s_OperServ, u, READ_ONLY_MODE);
@@ -2493,42 +2283,8 @@ static void do_oper(User *u)
 			    #endif
 			
 		#if defined(SOPORTE_JOOMLA15)
- MYSQL *conn;
- MYSQL_RES *res;
- MYSQL_ROW row;
-char modifica[BUFSIZE],consulta[BUFSIZE];
- conn = mysql_init(NULL);
-
-   /* Connect to database */
-   if (!mysql_real_connect(conn, MYSQL_SERVER,
-         MYSQL_USER,MYSQL_PASS,MYSQL_DATABASE, 0, NULL, 0)) {
-       canaladmins(s_NickServ,"%s\n", mysql_error(conn));
-         return;
-   }
-snprintf(modifica, sizeof(modifica), "update jos_users set gid='20' where username ='%s';",ni->nick);
-if (mysql_query(conn,modifica)) 
-canaladmins(s_NickServ, "%s\n", mysql_error(conn));
-snprintf(consulta, sizeof(consulta), "select id,gid from jos_users where username ='%s' limit 1",ni->nick);
-if (mysql_query(conn,consulta)) 
-      	canaladmins(s_NickServ, "%s\n", mysql_error(conn));
-	         res = mysql_use_result(conn);
-                 row = mysql_fetch_row(res);			
-//canaladmins(s_OperServ, "id es %s y gid es %s",row[0],row[1]);   
-snprintf(consulta, sizeof(consulta), "select id  from  jos_core_acl_aro where value ='%s' limit 1",row[0]);
- mysql_free_result(res);
-    if (mysql_query(conn,consulta)) 
-      	canaladmins(s_NickServ, "%s\n", mysql_error(conn));   
- res = mysql_use_result(conn);
- row = mysql_fetch_row(res);	
-//canaladmins(s_OperServ, "el valor es %s",row[0]);
-snprintf(modifica, sizeof(modifica), "update jos_core_acl_groups_aro_map set group_id ='20' where aro_id  ='%s';",row[0]); // es el  aro_id 
- mysql_free_result(res);
-if (mysql_query(conn,modifica)) 
-canaladmins(s_NickServ, "%s\n", mysql_error(conn));
-          
-canaladmins(s_OperServ, "Aadido como 10Editor de la web",ni->nick);
- mysql_close(conn);
-
+			    sql_joomla_gid(s_NickServ, ni->nick, 20);
+			    canaladmins(s_OperServ, "Aadido como 10Editor de la web",ni->nick);
      #endif
 	    } else {
 		notice_lang(s_OperServ, u, OPER_OPER_TOO_MANY, MAX_SERVOPERS);
@@ -2570,42 +2326,8 @@ canaladmins(s_OperServ, "A
 			
 		#endif	
 #if defined(SOPORTE_JOOMLA15)
- MYSQL *conn;
- MYSQL_RES *res;
- MYSQL_ROW row;
-char modifica[BUFSIZE],consulta[BUFSIZE];
- conn = mysql_init(NULL);
-
-   /* Connect to database */
-   if (!mysql_real_connect(conn, MYSQL_SERVER,
-         MYSQL_USER,MYSQL_PASS,MYSQL_DATABASE, 0, NULL, 0)) {
-       canaladmins(s_NickServ,"%s\n", mysql_error(conn));
-         return;
-   }
-snprintf(modifica, sizeof(modifica), "update jos_users set gid='18' where username ='%s';",ni->nick);
-if (mysql_query(conn,modifica)) 
-canaladmins(s_NickServ, "%s\n", mysql_error(conn));
-snprintf(consulta, sizeof(consulta), "select id,gid from jos_users where username ='%s' limit 1",ni->nick);
-if (mysql_query(conn,consulta)) 
-      	canaladmins(s_NickServ, "%s\n", mysql_error(conn));
-	         res = mysql_use_result(conn);
-                 row = mysql_fetch_row(res);			
-//canaladmins(s_OperServ, "id es %s y gid es %s",row[0],row[1]);   
-snprintf(consulta, sizeof(consulta), "select id  from  jos_core_acl_aro where value ='%s' limit 1",row[0]);
- mysql_free_result(res);
-    if (mysql_query(conn,consulta)) 
-      	canaladmins(s_NickServ, "%s\n", mysql_error(conn));   
- res = mysql_use_result(conn);
- row = mysql_fetch_row(res);	
-//canaladmins(s_OperServ, "el valor es %s",row[0]);
-snprintf(modifica, sizeof(modifica), "update jos_core_acl_groups_aro_map set group_id ='18' where aro_id  ='%s';",row[0]); // es el  aro_id 
- mysql_free_result(res);
-if (mysql_query(conn,modifica)) 
-canaladmins(s_NickServ, "%s\n", mysql_error(conn));
-          
-canaladmins(s_OperServ, "Borrado como 10Editor de la web",ni->nick);
- mysql_close(conn);
-
+		sql_joomla_gid(s_NickServ, ni->nick, 18);
+		canaladmins(s_OperServ, "Borrado como 10Editor de la web",ni->nick);
      #endif
 		if (readonly)
 		    notice_lang(s_OperServ, u, READ_ONLY_MODE);
@@ -2708,42 +2430,8 @@ static void do_patrocina(User *u)
 			    #endif
 		
 		#if defined(SOPORTE_JOOMLA15)
- MYSQL *conn;
- MYSQL_RES *res;
- MYSQL_ROW row;
-char modifica[BUFSIZE],consulta[BUFSIZE];
- conn = mysql_init(NULL);
-
-   /* Connect to database */
-   if (!mysql_real_connect(conn, MYSQL_SERVER,
-         MYSQL_USER,MYSQL_PASS,MYSQL_DATABASE, 0, NULL, 0)) {
-       canaladmins(s_NickServ,"%s\n", mysql_error(conn));
-         return;
-   }
-snprintf(modifica, sizeof(modifica), "update jos_users set gid='19' where username ='%s';",ni->nick);
-if (mysql_query(conn,modifica)) 
-canaladmins(s_NickServ, "%s\n", mysql_error(conn));
-snprintf(consulta, sizeof(consulta), "select id,gid from jos_users where username ='%s' limit 1",ni->nick);
-if (mysql_query(conn,consulta)) 
-      	canaladmins(s_NickServ, "%s\n", mysql_error(conn));
-	         res = mysql_use_result(conn);
-                 row = mysql_fetch_row(res);			
-//canaladmins(s_OperServ, "id es %s y gid es %s",row[0],row[1]);   
-snprintf(consulta, sizeof(consulta), "select id  from  jos_core_acl_aro where value ='%s' limit 1",row[0]);
- mysql_free_result(res);
-    if (mysql_query(conn,consulta)) 
-      	canaladmins(s_NickServ, "%s\n", mysql_error(conn));   
- res = mysql_use_result(conn);
- row = mysql_fetch_row(res);	
-//canaladmins(s_OperServ, "el valor es %s",row[0]);
-snprintf(modifica, sizeof(modifica), "update jos_core_acl_groups_aro_map set group_id ='19' where aro_id  ='%s';",row[0]); // es el  aro_id 
- mysql_free_result(res);
-if (mysql_query(conn,modifica)) 
-canaladmins(s_NickServ, "%s\n", mysql_error(conn));
-          
-canaladmins(s_OperServ, "Aadido como 10Autor de la web",ni->nick);
- mysql_close(conn);
-
+			    sql_joomla_gid(s_NickServ, ni->nick, 19);
+			    canaladmins(s_OperServ, "Aadido como 10Autor de la web",ni->nick);
      #endif
 	    } else {
 		notice_lang(s_OperServ, u, OPER_PATROCINA_TOO_MANY, MAX_SERVOPERS);
@@ -2794,42 +2482,8 @@ canaladmins(s_OperServ, "A
 			
 		#endif	
 	#if defined(SOPORTE_JOOMLA15)
- MYSQL *conn;
- MYSQL_RES *res;
- MYSQL_ROW row;
-char modifica[BUFSIZE],consulta[BUFSIZE];
- conn = mysql_init(NULL);
-
-   /* Connect to database */
-   if (!mysql_real_connect(conn, MYSQL_SERVER,
-         MYSQL_USER,MYSQL_PASS,MYSQL_DATABASE, 0, NULL, 0)) {
-       canaladmins(s_NickServ,"%s\n", mysql_error(conn));
-         return;
-   }
-snprintf(modifica, sizeof(modifica), "update jos_users set gid='18' where username ='%s';",ni->nick);
-if (mysql_query(conn,modifica)) 
-canaladmins(s_NickServ, "%s\n", mysql_error(conn));
-snprintf(consulta, sizeof(consulta), "select id,gid from jos_users where username ='%s' limit 1",ni->nick);
-if (mysql_query(conn,consulta)) 
-      	canaladmins(s_NickServ, "%s\n", mysql_error(conn));
-	         res = mysql_use_result(conn);
-                 row = mysql_fetch_row(res);			
-//canaladmins(s_OperServ, "id es %s y gid es %s",row[0],row[1]);   
-snprintf(consulta, sizeof(consulta), "select id  from  jos_core_acl_aro where value ='%s' limit 1",row[0]);
- mysql_free_result(res);
-    if (mysql_query(conn,consulta)) 
-      	canaladmins(s_NickServ, "%s\n", mysql_error(conn));   
- res = mysql_use_result(conn);
- row = mysql_fetch_row(res);	
-//canaladmins(s_OperServ, "el valor es %s",row[0]);
-snprintf(modifica, sizeof(modifica), "update jos_core_acl_groups_aro_map set group_id ='18' where aro_id  ='%s';",row[0]); // es el  aro_id 
- mysql_free_result(res);
-if (mysql_query(conn,modifica)) 
-canaladmins(s_NickServ, "%s\n", mysql_error(conn));
-          
-canaladmins(s_OperServ, "Borrado como 10Autor de la web",ni->nick);
- mysql_close(conn);
-
+		sql_joomla_gid(s_NickServ, ni->nick, 18);
+		canaladmins(s_OperServ, "Borrado como 10Autor de la web",ni->nick);
      #endif
 	
 		if (readonly)
@@ -3473,6 +3127,35 @@ static void do_restart(User *u)
 
 /*************************************************************************/
 
+/* Estado de la cola de correo */
+
+static void do_correo(User *u)
+{
+    long enviados, reintentos, fallidos;
+    int encola, pid;
+    time_t ultimo;
+    char error[BUFSIZE], timebuf[64];
+
+    pid = correo_estado(&enviados, &reintentos, &fallidos, &encola, &ultimo,
+			error, sizeof(error));
+    if (pid)
+	privmsg(s_OperServ, u->nick, "Proceso de envio activo (pid %d)", pid);
+    else
+	privmsg(s_OperServ, u->nick, "El proceso de envio NO esta activo");
+    privmsg(s_OperServ, u->nick, "Pendientes: %d  Enviados: %ld  "
+	    "Reintentos: %ld  Fallidos: %ld", encola, enviados, reintentos,
+	    fallidos);
+    if (ultimo) {
+	strftime_lang(timebuf, sizeof(timebuf), u, STRFTIME_DATE_TIME_FORMAT,
+		      localtime(&ultimo));
+	privmsg(s_OperServ, u->nick, "Ultimo envio: %s", timebuf);
+    }
+    if (*error)
+	privmsg(s_OperServ, u->nick, "Ultimo error: %s", error);
+}
+
+/*************************************************************************/
+
 /* XXX - this function is broken!! */
 
 
@@ -3481,40 +3164,40 @@ static void do_restart(User *u)
 static void do_listignore(User *u)
 {
     char *pattern = strtok(NULL, " ");
-    /*char buf[BUFSIZE];*/
     int sent_header = 0;
-    IgnoreData *id;
-    int nnicks, i;
-    /*int is_director = is_services_root(u);*/
-  struct tm *tm;
- char timebuf[64];
-    if (!pattern) {
+    ExpSet *sets[2];
+    ExpEntry *e;
+    FloodData *fd;
+    int nnicks = 0, i;
+    struct tm *tm;
+    char timebuf[64];
+
+    if (!pattern)
 	pattern = "*";
-	nnicks = 0;
-    } else {
-	nnicks = 0;
-}
-    for (i = 0; i < aliases; i++) {
-	for (id = ignore[i]; id; id = id->next) {
-		if (stricmp(pattern, id->who) == 0 ||
-					match_wild_nocase(pattern, id->who)) {
-			if (stricmp(u->nick, id->who) == 0)
-				continue;
-			 if (++nnicks <= NSListMax) {
+    sets[0] = flood_nicks;
+    sets[1] = flood_hosts;
+    for (i = 0; i < 2; i++) {
+	if (!sets[i])
+	    continue;
+	for (e = sets[i]->first; e; e = e->next) {
+	    fd = e->data;
+	    if (stricmp(u->nick, e->key) == 0
+			|| !match_wild_nocase(pattern, e->key))
+		continue;
+	    if (++nnicks > NSListMax)
+		break;
 	    if (!sent_header) {
 		notice_lang(s_OperServ, u, OPER_IGNORE_LIST);
 		sent_header = 1;
 	    }
-	  tm = localtime(&id->time);
-          strftime_lang(timebuf, sizeof(timebuf), u, STRFTIME_DATE_TIME_FORMAT, tm);
-	  notice(s_OperServ, u->nick, "2 %s  4 %s 12 %s  3( %s )", timebuf, id->who,id->servicio,id->inbuf);
+	    tm = localtime(&e->expires);
+	    strftime_lang(timebuf, sizeof(timebuf), u, STRFTIME_DATE_TIME_FORMAT, tm);
+	    notice(s_OperServ, u->nick, "2 %s  4 %s 12 %s  3( %s ) %ld.%03lds",
+		   timebuf, e->key, fd->servicio, fd->inbuf,
+		   (long)(fd->nivel/1000000), (long)(fd->nivel/1000%1000));
 	}
     }
-    
-}
-}
-
-if (!sent_header)
+    if (!sent_header)
 	notice_lang(s_OperServ, u, OPER_IGNORE_LIST_EMPTY);
 }
 /*************************************************************************/
@@ -3522,42 +3205,135 @@ if (!sent_header)
 static void do_debugserv(User *u)
 {
     char *pattern = strtok(NULL, " ");
-    /*char buf[BUFSIZE];*/
     int sent_header = 0;
-    DebugData *id;
-    int nnicks, i;
-    /*int is_director = is_services_root(u);*/
-  struct tm *tm;
- char timebuf[64];
-    if (!pattern) {
+    DebugData *dd;
+    int nnicks = 0, i;
+    struct tm *tm;
+    char timebuf[64];
+
+    if (!pattern)
 	pattern = "*";
-	nnicks = 0;
-    } else {
-	nnicks = 0;
-}
-    for (i = 0; i < aliases; i++) {
-	for (id = debugserv[i]; id; id = id->next) {
-		if (stricmp(pattern, id->who) == 0 ||
-					match_wild_nocase(pattern, id->who)) {
-			if (stricmp(u->nick, id->who) == 0)
-				continue;
-			 if (++nnicks <= NSListMax) {
-	    if (!sent_header) {
-		notice_lang(s_OperServ, u, OPER_IGNORE_LIST);
-		sent_header = 1;
-	    }
-	  tm = localtime(&id->time);
-          strftime_lang(timebuf, sizeof(timebuf), u, STRFTIME_DATE_TIME_FORMAT, tm);
-	  notice(s_OperServ, u->nick, "2 %s  4 %s 12 %s  3( %s )", timebuf, id->who,id->servicio,id->inbuf);
+    /* Del mas reciente al mas antiguo */
+    for (i = 1; i <= DEBUGSERV_MAX; i++) {
+	dd = &debugserv[(debugserv_pos - i + DEBUGSERV_MAX) % DEBUGSERV_MAX];
+	if (!*dd->who)
+	    break;
+	if (stricmp(u->nick, dd->who) == 0
+			|| !match_wild_nocase(pattern, dd->who))
+	    continue;
+	if (++nnicks > NSListMax)
+	    break;
+	if (!sent_header) {
+	    notice_lang(s_OperServ, u, OPER_IGNORE_LIST);
+	    sent_header = 1;
 	}
+	tm = localtime(&dd->time);
+	strftime_lang(timebuf, sizeof(timebuf), u, STRFTIME_DATE_TIME_FORMAT, tm);
+	notice(s_OperServ, u->nick, "2 %s  4 %s 12 %s  3( %s ) %ld us",
+	       timebuf, dd->who, dd->servicio, dd->inbuf, (long)dd->usado);
     }
-    
+    if (!sent_header)
+	notice_lang(s_OperServ, u, OPER_IGNORE_LIST_EMPTY);
 }
+/*************************************************************************/
+
+static int compara_muestras(const void *a, const void *b)
+{
+    uint32 ma = (*(Latencia **)a)->muestras;
+    uint32 mb = (*(Latencia **)b)->muestras;
+
+    return ma < mb ? 1 : ma > mb ? -1 : 0;
 }
 
-if (!sent_header)
-	notice_lang(s_OperServ, u, OPER_IGNORE_LIST_EMPTY);
+/* PERFIL [ON [ms] | OFF | RESET]: muestra a donde se va la CPU segun el
+ * muestreo de SIGPROF y las ultimas lineas lentas (latencia.c). */
+
+static void do_perfil(User *u)
+{
+    char *cmd = strtok(NULL, " ");
+    char *param = strtok(NULL, " ");
+    uint32 total, fases[PERFIL_FASES];
+    Latencia **lista;
+    LentaData *ll;
+    struct tm *tm;
+    char timebuf[64];
+    int ms, n, i, enviados;
+
+    if (cmd && stricmp(cmd, "ON") == 0) {
+	ms = param ? atoi(param) : (PerfilIntervalo ? PerfilIntervalo : 10);
+	if (ms <= 0) {
+	    notice(s_OperServ, u->nick, "Sintaxis: PERFIL ON [milisegundos]");
+	} else if (perfil_arranca(ms)) {
+	    notice(s_OperServ, u->nick, "Muestreo arrancado cada %d ms", ms);
+	    canaladmins(s_OperServ, "12%s ha usado 12PERFIL ON (%d ms)",
+			u->nick, ms);
+	} else {
+	    notice(s_OperServ, u->nick, "No se pudo arrancar el muestreo");
+	}
+	return;
+    } else if (cmd && stricmp(cmd, "OFF") == 0) {
+	perfil_arranca(0);
+	notice(s_OperServ, u->nick, "Muestreo parado");
+	canaladmins(s_OperServ, "12%s ha usado 12PERFIL OFF", u->nick);
+	return;
+    } else if (cmd && stricmp(cmd, "RESET") == 0) {
+	latencia_borra();
+	notice(s_OperServ, u->nick, "Borrados el perfil, las lineas lentas"
+		" y los histogramas de latencia");
+	canaladmins(s_OperServ, "12%s ha usado 12PERFIL RESET", u->nick);
+	return;
+    } else if (cmd) {
+	notice(s_OperServ, u->nick, "Sintaxis: PERFIL [ON [ms] | OFF | RESET]");
+	return;
+    }
+
+    ms = perfil_estado(&total, fases);
+    tm = localtime(&perfil_desde);
+    strftime_lang(timebuf, sizeof(timebuf), u, STRFTIME_DATE_TIME_FORMAT, tm);
+    if (ms)
+	notice(s_OperServ, u->nick, "Muestreo cada %d ms: %lu muestras desde %s",
+	       ms, (unsigned long)total, timebuf);
+    else
+	notice(s_OperServ, u->nick, "Muestreo parado: %lu muestras desde %s",
+	       (unsigned long)total, timebuf);
+
+    if (total) {
+	n = latencia_lista(&lista);
+	qsort(lista, n, sizeof(Latencia *), compara_muestras);
+	for (i = 0, enviados = 0; i < n && enviados < NSListMax; i++) {
+	    if (!lista[i]->muestras)
+		break;
+	    notice(s_OperServ, u->nick, "%5.1f%%  %s %s",
+		   lista[i]->muestras * 100.0 / total, lista[i]->servicio,
+		   lista[i]->comando);
+	    enviados++;
+	}
+	free(lista);
+	for (i = 0; i < PERFIL_FASES; i++) {
+	    if (fases[i])
+		notice(s_OperServ, u->nick, "%5.1f%%  (%s)",
+		       fases[i] * 100.0 / total,
+		       i ? nombre_fase(-i) : "resto del bucle principal");
+	}
+    }
+
+    /* Lineas lentas, de la mas reciente a la mas antigua */
+    enviados = 0;
+    for (i = 1; i <= LENTAS_MAX; i++) {
+	ll = &lineas_lentas[(lineas_lentas_pos - i + LENTAS_MAX) % LENTAS_MAX];
+	if (!ll->time)
+	    break;
+	if (!enviados++)
+	    notice(s_OperServ, u->nick, "Lineas de mas de %d ms:", LineaLenta);
+	tm = localtime(&ll->time);
+	strftime_lang(timebuf, sizeof(timebuf), u, STRFTIME_DATE_TIME_FORMAT, tm);
+	notice(s_OperServ, u->nick, "2 %s  4 %ld ms 12 %s  3( %s )",
+	       timebuf, (long)(ll->usado/1000), ll->ruta, ll->linea);
+    }
+    if (!enviados)
+	notice(s_OperServ, u->nick, "No hay lineas de mas de %d ms", LineaLenta);
 }
+
 /*************************************************************************/
 
 static void do_matchwild(User *u)
@@ -8,130 +8,165 @@
 
 #include "services.h"
 #include "messages.h"
-#define aliases 6000
 /*************************************************************************/
 /*************************************************************************/
 
 /* Use ignore code? */
 int allow_ignore = 1;
 
-/* People to ignore (hashed by first character of nick). */
-IgnoreData *ignore[aliases];
-/* People to debug(hashed by first character of nick). */
-DebugData *debugserv[aliases];
+/* Control de flood.  Cada nick y cada host tienen un cubo con el tiempo de
+ * proceso (en microsegundos) que han gastado en los Services; el cubo se
+ * vacia a razon de un segundo por segundo.  Cada mensaje cuesta FloodCoste
+ * mas lo que haya tardado en procesarse, multiplicado por el peso del
+ * comando (FloodPesos, en tanto por ciento).  Pasado FloodIgnora se ignoran
+ * los mensajes y pasado FloodKill se desconecta al usuario.  Los cubos de
+ * host admiten FloodHost veces mas, para no castigar a los que comparten
+ * IP.  Los cubos vacios caducan solos (expset.c). */
+ExpSet *flood_nicks = NULL;
+ExpSet *flood_hosts = NULL;
+
+/* Ultimos comandos procesados, para DEBUGSERV. */
+DebugData debugserv[DEBUGSERV_MAX];
+int debugserv_pos = 0;
+
 /*************************************************************************/
 
-/* add_ignore: Add someone to the ignorance list for the next `delta'
- *             seconds.
- */
+static void flood_libera(ExpEntry *e)
+{
+    free(e->data);
+}
 
-void add_ignore(const char *nick, time_t delta,const char *servicio,const char *inbuf)
+/* Devuelve el cubo de `clave' con el nivel ya descontado hasta `ahora',
+ * creandolo si no existe y `crea' es 1. */
+
+static FloodData *flood_cubo(ExpSet **ps, const char *clave, int64 ahora,
+			     int crea)
 {
-    IgnoreData *ign;
-    char who[NICKMAX];
-    time_t now = time(NULL);
-    IgnoreData **whichlist = &ignore[tolower(nick[0])];
-
-    strscpy(who, nick, NICKMAX);
-    for (ign = *whichlist; ign; ign = ign->next) {
-	if (stricmp(ign->who, who) == 0)
-	/*if (ign->time <  (now -300))*/
-	    break;
-    }
-    if (ign) {
-	if (ign->time > now)
-	    ign->time += delta;
-	else
-	    ign->time = now + delta;
-    } else {
-	ign = smalloc(sizeof(*ign));
-        ign->time = now + delta;
-	strscpy(ign->who, who, sizeof(ign->who));
-	
-	strscpy(ign->servicio, servicio, sizeof(ign->servicio));
-	strscpy(ign->inbuf, inbuf, sizeof(ign->inbuf));
-	ign->next = *whichlist;
-	*whichlist = ign;
+    ExpEntry *e;
+    FloodData *fd;
+
+    if (!*ps)
+	*ps = expset_create(1, NULL, flood_libera);
+    if (!(e = expset_find(*ps, clave))) {
+	if (!crea)
+	    return NULL;
+	fd = scalloc(1, sizeof(FloodData));
+	fd->ultimo = ahora;
+	e = expset_add(*ps, clave, time(NULL)+1, fd);
     }
+    fd = e->data;
+    fd->nivel -= ahora - fd->ultimo;
+    if (fd->nivel < 0)
+	fd->nivel = 0;
+    fd->ultimo = ahora;
+    fd->entrada = e;
+    return fd;
 }
-void almacena_debugserv(const char *nick, time_t delta,const char *servicio,const char *inbuf)
+
+/* Suma `coste' al cubo y lo programa para caducar cuando se vacie. */
+
+static void flood_suma(ExpSet *s, FloodData *fd, int64 coste,
+		       const char *servicio, const char *inbuf)
 {
-    IgnoreData *ign;
-    char who[NICKMAX];
-    time_t now = time(NULL);
-    IgnoreData **whichlist = &ignore[tolower(nick[0])];
-
-    strscpy(who, nick, NICKMAX);
-    for (ign = *whichlist; ign; ign = ign->next) {
-	/*if (stricmp(ign->who, who) == 0)*/
-	if (ign->time <  (now -300))
-	    break;
-    }
-    if (ign) {
-	if (ign->time > now)
-	    ign->time += delta;
-	else
-	    ign->time = now + delta;
-    } else {
-	ign = smalloc(sizeof(*ign));
-        ign->time = now + delta;
-	strscpy(ign->who, who, sizeof(ign->who));
-	
-	strscpy(ign->servicio, servicio, sizeof(ign->servicio));
-	strscpy(ign->inbuf, inbuf, sizeof(ign->inbuf));
-	ign->next = *whichlist;
-	*whichlist = ign;
+    fd->nivel += coste;
+    strscpy(fd->servicio, servicio, sizeof(fd->servicio));
+    strscpy(fd->inbuf, inbuf, sizeof(fd->inbuf));
+    expset_set_expires(s, fd->entrada, time(NULL) + fd->nivel/1000000 + 1);
+}
+
+/* Peso (en %) del comando `cmd' enviado a `servicio'. */
+
+static int flood_peso(const char *servicio, const char *cmd)
+{
+    int i;
+
+    for (i = 0; i < FloodPesosNumber; i++) {
+	if ((stricmp(FloodPesos[i].servicio, servicio) == 0
+			|| strcmp(FloodPesos[i].servicio, "*") == 0)
+		&& stricmp(FloodPesos[i].comando, cmd) == 0)
+	    return FloodPesos[i].peso;
     }
+    return 100;
 }
+
 /*************************************************************************/
 
-/* get_ignore: Retrieve an ignorance record for a nick.  If the nick isn't
- *             being ignored, return NULL and flush the record from the
- *             in-core list if it exists (i.e. ignore timed out).
+/* flood_comprueba: Antes de procesar un mensaje de `nick', mira si sus
+ *                  cubos estan llenos.  Devuelve FLOOD_OK, FLOOD_IGNORA o
+ *                  FLOOD_KILL.  Los mensajes ignorados tambien cuestan
+ *                  FloodCoste, para que el que siga floodeando acabe
+ *                  fuera.
  */
 
-IgnoreData *get_ignore(const char *nick)
+int flood_comprueba(const char *nick, const char *servicio, const char *inbuf)
 {
-    IgnoreData *ign, *prev;
-    time_t now = time(NULL);
-    IgnoreData **whichlist = &ignore[tolower(nick[0])];
-
-    for (ign = *whichlist, prev = NULL; ign; prev = ign, ign = ign->next) {
-	if (stricmp(ign->who, nick) == 0)
-	/*if (ign->time <  (now -300))*/
-	    break;
-    }
-    if (ign && ign->time <= now) {
-	if (prev)
-	    prev->next = ign->next;
-	else
-	    *whichlist = ign->next;
-	free(ign);
-	ign = NULL;
+    int64 ahora = reloj_us();
+    FloodData *fn, *fh = NULL;
+    User *u = finduser(nick);
+    int ret = FLOOD_OK;
+
+    fn = flood_cubo(&flood_nicks, nick, ahora, 0);
+    if (u && u->host)
+	fh = flood_cubo(&flood_hosts, u->host, ahora, 0);
+    if ((fn && fn->nivel > (int64)FloodKill * 1000000)
+	    || (fh && fh->nivel > (int64)FloodKill * FloodHost * 1000000))
+	ret = FLOOD_KILL;
+    else if ((fn && fn->nivel > (int64)FloodIgnora * 1000000)
+	    || (fh && fh->nivel > (int64)FloodIgnora * FloodHost * 1000000))
+	ret = FLOOD_IGNORA;
+    if (ret != FLOOD_OK) {
+	if (fn)
+	    flood_suma(flood_nicks, fn, FloodCoste, servicio, inbuf);
+	if (fh)
+	    flood_suma(flood_hosts, fh, FloodCoste, servicio, inbuf);
     }
-    return ign;
+    return ret;
 }
-DebugData *get_debugserv(const char *nick)
+
+/* flood_carga: Despues de procesar el mensaje `texto' de `nick', que ha
+ *              tardado `usado' microsegundos, le carga el coste.
+ */
+
+void flood_carga(const char *nick, const char *servicio, const char *texto,
+		 const char *inbuf, int64 usado)
 {
-    DebugData *igndebug, *prev;
-    time_t now = time(NULL);
-    DebugData **whichlist = &debugserv[tolower(nick[0])];
-
-    for (igndebug = *whichlist, prev = NULL; igndebug; prev = igndebug, igndebug = igndebug->next) {
-	/*if (stricmp(ign->who, nick) == 0)*/
-	if (igndebug->time <  (now -300))
-	    break;
-    }
-    if (igndebug && igndebug->time <= now) {
-	if (prev)
-	    prev->next = igndebug->next;
-	else
-	    *whichlist = igndebug->next;
-	free(igndebug);
-	igndebug = NULL;
+    int64 ahora = reloj_us(), coste;
+    char cmd[BUFSIZE], *s;
+    FloodData *fd;
+    User *u;
+
+    strscpy(cmd, texto, sizeof(cmd));
+    if ((s = strchr(cmd, ' ')))
+	*s = 0;
+    coste = (FloodCoste + usado) * flood_peso(servicio, cmd) / 100;
+    fd = flood_cubo(&flood_nicks, nick, ahora, 1);
+    flood_suma(flood_nicks, fd, coste, servicio, inbuf);
+    /* El usuario puede haber desaparecido al procesar el mensaje */
+    if ((u = finduser(nick)) && u->host) {
+	fd = flood_cubo(&flood_hosts, u->host, ahora, 1);
+	flood_suma(flood_hosts, fd, coste, servicio, inbuf);
     }
-    return igndebug;
 }
+
+/*************************************************************************/
+
+/* almacena_debugserv: Guarda el comando en la lista de los ultimos
+ *                     procesados.
+ */
+
+void almacena_debugserv(const char *nick, int64 usado, const char *servicio,
+			const char *inbuf)
+{
+    DebugData *dd = &debugserv[debugserv_pos];
+
+    debugserv_pos = (debugserv_pos+1) % DEBUGSERV_MAX;
+    dd->time = time(NULL);
+    dd->usado = usado;
+    strscpy(dd->who, nick, sizeof(dd->who));
+    strscpy(dd->servicio, servicio, sizeof(dd->servicio));
+    strscpy(dd->inbuf, inbuf, sizeof(dd->inbuf));
+}
+
 /*************************************************************************/
 /*************************************************************************/
 
@@ -250,8 +285,19 @@ void process()
     /* Do something with the message. */
     m = find_message(cmd);
     if (m) {
-	if (m->func)
+	if (m->func) {
+	    Latencia *l = latencia_busca("IRC", m->name);
+	    int64 inicio = reloj_us(), usado;
+
+	    perfil_entra(l);
 	    m->func(source, ac, av);
+	    perfil_sale();
+	    usado = reloj_us() - inicio;
+	    latencia_suma(l, usado);
+	    if (usado >= (int64)LineaLenta * 1000)
+		linea_lenta(usado, inbuf, stricmp(m->name, "PRIVMSG") == 0
+					 || stricmp(m->name, "P") == 0);
+	}
     } else {
      /*  log("unknown message from server (%s)", inbuf); */
 /*send_cmd(ServerName, "PRIVMSG #Debug :DEBUG: %s",inbuf);*/
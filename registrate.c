@@ -12,9 +12,6 @@
 */
 #include "services.h"
 #include "pseudo.h"
-#if defined(SOPORTE_JOOMLA15)
-#include <mysql.h>
-#endif
 /*************************************************************************/
 
 /* Har con registra en lugar de akill para mandar una serie de privados a un nick no reg
@@ -26,9 +23,19 @@ struct aregistra {
     time_t expires;	/* or 0 for no expiry */
 };
 
-static int32 naregistra = 0;
-static int32 aregistra_size = 0;
-static struct aregistra *aregistras = NULL;
+/* Se guardan en un ExpSet (expset.c); struct aregistra solo se usa al
+ * leer la base de datos. */
+
+static ExpSet *aregistras = NULL;
+
+static void aregistra_expira(ExpEntry *e);
+
+static ExpSet *lista_aregistras(void)
+{
+    if (!aregistras)
+	aregistras = expset_create(1, aregistra_expira, NULL);
+    return aregistras;
+}
 
 /*************************************************************************/
 /****************************** Statistics *******************************/
@@ -36,22 +43,14 @@ static struct aregistra *aregistras = NULL;
 
 void get_aregistra_stats(long *nrec, long *memuse)
 {
-    long mem;
-    int i;
-
-    mem = sizeof(struct aregistra) * aregistra_size;
-    for (i = 0; i < naregistra; i++) {
-	mem += strlen(aregistras[i].elnick)+1;
-	
-    }
-    *nrec = naregistra;
-    *memuse = mem;
+    *nrec = lista_aregistras()->count;
+    *memuse = expset_mem(aregistras);
 }
 
 
 int num_aregistras(void)
 {
-    return (int) naregistra;
+    return lista_aregistras()->count;
 }
 
 /*************************************************************************/
@@ -62,7 +61,7 @@ int num_aregistras(void)
     if ((x) < 0) {					\
 	if (!forceload)					\
 	    fatal("Error de lectura en %s", AutoregistraDBName);	\
-	naregistra = i;					\
+	n = i;						\
 	break;						\
     }							\
 } while (0)
@@ -73,6 +72,8 @@ void load_aregistra(void)
     int i, ver;
     int16 tmp16;
     int32 tmp32;
+    int32 n;
+    struct aregistra *lista;
 
     if (!(f = open_db("AREGISTRA", AutoregistraDBName, "r")))
 	return;
@@ -80,27 +81,21 @@ void load_aregistra(void)
     ver = get_file_version(f);
 
     read_int16(&tmp16, f);
-    naregistra = tmp16;
-    if (naregistra < 8)
-	aregistra_size = 16;
-    else if (naregistra >= 16384)
-	aregistra_size = 32767;
-    else
-	aregistra_size = 2*naregistra;
-    aregistras = scalloc(sizeof(*aregistras), aregistra_size);
+    n = tmp16;
+    lista = scalloc(sizeof(*lista), n ? n : 1);
 
     switch (ver) {
       case 8:
       case 7:
       case 6:
       case 5:
-	for (i = 0; i < naregistra; i++) {
+	for (i = 0; i < n; i++) {
 	  
-	    SAFE(read_string(&aregistras[i].elnick, f));
+	    SAFE(read_string(&lista[i].elnick, f));
 	    SAFE(read_int32(&tmp32, f));
-	    aregistras[i].time = tmp32;
+	    lista[i].time = tmp32;
 	    SAFE(read_int32(&tmp32, f));
-	    aregistras[i].expires = tmp32;
+	    lista[i].expires = tmp32;
 	}
 	break;
 
@@ -113,13 +108,13 @@ void load_aregistra(void)
 	    long reserved[4];
 	} old_aregistra;
 
-	for (i = 0; i < naregistra; i++) {
+	for (i = 0; i < n; i++) {
 	    SAFE(read_variable(old_aregistra, f));
-	    aregistras[i].time = old_aregistra.time;
-	    aregistras[i].expires = old_aregistra.expires;
+	    lista[i].time = old_aregistra.time;
+	    lista[i].expires = old_aregistra.expires;
 	}
-	for (i = 0; i < naregistra; i++) {
-	     SAFE(read_string(&aregistras[i].elnick, f));
+	for (i = 0; i < n; i++) {
+	     SAFE(read_string(&lista[i].elnick, f));
 	}
 	break;
       } /* case 3/4 */
@@ -130,13 +125,13 @@ void load_aregistra(void)
 	    time_t time;
 	} old_aregistra;
 
-	for (i = 0; i < naregistra; i++) {
+	for (i = 0; i < n; i++) {
 	    SAFE(read_variable(old_aregistra, f));
-	    aregistras[i].time = old_aregistra.time;
-	     aregistras[i].expires = 0;
+	    lista[i].time = old_aregistra.time;
+	     lista[i].expires = 0;
 	}
-	for (i = 0; i < naregistra; i++) {
-	    SAFE(read_string(&aregistras[i].elnick, f));
+	for (i = 0; i < n; i++) {
+	    SAFE(read_string(&lista[i].elnick, f));
 	    
 	}
 	break;
@@ -148,13 +143,13 @@ void load_aregistra(void)
 	    time_t time;
 	} old_aregistra;
 
-	for (i = 0; i < naregistra; i++) {
+	for (i = 0; i < n; i++) {
 	    SAFE(read_variable(old_aregistra, f));
-	    aregistras[i].time = old_aregistra.time;
-	    aregistras[i].expires = 0;
+	    lista[i].time = old_aregistra.time;
+	    lista[i].expires = 0;
 	}
-	for (i = 0; i < naregistra; i++) {
-	    SAFE(read_string(&aregistras[i].elnick, f));
+	for (i = 0; i < n; i++) {
+	    SAFE(read_string(&lista[i].elnick, f));
 	   	}
 	break;
       } /* case 1 */
@@ -164,6 +159,16 @@ void load_aregistra(void)
     } /* switch (version) */
 
     close_db(f);
+
+    for (i = 0; i < n; i++) {
+	if (lista[i].elnick) {
+	    ExpEntry *e = expset_add(lista_aregistras(), lista[i].elnick,
+				     lista[i].expires, NULL);
+	    e->time = lista[i].time;
+	    free(lista[i].elnick);
+	}
+    }
+    free(lista);
 }
 
 #undef SAFE
@@ -186,16 +191,15 @@ void load_aregistra(void)
 void save_aregistra(void)
 {
     dbFILE *f;
-    int i;
+    ExpEntry *e;
     static time_t lastwarn = 0;
 
     f = open_db("AREGISTRA", AutoregistraDBName, "w");
-    write_int16(naregistra, f);
-    for (i = 0; i < naregistra; i++) {
-	
-	SAFE(write_string(aregistras[i].elnick, f));
-	SAFE(write_int32(aregistras[i].time, f));
-	SAFE(write_int32(aregistras[i].expires, f));
+    write_int16(lista_aregistras()->count, f);
+    for (e = aregistras->first; e; e = e->next) {
+	SAFE(write_string(e->key, f));
+	SAFE(write_int32(e->time, f));
+	SAFE(write_int32(e->expires, f));
     }
     close_db(f);
 }
@@ -205,86 +209,62 @@ void save_aregistra(void)
 
 /*************************************************************************/
 
-/* Borro autoregistras expirados */
+/* Llamada por expset_expire() al vencer el plazo de una entrada; la
+ * entrada se libera despues. */
 
-int expire_aregistras(void)
+static void aregistra_expira(ExpEntry *e)
 {
-    int i;
-    time_t now = time(NULL);
-
-    for (i = 0; i < naregistra; i++) {
-	if (aregistras[i].expires > now)
-	    continue;
-	    //canalopers(s_OperServ, "AREGISTRA en %s ha expirado", aregistras[i].elnick);
+	    //canalopers(s_OperServ, "AREGISTRA en %s ha expirado", e->key);
 
 #if defined(IRC_UNDERNET_P10)
-        //send_cmd(NULL,"%c P * -%s", convert2y[ServerNumerico], aregistras[i].elnick);        	
+        //send_cmd(NULL,"%c P * -%s", convert2y[ServerNumerico], e->key);        	
 #else
        if (!notifinouts) {
-        privmsg(s_NickServ, aregistras[i].elnick, "Hola 12%s2",aregistras[i].elnick);
-        privmsg(s_NickServ, aregistras[i].elnick, "Soy 4NiCK, el encargado de los registros de los apodos en la Red.");
-        privmsg(s_NickServ, aregistras[i].elnick, "Veo que tu apodo no est registrado.");
-	privmsg(s_NickServ, aregistras[i].elnick, "Registrate con nosotros,es bien sencillo y totalmente gratuito.");
-	privmsg(s_NickServ, aregistras[i].elnick, "Una vez registrado,podrs acceder a servicios exclusivos de usuarios registrados.");
-        privmsg(s_NickServ, aregistras[i].elnick, "Como por ejemplo, nuestro servicio de mensajera 5(MeMo),");
-	privmsg(s_NickServ, aregistras[i].elnick, "entrar a canales restringidos a usuarios registrados,");
-	privmsg(s_NickServ, aregistras[i].elnick, "o recibir soporte especializado por parte de los representantes de la red.");
+        privmsg(s_NickServ, e->key, "Hola 12%s2",e->key);
+        privmsg(s_NickServ, e->key, "Soy 4NiCK, el encargado de los registros de los apodos en la Red.");
+        privmsg(s_NickServ, e->key, "Veo que tu apodo no est registrado.");
+	privmsg(s_NickServ, e->key, "Registrate con nosotros,es bien sencillo y totalmente gratuito.");
+	privmsg(s_NickServ, e->key, "Una vez registrado,podrs acceder a servicios exclusivos de usuarios registrados.");
+        privmsg(s_NickServ, e->key, "Como por ejemplo, nuestro servicio de mensajera 5(MeMo),");
+	privmsg(s_NickServ, e->key, "entrar a canales restringidos a usuarios registrados,");
+	privmsg(s_NickServ, e->key, "o recibir soporte especializado por parte de los representantes de la red.");
 	#if defined(SOPORTE_JOOMLA15)
-	 privmsg(s_NickServ, aregistras[i].elnick, "Para registrartelo slo debes entrar en la web oficial de la red,");
-	 privmsg(s_NickServ, aregistras[i].elnick, "en el enlace 12%s/index.php?option=com_user&task=register",WebNetwork);
-	 privmsg(s_NickServ, aregistras[i].elnick, "y rellenar todos los datos que se te solicitan en el formulario.");
+	 privmsg(s_NickServ, e->key, "Para registrartelo slo debes entrar en la web oficial de la red,");
+	 privmsg(s_NickServ, e->key, "en el enlace 12%s/index.php?option=com_user&task=register",WebNetwork);
+	 privmsg(s_NickServ, e->key, "y rellenar todos los datos que se te solicitan en el formulario.");
 	#else
-        privmsg(s_NickServ, aregistras[i].elnick, "Para registrartelo slo debes escribir aqu  mismo el comando 3/msg 2NiCK 12register 4email");
-        privmsg(s_NickServ, aregistras[i].elnick, "cambiando unicamente  tu direccin de 4email");
-        privmsg(s_NickServ, aregistras[i].elnick, "No Cambies la palabra 2NiCK,que es el bot que te registra.");
-	privmsg(s_NickServ, aregistras[i].elnick, "Se te registrar el nick que lleves puesto en ese momento y recibirs");
-	privmsg(s_NickServ, aregistras[i].elnick, "un email con los datos e instrucciones de tu registro.");
+        privmsg(s_NickServ, e->key, "Para registrartelo slo debes escribir aqu  mismo el comando 3/msg 2NiCK 12register 4email");
+        privmsg(s_NickServ, e->key, "cambiando unicamente  tu direccin de 4email");
+        privmsg(s_NickServ, e->key, "No Cambies la palabra 2NiCK,que es el bot que te registra.");
+	privmsg(s_NickServ, e->key, "Se te registrar el nick que lleves puesto en ese momento y recibirs");
+	privmsg(s_NickServ, e->key, "un email con los datos e instrucciones de tu registro.");
 	#endif
-        privmsg(s_NickServ, aregistras[i].elnick, "Si tienes dudas,no dudes en acudir al canal oficial de la red.");
-	privmsg(s_NickServ, aregistras[i].elnick, "Gracias por leer este mensaje automtico.");
-	privmsg(s_NickServ, aregistras[i].elnick, "Un Saludo.La Administracin");
+        privmsg(s_NickServ, e->key, "Si tienes dudas,no dudes en acudir al canal oficial de la red.");
+	privmsg(s_NickServ, e->key, "Gracias por leer este mensaje automtico.");
+	privmsg(s_NickServ, e->key, "Un Saludo.La Administracin");
        }
 #endif        
-        free(aregistras[i].elnick);
-        naregistra--;
-	if (i < naregistra)
-	    memmove(aregistras+i, aregistras+i+1, sizeof(*aregistras) * (naregistra-i));
-	i--;
-    }
+}
+
+/* Borro autoregistras expirados */
+
+int expire_aregistras(void)
+{
+    return expset_expire(lista_aregistras(), time(NULL));
 }
 
 
 void add_aregistra(const char *elnick,const time_t expiry)
 {
-    if (naregistra >= 32767) {
+    if (lista_aregistras()->count >= 32767) {
 	logeo("%s: Intento para aadir AREGISTRA a la lista llena!", s_NickServ);
 	return;
     }
-    if (naregistra >= aregistra_size) {
-	if (aregistra_size < 8)
-	    aregistra_size = 8;
-	else
-	    aregistra_size *= 2;
-	aregistras = srealloc(aregistras, sizeof(*aregistras) * aregistra_size);
-    }
-    aregistras[naregistra].elnick = sstrdup(elnick);
-    aregistras[naregistra].time = time(NULL);
-    aregistras[naregistra].expires = expiry;
-
-    naregistra++;
+    expset_add(aregistras, elnick, expiry, NULL);
 }
 /*************************************************************************/
 
 void del_aregistra(const char *elnick)
 {
-    int i;
-
-    for (i = 0; i < naregistra && strcmp(aregistras[i].elnick, elnick) != 0; i++)
-	;
-    if (i < naregistra) {
-	free(aregistras[i].elnick);
-	naregistra--;
-	memmove(aregistras+i, aregistras+i+1, sizeof(*aregistras) * (naregistra-i));
-	
-       }
+    expset_del(lista_aregistras(), elnick);
 }
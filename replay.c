@@ -0,0 +1,259 @@
+/* Banco de pruebas: reproduce una sesion grabada del enlace con el servidor.
+ *
+ * Services is copyright (c) 1996-1999 Andy Church.
+ *     E-mail: <achurch@dragonfire.net>
+ * This program is free but copyrighted software; see the file COPYING for
+ * details.
+ *
+ * "make replay-bench" enlaza los Services con este fichero en lugar de
+ * main() (main.c e init.c se compilan con -DREPLAY_BENCH).  init() carga
+ * las bases de datos como siempre pero, en vez de conectar, usa como
+ * socket el fichero dado con -salida (por defecto /dev/null), donde acaba
+ * todo lo que mandan send_cmd() y compania.  Luego cada linea de la
+ * captura pasa por process(), igual que si llegase del servidor.
+ *
+ * La captura puede ser un log con -debug (se cogen las lineas
+ * "debug: Received: ..." y su hora) o directamente las lineas del
+ * protocolo, una por linea; en ese caso el reloj avanza un segundo cada
+ * -lps lineas (1000 por defecto).  time() devuelve siempre esa hora
+ * virtual, asi que dos pasadas con la misma captura y las mismas bases de
+ * datos hacen exactamente lo mismo.  El control de flood se desactiva,
+ * porque va con el reloj real.
+ *
+ * Al acabar se escriben las lineas por segundo (reales), las reservas de
+ * memoria hechas despues de cargar las bases de datos (malloc() y
+ * compania, con --wrap del enlazador de GNU) y el pico de memoria
+ * residente, y se vuelcan los histogramas en LatenciaFichero.
+ *
+ * No se arrancan los hilos de MySQL ni el detector de proxies (init.c):
+ * las sentencias a la web se descartan y los hosts no se resuelven ni se
+ * escanean, para que la reproduccion no dependa de nada de fuera.
+ *
+ * Uso: replay-bench [-salida fichero] [-lps N] [opciones] captura
+ *
+ * donde las opciones son las de los Services (-dir, -debug...).  Ojo: las
+ * bases de datos se cargan y los memos se escriben como en los Services
+ * de verdad, asi que conviene usar -dir con una copia de los datos.  En
+ * data/captura-muestra.txt hay una captura de ejemplo: 500 usuarios que
+ * entran, se unen a un canal, piden INFO a NickServ y salen.
+ */
+
+#include "services.h"
+#include "timeout.h"
+#include <fcntl.h>
+#include <sys/resource.h>
+
+static time_t reloj_virtual = 0;
+
+static unsigned long reservas = 0, liberaciones = 0;
+static unsigned long long reservado = 0;
+
+/*************************************************************************/
+
+/* Reloj virtual: sustituye al time() de la libc en todo el programa. */
+
+time_t time(time_t *t)
+{
+    if (t)
+	*t = reloj_virtual;
+    return reloj_virtual;
+}
+
+/* Contadores de memoria (-Wl,--wrap=malloc,...). */
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t nelem, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+void __real_free(void *ptr);
+char *__real_strdup(const char *s);
+
+void *__wrap_malloc(size_t size)
+{
+    reservas++;
+    reservado += size;
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t nelem, size_t size)
+{
+    reservas++;
+    reservado += nelem * size;
+    return __real_calloc(nelem, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+    reservas++;
+    reservado += size;
+    return __real_realloc(ptr, size);
+}
+
+void __wrap_free(void *ptr)
+{
+    if (ptr)
+	liberaciones++;
+    __real_free(ptr);
+}
+
+char *__wrap_strdup(const char *s)
+{
+    reservas++;
+    reservado += strlen(s) + 1;
+    return __real_strdup(s);
+}
+
+/*************************************************************************/
+
+static int salida = -1;
+
+/* Lo llama init() en lugar de conn(). */
+
+int replay_conecta(void)
+{
+    return salida;
+}
+
+/* Saca la hora de un "[Oct 19 09:32:01[.123456] 2026] " de logeo().
+ * Devuelve 0 si la linea no empieza asi. */
+
+static time_t hora_log(const char *s)
+{
+    static const char *meses[] = { "Jan", "Feb", "Mar", "Apr", "May", "Jun",
+				   "Jul", "Aug", "Sep", "Oct", "Nov", "Dec" };
+    struct tm tm;
+    char mes[4];
+    int i;
+
+    memset(&tm, 0, sizeof(tm));
+    if (sscanf(s, "[%3s %d %d:%d:%d", mes, &tm.tm_mday, &tm.tm_hour,
+	       &tm.tm_min, &tm.tm_sec) != 5)
+	return 0;
+    for (i = 0; i < 12 && strcmp(mes, meses[i]) != 0; i++)
+	;
+    if (i == 12 || !(s = strchr(s, ' ')) || !(s = strchr(s+1, ' '))
+		|| !(s = strchr(s+1, ' ')) || sscanf(s, " %d]", &tm.tm_year) != 1)
+	return 0;
+    tm.tm_mon = i;
+    tm.tm_year -= 1900;
+    tm.tm_isdst = -1;
+    return mktime(&tm);
+}
+
+/*************************************************************************/
+
+int main(int ac, char **av, char **envp)
+{
+    char **nav, *captura = NULL, *fsalida = "/dev/null";
+    char linea[BUFSIZE*2], *s;
+    long lps = 1000, nlineas = 0, leidas = 0;
+    int64 inicio, usado, proceso = 0;
+    time_t ultimo;
+    struct rusage ru;
+    FILE *fp;
+    int nac = 1, i;
+
+    nav = malloc(sizeof(char *) * (ac+1));
+    nav[0] = av[0];
+    for (i = 1; i < ac; i++) {
+	if (strcmp(av[i], "-salida") == 0 && i+1 < ac)
+	    fsalida = av[++i];
+	else if (strcmp(av[i], "-lps") == 0 && i+1 < ac)
+	    lps = atol(av[++i]) > 0 ? atol(av[i]) : 1;
+	else if (*av[i] != '-' && i == ac-1)
+	    captura = av[i];
+	else
+	    nav[nac++] = av[i];
+    }
+    nav[nac] = NULL;
+    if (!captura) {
+	fprintf(stderr, "Uso: %s [-salida fichero] [-lps N] [opciones]"
+			" captura\n", av[0]);
+	return 1;
+    }
+    if (!(fp = fopen(captura, "r"))) {
+	perror(captura);
+	return 1;
+    }
+    if ((salida = open(fsalida, O_WRONLY|O_CREAT|O_TRUNC, 0600)) < 0) {
+	perror(fsalida);
+	return 1;
+    }
+
+    /* La hora de arranque es la de la primera linea con hora */
+    while (!reloj_virtual && fgets(linea, sizeof(linea), fp))
+	reloj_virtual = hora_log(linea);
+    if (!reloj_virtual)
+	reloj_virtual = 1000000000;
+    rewind(fp);
+    start_time = reloj_virtual;
+
+    nofork = 1;
+    if ((i = init(nac, nav)) != 0)
+	return i;
+    allow_ignore = 0;
+    reservas = liberaciones = 0;
+    reservado = 0;
+
+    ultimo = reloj_virtual;
+    inicio = reloj_us();
+    while (!quitting && fgets(linea, sizeof(linea), fp)) {
+	time_t t;
+
+	leidas++;
+	if ((s = strchr(linea, '\n')) != NULL)
+	    *s = 0;
+	if ((s = strchr(linea, '\r')) != NULL)
+	    *s = 0;
+	if (*linea == '[') {
+	    if (!(s = strstr(linea, "debug: Received: ")))
+		continue;
+	    if ((t = hora_log(linea)) > reloj_virtual)
+		reloj_virtual = t;
+	    s += 17;
+	} else {
+	    s = linea;
+	    if (nlineas && nlineas % lps == 0)
+		reloj_virtual++;
+	}
+	if (!*s)
+	    continue;
+
+	/* Lo que haria el bucle principal al cambiar de segundo */
+	if (reloj_virtual != ultimo) {
+	    ultimo = reloj_virtual;
+	    check_timeouts();
+	    if (!readonly)
+		expset_run();
+	}
+
+	strscpy(inbuf, s, sizeof(inbuf));
+	usado = reloj_us();
+	process();
+	proceso += reloj_us() - usado;
+	modos_envia();
+#if defined(IRC_BDD)
+	bdd_fin_lote();
+#endif
+	avisos_envia();
+	nlineas++;
+    }
+    usado = reloj_us() - inicio;
+    fclose(fp);
+    sflush();
+    latencia_vuelca();
+
+    getrusage(RUSAGE_SELF, &ru);
+    printf("%ld lineas procesadas de %ld leidas en %ld.%03ld s"
+	   " (%ld.%03ld s en process())\n", nlineas, leidas,
+	   (long)(usado/1000000), (long)(usado/1000%1000),
+	   (long)(proceso/1000000), (long)(proceso/1000%1000));
+    if (usado > 0)
+	printf("%.0f lineas/s\n", nlineas * 1000000.0 / usado);
+    printf("%lu bytes enviados a %s\n", (unsigned long)total_written, fsalida);
+    printf("%lu reservas de memoria (%llu bytes), %lu liberaciones"
+	   " durante la reproduccion\n",
+	   reservas, reservado, liberaciones);
+    printf("Pico de memoria residente: %ld KB\n", (long)ru.ru_maxrss);
+    printf("Histogramas de latencia en %s\n", LatenciaFichero);
+    return 0;
+}
@@ -0,0 +1,437 @@
+/* Detector de puertos abiertos (proxies) para los usuarios que entran.
+ *
+ * Services is copyright (c) 1996-1999 Andy Church.
+ *     E-mail: <achurch@dragonfire.net>
+ * This program is free but copyrighted software; see the file COPYING for
+ * details.
+ *
+ * Antes do_nick() hacia gethostbyname() y un connect() bloqueante a cada
+ * puerto de Puertos[] para cada usuario nuevo: un puerto filtrado dejaba
+ * los Services parados hasta que vencia el timeout de TCP.  Ahora
+ * scanner_add() solo apunta el host; la resolucion (getaddrinfo_a) y los
+ * connect() no bloqueantes (vigilados con epoll) avanzan desde
+ * scanner_process() en el bucle principal, con un maximo de
+ * ScannerConexiones sockets a la vez.  Los resultados se guardan
+ * ScannerCache segundos por host, y las GLINEs se mandan desde una cola.
+ */
+
+#define _GNU_SOURCE
+#include "services.h"
+
+#if defined(SOPORTE_SCANNER)
+
+#include <sys/epoll.h>
+#include <fcntl.h>
+
+/*************************************************************************/
+
+#define SCAN_HASH	1024	/* Tamano de la tabla de la cache */
+#define SCAN_GLINES	20	/* GLINEs por segundo como maximo */
+
+/* Host en la cache (y, mientras se escanea, en la cola) */
+typedef struct scanhost_ ScanHost;
+struct scanhost_ {
+    ScanHost *next, *prev;	/* Cadena de la tabla hash */
+    ScanHost *sig;		/* Cola de escaneo o de GLINEs */
+    char *host;
+    struct in_addr addr;
+    int estado;
+    int puerto;			/* Siguiente puerto a probar */
+    int abierto;		/* Puerto abierto encontrado, o -1 */
+    int conexiones;		/* Conexiones en curso */
+    int gline;			/* Esta en la cola de GLINEs */
+    time_t expira;		/* Fin de validez del resultado */
+    struct gaicb *dns;
+};
+
+#define SCAN_DNS	0	/* Resolviendo el nombre */
+#define SCAN_ESPERA	1	/* En la cola, esperando conexiones libres */
+#define SCAN_PROBANDO	2	/* Fuera de la cola, con conexiones en curso */
+#define SCAN_HECHO	3	/* Resultado en cache */
+
+/* Conexion en curso */
+typedef struct scanconn_ ScanConn;
+struct scanconn_ {
+    ScanConn *next, *prev;
+    ScanHost *sh;
+    int fd;
+    int puerto;
+    time_t limite;
+};
+
+static ScanHost *hashtable[SCAN_HASH];
+static ScanHost *cola = NULL, **cola_fin = &cola;	/* Hosts por escanear */
+static ScanHost *glines = NULL, **glines_fin = &glines;	/* GLINEs pendientes */
+static ScanHost *resolviendo = NULL;	/* Lista (por sig) de hosts en DNS */
+static ScanConn *conexiones = NULL;
+static int nconexiones = 0, nresolviendo = 0, encola = 0, englines = 0;
+static int epfd = -1;
+
+/* Estadisticas */
+static long st_hosts = 0, st_cache = 0, st_conexiones = 0, st_abiertos = 0,
+	    st_glines = 0, st_dns = 0;
+static long st_minuto = 0, st_ult_minuto = 0;
+static time_t st_inicio_minuto = 0;
+
+/*************************************************************************/
+/******************************** Cache **********************************/
+/*************************************************************************/
+
+static unsigned int scan_hash(const char *host)
+{
+    unsigned int h = 0;
+
+    while (*host)
+	h = h*31 + tolower(*host++);
+    return h % SCAN_HASH;
+}
+
+static ScanHost *scan_find(const char *host)
+{
+    ScanHost *sh;
+
+    for (sh = hashtable[scan_hash(host)]; sh; sh = sh->next) {
+	if (stricmp(sh->host, host) == 0)
+	    return sh;
+    }
+    return NULL;
+}
+
+static void scan_del(ScanHost *sh)
+{
+    if (sh->next)
+	sh->next->prev = sh->prev;
+    if (sh->prev)
+	sh->prev->next = sh->next;
+    else
+	hashtable[scan_hash(sh->host)] = sh->next;
+    free(sh->host);
+    free(sh);
+}
+
+/* Quita de la cache los resultados caducados.  Se llama en cada
+ * expiracion. */
+
+void expire_scanner(void)
+{
+    ScanHost *sh, *next;
+    time_t now = time(NULL);
+    int i;
+
+    for (i = 0; i < SCAN_HASH; i++) {
+	for (sh = hashtable[i]; sh; sh = next) {
+	    next = sh->next;
+	    if (sh->estado == SCAN_HECHO && sh->expira <= now && !sh->gline)
+		scan_del(sh);
+	}
+    }
+}
+
+/*************************************************************************/
+/******************************* Escaneo *********************************/
+/*************************************************************************/
+
+static void scan_encola(ScanHost *sh)
+{
+    sh->estado = SCAN_ESPERA;
+    sh->sig = NULL;
+    *cola_fin = sh;
+    cola_fin = &sh->sig;
+    encola++;
+}
+
+static void scan_termina(ScanHost *sh)
+{
+    sh->estado = SCAN_HECHO;
+    sh->expira = time(NULL) + ScannerCache;
+    st_hosts++;
+    st_minuto++;
+    if (sh->abierto >= 0) {
+	st_abiertos++;
+	sh->gline = 1;
+	sh->sig = NULL;
+	*glines_fin = sh;
+	glines_fin = &sh->sig;
+	englines++;
+    }
+}
+
+/* Apunta un host para escanearlo.  Llamado desde do_nick() para cada
+ * usuario nuevo. */
+
+void scanner_add(const char *host)
+{
+    ScanHost *sh;
+    unsigned int h;
+
+    if (epfd < 0 || !host || !*host)
+	return;
+    if ((sh = scan_find(host))) {
+	if (sh->estado != SCAN_HECHO || sh->expira > time(NULL) || sh->gline) {
+	    st_cache++;
+	    return;
+	}
+	/* Resultado caducado: se vuelve a escanear */
+    } else {
+	sh = scalloc(1, sizeof(ScanHost));
+	sh->host = sstrdup(host);
+	h = scan_hash(host);
+	sh->next = hashtable[h];
+	if (sh->next)
+	    sh->next->prev = sh;
+	hashtable[h] = sh;
+    }
+    sh->puerto = 0;
+    sh->abierto = -1;
+    sh->conexiones = 0;
+    if (inet_aton(host, &sh->addr)) {
+	scan_encola(sh);
+    } else {
+	sh->estado = SCAN_DNS;
+	sh->dns = scalloc(1, sizeof(struct gaicb));
+	sh->dns->ar_name = sh->host;
+	if (getaddrinfo_a(GAI_NOWAIT, &sh->dns, 1, NULL) != 0) {
+	    free(sh->dns);
+	    sh->dns = NULL;
+	    st_dns++;
+	    scan_termina(sh);
+	    return;
+	}
+	sh->sig = resolviendo;
+	resolviendo = sh;
+	nresolviendo++;
+    }
+}
+
+/* Mira que resoluciones de nombres han terminado. */
+
+static void scan_dns(void)
+{
+    ScanHost *sh, **psh;
+    struct addrinfo *ai;
+    int err;
+
+    for (psh = &resolviendo; (sh = *psh); ) {
+	if ((err = gai_error(sh->dns)) == EAI_INPROGRESS) {
+	    psh = &sh->sig;
+	    continue;
+	}
+	*psh = sh->sig;
+	nresolviendo--;
+	for (ai = err ? NULL : sh->dns->ar_result; ai; ai = ai->ai_next) {
+	    if (ai->ai_family == AF_INET)
+		break;
+	}
+	if (ai) {
+	    sh->addr = ((struct sockaddr_in *)ai->ai_addr)->sin_addr;
+	    scan_encola(sh);
+	} else {
+	    st_dns++;
+	    scan_termina(sh);
+	}
+	if (!err)
+	    freeaddrinfo(sh->dns->ar_result);
+	free(sh->dns);
+	sh->dns = NULL;
+    }
+}
+
+static void scan_cierra(ScanConn *sc)
+{
+    epoll_ctl(epfd, EPOLL_CTL_DEL, sc->fd, NULL);
+    close(sc->fd);
+    if (sc->next)
+	sc->next->prev = sc->prev;
+    if (sc->prev)
+	sc->prev->next = sc->next;
+    else
+	conexiones = sc->next;
+    nconexiones--;
+    sc->sh->conexiones--;
+    free(sc);
+}
+
+/* Resultado de una conexion: si el puerto esta abierto, el host queda
+ * marcado; si ya no le quedan puertos ni conexiones, termina. */
+
+static void scan_resultado(ScanConn *sc, int abierto)
+{
+    ScanHost *sh = sc->sh;
+
+    if (abierto && sh->abierto < 0)
+	sh->abierto = sc->puerto;
+    scan_cierra(sc);
+    if (sh->conexiones == 0 && sh->estado == SCAN_PROBANDO)
+	scan_termina(sh);
+}
+
+/* Abre conexiones para los hosts de la cola mientras haya sitio. */
+
+static void scan_lanza(void)
+{
+    struct sockaddr_in sa;
+    struct epoll_event ev;
+    ScanHost *sh;
+    ScanConn *sc;
+    int fd;
+
+    while (cola && nconexiones < ScannerConexiones) {
+	sh = cola;
+	if (sh->abierto >= 0 || sh->puerto >= PuertoNumber) {
+	    /* Ya no le quedan puertos: fuera de la cola */
+	    if (!(cola = sh->sig))
+		cola_fin = &cola;
+	    sh->sig = NULL;
+	    encola--;
+	    sh->estado = SCAN_PROBANDO;
+	    if (sh->conexiones == 0)
+		scan_termina(sh);
+	    continue;
+	}
+	if ((fd = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP)) < 0) {
+	    canaladmins(s_XServ, "Error Socket()");
+	    return;
+	}
+	fcntl(fd, F_SETFL, O_NONBLOCK);
+	memset(&sa, 0, sizeof(sa));
+	sa.sin_family = AF_INET;
+	sa.sin_port = htons(atoi(Puertos[sh->puerto]));
+	sa.sin_addr = sh->addr;
+
+	sc = scalloc(1, sizeof(ScanConn));
+	sc->sh = sh;
+	sc->fd = fd;
+	sc->puerto = sh->puerto++;
+	sc->limite = time(NULL) + ScannerTimeout;
+	sc->next = conexiones;
+	if (conexiones)
+	    conexiones->prev = sc;
+	conexiones = sc;
+	nconexiones++;
+	sh->conexiones++;
+	st_conexiones++;
+
+	if (connect(fd, (struct sockaddr *)&sa, sizeof(sa)) == 0) {
+	    scan_resultado(sc, 1);
+	} else if (errno != EINPROGRESS) {
+	    scan_resultado(sc, 0);
+	} else {
+	    ev.events = EPOLLOUT;
+	    ev.data.ptr = sc;
+	    if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) < 0)
+		scan_resultado(sc, 0);
+	}
+    }
+}
+
+/* Manda las GLINEs pendientes, sin pasar de SCAN_GLINES por segundo. */
+
+static void scan_glines(void)
+{
+    static time_t ultimo = 0;
+    static int enviadas = 0;
+    time_t now = time(NULL);
+    ScanHost *sh;
+
+    if (now != ultimo) {
+	ultimo = now;
+	enviadas = 0;
+    }
+    while (glines && enviadas < SCAN_GLINES) {
+	sh = glines;
+	if (!(glines = sh->sig))
+	    glines_fin = &glines;
+	sh->sig = NULL;
+	sh->gline = 0;
+	englines--;
+	enviadas++;
+	st_glines++;
+	send_cmd(ServerName, "GLINE * -*@%s", sh->host);
+	send_cmd(ServerName,
+		    "GLINE * +*@%s %lu :Esta red tiene en funcionamiento un detector que comprueba en los equipos ,puertos abiertos que no permitimos su entrada por considerarlas conexiones inseguras,y el puerto 12%s es uno de ellos.Por favor no lo tenga en cuenta, es el detector en accin y 5NO es un intento hostil.Cierrelo, y podr visitarnos(2%s)",
+		sh->host, (unsigned long)GlinePscannerExpiry,
+		Puertos[sh->abierto], WebNetwork);
+    }
+}
+
+/*************************************************************************/
+
+/* Llamado en cada vuelta del bucle principal. */
+
+void scanner_process(void)
+{
+    struct epoll_event ev[64];
+    ScanConn *sc, *next;
+    time_t now = time(NULL);
+    int n, i, err;
+    socklen_t len;
+
+    if (epfd < 0)
+	return;
+    if (now - st_inicio_minuto >= 60) {
+	st_ult_minuto = st_minuto;
+	st_minuto = 0;
+	st_inicio_minuto = now;
+    }
+    if (nresolviendo)
+	scan_dns();
+    while ((n = epoll_wait(epfd, ev, (int)(sizeof(ev)/sizeof(*ev)), 0)) > 0) {
+	for (i = 0; i < n; i++) {
+	    sc = ev[i].data.ptr;
+	    err = 0;
+	    len = sizeof(err);
+	    if (getsockopt(sc->fd, SOL_SOCKET, SO_ERROR, &err, &len) < 0)
+		err = errno;
+	    scan_resultado(sc, err == 0 && !(ev[i].events & EPOLLERR));
+	}
+	if (n < (int)(sizeof(ev)/sizeof(*ev)))
+	    break;
+    }
+    for (sc = conexiones; sc; sc = next) {
+	next = sc->next;
+	if (sc->limite <= now)
+	    scan_resultado(sc, 0);
+    }
+    scan_lanza();
+    scan_glines();
+}
+
+/* Descriptor que el bucle principal debe vigilar junto al del servidor, y
+ * si hay trabajo pendiente que no avisa por el (DNS, timeouts, GLINEs). */
+
+int scanner_fd(int *ocupado)
+{
+    *ocupado = nresolviendo || nconexiones || englines;
+    return epfd;
+}
+
+/*************************************************************************/
+
+void scanner_init(void)
+{
+    if ((epfd = epoll_create(64)) < 0)
+	logeo("Scanner: epoll_create(): %s", strerror(errno));
+    else
+	fcntl(epfd, F_SETFD, FD_CLOEXEC);
+    st_inicio_minuto = time(NULL);
+}
+
+/*************************************************************************/
+
+void get_scanner_stats(long *hosts, long *cache, long *conex, long *abiertos,
+		       long *gls, long *dns, long *por_minuto, int *activas,
+		       int *cola_hosts, int *cola_glines)
+{
+    *hosts = st_hosts;
+    *cache = st_cache;
+    *conex = st_conexiones;
+    *abiertos = st_abiertos;
+    *gls = st_glines;
+    *dns = st_dns;
+    *por_minuto = st_ult_minuto;
+    *activas = nconexiones;
+    *cola_hosts = encola + nresolviendo;
+    *cola_glines = englines;
+}
+
+#endif /* SOPORTE_SCANNER */
@@ -27,6 +27,10 @@ void vsend_cmd(const char *source, const char *fmt, va_list args)
     char buf[BUFSIZE];
 
     vsnprintf(buf, sizeof(buf), fmt, args);
+    /* Un KICK puede necesitar un +b o un +o que aun esta en modos.c */
+    if (modos_pendientes() && (strncmp(buf, "KICK ", 5) == 0
+				|| strncmp(buf, "K ", 2) == 0))
+	modos_envia();
     if (source) {
 	sockprintf(servsock, ":%s %s\r\n", source, buf);
 	if (debug)
@@ -40,7 +44,7 @@ void vsend_cmd(const char *source, const char *fmt, va_list args)
 
 /*************************************************************************/
 
-/* Enviar cosas al canal de admins.. */
+/* Enviar cosas al canal de admins..  Pasa por la cola de avisos.c. */
 
 void canaladmins(const char *source, const char *fmt, ...)
 {
@@ -48,12 +52,14 @@ void canaladmins(const char *source, const char *fmt, ...)
     char buf[BUFSIZE];
         
     va_start(args, fmt);
-    snprintf(buf, sizeof(buf), "PRIVMSG #%s :%s", CanalAdmins, fmt);
-    vsend_cmd(source, buf, args);
+    vsnprintf(buf, sizeof(buf), fmt, args);
+    va_end(args);
+    avisos_encola(AVISOS_ADMINS, AVISO_NORMAL, source, buf);
 }
 /*************************************************************************/
 
-/* Enviar cosas al canal de opers.. */
+/* Enviar cosas al canal de opers..  Estos salen en el acto: son pocos y
+ * urgentes, y el manejador de senales tambien los usa. */
 
 void canalopers(const char *source, const char *fmt, ...)
 {
@@ -76,8 +82,9 @@ void canalayuda(const char *source, const char *fmt, ...)
     char buf[BUFSIZE];
         
     va_start(args, fmt);
-    snprintf(buf, sizeof(buf), "PRIVMSG #%s :%s", CanalAyuda, fmt);
-    vsend_cmd(source, buf, args);
+    vsnprintf(buf, sizeof(buf), fmt, args);
+    va_end(args);
+    avisos_encola(AVISOS_AYUDA, AVISO_NORMAL, source, buf);
 }            
 
 /********************************************************************/
@@ -91,8 +98,9 @@ void canalcybers(const char *source, const char *fmt, ...)
     char buf[BUFSIZE];
         
     va_start(args, fmt);
-    snprintf(buf, sizeof(buf), "PRIVMSG #%s :%s", CanalCybers, fmt);
-    vsend_cmd(source, buf, args);
+    vsnprintf(buf, sizeof(buf), fmt, args);
+    va_end(args);
+    avisos_encola(AVISOS_CYBERS, AVISO_NORMAL, source, buf);
 }            
 
 /********************************************************************/
@@ -135,19 +135,15 @@ extern int toupper(char), tolower(char);
 /* Hispano BDD Support
  * Aadimos soporte para la base de datos hispano.
  * 
- * Se almacenaran segun su posicin.
- * a b c d e f g h i j k l m n o p q r s t u v w x y z 
- *
- * En TKOPURU se almacena el n-1 de tablas.
+ * Las tablas van de la 'a' a la 'z'.  bdd.c lleva las escrituras, las
+ * series y la copia local para los dos protocolos (P09 de Hispano/Terra y
+ * P10); solo cambia el formato de las filas en el enlace.
  *
  * Aritz, aritz@itxaropena.org
  * Itxaropena Garapen Taldea - www.itxaropena.org
  */
-#if defined(IRC_UNDERNET_P10)
-#define TKOPURU	26
-unsigned int tablas[28];
-
-
+#if defined(IRC_UNDERNET_P09) || defined(IRC_UNDERNET_P10)
+# define IRC_BDD
 #endif
 
 typedef struct server_ Server;
@@ -177,10 +173,23 @@ struct memo_ {
 
 #define MF_UNREAD	0x0001	/* Memo has not yet been read */
 
+/* Entrada del indice de memos; el texto esta en MemoDB (ver memodb.c). */
 typedef struct {
+    int32 id;		/* Id del registro en MemoDB */
+    uint32 number;
+    long offset;	/* Posicion del registro, -1 si solo esta en memoria */
+} MemoIdx;
+
+typedef struct memoinfo_ MemoInfo;
+struct memoinfo_ {
     int16 memocount, memomax;
-    Memo *memos;
-} MemoInfo;
+    Memo *memos;	/* Solo mientras estan cargados (memo_carga()) */
+    MemoIdx *idx;
+    uint32 *unread;	/* Mapa de bits de memos no leidos */
+    int16 unreadcount;
+    MemoInfo *next, *prev;	/* Lista de MemoInfos con memos */
+    MemoInfo *cargado_sig;	/* Lista de MemoInfos cargados */
+};
 
 /*************************************************************************/
 
@@ -191,6 +200,17 @@ typedef struct {
 
 typedef struct nickinfo_ NickInfo;
 
+/* Indice inverso nick -> canales.  Cada nick guarda la lista de canales
+ * en los que figura como founder, sucesor, en la lista de acceso o en la
+ * de akicks; refs cuenta cuantas veces aparece en ese canal.  Lo mantiene
+ * chanserv.c. */
+typedef struct chanref_ ChanRef;
+struct chanref_ {
+    ChanRef *next, *prev;
+    struct chaninfo_ *ci;
+    int16 refs;
+};
+
 struct nickinfo_ {
     NickInfo *next, *prev;
     char nick[NICKMAX];
@@ -247,6 +267,10 @@ struct nickinfo_ {
 
     time_t id_timestamp;/* TS8 timestamp of user who last ID'd for nick */
 /*     char *msuspend; */
+
+    ChanRef *chanrefs;	/* Canales donde aparece (no se guarda en disco) */
+    struct user_ *sesiones;	/* Usuarios conectados con este nick o sus links;
+			 * solo en el nick principal (no se guarda) */
 };
 #define AYU_ENTRA      0x00000001
 #define AYU_PROCESO    0x00000002
@@ -502,9 +526,12 @@ struct user_ {
     char nick[NICKMAX];
 #if defined(IRC_UNDERNET_P10)
     char *numerico;			/* Numerico del nick en Redes P10 */
+    User *num_next;			/* En el mismo cubo de numlist (users.c) */
 #endif    
     NickInfo *ni;			/* Effective NickInfo (not a link) */
     NickInfo *real_ni;			/* Real NickInfo (ni.nick==user.nick) */
+    NickInfo *sesion_ni;		/* En cuya lista de sesiones esta */
+    User *sesion_next, *sesion_prev;	/* Lista de sesiones de sesion_ni */
     char *username;
     char *host;				/* User's hostname */
     char *realname;
@@ -579,6 +606,7 @@ struct channel_ {
     int16 chanserv_modecount;		/* Number of check_mode()'s this sec */
     int16 bouncy_modes;			/* Did we fail to set modes here? */
     int erab;
+    struct canal_burst *burst;		/* Por revisar al acabar el burst */
 };
 
 
@@ -636,25 +664,146 @@ struct channel_ {
 
 /*************************************************************************/
 
-/* Ignorance list data. */
+/* Control de flood (process.c).  Un cubo por nick y otro por host. */
 
-typedef struct ignore_data {
-    struct ignore_data *next;
-     time_t time;	/* When do we stop ignoring them? */
-    char who[NICKMAX];
-   char servicio[NICKMAX];
+typedef struct flood_data {
+    int64 nivel;	/* Microsegundos acumulados */
+    int64 ultimo;	/* Ultima actualizacion de `nivel' */
+    struct expentry_ *entrada;	/* Entrada en flood_nicks o flood_hosts */
+    char servicio[NICKMAX];
     char inbuf[BUFSIZE];
-} IgnoreData;
+} FloodData;
+
+#define FLOOD_OK	0
+#define FLOOD_IGNORA	1
+#define FLOOD_KILL	2
+
+/* Peso de un comando en el coste de flood (directiva FloodPesos). */
+typedef struct {
+    char *servicio;	/* "*" vale para todos */
+    char *comando;
+    int peso;		/* En tanto por ciento */
+} FloodPeso;
+
+#define DEBUGSERV_MAX	100	/* Comandos que recuerda DEBUGSERV */
+
+/* Histograma de latencias de un comando (latencia.c).  El cubo i cuenta
+ * las medidas de 2^i a 2^(i+1)-1 microsegundos. */
+
+#define LATENCIA_CUBOS	32
+
+typedef struct latencia_ Latencia;
+struct latencia_ {
+    Latencia *next;
+    char *servicio;	/* Nick del *Serv, o "IRC" para mensajes del servidor */
+    char *comando;
+    uint32 cuenta;
+    int64 total, max;	/* Microsegundos */
+    uint32 cubos[LATENCIA_CUBOS];
+    volatile uint32 muestras;	/* Muestras de SIGPROF dentro del comando */
+};
+
+/* Lineas del servidor que han tardado mas de LineaLenta en procesarse. */
+
+#define LENTAS_MAX	32
+#define PERFIL_FASES	32	/* Valores de -waiting que distingue el perfil */
+
+typedef struct linea_lenta {
+    time_t time;
+    int64 usado;	/* Microsegundos */
+    char ruta[64];	/* "IRC PRIVMSG > NickServ IDENTIFY" */
+    char linea[BUFSIZE];
+} LentaData;
+
+/* Registro de la copia local de la BDD (bddlocal.c). */
+
+typedef struct bddreg_ BddReg;
+struct bddreg_ {
+    BddReg *next;			/* En el mismo cubo del hash */
+    BddReg *lista_sig, *lista_ant;	/* En la misma tabla */
+    uint32 hash;
+    uint32 serie;
+    uint32 marca;			/* Ultima auditoria que lo ha visto */
+    char tabla;				/* 'a' a 'z' */
+    char *clave;			/* Normalizada con toLower() */
+    char *valor;
+};
+
+/* Avisos a los canales de la administracion (avisos.c): colas, prioridades
+ * y clases de aviso() que se resumen. */
+
+#define AVISOS_ADMINS	0
+#define AVISOS_AYUDA	1
+#define AVISOS_CYBERS	2
+#define AVISOS_CANALES	3
+
+#define AVISO_NORMAL	0
+#define AVISO_BAJA	1
+
+#define AVISO_ENTRA	0	/* Conexiones */
+#define AVISO_NICK	1	/* Cambios de nick */
+#define AVISO_CANAL	2	/* JOIN y PART */
+#define AVISO_SALE	3	/* QUIT */
+#define AVISO_CLASES	4
 
 typedef struct debug_data {
-    struct debug_data *next;
-     time_t time;	/* When do we stop ignoring them? */
+    time_t time;	/* Cuando se proceso */
+    int64 usado;	/* Microsegundos que tardo */
     char who[NICKMAX];
-   char servicio[NICKMAX];
+    char servicio[NICKMAX];
     char inbuf[BUFSIZE];
 } DebugData;
 
+/*************************************************************************/
+
+/* Resultado de una consulta a la base de datos de la web (joomla.c).  Lo
+ * rellena el hilo de la base de datos y se entrega al callback desde el
+ * bucle principal; se libera al volver del callback. */
+
+typedef struct sqlresult_ {
+    int error;			/* 1 si ha fallado */
+    unsigned int errnum;	/* mysql_errno(), 0 si no lo ha dado MySQL */
+    char errmsg[BUFSIZE];
+    long affected;		/* Filas modificadas */
+    int nrows, ncols;
+    char ***rows;		/* rows[fila][columna], NULL si es NULL */
+} SqlResult;
 
+#define SQL_SIN_TABLA	1146	/* ER_NO_SUCH_TABLE */
+
+typedef void (*SqlCallback)(SqlResult *res, void *data);
+
+/*************************************************************************/
+
+/* Conjunto de entradas con caducidad (expset.c): AREGISTRA, ALIMIT, ANICK
+ * y AKILL.  Cada entrada esta a la vez en la tabla hash por clave, en el
+ * monticulo por fecha de expiracion (si expira) y en la lista en orden de
+ * insercion que recorren los listados y las grabaciones. */
+
+typedef struct expentry_ ExpEntry;
+struct expentry_ {
+    ExpEntry *hnext;		/* Cadena de la tabla hash */
+    ExpEntry *prev, *next;	/* Orden de insercion */
+    char *key;
+    time_t time;		/* Cuando se anadio */
+    time_t expires;		/* 0 = no expira */
+    int heappos;		/* Posicion en el monticulo, -1 si no esta */
+    void *data;
+};
+
+typedef struct expset_ ExpSet;
+struct expset_ {
+    ExpSet *sig;		/* Siguiente conjunto (para expset_run()) */
+    ExpEntry **hash;
+    int hashsize;
+    ExpEntry **heap;
+    int nheap, heapsize;
+    ExpEntry *first, *last;
+    int count;
+    int nocase;			/* Claves sin distinguir mayusculas */
+    void (*expira)(ExpEntry *e);
+    void (*libera)(ExpEntry *e);
+};
 
 /*************************************************************************/
 /*************************************************************************/
@@ -31,12 +31,29 @@ int32 read_buffer_len()
 }
 
 
+/* select() sobre un solo socket, repitiendo si lo corta una senal (el
+ * SIGPROF del perfil, por ejemplo). */
+
+static int espera_socket(int fd, int escribir, struct timeval *tv)
+{
+    fd_set fds;
+    int r;
+
+    do {
+	FD_ZERO(&fds);
+	FD_SET(fd, &fds);
+	r = escribir ? select(fd+1, 0, &fds, 0, tv)
+		     : select(fd+1, &fds, 0, 0, tv);
+    } while (r < 0 && errno == EINTR);
+    return r;
+}
+
+
 /* Read data. */
 
 static int buffered_read(int fd, char *buf, int len)
 {
     int nread, left = len;
-    fd_set fds;
     struct timeval tv = {0,0};
     int errno_save = errno;
 
@@ -46,10 +63,8 @@ static int buffered_read(int fd, char *buf, int len)
     }
     while (left > 0) {
 	struct timeval *tvptr = (read_bufend == read_curpos ? NULL : &tv);
-	FD_ZERO(&fds);
-	FD_SET(fd, &fds);
 	while (read_bufend != read_curpos-1 && !(read_curpos == read_netbuf && read_bufend == read_buftop-1)
-				  && select(fd+1, &fds, 0, 0, tvptr) == 1) {
+				  && espera_socket(fd, 0, tvptr) == 1) {
 	    int maxread;
 	    tvptr = &tv;		/* don't wait next time */
 	    if (read_bufend < read_curpos)	/* wrapped around? */
@@ -105,7 +120,6 @@ static int buffered_read(int fd, char *buf, int len)
 static int buffered_read_one(int fd)
 {
     int nread;
-    fd_set fds;
     struct timeval tv = {0,0};
     char c;
     struct timeval *tvptr = (read_bufend == read_curpos ? NULL : &tv);
@@ -115,11 +129,9 @@ static int buffered_read_one(int fd)
 	errno = EBADF;
 	return -1;
     }
-    FD_ZERO(&fds);
-    FD_SET(fd, &fds);
     while (read_bufend != read_curpos-1
 		&& !(read_curpos == read_netbuf && read_bufend == read_buftop-1)
-		&& select(fd+1, &fds, 0, 0, tvptr) == 1) {
+		&& espera_socket(fd, 0, tvptr) == 1) {
 	int maxread;
 	tvptr = &tv;		/* don't wait next time */
 	if (read_bufend < read_curpos)	/* wrapped around? */
@@ -182,15 +194,12 @@ int32 write_buffer_len()
 
 static int flush_write_buffer(int wait)
 {
-    fd_set fds;
     struct timeval tv = {0,0};
     int errno_save = errno;
 
     if (write_bufend == write_curpos || write_fd == -1)
 	return 0;
-    FD_ZERO(&fds);
-    FD_SET(write_fd, &fds);
-    if (select(write_fd+1, 0, &fds, 0, wait ? NULL : &tv) == 1) {
+    if (espera_socket(write_fd, 1, wait ? NULL : &tv) == 1) {
 	int maxwrite, nwritten;
 	if (write_curpos > write_bufend)	/* wrapped around? */
 	    maxwrite = write_buftop - write_curpos;
@@ -215,6 +224,15 @@ static int flush_write_buffer(int wait)
 }
 
 
+/* Write out everything left in the write buffer, waiting if necessary. */
+
+void sflush(void)
+{
+    while (write_buffer_len() > 0 && flush_write_buffer(1) > 0)
+	;
+}
+
+
 /* Write data. */
 
 static int buffered_write(int fd, char *buf, int len)
@@ -353,11 +371,41 @@ char *sgets(char *buf, int len, int s)
     fd_set fds;
     char *ptr = buf;
 
+#if defined(SOPORTE_SCANNER)
+    int sfd, ocupado, maxfd = s;
+#endif
+
     if (len == 0)
 	return NULL;
+    FD_ZERO(&fds);
     FD_SET(s, &fds);
     tv.tv_sec = ReadTimeout;
     tv.tv_usec = 0;
+    /* Con avisos en cola hay que volver al bucle para ir mandandolos */
+    if (tv.tv_sec > 1 && avisos_pendientes())
+	tv.tv_sec = 1;
+#if defined(IRC_BDD)
+    /* Y lo mismo mientras se compactan o se reparan las tablas de la BDD */
+    if (tv.tv_sec > 1 && bdd_repasando())
+	tv.tv_sec = 1;
+#endif
+#if defined(SOPORTE_SCANNER)
+    /* Que las conexiones del detector despierten tambien al bucle */
+    if ((sfd = scanner_fd(&ocupado)) >= 0) {
+	FD_SET(sfd, &fds);
+	if (sfd > maxfd)
+	    maxfd = sfd;
+	if (ocupado && tv.tv_sec > 1)
+	    tv.tv_sec = 1;
+    }
+    while (read_buffer_len() == 0 &&
+		(c = select(maxfd+1, &fds, NULL, NULL, &tv)) < 0) {
+	if (errno != EINTR)
+	    break;
+    }
+    if (read_buffer_len() == 0 && (c == 0 || (c > 0 && !FD_ISSET(s, &fds))))
+	return (char *)-1;
+#else
     while (read_buffer_len() == 0 &&
 		(c = select(s+1, &fds, NULL, NULL, &tv)) < 0) {
 	if (errno != EINTR)
@@ -365,6 +413,7 @@ char *sgets(char *buf, int len, int s)
     }
     if (read_buffer_len() == 0 && c == 0)
 	return (char *)-1;
+#endif
     c = sgetc(s);
     while (--len && (*ptr++ = c) != '\n' && (c = sgetc(s)) >= 0)
 	;
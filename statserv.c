@@ -18,6 +18,7 @@ static void do_credits (User *u);
 static void do_help (User *u);
 static void do_stats(User *u);
 static void do_sendweb(User *u);
+static void do_latency(User *u);
 
 
 
@@ -32,6 +33,7 @@ static Command cmds[] = {
     { "SENDWEB",    do_sendweb,    is_services_cregadmin,  STATS_HELP_SENDWEB,                   -1,-1,-1,-1 },
     { "STATS",      do_stats,      is_services_devel,  OPER_HELP_STATS,      -1,-1,-1,-1 },
     { "UPTIME",     do_stats,      is_services_devel,  OPER_HELP_STATS,      -1,-1,-1,-1 },
+    { "LATENCY",    do_latency,    is_services_devel,  -1,                   -1,-1,-1,-1 },
    /*del servers.c*/
     { "SERVERS",    do_servers,    is_services_oper,  -1,                   -1,-1,-1,-1 },
       /* Commands for Services CoAdmins: */
@@ -235,6 +237,41 @@ static void do_stats(User *u)
 	mem += mem2;
 	/*notice_lang(s_StatServ, u, OPER_STATS_OPERSERV_MEM,
 			count, (mem+512) / 1024);*/ /*habra que mirar otros registros*/
+#if defined(SOPORTE_JOOMLA15)
+	{
+	    long encoladas, ejecutadas, errores, descartadas, reconexiones;
+	    long leidas, aplicadas, total_leidas, total_aplicadas;
+	    int encola;
+
+	    get_sql_stats(&encoladas, &ejecutadas, &errores, &descartadas,
+			  &reconexiones, &encola);
+	    privmsg(s_StatServ, u->nick, "SQL: %ld encoladas, %ld ejecutadas, "
+		    "%ld errores, %ld descartadas, %ld reconexiones, %d en cola",
+		    encoladas, ejecutadas, errores, descartadas, reconexiones,
+		    encola);
+	    get_joomla_sync_stats(&leidas, &aplicadas, &total_leidas,
+				  &total_aplicadas);
+	    privmsg(s_StatServ, u->nick, "jos_users: %ld leidas y %ld aplicadas "
+		    "en el ultimo ciclo (%ld y %ld en total)", leidas, aplicadas,
+		    total_leidas, total_aplicadas);
+	}
+#endif
+#if defined(SOPORTE_SCANNER)
+	{
+	    long hosts, cache, conex, abiertos, gls, dns, por_minuto;
+	    int activas, cola_hosts, cola_glines;
+
+	    get_scanner_stats(&hosts, &cache, &conex, &abiertos, &gls, &dns,
+			      &por_minuto, &activas, &cola_hosts, &cola_glines);
+	    privmsg(s_StatServ, u->nick, "Scanner: %ld hosts (%ld/min), "
+		    "%ld en cache, %ld conexiones, %ld abiertos, %ld GLINEs, "
+		    "%ld fallos DNS", hosts, por_minuto, cache, conex, abiertos,
+		    gls, dns);
+	    privmsg(s_StatServ, u->nick, "Scanner: %d conexiones activas, "
+		    "%d hosts y %d GLINEs en cola", activas, cola_hosts,
+		    cola_glines);
+	}
+#endif
 
     }
 }
@@ -272,5 +309,62 @@ strftime_lang(timebuf, sizeof(timebuf), u, STRFTIME_DATE_TIME_FORMAT, tm);
 
 }                                           
 
+/*************************************************************************/
+
+/* LATENCY [servicio|RESET]: p50/p99/max de cada comando, de mas lento a
+ * mas rapido segun el p99. */
+
+static void fmt_us(char *buf, int len, int64 us)
+{
+    if (us >= 1000000)
+	snprintf(buf, len, "%ld.%03lds", (long)(us/1000000),
+		 (long)(us/1000%1000));
+    else if (us >= 1000)
+	snprintf(buf, len, "%ld.%03ldms", (long)(us/1000), (long)(us%1000));
+    else
+	snprintf(buf, len, "%ldus", (long)us);
+}
+
+static int compara_p99(const void *a, const void *b)
+{
+    int64 pa = latencia_percentil(*(Latencia **)a, 99);
+    int64 pb = latencia_percentil(*(Latencia **)b, 99);
 
+    return pa < pb ? 1 : pa > pb ? -1 : 0;
+}
+
+static void do_latency(User *u)
+{
+    char *servicio = strtok(NULL, " ");
+    Latencia **lista;
+    char p50[32], p99[32], max[32];
+    int n, i, enviados = 0;
 
+    if (servicio && stricmp(servicio, "RESET") == 0) {
+	latencia_borra();
+	privmsg(s_StatServ, u->nick, "Borrados los histogramas de latencia");
+	canaladmins(s_StatServ, "12%s ha usado 12LATENCY RESET", u->nick);
+	return;
+    }
+    n = latencia_lista(&lista);
+    qsort(lista, n, sizeof(Latencia *), compara_p99);
+    for (i = 0; i < n && enviados < NSListMax; i++) {
+	if (servicio && stricmp(servicio, lista[i]->servicio) != 0)
+	    continue;
+	if (!enviados++)
+	    privmsg(s_StatServ, u->nick,
+		    "Servicio   Comando        Veces      p50      p99      max");
+	fmt_us(p50, sizeof(p50), latencia_percentil(lista[i], 50));
+	fmt_us(p99, sizeof(p99), latencia_percentil(lista[i], 99));
+	fmt_us(max, sizeof(max), lista[i]->max);
+	privmsg(s_StatServ, u->nick, "%-10s %-14s %5lu %8s %8s %8s",
+		lista[i]->servicio, lista[i]->comando,
+		(unsigned long)lista[i]->cuenta, p50, p99, max);
+    }
+    free(lista);
+    if (!enviados)
+	privmsg(s_StatServ, u->nick, "No hay medidas de latencia");
+    else
+	privmsg(s_StatServ, u->nick, "Volcado completo en 12%s",
+		LatenciaFichero);
+}
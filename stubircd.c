@@ -0,0 +1,686 @@
+/* Servidor de IRC de mentira para pruebas de carga de los Services.
+ *
+ * Services is copyright (c) 1996-1999 Andy Church.
+ *     E-mail: <achurch@dragonfire.net>
+ * This program is free but copyrighted software; see the file COPYING for
+ * details.
+ *
+ * "make stub-ircd" compila este programa, que no usa nada de los Services.
+ * Escucha en un puerto, espera a que los Services conecten (RemoteServer
+ * apuntando aqui), completa el enlace en P09 (Hispano/Terra) o en P10 y
+ * se inventa una red: unos cuantos servidores hoja con -usuarios usuarios
+ * repartidos entre ellos y -canales canales.  Despues del burst genera
+ * trafico al ritmo pedido (eventos por segundo):
+ *
+ *	-msg	PRIVMSG de un usuario a -objetivo con el texto -texto
+ *	-join	JOIN de un usuario a un canal
+ *	-mode	MODE de un usuario sobre su canal (+t/-t) o sobre si mismo
+ *	-quit	QUIT de un usuario, que vuelve a entrar en el acto
+ *	-split	cada tantos segundos un servidor hoja hace SQUIT y vuelve
+ *		(netjoin, con todos sus usuarios y canales) a los -reunion s
+ *
+ * Para medir la latencia manda un PING cada -ping ms y apunta cuanto
+ * tarda el PONG, y para cada PRIVMSG cuanto tarda la primera linea
+ * (NOTICE o PRIVMSG) de vuelta al mismo usuario.  Cada segundo escribe las lineas enviadas y
+ * recibidas, los bytes recibidos y los percentiles de las dos latencias;
+ * al acabar (-duracion s, o al cerrar los Services la conexion) escribe
+ * el total.  Si los Services no leen lo bastante rapido el trafico se
+ * frena en vez de acumularse (se cuenta como "retenido").
+ *
+ * En P10 el hub tiene el numerico J y las hojas K, L...; el ServerNumerico
+ * de los Services no debe coincidir con ninguno.
+ *
+ * Ejemplo, 100.000 usuarios y 2000 mensajes por segundo durante 5 minutos:
+ *
+ *	stub-ircd -usuarios 100000 -servidores 32 -msg 2000 -join 500 \
+ *		-quit 200 -split 60 -duracion 300
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define CUBOS		32		/* Histograma de latencias, como latencia.c */
+#define MAXPINGS	1024		/* PINGs pendientes que se recuerdan */
+#define MAXSALIDA	(1024*1024)	/* A partir de aqui se retiene el trafico */
+#define MAXLINEA	1024
+
+typedef long long int64;
+
+typedef struct {
+    unsigned long cuenta;
+    int64 max;
+    unsigned long cubos[CUBOS];
+} Histograma;
+
+typedef struct {
+    short servidor;	/* Servidor hoja al que esta conectado */
+    char activo;	/* Dentro de la red */
+    int canal;		/* Canal en el que esta, o -1 */
+    int64 envio;	/* Cuando mando el PRIVMSG que espera respuesta, o 0 */
+} Usuario;
+
+typedef struct {
+    char activo;
+    char inicial;	/* El burst es el del enlace: cada uno a su canal */
+    int burst;		/* Siguiente usuario que falta por meter, o -1 */
+    int64 vuelve;	/* Si esta separado, cuando hace el netjoin */
+} Hoja;
+
+/* Opciones */
+static int puerto = 4400;
+static int p10 = 0;
+static int nusuarios = 1000, nhojas = 4, ncanales = 100;
+static double r_msg = 0, r_join = 0, r_mode = 0, r_quit = 0;
+static int split = 0, reunion = 5, ping_ms = 1000, duracion = 0;
+static char *clave = "openaccess", *nombre = "stub.irc";
+static char *objetivo = "NickServ", *texto = "INFO";
+static unsigned int semilla = 1;
+
+static Usuario *usuarios;
+static Hoja *hojas;
+static int sock = -1;
+
+static char salida[MAXSALIDA*2];
+static int nsalida = 0;
+static char entrada[MAXLINEA*8];
+static int nentrada = 0;
+
+static unsigned long enviadas = 0, recibidas = 0, retenidas = 0;
+static unsigned long long bytes_rx = 0;
+static Histograma h_ping, h_resp;	/* Todo el rato */
+static Histograma i_ping, i_resp;	/* El ultimo segundo */
+static int64 pings[MAXPINGS];
+static unsigned long npings = 0;
+
+static const char base64[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789[]";
+
+/*************************************************************************/
+
+static int64 reloj_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void anota(Histograma *h, int64 us)
+{
+    int i = 0;
+    int64 v = us;
+
+    while (v > 1 && i < CUBOS-1) {
+	v >>= 1;
+	i++;
+    }
+    h->cubos[i]++;
+    h->cuenta++;
+    if (us > h->max)
+	h->max = us;
+}
+
+static int64 percentil(Histograma *h, int pct)
+{
+    unsigned long objetivo = (h->cuenta * pct + 99) / 100, suma = 0;
+    int i;
+
+    if (!h->cuenta)
+	return 0;
+    for (i = 0; i < CUBOS-1; i++) {
+	suma += h->cubos[i];
+	if (suma >= objetivo)
+	    break;
+    }
+    return ((int64)2 << i) - 1 < h->max ? ((int64)2 << i) - 1 : h->max;
+}
+
+/*************************************************************************/
+
+/* Numerico P10 del servidor hoja `i' (el hub es 'J') y de un usuario. */
+
+static char num_hoja(int i)
+{
+    return base64[10 + i];
+}
+
+static const char *num_usuario(int u)
+{
+    static char buf[4];
+    int i = u / nhojas;		/* Posicion dentro de su servidor */
+
+    buf[0] = num_hoja(usuarios[u].servidor);
+    buf[1] = base64[(i >> 6) & 63];
+    buf[2] = base64[i & 63];
+    buf[3] = 0;
+    return buf;
+}
+
+/* Usuario a partir del destino de un mensaje (nick o numerico), o -1. */
+
+static int busca_usuario(const char *s)
+{
+    const char *p;
+    int u;
+
+    if (strncmp(s, "stub", 4) == 0) {
+	u = atoi(s+4);
+    } else if (p10 && strlen(s) == 3) {
+	if (!(p = strchr(base64, s[0])) || p - base64 < 10)
+	    return -1;
+	u = (int)(p - base64 - 10);
+	if (!(p = strchr(base64, s[1])))
+	    return -1;
+	u += (int)(p - base64) * 64 * nhojas;
+	if (!(p = strchr(base64, s[2])))
+	    return -1;
+	u += (int)(p - base64) * nhojas;
+    } else {
+	return -1;
+    }
+    return u >= 0 && u < nusuarios ? u : -1;
+}
+
+/*************************************************************************/
+
+static void envia(const char *fmt, ...)
+{
+    va_list args;
+    int n;
+
+    va_start(args, fmt);
+    n = vsnprintf(salida+nsalida, sizeof(salida)-nsalida-2, fmt, args);
+    va_end(args);
+    if (n < 0 || nsalida + n + 2 > (int)sizeof(salida)) {
+	retenidas++;
+	return;
+    }
+    nsalida += n;
+    salida[nsalida++] = '\r';
+    salida[nsalida++] = '\n';
+    enviadas++;
+}
+
+static void vacia(void)
+{
+    int n, hecho = 0;
+
+    while (hecho < nsalida) {
+	n = write(sock, salida+hecho, nsalida-hecho);
+	if (n <= 0)
+	    break;
+	hecho += n;
+    }
+    memmove(salida, salida+hecho, nsalida-hecho);
+    nsalida -= hecho;
+}
+
+/*************************************************************************/
+
+/* Lineas de la red inventada, en el dialecto que toque. */
+
+static void nick(int u, time_t ts)
+{
+    Usuario *us = &usuarios[u];
+
+    us->activo = 1;
+    us->canal = -1;
+    us->envio = 0;
+    if (p10)
+	envia("%c N stub%d 2 %ld u%d h%d.stub.test +i AAAAAA %s :Usuario %d",
+	      num_hoja(us->servidor), u, (long)ts, u, u % 5000, num_usuario(u),
+	      u);
+    else
+	envia(":hoja%d.%s NICK stub%d 2 %ld u%d h%d.stub.test hoja%d.%s"
+	      " :Usuario %d", us->servidor, nombre, u, (long)ts, u, u % 5000,
+	      us->servidor, nombre, u);
+}
+
+static const char *origen(int u)
+{
+    static char buf[32];
+
+    if (p10)
+	return num_usuario(u);
+    snprintf(buf, sizeof(buf), ":stub%d", u);
+    return buf;
+}
+
+static void join(int u, int c)
+{
+    usuarios[u].canal = c;
+    envia("%s %s #stub%d", origen(u), p10 ? "J" : "JOIN", c);
+}
+
+static void servidor(int h)
+{
+    hojas[h].activo = 1;
+    hojas[h].vuelve = 0;
+    if (p10)
+	envia("J S hoja%d.%s 2 %ld %ld J10 %c]] :Hoja %d", h, nombre,
+	      (long)time(NULL), (long)time(NULL), num_hoja(h), h);
+    else
+	envia(":%s SERVER hoja%d.%s 2 %ld %ld P09 %c]]] :Hoja %d", nombre,
+	      h, nombre, (long)time(NULL), (long)time(NULL), num_hoja(h), h);
+}
+
+/* Mete en la red el servidor hoja `h'; sus usuarios y canales los va
+ * mandando sigue_burst() segun se vacia la salida. */
+
+static void netjoin(int h, int inicial)
+{
+    servidor(h);
+    hojas[h].inicial = inicial;
+    hojas[h].burst = h;
+}
+
+/* Devuelve 1 si queda burst por mandar. */
+
+static int sigue_burst(void)
+{
+    int h, u, c, queda = 0;
+
+    for (h = 0; h < nhojas; h++) {
+	while ((u = hojas[h].burst) >= 0 && nsalida < MAXSALIDA) {
+	    c = hojas[h].inicial ? u % ncanales : usuarios[u].canal;
+	    nick(u, time(NULL));
+	    if (c >= 0)
+		join(u, c);
+	    hojas[h].burst = u + nhojas < nusuarios ? u + nhojas : -1;
+	}
+	if (hojas[h].burst >= 0)
+	    queda = 1;
+    }
+    return queda;
+}
+
+static void netsplit(int h)
+{
+    int u;
+
+    if (p10)
+	envia("J SQ hoja%d.%s 0 :Net split", h, nombre);
+    else
+	envia(":%s SQUIT hoja%d.%s 0 :Net split", nombre, h, nombre);
+    hojas[h].activo = 0;
+    hojas[h].burst = -1;
+    hojas[h].vuelve = reloj_us() + (int64)reunion * 1000000;
+    for (u = h; u < nusuarios; u += nhojas)
+	usuarios[u].activo = 0;
+}
+
+/*************************************************************************/
+
+/* Un usuario al azar de los que estan en la red, o -1. */
+
+static int al_azar(void)
+{
+    int i, u;
+
+    for (i = 0; i < 16; i++) {
+	u = rand() % nusuarios;
+	if (usuarios[u].activo)
+	    return u;
+    }
+    return -1;
+}
+
+static void evento(int tipo)
+{
+    int u = al_azar(), c;
+
+    if (u < 0)
+	return;
+    switch (tipo) {
+      case 0:	/* PRIVMSG */
+	if (!usuarios[u].envio)
+	    usuarios[u].envio = reloj_us();
+	envia("%s %s %s :%s", origen(u), p10 ? "P" : "PRIVMSG", objetivo,
+	      texto);
+	break;
+      case 1:	/* JOIN */
+	join(u, rand() % ncanales);
+	break;
+      case 2:	/* MODE */
+	if ((c = usuarios[u].canal) >= 0)
+	    envia("%s %s #stub%d %ct", origen(u), p10 ? "M" : "MODE", c,
+		  rand() & 1 ? '+' : '-');
+	else
+	    envia("%s %s stub%d %ci", origen(u), p10 ? "M" : "MODE", u,
+		  rand() & 1 ? '+' : '-');
+	break;
+      case 3:	/* QUIT y vuelta */
+	envia("%s %s :Hasta luego", origen(u), p10 ? "Q" : "QUIT");
+	usuarios[u].activo = 0;
+	nick(u, time(NULL));
+	break;
+    }
+}
+
+/*************************************************************************/
+
+/* Procesa una linea recibida de los Services. */
+
+static void recibe(char *linea)
+{
+    char *av[4], *s = linea, *fin;
+    int ac = 0, u;
+    unsigned long n;
+
+    recibidas++;
+    if (*s == ':')
+	s++;
+    while (ac < 4 && *s && *s != ':') {
+	av[ac++] = s;
+	if (!(s = strchr(s, ' ')))
+	    break;
+	*s++ = 0;
+    }
+    if (ac == 1 && strcmp(av[0], "PING") == 0) {
+	envia(p10 ? "J Z %s" : ":%s PONG %s", nombre, nombre);
+	return;
+    } else if (ac < 2) {
+	return;
+    }
+    if (strcmp(av[1], "PONG") == 0 || strcmp(av[1], "Z") == 0) {
+	/* El ultimo parametro es el numero de PING */
+	fin = s && *s ? (*s == ':' ? s+1 : s) : av[ac-1];
+	n = strtoul(fin, NULL, 10);
+	if (n < npings && npings - n <= MAXPINGS && pings[n % MAXPINGS]) {
+	    anota(&h_ping, reloj_us() - pings[n % MAXPINGS]);
+	    anota(&i_ping, reloj_us() - pings[n % MAXPINGS]);
+	    pings[n % MAXPINGS] = 0;
+	}
+    } else if (ac >= 3 && (strcmp(av[1], "NOTICE") == 0
+			   || strcmp(av[1], "PRIVMSG") == 0
+			   || strcmp(av[1], "O") == 0 || strcmp(av[1], "P") == 0)) {
+	if ((u = busca_usuario(av[2])) >= 0 && usuarios[u].envio) {
+	    anota(&h_resp, reloj_us() - usuarios[u].envio);
+	    anota(&i_resp, reloj_us() - usuarios[u].envio);
+	    usuarios[u].envio = 0;
+	}
+    } else if (strcmp(av[0], "PING") == 0 || strcmp(av[1], "PING") == 0
+	       || strcmp(av[1], "G") == 0) {
+	envia(p10 ? "J Z %s" : ":%s PONG %s", nombre, nombre);
+    } else if (p10 && strcmp(av[1], "EB") == 0) {
+	envia("J EA");
+    }
+}
+
+static int lee(void)
+{
+    char *s, *e;
+    int n;
+
+    n = read(sock, entrada+nentrada, sizeof(entrada)-nentrada-1);
+    if (n == 0 || (n < 0 && errno != EAGAIN && errno != EINTR))
+	return -1;
+    if (n < 0)
+	return 0;
+    bytes_rx += n;
+    nentrada += n;
+    entrada[nentrada] = 0;
+    s = entrada;
+    while ((e = strchr(s, '\n')) != NULL) {
+	*e = 0;
+	if (e > s && e[-1] == '\r')
+	    e[-1] = 0;
+	recibe(s);
+	s = e+1;
+    }
+    nentrada -= s - entrada;
+    memmove(entrada, s, nentrada);
+    if (nentrada >= (int)sizeof(entrada)-1)
+	nentrada = 0;		/* Linea demasiado larga */
+    return 0;
+}
+
+/*************************************************************************/
+
+static void informe(const char *que, double segs, unsigned long env,
+		    unsigned long rec, unsigned long long bytes,
+		    Histograma *ping, Histograma *resp)
+{
+    int activos = 0, u;
+
+    for (u = 0; u < nusuarios; u++)
+	activos += usuarios[u].activo;
+    if (segs <= 0)
+	segs = 1;
+    printf("%s: %d usuarios, %.0f lin/s enviadas, %.0f lin/s y %.0f KB/s"
+	   " recibidas, %lu retenidas; PING p50 %.1fms p99 %.1fms max %.1fms;"
+	   " respuesta p50 %.1fms p99 %.1fms max %.1fms (%lu)\n",
+	   que, activos, env/segs, rec/segs, bytes/1024.0/segs, retenidas,
+	   percentil(ping, 50)/1000.0, percentil(ping, 99)/1000.0,
+	   ping->max/1000.0, percentil(resp, 50)/1000.0,
+	   percentil(resp, 99)/1000.0, resp->max/1000.0, resp->cuenta);
+    fflush(stdout);
+}
+
+static void opciones(int ac, char **av)
+{
+    int i;
+
+    for (i = 1; i < ac; i++) {
+	char *o = av[i], *v = i+1 < ac ? av[i+1] : NULL;
+
+	if (strcmp(o, "-P10") == 0) {
+	    p10 = 1;
+	    continue;
+	} else if (strcmp(o, "-P09") == 0) {
+	    p10 = 0;
+	    continue;
+	}
+	if (!v) {
+	    fprintf(stderr, "%s requiere un parametro\n", o);
+	    exit(1);
+	}
+	i++;
+	if (strcmp(o, "-p") == 0)		puerto = atoi(v);
+	else if (strcmp(o, "-usuarios") == 0)	nusuarios = atoi(v);
+	else if (strcmp(o, "-servidores") == 0)	nhojas = atoi(v);
+	else if (strcmp(o, "-canales") == 0)	ncanales = atoi(v);
+	else if (strcmp(o, "-msg") == 0)	r_msg = atof(v);
+	else if (strcmp(o, "-join") == 0)	r_join = atof(v);
+	else if (strcmp(o, "-mode") == 0)	r_mode = atof(v);
+	else if (strcmp(o, "-quit") == 0)	r_quit = atof(v);
+	else if (strcmp(o, "-split") == 0)	split = atoi(v);
+	else if (strcmp(o, "-reunion") == 0)	reunion = atoi(v);
+	else if (strcmp(o, "-ping") == 0)	ping_ms = atoi(v);
+	else if (strcmp(o, "-duracion") == 0)	duracion = atoi(v);
+	else if (strcmp(o, "-pass") == 0)	clave = v;
+	else if (strcmp(o, "-nombre") == 0)	nombre = v;
+	else if (strcmp(o, "-objetivo") == 0)	objetivo = v;
+	else if (strcmp(o, "-texto") == 0)	texto = v;
+	else if (strcmp(o, "-semilla") == 0)	semilla = atoi(v);
+	else {
+	    fprintf(stderr, "Opcion desconocida %s\n", o);
+	    exit(1);
+	}
+    }
+    if (nusuarios < 1 || nhojas < 1 || ncanales < 1 || ping_ms < 1) {
+	fprintf(stderr, "-usuarios, -servidores, -canales y -ping deben ser"
+			" positivos\n");
+	exit(1);
+    }
+    /* En P10 cada servidor tiene 4096 numericos de usuario y hay 54
+     * numericos de servidor libres despues del hub */
+    if (p10 && (nhojas > 54 || nusuarios > nhojas * 4096)) {
+	fprintf(stderr, "En P10 caben como mucho 54 servidores de 4096"
+			" usuarios\n");
+	exit(1);
+    }
+}
+
+/*************************************************************************/
+
+int main(int ac, char **av)
+{
+    struct sockaddr_in sa;
+    struct timeval tv;
+    fd_set rfds, wfds;
+    double deuda[4] = { 0, 0, 0, 0 }, ritmo[4];
+    int64 ahora, antes, inicio, prox_ping, prox_split, prox_informe;
+    unsigned long env0 = 0, rec0 = 0;
+    unsigned long long bytes0 = 0;
+    char linea[MAXLINEA];
+    int l, i, u, h, siguiente_split = 0;
+    int enlazado = 0;		/* 1 = mandando el burst, 2 = generando trafico */
+
+    opciones(ac, av);
+    srand(semilla);
+    signal(SIGPIPE, SIG_IGN);
+    usuarios = calloc(nusuarios, sizeof(Usuario));
+    hojas = calloc(nhojas, sizeof(Hoja));
+    if (!usuarios || !hojas) {
+	perror("calloc");
+	return 1;
+    }
+    for (u = 0; u < nusuarios; u++)
+	usuarios[u].servidor = u % nhojas;
+    for (h = 0; h < nhojas; h++)
+	hojas[h].burst = -1;
+
+    if ((l = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
+	perror("socket");
+	return 1;
+    }
+    i = 1;
+    setsockopt(l, SOL_SOCKET, SO_REUSEADDR, &i, sizeof(i));
+    memset(&sa, 0, sizeof(sa));
+    sa.sin_family = AF_INET;
+    sa.sin_port = htons(puerto);
+    sa.sin_addr.s_addr = htonl(INADDR_ANY);
+    if (bind(l, (struct sockaddr *)&sa, sizeof(sa)) < 0 || listen(l, 1) < 0) {
+	perror("bind/listen");
+	return 1;
+    }
+    printf("Esperando a los Services en el puerto %d (%s)\n", puerto,
+	   p10 ? "P10" : "P09");
+    fflush(stdout);
+    if ((sock = accept(l, NULL, NULL)) < 0) {
+	perror("accept");
+	return 1;
+    }
+    close(l);
+    fcntl(sock, F_SETFL, O_NONBLOCK);
+
+    /* Enlace: nos presentamos en cuanto llega su SERVER */
+    envia("PASS :%s", clave);
+    ritmo[0] = r_msg;
+    ritmo[1] = r_join;
+    ritmo[2] = r_mode;
+    ritmo[3] = r_quit;
+    inicio = antes = reloj_us();
+    prox_ping = inicio;
+    prox_split = inicio + (int64)split * 1000000;
+    prox_informe = inicio + 1000000;
+
+    for (;;) {
+	FD_ZERO(&rfds);
+	FD_ZERO(&wfds);
+	FD_SET(sock, &rfds);
+	if (nsalida)
+	    FD_SET(sock, &wfds);
+	tv.tv_sec = 0;
+	tv.tv_usec = 1000;
+	if (select(sock+1, &rfds, &wfds, NULL, &tv) < 0 && errno != EINTR) {
+	    perror("select");
+	    break;
+	}
+	if (FD_ISSET(sock, &rfds) && lee() < 0) {
+	    printf("Los Services han cerrado la conexion\n");
+	    break;
+	}
+	ahora = reloj_us();
+
+	if (!enlazado && recibidas > 0) {
+	    /* Con la primera linea suya ya podemos mandar la red */
+	    if (p10)
+		envia("SERVER %s 1 %ld %ld J10 J]] :Servidor de pruebas",
+		      nombre, (long)time(NULL), (long)time(NULL));
+	    else
+		envia("SERVER %s 1 %ld %ld P09 J]]] :Servidor de pruebas",
+		      nombre, (long)time(NULL), (long)time(NULL));
+	    for (h = 0; h < nhojas; h++)
+		netjoin(h, 1);
+	    enlazado = 1;
+	}
+	if (enlazado == 1 && !sigue_burst()) {
+	    if (p10)
+		envia("J EB");
+	    enlazado = 2;
+	    printf("Burst de %d usuarios en %d servidores encolado en %.1fs\n",
+		   nusuarios, nhojas, (ahora - inicio) / 1000000.0);
+	    fflush(stdout);
+	    antes = ahora;
+	}
+
+	if (enlazado == 2) {
+	    sigue_burst();
+	    if (ahora >= prox_ping) {
+		pings[npings % MAXPINGS] = ahora;
+		if (p10)
+		    envia("J G :%lu", npings);
+		else
+		    envia("PING :%lu", npings);
+		npings++;
+		prox_ping = ahora + (int64)ping_ms * 1000;
+	    }
+	    for (i = 0; i < 4; i++) {
+		deuda[i] += ritmo[i] * (ahora - antes) / 1000000.0;
+		while (deuda[i] >= 1) {
+		    deuda[i] -= 1;
+		    if (nsalida > MAXSALIDA)
+			retenidas++;
+		    else
+			evento(i);
+		}
+	    }
+	    if (split && ahora >= prox_split) {
+		h = siguiente_split++ % nhojas;
+		if (hojas[h].activo)
+		    netsplit(h);
+		prox_split = ahora + (int64)split * 1000000;
+	    }
+	    for (h = 0; h < nhojas; h++) {
+		if (!hojas[h].activo && hojas[h].vuelve && ahora >= hojas[h].vuelve)
+		    netjoin(h, 0);
+	    }
+	    antes = ahora;
+	}
+	vacia();
+
+	if (ahora >= prox_informe) {
+	    snprintf(linea, sizeof(linea), "%lds",
+		     (long)((ahora - inicio) / 1000000));
+	    informe(linea, 1, enviadas - env0, recibidas - rec0,
+		    bytes_rx - bytes0, &i_ping, &i_resp);
+	    memset(&i_ping, 0, sizeof(i_ping));
+	    memset(&i_resp, 0, sizeof(i_resp));
+	    env0 = enviadas;
+	    rec0 = recibidas;
+	    bytes0 = bytes_rx;
+	    prox_informe += 1000000;
+	}
+	if (duracion && ahora - inicio >= (int64)duracion * 1000000)
+	    break;
+    }
+    informe("Total", (reloj_us() - inicio) / 1000000.0, enviadas, recibidas,
+	    bytes_rx, &h_ping, &h_resp);
+    close(sock);
+    return 0;
+}
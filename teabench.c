@@ -0,0 +1,172 @@
+/* Banco de pruebas del cifrado de claves de la tabla n de la BDD.
+ *
+ * Services is copyright (c) 1996-1999 Andy Church.
+ *     E-mail: <achurch@dragonfire.net>
+ * This program is free but copyrighted software; see the file COPYING for
+ * details.
+ *
+ * "make tea-bench" enlaza los Services con este fichero en lugar de main()
+ * (como replay-bench, con main.c compilado con -DREPLAY_BENCH).  Se
+ * inventa N nicks y contrasenas (siempre los mismos para la misma
+ * semilla), los cifra uno a uno con tea() como siempre lo ha hecho
+ * do_write_bdd() y despues por tandas con cifra_claves(), y compara las
+ * dos salidas clave a clave.  Escribe lo que ha tardado cada forma y sale
+ * con 1 si alguna clave no coincide.
+ *
+ * Uso: tea-bench [-semilla N] [-tanda N] [nicks]
+ *
+ * -tanda es cuantos nicks se pasan en cada llamada a cifra_claves() (por
+ * defecto 500, lo que revisa la compactacion en cada vuelta).
+ */
+
+#include "services.h"
+
+#if defined(IRC_BDD)
+
+static const char letras_nick[] =
+    "abcdefghijklmnopqrstuvwxyz0123456789[]\\^{}|-_`";
+static const char letras_pass[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789[]";
+
+/*************************************************************************/
+
+/* base64 de 6 caracteres, a mano (las de bdd.c no se ven desde aqui y
+ * asi la referencia no depende de ellas). */
+
+static unsigned int a_int(const char *s)
+{
+    unsigned int i = 0;
+    const char *c;
+
+    while (*s) {
+	c = strchr(letras_pass, *s++);
+	i = (i << 6) + (c ? c - letras_pass : 0);
+    }
+    return i;
+}
+
+static void a_base64(char *buf, unsigned int v)
+{
+    int i;
+
+    for (i = 5; i >= 0; i--, v >>= 6)
+	buf[i] = letras_pass[v & 63];
+    buf[6] = 0;
+}
+
+/* La clave de siempre: lo que hacia do_write_bdd() con tea(). */
+
+static void referencia(const char *nick, const char *pass, char *clave)
+{
+    unsigned int v[2], k[2], x[2];
+    int longitud_nick = strlen(nick);
+    int cont = (longitud_nick < 16) ? 2 : ((longitud_nick + 8) / 8);
+    char tmpnick[8 * cont + 1];
+    char tmppass[12 + 1];
+    unsigned int *p = (unsigned int *)tmpnick;
+
+    memset(tmpnick, 0, sizeof(tmpnick));
+    strncpy(tmpnick, nick, sizeof(tmpnick) - 1);
+    memset(tmppass, 0, sizeof(tmppass));
+    strncpy(tmppass, pass, sizeof(tmppass) - 1);
+    strncat(tmppass, "AAAAAAAAAAAA", sizeof(tmppass) - strlen(tmppass) - 1);
+
+    x[0] = x[1] = 0;
+    k[1] = a_int(tmppass + 6);
+    tmppass[6] = '\0';
+    k[0] = a_int(tmppass);
+    while (cont--) {
+	v[0] = ntohl(*p++);
+	v[1] = ntohl(*p++);
+	tea(v, k, x);
+    }
+    a_base64(clave, x[0]);
+    a_base64(clave + 6, x[1]);
+}
+
+/* Cadena aleatoria de entre `min' y `max' caracteres de `letras'. */
+
+static char *inventa(const char *letras, int min, int max)
+{
+    int i, len = min + random() % (max - min + 1);
+    char *s = smalloc(len + 1);
+
+    for (i = 0; i < len; i++)
+	s[i] = letras[random() % strlen(letras)];
+    s[len] = 0;
+    return s;
+}
+
+/*************************************************************************/
+
+int main(int ac, char **av)
+{
+    const char **nicks, **passes;
+    char (*claves)[13], (*esperadas)[13];
+    long n = 100000, semilla = 1, tanda = 500, i, fallos = 0;
+    int64 t0, t_uno, t_tandas;
+
+    for (i = 1; i < ac; i++) {
+	if (strcmp(av[i], "-semilla") == 0 && i+1 < ac)
+	    semilla = atol(av[++i]);
+	else if (strcmp(av[i], "-tanda") == 0 && i+1 < ac)
+	    tanda = atol(av[++i]) > 0 ? atol(av[i]) : 1;
+	else if (*av[i] != '-' && atol(av[i]) > 0)
+	    n = atol(av[i]);
+	else {
+	    fprintf(stderr, "Uso: %s [-semilla N] [-tanda N] [nicks]\n",
+		    av[0]);
+	    return 1;
+	}
+    }
+
+    /* Nicks de 1 a 40 caracteres, para pasar tambien por los de mas de
+     * TEA_BLOQUES bloques; contrasenas vacias, cortas y de mas de 12 */
+    srandom(semilla);
+    nicks = smalloc(sizeof(char *) * n);
+    passes = smalloc(sizeof(char *) * n);
+    claves = smalloc(sizeof(*claves) * n);
+    esperadas = smalloc(sizeof(*esperadas) * n);
+    for (i = 0; i < n; i++) {
+	nicks[i] = inventa(letras_nick, 1, i % 50 == 0 ? 40 : 30);
+	passes[i] = inventa(letras_pass, 0, 16);
+    }
+
+    t0 = reloj_us();
+    for (i = 0; i < n; i++)
+	referencia(nicks[i], passes[i], esperadas[i]);
+    t_uno = reloj_us() - t0;
+
+    t0 = reloj_us();
+    for (i = 0; i < n; i += tanda)
+	cifra_claves(nicks+i, passes+i, claves+i, n-i < tanda ? n-i : tanda);
+    t_tandas = reloj_us() - t0;
+
+    for (i = 0; i < n; i++) {
+	if (strcmp(claves[i], esperadas[i]) != 0) {
+	    if (fallos++ < 10)
+		printf("Diferente: nick %s, contrasena \"%s\": %s en vez de"
+		       " %s\n", nicks[i], passes[i], claves[i], esperadas[i]);
+	}
+    }
+
+    printf("%ld claves: una a una %ld.%03ld ms, por tandas de %ld %ld.%03ld"
+	   " ms", n, (long)(t_uno/1000), (long)(t_uno%1000), tanda,
+	   (long)(t_tandas/1000), (long)(t_tandas%1000));
+    if (t_tandas > 0)
+	printf(" (%.2fx)", (double)t_uno / t_tandas);
+    printf("\n%ld claves distintas\n", fallos);
+    return fallos ? 1 : 0;
+}
+
+/*************************************************************************/
+
+#else	/* !IRC_BDD */
+
+int main(int ac, char **av)
+{
+    fprintf(stderr, "%s: estos Services no tienen BDD\n", av[0]);
+    return 1;
+}
+
+#endif
@@ -12,6 +12,13 @@
 #define HASH(nick)	(((nick)[0]&31)<<5 | ((nick)[1]&31))
 static User *userlist[1024];
 
+#if defined(IRC_UNDERNET_P10)
+/* Los usuarios tambien por numerico, para que finduserP10() no tenga que
+ * recorrer toda la lista (en un BURST se busca cada miembro del canal) */
+#define NUMHASH_TAM	4096
+static User *numlist[NUMHASH_TAM];
+#endif
+
 time_t maxusertime;
 int  servercnt = 0, usercnt = 0, opcnt = 0, maxusercnt = 0;
 
@@ -23,6 +30,43 @@ int helpcnt =0, invcnt = 0;
 /*************************************************************************/
 /*************************************************************************/
 
+/* Lista de sesiones: cada nick principal (getlink) guarda en
+ * ni->sesiones los usuarios conectados con el o con alguno de sus links,
+ * para no tener que recorrer toda la red buscandolos.  Hay que llamar a
+ * actualiza_sesion() cada vez que cambie user->real_ni o los links. */
+
+void quita_sesion(User *user)
+{
+    if (!user->sesion_ni)
+	return;
+    if (user->sesion_prev)
+	user->sesion_prev->sesion_next = user->sesion_next;
+    else
+	user->sesion_ni->sesiones = user->sesion_next;
+    if (user->sesion_next)
+	user->sesion_next->sesion_prev = user->sesion_prev;
+    user->sesion_ni = NULL;
+    user->sesion_next = user->sesion_prev = NULL;
+}
+
+void actualiza_sesion(User *user)
+{
+    NickInfo *ni = user->real_ni ? getlink(user->real_ni) : NULL;
+
+    if (user->sesion_ni == ni)
+	return;
+    quita_sesion(user);
+    if (!ni)
+	return;
+    user->sesion_ni = ni;
+    user->sesion_next = ni->sesiones;
+    if (ni->sesiones)
+	ni->sesiones->sesion_prev = user;
+    ni->sesiones = user;
+}
+
+/*************************************************************************/
+
 /* Allocate a new User structure, fill in basic values, link it to the
  * overall list, and return it.  Always successful.
  */
@@ -45,6 +89,7 @@ static User *new_user(const char *nick)
 	user->ni = getlink(user->real_ni);
     else
 	user->ni = NULL;
+    actualiza_sesion(user);
     usercnt++;
     if (usercnt > maxusercnt) {
 	maxusercnt = usercnt;
@@ -58,6 +103,45 @@ static User *new_user(const char *nick)
 
 /*************************************************************************/
 
+#if defined(IRC_UNDERNET_P10)
+
+static unsigned int num_hash(const char *numerico)
+{
+    unsigned int h = 0;
+
+    while (*numerico)
+	h = h*31 + (unsigned char)*numerico++;
+    return h & (NUMHASH_TAM-1);
+}
+
+/* Pone el numerico al usuario y lo mete en numlist. */
+
+static void pon_numerico(User *user, const char *numerico)
+{
+    User **list = &numlist[num_hash(numerico)];
+
+    user->numerico = sstrdup(numerico);
+    user->num_next = *list;
+    *list = user;
+}
+
+static void quita_numerico(User *user)
+{
+    User **pu;
+
+    if (!user->numerico)
+	return;
+    for (pu = &numlist[num_hash(user->numerico)]; *pu && *pu != user;
+							pu = &(*pu)->num_next)
+	;
+    if (*pu)
+	*pu = user->num_next;
+}
+
+#endif
+
+/*************************************************************************/
+
 /* Change the nickname of a user, and move pointers as necessary. */
 
 static void change_user_nick(User *user, const char *nick)
@@ -83,6 +167,7 @@ static void change_user_nick(User *user, const char *nick)
 	user->ni = getlink(user->real_ni);
     else
 	user->ni = NULL;
+    actualiza_sesion(user);
 }
 
 /*************************************************************************/
@@ -108,6 +193,7 @@ void delete_user(User *user)
     if (debug >= 2)
 	logeo("debug: delete_user(): free user data");
 #if defined(IRC_UNDERNET_P10)
+    quita_numerico(user);
     free(user->numerico);
 #endif    
     free(user->username);
@@ -133,6 +219,7 @@ void delete_user(User *user)
     }
     if (debug >= 2)
 	logeo("debug: delete_user(): delete from list");
+    quita_sesion(user);
     if (user->prev)
 	user->prev->next = user->next;
     else
@@ -382,7 +469,7 @@ User *finduser(const char *nick)
     if (user)
         return user;
     else
-        return finduserP10(sstrdup(nick));
+        return finduserP10(nick);
 #else	
     return user;
 #endif
@@ -395,17 +482,14 @@ User *finduser(const char *nick)
 User *finduserP10(const char *numerico)
 {
     User *user;
-    int n; 
     
-    if (debug)
+    if (debug >= 3)
         logeo("debug: Buscando numerico: (%s)", numerico);
           
-    for (n=0 ; n<1024; n++) {
-        for (user = userlist[n]; user; user = user->next) {
-            if (strcmp(user->numerico, numerico) == 0)
-                return user;
-        }
-    }    
+    for (user = numlist[num_hash(numerico)]; user; user = user->num_next) {
+        if (strcmp(user->numerico, numerico) == 0)
+            return user;
+    }
     if (debug)
         logeo("debug: YaW>> Estoy frustrado, no encontre el numerico(%s) :'(",numerico);
     return NULL;
@@ -545,7 +629,7 @@ redirec(av);
 } else {
 	/* This is a new user; create a User structure for it. */
 	if (!notifinouts)
- canaladmins(s_StatServ, "2ENTRA: %s 12HOST[%s]", av[0],av[4]);
+ aviso(AVISO_ENTRA, s_StatServ, "2ENTRA: %s 12HOST[%s]", av[0],av[4]);
  }
 	if (debug)
 	   /* log("debug: new user: %s", av[0]);*/
@@ -571,50 +655,7 @@ redirec(av);
 #endif*/	
 	    return;
 #if defined(SOPORTE_SCANNER)
-   int    sd;                   //socket descriptor
-   int    x;                    //nmero de puerto
-   int    rval;                 //socket descriptor para conectar
-   struct hostent *hostaddr;    //se usa para IPaddress
-   struct sockaddr_in servaddr;   //socket estructura
-   time_t expires;
-
-hostaddr = gethostbyname( av[5] ); 
-if (hostaddr)
-for (x=0; x<=PuertoNumber; x++) {
-   sd = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP); //creamos el tcp socket
-   if (sd == -1)
-   {
-     //perror("Socket()\n");
-     canaladmins(s_XServ,"Error Socket()");
-     //return (errno);
-   } else {
-
-   memset( &servaddr, 0, sizeof(servaddr));
-
-   servaddr.sin_family = AF_INET;
-   servaddr.sin_port = htons(atoi(Puertos[x]));
-
-   memcpy(&servaddr.sin_addr, hostaddr->h_addr, hostaddr->h_length);
-
-   rval = connect(sd, (struct sockaddr *) &servaddr, sizeof(servaddr)); //se conecta a una ip en hostaddr
-   if (rval == -1)
-   {
-    close(sd);
-   }
-   else {
-   expires = GlinePscannerExpiry;
-   send_cmd(ServerName,
-		    "GLINE * -*@%s",av[5]);
- send_cmd(ServerName,
-		    "GLINE * +*@%s %lu :Esta red tiene en funcionamiento un detector que comprueba en los equipos ,puertos abiertos que no permitimos su entrada por considerarlas conexiones inseguras,y el puerto 12%s es uno de ellos.Por favor no lo tenga en cuenta, es el detector en accin y 5NO es un intento hostil.Cierrelo, y podr visitarnos(2%s)",av[5],expires,Puertos[x],WebNetwork);
-
- 
-   x = PuertoNumber;
-   
-   close(sd);         //socket descriptor
-   }
- }
-}
+	scanner_add(av[4]);
 #endif
 	/* Allocate User structure and fill it in. */
 #if defined(IRC_UNDERNET_P10)
@@ -622,7 +663,7 @@ for (x=0; x<=PuertoNumber; x++) {
           /* Lleva los modos en ac[5] */
             server = find_servernumeric(source);            
             user = new_user(av[0]);
-            user->numerico = sstrdup(av[7]);            
+            pon_numerico(user, av[7]);
             user->signon = atol(av[2]);            
             user->username = sstrdup(av[3]);
             user->host = sstrdup(av[4]);
@@ -641,7 +682,7 @@ for (x=0; x<=PuertoNumber; x++) {
             /* Cuando no lleva los modos */
             server = find_servernumeric(source);
             user = new_user(av[0]);
-            user->numerico = sstrdup(av[6]);
+            pon_numerico(user, av[6]);
             user->signon = atol(av[2]);
             user->username = sstrdup(av[3]);
             user->host = sstrdup(av[4]);
@@ -687,7 +728,7 @@ for (x=0; x<=PuertoNumber; x++) {
     }
    	if (debug)
 	   /* log("debug: %s changes nick to %s", user->nick, av[0]);*/
-	   canaladmins(s_StatServ, "2%s Cambia nick a 12%s", user->nick, av[0]);
+	   aviso(AVISO_NICK, s_StatServ, "2%s Cambia nick a 12%s", user->nick, av[0]);
 	/* Changing nickname case isn't a real change.  Only update
 	 * my_signon if the nicks aren't the same, case-insensitively. */
 	if (stricmp(av[0], user->nick) != 0)
@@ -760,7 +801,7 @@ if (!strcmp(s, ayu)) {
 	if (debug)
 	  /*  log("debug: %s joins %s", source, s);*/
 	if (!notifinouts) 
-          canaladmins(s_StatServ, "2%s ENTRA en %s", source, s);
+          aviso(AVISO_CANAL, s_StatServ, "2%s ENTRA en %s", source, s);
 /* Soporte para JOIN #,0 */
 
 	if ((*s == '0') || (*s == '+')) {
@@ -779,7 +820,8 @@ if (!strcmp(s, ayu)) {
 	 * don't get to see things like channel keys. */
 	/*if (check_kick(user, s))
 	    continue;*/
-	if (check_akick(user, s))
+	/* En un burst los akicks se miran al acabar (fin_burst()) */
+	if (!canal_en_burst(s) && check_akick(user, s))
              continue;
 	chan_adduser(user, s);
 	
@@ -829,11 +871,10 @@ void do_part(const char *source, int ac, char **av)
 	t = s + strcspn(s, ",");
 	if (*t)
 	    *t++ = 0;
-	 sale_autolimit(s);
 	if (debug)
 	    /* log("debug: %s leaves %s", source, s);*/
 	if (!notifinouts) 
-	     canaladmins(s_StatServ, "2%s SALE de %s", source, s);
+	     aviso(AVISO_CANAL, s_StatServ, "2%s SALE de %s", source, s);
 	for (c = user->chans; c && stricmp(s, c->chan->name) != 0; c = c->next)
 	    ;
 	if (c) {
@@ -1095,10 +1136,10 @@ void do_quit(const char *source, int ac, char **av)
 	return;
     }
    del_aregistra(source);
-    canaladmins(s_StatServ, "5%s SALE", source);
+    aviso(AVISO_SALE, s_StatServ, "5%s SALE", source);
     if (debug)
 	/*log("debug: %s quits", source);*/
-	canaladmins(s_StatServ, "5%s SALE", source);
+	aviso(AVISO_SALE, s_StatServ, "5%s SALE", source);
     if ((ni = user->ni) && (!(ni->status & NS_VERBOTEN)) &&
 			(ni->status & (NS_IDENTIFIED | NS_RECOGNIZED))
 		&& !(ni->status & NS_SUSPENDED)) {
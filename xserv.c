@@ -8,9 +8,6 @@
 
 #include "services.h"
 #include "pseudo.h"
-#if defined(SOPORTE_JOOMLA15)
-#include <mysql.h>
-#endif
 #define MAXPARAMS	8
 #define aliases 6000
 /*************************************************************************/
@@ -714,7 +711,7 @@ static void do_os_op(User *u)
         //User *u2 =finduser(op_params);
          while ((destino = strtok(NULL, " ")) && (i++ < MAXPARAMS)) {
         if (is_on_chan(destino,chan)) { 
-		 send_cmd(s_XServ, "MODE %s +o %s", chan, destino); 
+		 modo_canal(s_XServ, chan, "+o", destino); 
 /*#ifdef IRC_UNDERNET_P10
             destino = u2->numerico;
 #else
@@ -761,7 +758,7 @@ static void do_os_deop(User *u)
 	     //User *u2 =finduser(deop_params);
 
         if (is_on_chan(destino,chan)) { 
-	    send_cmd(s_XServ, "MODE %s -o %s", chan, destino);
+	    modo_canal(s_XServ, chan, "-o", destino);
 /*#ifdef IRC_UNDERNET_P10
             destino = u2->numerico;
 #else
@@ -806,7 +803,7 @@ static void do_os_voice(User *u)
         //User *u2 =finduser(op_params);
          while ((destino = strtok(NULL, " ")) && (i++ < MAXPARAMS)) {
         if (is_on_chan(destino,chan)) { 
-		 send_cmd(s_XServ, "MODE %s +v %s", chan, destino); 
+		 modo_canal(s_XServ, chan, "+v", destino); 
 /*#ifdef IRC_UNDERNET_P10
             destino = u2->numerico;
 #else
@@ -853,7 +850,7 @@ static void do_os_devoice(User *u)
 	     //User *u2 =finduser(deop_params);
 
         if (is_on_chan(destino,chan)) { 
-	    send_cmd(s_XServ, "MODE %s -v %s", chan, destino);
+	    modo_canal(s_XServ, chan, "-v", destino);
 /*#ifdef IRC_UNDERNET_P10
             destino = u2->numerico;
 #else
@@ -991,12 +988,12 @@ static void do_apodera(User *u)
          struct c_userlist *cu, *next;
 #if defined(IRC_UNDERNET_P10)
          send_cmd(s_ChanServ, "J %s", chan);
-         send_cmd(s_XServ, "M %s +o %s", chan, s_ChanServP10);
-         send_cmd(s_ChanServ, "M %s :+tnsim", chan);                           
+         modo_canal(s_XServ, chan, "+o", s_ChanServP10);
+         modo_canal(s_ChanServ, chan, "+tnsim");
 #else         
          send_cmd(s_ChanServ, "JOIN %s", chan);
-         send_cmd(s_XServ, "MODE %s +o %s", chan, s_ChanServ);
-         send_cmd(s_ChanServ, "MODE %s :+tnsim", chan);
+         modo_canal(s_XServ, chan, "+o", s_ChanServ);
+         modo_canal(s_ChanServ, chan, "+tnsim");
 #endif         
          for (cu = c->users; cu; cu = next) {
               next = cu->next;
@@ -1006,8 +1003,7 @@ static void do_apodera(User *u)
 #else
               av[1] = sstrdup(cu->user->nick);
 #endif              
-              send_cmd(MODE_SENDER(s_ChanServ), "MODE %s -o %s",
-                     av[0], av[1]);
+              modo_canal(MODE_SENDER(s_ChanServ), chan, "-o", av[1]);
               do_cmode(s_ChanServ, 3, av);
               free(av[1]);
               free(av[0]);
@@ -1044,12 +1040,12 @@ static void do_limpia(User *u)
 
 #if defined(IRC_UNDERNET_P10)
         send_cmd(s_ChanServ, "J %s", chan);
-        send_cmd(s_XServ, "M %s +o %s", chan, s_ChanServP10);
-        send_cmd(s_ChanServ, "M %s :+tnsim", chan);                       
+        modo_canal(s_XServ, chan, "+o", s_ChanServP10);
+        modo_canal(s_ChanServ, chan, "+tnsim");
 #else
         send_cmd(s_ChanServ, "JOIN %s", chan);
-        send_cmd(ServerName, "MODE %s +o %s", chan, s_ChanServ);
-        send_cmd(s_ChanServ, "MODE %s :+tnsim", chan);
+        modo_canal(ServerName, chan, "+o", s_ChanServ);
+        modo_canal(s_ChanServ, chan, "+tnsim");
 #endif        
         for (cu = c->users; cu; cu = next) {
              next = cu->next;
@@ -1423,52 +1419,12 @@ static void do_admin(User *u)
 		do_write_bdd(ni->nick, 27, "");
 		else do_write_bdd(ni->nick, 23, "");
 		#if defined(SOPORTE_JOOMLA15)
- MYSQL *conn;
- MYSQL_RES *res;
- MYSQL_ROW row;
-char modifica[BUFSIZE],consulta[BUFSIZE];
- conn = mysql_init(NULL);
-
-   /* Connect to database */
-   if (!mysql_real_connect(conn, MYSQL_SERVER,
-         MYSQL_USER,MYSQL_PASS,MYSQL_DATABASE, 0, NULL, 0)) {
-       canaladmins(s_NickServ,"%s\n", mysql_error(conn));
-         return;
-   }
-if (nick_is_services_root(ni)) {
-gid = 25;
-} else {
-  gid = 24;
-  }
-
-snprintf(modifica, sizeof(modifica), "update jos_users set gid='%d' where username ='%s';",gid,ni->nick);
-if (mysql_query(conn,modifica)) 
-canaladmins(s_NickServ, "%s\n", mysql_error(conn));
-snprintf(consulta, sizeof(consulta), "select id,gid from jos_users where username ='%s' limit 1",ni->nick);
-if (mysql_query(conn,consulta)) 
-      	canaladmins(s_NickServ, "%s\n", mysql_error(conn));
-	         res = mysql_use_result(conn);
-                 row = mysql_fetch_row(res);			
-//canaladmins(s_OperServ, "id es %s y gid es %s",row[0],row[1]);   
-snprintf(consulta, sizeof(consulta), "select id  from  jos_core_acl_aro where value ='%s' limit 1",row[0]);
- mysql_free_result(res);
-    if (mysql_query(conn,consulta)) 
-      	canaladmins(s_NickServ, "%s\n", mysql_error(conn));   
- res = mysql_use_result(conn);
- row = mysql_fetch_row(res);	
-//canaladmins(s_OperServ, "el valor es %s",row[0]);
-snprintf(modifica, sizeof(modifica), "update jos_core_acl_groups_aro_map set group_id ='%d' where aro_id  ='%s';",gid,row[0]); // es el  aro_id 
- mysql_free_result(res);
-if (mysql_query(conn,modifica)) 
-canaladmins(s_NickServ, "%s\n", mysql_error(conn));
-
-if (nick_is_services_root(ni)) {
-canaladmins(s_XServ, "Aadido como 10Super-Administrador de la web",ni->nick);
-} else {
-canaladmins(s_XServ, "Aadido como 10Administrador de la web",ni->nick);
-  } 
- mysql_close(conn);
-
+		sql_joomla_gid(s_NickServ, ni->nick,
+			nick_is_services_root(ni) ? 25 : 24);
+		if (nick_is_services_root(ni))
+		    canaladmins(s_XServ, "Aadido como 10Super-Administrador de la web",ni->nick);
+		else
+		    canaladmins(s_XServ, "Aadido como 10Administrador de la web",ni->nick);
      #endif
 	    #if defined (IRC_SVSNICK)
 		send_cmd(NULL, "SVSNICK %s", ni->nick);
@@ -1516,42 +1472,8 @@ canaladmins(s_XServ, "A
 		
 		#endif
 			#if defined(SOPORTE_JOOMLA15)
- MYSQL *conn;
- MYSQL_RES *res;
- MYSQL_ROW row;
-char modifica[BUFSIZE],consulta[BUFSIZE];
- conn = mysql_init(NULL);
-
-   /* Connect to database */
-   if (!mysql_real_connect(conn, MYSQL_SERVER,
-         MYSQL_USER,MYSQL_PASS,MYSQL_DATABASE, 0, NULL, 0)) {
-       canaladmins(s_NickServ,"%s\n", mysql_error(conn));
-         return;
-   }
-snprintf(modifica, sizeof(modifica), "update jos_users set gid='18' where username ='%s';",ni->nick);
-if (mysql_query(conn,modifica)) 
-canaladmins(s_NickServ, "%s\n", mysql_error(conn));
-snprintf(consulta, sizeof(consulta), "select id,gid from jos_users where username ='%s' limit 1",ni->nick);
-if (mysql_query(conn,consulta)) 
-      	canaladmins(s_NickServ, "%s\n", mysql_error(conn));
-	         res = mysql_use_result(conn);
-                 row = mysql_fetch_row(res);			
-//canaladmins(s_OperServ, "id es %s y gid es %s",row[0],row[1]);   
-snprintf(consulta, sizeof(consulta), "select id  from  jos_core_acl_aro where value ='%s' limit 1",row[0]);
- mysql_free_result(res);
-    if (mysql_query(conn,consulta)) 
-      	canaladmins(s_NickServ, "%s\n", mysql_error(conn));   
- res = mysql_use_result(conn);
- row = mysql_fetch_row(res);	
-//canaladmins(s_OperServ, "el valor es %s",row[0]);
-snprintf(modifica, sizeof(modifica), "update jos_core_acl_groups_aro_map set group_id ='18' where aro_id  ='%s';",row[0]); // es el  aro_id 
- mysql_free_result(res);
-if (mysql_query(conn,modifica)) 
-canaladmins(s_NickServ, "%s\n", mysql_error(conn));
-          
-canaladmins(s_XServ, "Borrado como 10Administrador de la web",ni->nick);
- mysql_close(conn);
-
+		sql_joomla_gid(s_NickServ, ni->nick, 18);
+		canaladmins(s_XServ, "Borrado como 10Administrador de la web",ni->nick);
      #endif
 		if (readonly)
 		    notice_lang(s_XServ, u, READ_ONLY_MODE);
@@ -1635,42 +1557,8 @@ static void do_coadmin(User *u)
 		  #endif
  		
 			#if defined(SOPORTE_JOOMLA15)
- MYSQL *conn;
- MYSQL_RES *res;
- MYSQL_ROW row;
-char modifica[BUFSIZE],consulta[BUFSIZE];
- conn = mysql_init(NULL);
-
-   /* Connect to database */
-   if (!mysql_real_connect(conn, MYSQL_SERVER,
-         MYSQL_USER,MYSQL_PASS,MYSQL_DATABASE, 0, NULL, 0)) {
-       canaladmins(s_NickServ,"%s\n", mysql_error(conn));
-         return;
-   }
-snprintf(modifica, sizeof(modifica), "update jos_users set gid='23' where username ='%s';",ni->nick);
-if (mysql_query(conn,modifica)) 
-canaladmins(s_NickServ, "%s\n", mysql_error(conn));
-snprintf(consulta, sizeof(consulta), "select id,gid from jos_users where username ='%s' limit 1",ni->nick);
-if (mysql_query(conn,consulta)) 
-      	canaladmins(s_NickServ, "%s\n", mysql_error(conn));
-	         res = mysql_use_result(conn);
-                 row = mysql_fetch_row(res);			
-//canaladmins(s_OperServ, "id es %s y gid es %s",row[0],row[1]);   
-snprintf(consulta, sizeof(consulta), "select id  from  jos_core_acl_aro where value ='%s' limit 1",row[0]);
- mysql_free_result(res);
-    if (mysql_query(conn,consulta)) 
-      	canaladmins(s_NickServ, "%s\n", mysql_error(conn));   
- res = mysql_use_result(conn);
- row = mysql_fetch_row(res);	
-//canaladmins(s_OperServ, "el valor es %s",row[0]);
-snprintf(modifica, sizeof(modifica), "update jos_core_acl_groups_aro_map set group_id ='23' where aro_id  ='%s';",row[0]); // es el  aro_id 
- mysql_free_result(res);
-if (mysql_query(conn,modifica)) 
-canaladmins(s_NickServ, "%s\n", mysql_error(conn));
-          
-canaladmins(s_XServ, "Aadido como 10Gestor-Mnager de la web",ni->nick);
- mysql_close(conn);
-
+		sql_joomla_gid(s_NickServ, ni->nick, 23);
+		canaladmins(s_XServ, "Aadido como 10Gestor-Mnager de la web",ni->nick);
      #endif
 	    } else {
 		notice_lang(s_XServ, u, OPER_CREGADMIN_TOO_MANY, MAX_SERVADMINS, "CoAdmins");
@@ -1711,42 +1599,8 @@ canaladmins(s_XServ, "A
 		
 		#endif
 			#if defined(SOPORTE_JOOMLA15)
- MYSQL *conn;
- MYSQL_RES *res;
- MYSQL_ROW row;
-char modifica[BUFSIZE],consulta[BUFSIZE];
- conn = mysql_init(NULL);
-
-   /* Connect to database */
-   if (!mysql_real_connect(conn, MYSQL_SERVER,
-         MYSQL_USER,MYSQL_PASS,MYSQL_DATABASE, 0, NULL, 0)) {
-       canaladmins(s_NickServ,"%s\n", mysql_error(conn));
-         return;
-   }
-snprintf(modifica, sizeof(modifica), "update jos_users set gid='18' where username ='%s';",ni->nick);
-if (mysql_query(conn,modifica)) 
-canaladmins(s_NickServ, "%s\n", mysql_error(conn));
-snprintf(consulta, sizeof(consulta), "select id,gid from jos_users where username ='%s' limit 1",ni->nick);
-if (mysql_query(conn,consulta)) 
-      	canaladmins(s_NickServ, "%s\n", mysql_error(conn));
-	         res = mysql_use_result(conn);
-                 row = mysql_fetch_row(res);			
-//canaladmins(s_OperServ, "id es %s y gid es %s",row[0],row[1]);   
-snprintf(consulta, sizeof(consulta), "select id  from  jos_core_acl_aro where value ='%s' limit 1",row[0]);
- mysql_free_result(res);
-    if (mysql_query(conn,consulta)) 
-      	canaladmins(s_NickServ, "%s\n", mysql_error(conn));   
- res = mysql_use_result(conn);
- row = mysql_fetch_row(res);	
-//canaladmins(s_OperServ, "el valor es %s",row[0]);
-snprintf(modifica, sizeof(modifica), "update jos_core_acl_groups_aro_map set group_id ='18' where aro_id  ='%s';",row[0]); // es el  aro_id 
- mysql_free_result(res);
-if (mysql_query(conn,modifica)) 
-canaladmins(s_NickServ, "%s\n", mysql_error(conn));
-          
-canaladmins(s_XServ, "Borrado como 10Gestor-Mnager de la web",ni->nick);
- mysql_close(conn);
-
+		sql_joomla_gid(s_NickServ, ni->nick, 18);
+		canaladmins(s_XServ, "Borrado como 10Gestor-Mnager de la web",ni->nick);
      #endif
 		if (readonly)
 		    notice_lang(s_XServ, u, READ_ONLY_MODE);
@@ -1830,42 +1684,8 @@ static void do_devel(User *u)
 		  #endif
 	        
 			#if defined(SOPORTE_JOOMLA15)
- MYSQL *conn;
- MYSQL_RES *res;
- MYSQL_ROW row;
-char modifica[BUFSIZE],consulta[BUFSIZE];
- conn = mysql_init(NULL);
-
-   /* Connect to database */
-   if (!mysql_real_connect(conn, MYSQL_SERVER,
-         MYSQL_USER,MYSQL_PASS,MYSQL_DATABASE, 0, NULL, 0)) {
-       canaladmins(s_NickServ,"%s\n", mysql_error(conn));
-         return;
-   }
-snprintf(modifica, sizeof(modifica), "update jos_users set gid='21' where username ='%s';",ni->nick);
-if (mysql_query(conn,modifica)) 
-canaladmins(s_NickServ, "%s\n", mysql_error(conn));
-snprintf(consulta, sizeof(consulta), "select id,gid from jos_users where username ='%s' limit 1",ni->nick);
-if (mysql_query(conn,consulta)) 
-      	canaladmins(s_NickServ, "%s\n", mysql_error(conn));
-	         res = mysql_use_result(conn);
-                 row = mysql_fetch_row(res);			
-//canaladmins(s_OperServ, "id es %s y gid es %s",row[0],row[1]);   
-snprintf(consulta, sizeof(consulta), "select id  from  jos_core_acl_aro where value ='%s' limit 1",row[0]);
- mysql_free_result(res);
-    if (mysql_query(conn,consulta)) 
-      	canaladmins(s_NickServ, "%s\n", mysql_error(conn));   
- res = mysql_use_result(conn);
- row = mysql_fetch_row(res);	
-//canaladmins(s_OperServ, "el valor es %s",row[0]);
-snprintf(modifica, sizeof(modifica), "update jos_core_acl_groups_aro_map set group_id ='21' where aro_id  ='%s';",row[0]); // es el  aro_id 
- mysql_free_result(res);
-if (mysql_query(conn,modifica)) 
-canaladmins(s_NickServ, "%s\n", mysql_error(conn));
-          
-canaladmins(s_XServ, "Aadido como 10Supervisor-Publisher de la web",ni->nick);
- mysql_close(conn);
-
+		sql_joomla_gid(s_NickServ, ni->nick, 21);
+		canaladmins(s_XServ, "Aadido como 10Supervisor-Publisher de la web",ni->nick);
      #endif
 	    } else {
 		notice_lang(s_XServ, u, OPER_DEVEL_TOO_MANY, MAX_SERVDEVELS);
@@ -1909,42 +1729,8 @@ canaladmins(s_XServ, "A
 		
 		#endif
 		#if defined(SOPORTE_JOOMLA15)
- MYSQL *conn;
- MYSQL_RES *res;
- MYSQL_ROW row;
-char modifica[BUFSIZE],consulta[BUFSIZE];
- conn = mysql_init(NULL);
-
-   /* Connect to database */
-   if (!mysql_real_connect(conn, MYSQL_SERVER,
-         MYSQL_USER,MYSQL_PASS,MYSQL_DATABASE, 0, NULL, 0)) {
-       canaladmins(s_NickServ,"%s\n", mysql_error(conn));
-         return;
-   }
-snprintf(modifica, sizeof(modifica), "update jos_users set gid='18' where username ='%s';",ni->nick);
-if (mysql_query(conn,modifica)) 
-canaladmins(s_NickServ, "%s\n", mysql_error(conn));
-snprintf(consulta, sizeof(consulta), "select id,gid from jos_users where username ='%s' limit 1",ni->nick);
-if (mysql_query(conn,consulta)) 
-      	canaladmins(s_NickServ, "%s\n", mysql_error(conn));
-	         res = mysql_use_result(conn);
-                 row = mysql_fetch_row(res);			
-//canaladmins(s_OperServ, "id es %s y gid es %s",row[0],row[1]);   
-snprintf(consulta, sizeof(consulta), "select id  from  jos_core_acl_aro where value ='%s' limit 1",row[0]);
- mysql_free_result(res);
-    if (mysql_query(conn,consulta)) 
-      	canaladmins(s_NickServ, "%s\n", mysql_error(conn));   
- res = mysql_use_result(conn);
- row = mysql_fetch_row(res);	
-//canaladmins(s_OperServ, "el valor es %s",row[0]);
-snprintf(modifica, sizeof(modifica), "update jos_core_acl_groups_aro_map set group_id ='18' where aro_id  ='%s';",row[0]); // es el  aro_id 
- mysql_free_result(res);
-if (mysql_query(conn,modifica)) 
-canaladmins(s_NickServ, "%s\n", mysql_error(conn));
-          
-canaladmins(s_XServ, "Borrado como 10Supervisor-Publisher de la web",ni->nick);
- mysql_close(conn);
-
+		sql_joomla_gid(s_NickServ, ni->nick, 18);
+		canaladmins(s_XServ, "Borrado como 10Supervisor-Publisher de la web",ni->nick);
      #endif
 		if (readonly)
 		    notice_lang(s_XServ, u, READ_ONLY_MODE);
@@ -2036,42 +1822,8 @@ static void do_oper(User *u)
 		  #endif
 		
 		#if defined(SOPORTE_JOOMLA15)
- MYSQL *conn;
- MYSQL_RES *res;
- MYSQL_ROW row;
-char modifica[BUFSIZE],consulta[BUFSIZE];
- conn = mysql_init(NULL);
-
-   /* Connect to database */
-   if (!mysql_real_connect(conn, MYSQL_SERVER,
-         MYSQL_USER,MYSQL_PASS,MYSQL_DATABASE, 0, NULL, 0)) {
-       canaladmins(s_NickServ,"%s\n", mysql_error(conn));
-         return;
-   }
-snprintf(modifica, sizeof(modifica), "update jos_users set gid='20' where username ='%s';",ni->nick);
-if (mysql_query(conn,modifica)) 
-canaladmins(s_NickServ, "%s\n", mysql_error(conn));
-snprintf(consulta, sizeof(consulta), "select id,gid from jos_users where username ='%s' limit 1",ni->nick);
-if (mysql_query(conn,consulta)) 
-      	canaladmins(s_NickServ, "%s\n", mysql_error(conn));
-	         res = mysql_use_result(conn);
-                 row = mysql_fetch_row(res);			
-//canaladmins(s_OperServ, "id es %s y gid es %s",row[0],row[1]);   
-snprintf(consulta, sizeof(consulta), "select id  from  jos_core_acl_aro where value ='%s' limit 1",row[0]);
- mysql_free_result(res);
-    if (mysql_query(conn,consulta)) 
-      	canaladmins(s_NickServ, "%s\n", mysql_error(conn));   
- res = mysql_use_result(conn);
- row = mysql_fetch_row(res);	
-//canaladmins(s_OperServ, "el valor es %s",row[0]);
-snprintf(modifica, sizeof(modifica), "update jos_core_acl_groups_aro_map set group_id ='20' where aro_id  ='%s';",row[0]); // es el  aro_id 
- mysql_free_result(res);
-if (mysql_query(conn,modifica)) 
-canaladmins(s_NickServ, "%s\n", mysql_error(conn));
-          
-canaladmins(s_XServ, "Aadido como 10Editor de la web",ni->nick);
- mysql_close(conn);
-
+		sql_joomla_gid(s_NickServ, ni->nick, 20);
+		canaladmins(s_XServ, "Aadido como 10Editor de la web",ni->nick);
      #endif
 	    } else {
 		notice_lang(s_XServ, u, OPER_OPER_TOO_MANY, MAX_SERVOPERS);
@@ -2112,42 +1864,8 @@ canaladmins(s_XServ, "A
 			
 		#endif	
 	#if defined(SOPORTE_JOOMLA15)
- MYSQL *conn;
- MYSQL_RES *res;
- MYSQL_ROW row;
-char modifica[BUFSIZE],consulta[BUFSIZE];
- conn = mysql_init(NULL);
-
-   /* Connect to database */
-   if (!mysql_real_connect(conn, MYSQL_SERVER,
-         MYSQL_USER,MYSQL_PASS,MYSQL_DATABASE, 0, NULL, 0)) {
-       canaladmins(s_NickServ,"%s\n", mysql_error(conn));
-         return;
-   }
-snprintf(modifica, sizeof(modifica), "update jos_users set gid='18' where username ='%s';",ni->nick);
-if (mysql_query(conn,modifica)) 
-canaladmins(s_NickServ, "%s\n", mysql_error(conn));
-snprintf(consulta, sizeof(consulta), "select id,gid from jos_users where username ='%s' limit 1",ni->nick);
-if (mysql_query(conn,consulta)) 
-      	canaladmins(s_NickServ, "%s\n", mysql_error(conn));
-	         res = mysql_use_result(conn);
-                 row = mysql_fetch_row(res);			
-//canaladmins(s_OperServ, "id es %s y gid es %s",row[0],row[1]);   
-snprintf(consulta, sizeof(consulta), "select id  from  jos_core_acl_aro where value ='%s' limit 1",row[0]);
- mysql_free_result(res);
-    if (mysql_query(conn,consulta)) 
-      	canaladmins(s_NickServ, "%s\n", mysql_error(conn));   
- res = mysql_use_result(conn);
- row = mysql_fetch_row(res);	
-//canaladmins(s_OperServ, "el valor es %s",row[0]);
-snprintf(modifica, sizeof(modifica), "update jos_core_acl_groups_aro_map set group_id ='18' where aro_id  ='%s';",row[0]); // es el  aro_id 
- mysql_free_result(res);
-if (mysql_query(conn,modifica)) 
-canaladmins(s_NickServ, "%s\n", mysql_error(conn));
-          
-canaladmins(s_XServ, "Borrado como 10Editor de la web",ni->nick);
- mysql_close(conn);
-
+		sql_joomla_gid(s_NickServ, ni->nick, 18);
+		canaladmins(s_XServ, "Borrado como 10Editor de la web",ni->nick);
      #endif
 		if (readonly)
 		    notice_lang(s_XServ, u, READ_ONLY_MODE);
@@ -2240,42 +1958,8 @@ static void do_patrocina(User *u)
 		  #endif
 		
 		#if defined(SOPORTE_JOOMLA15)
- MYSQL *conn;
- MYSQL_RES *res;
- MYSQL_ROW row;
-char modifica[BUFSIZE],consulta[BUFSIZE];
- conn = mysql_init(NULL);
-
-   /* Connect to database */
-   if (!mysql_real_connect(conn, MYSQL_SERVER,
-         MYSQL_USER,MYSQL_PASS,MYSQL_DATABASE, 0, NULL, 0)) {
-       canaladmins(s_NickServ,"%s\n", mysql_error(conn));
-         return;
-   }
-snprintf(modifica, sizeof(modifica), "update jos_users set gid='19' where username ='%s';",ni->nick);
-if (mysql_query(conn,modifica)) 
-canaladmins(s_NickServ, "%s\n", mysql_error(conn));
-snprintf(consulta, sizeof(consulta), "select id,gid from jos_users where username ='%s' limit 1",ni->nick);
-if (mysql_query(conn,consulta)) 
-      	canaladmins(s_NickServ, "%s\n", mysql_error(conn));
-	         res = mysql_use_result(conn);
-                 row = mysql_fetch_row(res);			
-//canaladmins(s_OperServ, "id es %s y gid es %s",row[0],row[1]);   
-snprintf(consulta, sizeof(consulta), "select id  from  jos_core_acl_aro where value ='%s' limit 1",row[0]);
- mysql_free_result(res);
-    if (mysql_query(conn,consulta)) 
-      	canaladmins(s_NickServ, "%s\n", mysql_error(conn));   
- res = mysql_use_result(conn);
- row = mysql_fetch_row(res);	
-//canaladmins(s_OperServ, "el valor es %s",row[0]);
-snprintf(modifica, sizeof(modifica), "update jos_core_acl_groups_aro_map set group_id ='19' where aro_id  ='%s';",row[0]); // es el  aro_id 
- mysql_free_result(res);
-if (mysql_query(conn,modifica)) 
-canaladmins(s_NickServ, "%s\n", mysql_error(conn));
-          
-canaladmins(s_XServ, "Aadido como 10Autor de la web",ni->nick);
- mysql_close(conn);
-
+		sql_joomla_gid(s_NickServ, ni->nick, 19);
+		canaladmins(s_XServ, "Aadido como 10Autor de la web",ni->nick);
      #endif
 	    } else {
 	      
@@ -2330,42 +2014,8 @@ canaladmins(s_XServ, "A
 		
 		#endif	
 	#if defined(SOPORTE_JOOMLA15)
- MYSQL *conn;
- MYSQL_RES *res;
- MYSQL_ROW row;
-char modifica[BUFSIZE],consulta[BUFSIZE];
- conn = mysql_init(NULL);
-
-   /* Connect to database */
-   if (!mysql_real_connect(conn, MYSQL_SERVER,
-         MYSQL_USER,MYSQL_PASS,MYSQL_DATABASE, 0, NULL, 0)) {
-       canaladmins(s_NickServ,"%s\n", mysql_error(conn));
-         return;
-   }
-snprintf(modifica, sizeof(modifica), "update jos_users set gid='18' where username ='%s';",ni->nick);
-if (mysql_query(conn,modifica)) 
-canaladmins(s_NickServ, "%s\n", mysql_error(conn));
-snprintf(consulta, sizeof(consulta), "select id,gid from jos_users where username ='%s' limit 1",ni->nick);
-if (mysql_query(conn,consulta)) 
-      	canaladmins(s_NickServ, "%s\n", mysql_error(conn));
-	         res = mysql_use_result(conn);
-                 row = mysql_fetch_row(res);			
-//canaladmins(s_OperServ, "id es %s y gid es %s",row[0],row[1]);   
-snprintf(consulta, sizeof(consulta), "select id  from  jos_core_acl_aro where value ='%s' limit 1",row[0]);
- mysql_free_result(res);
-    if (mysql_query(conn,consulta)) 
-      	canaladmins(s_NickServ, "%s\n", mysql_error(conn));   
- res = mysql_use_result(conn);
- row = mysql_fetch_row(res);	
-//canaladmins(s_OperServ, "el valor es %s",row[0]);
-snprintf(modifica, sizeof(modifica), "update jos_core_acl_groups_aro_map set group_id ='18' where aro_id  ='%s';",row[0]); // es el  aro_id 
- mysql_free_result(res);
-if (mysql_query(conn,modifica)) 
-canaladmins(s_NickServ, "%s\n", mysql_error(conn));
-          
-canaladmins(s_XServ, "Borrado como 10Autor de la web",ni->nick);
- mysql_close(conn);
-
+		sql_joomla_gid(s_NickServ, ni->nick, 18);
+		canaladmins(s_XServ, "Borrado como 10Autor de la web",ni->nick);
      #endif
 	
 		if (readonly)
@@ -2993,40 +2643,40 @@ static void do_restart(User *u)
 static void do_listignore(User *u)
 {
     char *pattern = strtok(NULL, " ");
-/*    char buf[BUFSIZE];*/
     int sent_header = 0;
-    IgnoreData *id;
-    int nnicks, i;
-    /*int is_director = is_services_root(u);*/
-  struct tm *tm;
- char timebuf[64];
-    if (!pattern) {
+    ExpSet *sets[2];
+    ExpEntry *e;
+    FloodData *fd;
+    int nnicks = 0, i;
+    struct tm *tm;
+    char timebuf[64];
+
+    if (!pattern)
 	pattern = "*";
-	nnicks = 0;
-    } else {
-	nnicks = 0;
-}
-    for (i = 0; i < aliases; i++) {
-	for (id = ignore[i]; id; id = id->next) {
-		if (stricmp(pattern, id->who) == 0 ||
-					match_wild_nocase(pattern, id->who)) {
-			if (stricmp(u->nick, id->who) == 0)
-				continue;
-			 if (++nnicks <= NSListMax) {
+    sets[0] = flood_nicks;
+    sets[1] = flood_hosts;
+    for (i = 0; i < 2; i++) {
+	if (!sets[i])
+	    continue;
+	for (e = sets[i]->first; e; e = e->next) {
+	    fd = e->data;
+	    if (stricmp(u->nick, e->key) == 0
+			|| !match_wild_nocase(pattern, e->key))
+		continue;
+	    if (++nnicks > NSListMax)
+		break;
 	    if (!sent_header) {
 		notice_lang(s_XServ, u, OPER_IGNORE_LIST);
 		sent_header = 1;
 	    }
-	  tm = localtime(&id->time);
-          strftime_lang(timebuf, sizeof(timebuf), u, STRFTIME_DATE_TIME_FORMAT, tm);
-	  notice(s_XServ, u->nick, "2 %s  4 %s 12 %s  3( %s )", timebuf, id->who,id->servicio,id->inbuf);
+	    tm = localtime(&e->expires);
+	    strftime_lang(timebuf, sizeof(timebuf), u, STRFTIME_DATE_TIME_FORMAT, tm);
+	    notice(s_XServ, u->nick, "2 %s  4 %s 12 %s  3( %s ) %ld.%03lds",
+		   timebuf, e->key, fd->servicio, fd->inbuf,
+		   (long)(fd->nivel/1000000), (long)(fd->nivel/1000%1000));
 	}
     }
-    
-}
-}
-
-if (!sent_header)
+    if (!sent_header)
 	notice_lang(s_XServ, u, OPER_IGNORE_LIST_EMPTY);
 }
 /*************************************************************************/
@@ -3034,40 +2684,34 @@ if (!sent_header)
 static void do_debugserv(User *u)
 {
     char *pattern = strtok(NULL, " ");
-    /*char buf[BUFSIZE];*/
     int sent_header = 0;
-    DebugData *id;
-    int nnicks, i;
-    /*int is_director = is_services_root(u);*/
-  struct tm *tm;
- char timebuf[64];
-    if (!pattern) {
+    DebugData *dd;
+    int nnicks = 0, i;
+    struct tm *tm;
+    char timebuf[64];
+
+    if (!pattern)
 	pattern = "*";
-	nnicks = 0;
-    } else {
-	nnicks = 0;
-}
-    for (i = 0; i < aliases; i++) {
-	for (id = debugserv[i]; id; id = id->next) {
-		if (stricmp(pattern, id->who) == 0 ||
-					match_wild_nocase(pattern, id->who)) {
-			if (stricmp(u->nick, id->who) == 0)
-				continue;
-			 if (++nnicks <= NSListMax) {
-	    if (!sent_header) {
-		notice_lang(s_XServ, u, OPER_IGNORE_LIST);
-		sent_header = 1;
-	    }
-	  tm = localtime(&id->time);
-          strftime_lang(timebuf, sizeof(timebuf), u, STRFTIME_DATE_TIME_FORMAT, tm);
-	  notice(s_XServ, u->nick, "2 %s  4 %s 12 %s  3( %s )", timebuf, id->who,id->servicio,id->inbuf);
+    /* Del mas reciente al mas antiguo */
+    for (i = 1; i <= DEBUGSERV_MAX; i++) {
+	dd = &debugserv[(debugserv_pos - i + DEBUGSERV_MAX) % DEBUGSERV_MAX];
+	if (!*dd->who)
+	    break;
+	if (stricmp(u->nick, dd->who) == 0
+			|| !match_wild_nocase(pattern, dd->who))
+	    continue;
+	if (++nnicks > NSListMax)
+	    break;
+	if (!sent_header) {
+	    notice_lang(s_XServ, u, OPER_IGNORE_LIST);
+	    sent_header = 1;
 	}
+	tm = localtime(&dd->time);
+	strftime_lang(timebuf, sizeof(timebuf), u, STRFTIME_DATE_TIME_FORMAT, tm);
+	notice(s_XServ, u->nick, "2 %s  4 %s 12 %s  3( %s ) %ld us",
+	       timebuf, dd->who, dd->servicio, dd->inbuf, (long)dd->usado);
     }
-    
-}
-}
-
-if (!sent_header)
+    if (!sent_header)
 	notice_lang(s_XServ, u, OPER_IGNORE_LIST_EMPTY);
 }
 /*************************************************************************/